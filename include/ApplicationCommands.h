@@ -20,6 +20,8 @@ crow::response installApplication(PersistentStore& store, const crow::request& r
 crow::response installAdHocApplication(PersistentStore& store, const crow::request& req);
 ///Update the application catalog
 crow::response updateCatalog(PersistentStore& store, const crow::request& req);
+///Re-probe the installed helm's version, flags, and repositories
+crow::response updateHelmCapabilities(PersistentStore& store, const crow::request& req);
 
 namespace internal{
 	///Construct the additional set of values which should be injected into the helm template
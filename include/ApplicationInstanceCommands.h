@@ -4,6 +4,7 @@
 #include "crow.h"
 #include "Entities.h"
 #include "PersistentStore.h"
+#include "ServerUtilities.h"
 
 ///List application instances which currently exist
 crow::response listApplicationInstances(PersistentStore& store, const crow::request& req);
@@ -36,6 +37,20 @@ namespace internal{
 	///\return a string describing the error which has occured, or an empty 
 	///        string indicating success
 	std::string deleteApplicationInstance(PersistentStore& store, const ApplicationInstance& instance, bool force);
+	
+	///Write the body of an application instance listing
+	///\param writer the destination for the listing
+	///\param instances the instances to list
+	///\param groups the Groups which own the instances, indexed by ID
+	///\param clusters the clusters on which the instances run, indexed by ID
+	///\param options the metadata fields to include
+	///\param nextCursor the cursor for the following page, if any
+	void writeApplicationInstanceListing(JSONStreamWriter& writer, 
+	                                     const std::vector<ApplicationInstance>& instances,
+	                                     const std::map<std::string,Group>& groups,
+	                                     const std::map<std::string,Cluster>& clusters,
+	                                     const ListingOptions& options=ListingOptions(),
+	                                     const std::string& nextCursor="");
 }
 
 #endif //SLATE_APPLICATION_INSTANCE_COMMANDS_H
@@ -0,0 +1,94 @@
+#ifndef SLATE_CIRCUIT_BREAKER_H
+#define SLATE_CIRCUIT_BREAKER_H
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+///Tracks whether each of a set of remote targets is responding, so that
+///attempts to contact a target which has stopped responding can fail
+///immediately instead of waiting to time out.
+///Each target's circuit starts closed, allowing all attempts. After a number
+///of consecutive failures it opens, and attempts are refused. Once the retry
+///interval has passed, the circuit becomes half-open and allows a single
+///trial attempt: if it succeeds the circuit closes, and if it fails the
+///circuit opens again. A trial whose outcome is never reported is abandoned
+///after the retry interval, and another is allowed.
+class CircuitBreaker{
+public:
+	enum class State{
+		Closed, ///<the target is responding
+		Open, ///<the target is not responding
+		HalfOpen ///<a trial attempt to contact the target is in progress
+	};
+
+	///A summary of one target's circuit
+	struct TargetStatistics{
+		std::string target;
+		State state;
+		///The number of consecutive failed attempts
+		unsigned int failures;
+		///The number of times the circuit has opened
+		std::size_t trips;
+		///The number of attempts refused while the circuit was open
+		std::size_t refused;
+	};
+
+	///\param failureThreshold the number of consecutive failures after which a
+	///                        circuit opens
+	///\param retryInterval how long an open circuit waits before allowing a
+	///                     trial attempt
+	CircuitBreaker(unsigned int failureThreshold, std::chrono::seconds retryInterval);
+	CircuitBreaker(const CircuitBreaker&)=delete;
+	CircuitBreaker& operator=(const CircuitBreaker&)=delete;
+
+	///Decide whether an attempt to contact a target should be made. If this
+	///returns true, the outcome of the attempt must be reported with record().
+	///\param target the name of the target
+	///\return whether the attempt may proceed
+	bool allow(const std::string& target);
+	///Report the outcome of an attempt to contact a target
+	///\param target the name of the target
+	///\param success whether the target responded
+	void record(const std::string& target, bool success);
+
+	///\return the state of the target's circuit. An open circuit whose retry
+	///        interval has passed remains open until a trial attempt is allowed.
+	State state(const std::string& target) const;
+	///\return whether the target's circuit is open and its retry interval has
+	///        passed, so that a trial attempt would be allowed
+	bool retryDue(const std::string& target) const;
+
+	///\return summaries of all circuits which are not closed, or which have
+	///        ever opened
+	std::vector<TargetStatistics> getStatistics() const;
+
+private:
+	using clock=std::chrono::steady_clock;
+
+	struct Circuit{
+		Circuit():state(State::Closed),failures(0),trips(0),refused(0){}
+		State state;
+		unsigned int failures;
+		///When the circuit most recently opened, or began a trial attempt
+		clock::time_point since;
+		std::size_t trips;
+		std::size_t refused;
+	};
+
+	///Change a circuit to the open state. Must be called with mutex held.
+	void open(Circuit& circuit);
+
+	const unsigned int failureThreshold;
+	const std::chrono::seconds retryInterval;
+	///Guards circuits
+	mutable std::mutex mutex;
+	std::map<std::string,Circuit> circuits;
+};
+
+///\return the name of a circuit state
+std::string to_string(CircuitBreaker::State state);
+
+#endif //SLATE_CIRCUIT_BREAKER_H
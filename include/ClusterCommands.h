@@ -69,6 +69,15 @@ crow::response pingCluster(PersistentStore& store, const crow::request& req,
 crow::response verifyCluster(PersistentStore& store, const crow::request& req,
                              const std::string& clusterID);
 
+///Check whether a cluster is believed to be reachable before performing an
+///operation which would contact it, so that the request can fail quickly if
+///it is not. If the cluster has been unreachable for long enough that it
+///should be tried again, it is pinged in the background, and the result is
+///also recorded as its cached reachability.
+///\param cluster the cluster which would be contacted
+///\return whether the operation should proceed
+bool checkClusterReachable(PersistentStore& store, const Cluster& cluster);
+
 namespace internal{
 	///Internal function which implements deletion of clusters, 
 	///assuming that all authentication, authorization, and validation of the 
@@ -0,0 +1,104 @@
+#ifndef SLATE_COLLECTION_SNAPSHOT_H
+#define SLATE_COLLECTION_SNAPSHOT_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//libstdc++ versions < 5 lack the atomic operations on shared_ptr, so in that
+//case the current snapshot pointer must be protected by a lock
+#ifdef __GNUC__
+	#ifndef __clang__
+		#if __GNUC__ < 5
+			#define SLATE_SNAPSHOT_POINTER_LOCK 1
+		#endif
+	#endif
+#endif
+
+///An immutable copy of a full collection of cached objects, which readers
+///obtain by loading a single pointer rather than locking the cache it was
+///copied from. Whenever the collection changes the snapshot is discarded, and
+///the next reader builds and publishes a replacement, which is then shared by
+///all readers until the collection changes again.
+template<typename T>
+class CollectionSnapshot{
+public:
+	using Collection=std::vector<T>;
+
+	CollectionSnapshot():version(0),rebuilds(0){}
+	CollectionSnapshot(const CollectionSnapshot&)=delete;
+	CollectionSnapshot& operator=(const CollectionSnapshot&)=delete;
+
+	///Get the current snapshot of the collection, building it if the
+	///collection has changed since the last snapshot was made.
+	///\param build a function which copies the full collection
+	///\return the snapshot, which remains valid for as long as the caller holds
+	///        it, even if it is replaced in the meantime
+	std::shared_ptr<const Collection> get(const std::function<Collection()>& build){
+		std::shared_ptr<const Collection> snapshot=load();
+		if(snapshot)
+			return snapshot;
+		//only one thread builds a replacement; others wait and then use it
+		std::lock_guard<std::mutex> buildLock(buildMutex);
+		snapshot=load();
+		if(snapshot)
+			return snapshot;
+		std::size_t startVersion=version.load();
+		snapshot=std::make_shared<const Collection>(build());
+		rebuilds++;
+		{
+			//if the collection changed while the copy was being made, the copy
+			//may not include the change, so it may be returned to this caller
+			//but must not be published for others
+			std::lock_guard<std::mutex> lock(publishMutex);
+			if(version.load()==startVersion)
+				store(snapshot);
+		}
+		return snapshot;
+	}
+
+	///Discard the current snapshot because the collection has changed. This
+	///must be called after the change is visible in the underlying cache.
+	void invalidate(){
+		std::lock_guard<std::mutex> lock(publishMutex);
+		version++;
+		store(nullptr);
+	}
+
+	///\return the number of times the snapshot has been rebuilt
+	std::size_t rebuildCount() const{ return rebuilds.load(); }
+
+private:
+	std::shared_ptr<const Collection> current;
+	///Incremented each time the collection changes
+	std::atomic<std::size_t> version;
+	std::atomic<std::size_t> rebuilds;
+	///Serializes building new snapshots
+	std::mutex buildMutex;
+	///Serializes publishing and discarding snapshots, so that a stale
+	///snapshot cannot be published after it has been invalidated
+	std::mutex publishMutex;
+#ifdef SLATE_SNAPSHOT_POINTER_LOCK
+	mutable std::mutex pointerMutex;
+
+	std::shared_ptr<const Collection> load() const{
+		std::lock_guard<std::mutex> lock(pointerMutex);
+		return current;
+	}
+	void store(std::shared_ptr<const Collection> snapshot){
+		std::lock_guard<std::mutex> lock(pointerMutex);
+		current=std::move(snapshot);
+	}
+#else
+	std::shared_ptr<const Collection> load() const{
+		return std::atomic_load(&current);
+	}
+	void store(std::shared_ptr<const Collection> snapshot){
+		std::atomic_store(&current,std::move(snapshot));
+	}
+#endif
+};
+
+#endif //SLATE_COLLECTION_SNAPSHOT_H
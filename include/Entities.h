@@ -262,6 +262,10 @@ public:
 	std::string generateSecretID(){
 		return secretIDPrefix+generateRawID();
 	}
+	///Creates a random ID for a new job
+	std::string generateJobID(){
+		return jobIDPrefix+generateRawID();
+	}
 	///Creates a random access token for a user
 	///At the moment there is no apparent reason that a user's access token
 	///should have any particular structure or meaning. Definite requirements:
@@ -280,6 +284,7 @@ public:
 	const static std::string groupIDPrefix;
 	const static std::string instanceIDPrefix;
 	const static std::string secretIDPrefix;
+	const static std::string jobIDPrefix;
 	
 private:
 	std::mutex mut;
@@ -0,0 +1,99 @@
+#ifndef SLATE_JOB_COMMANDS_H
+#define SLATE_JOB_COMMANDS_H
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include "crow.h"
+#include "Entities.h"
+#include "PersistentStore.h"
+#include "WorkerPool.h"
+
+///The record of a slow operation which runs after the request which started
+///it has been answered
+struct Job{
+	enum class State{
+		Pending, ///<waiting for a thread to run it
+		Running, ///<in progress
+		Succeeded, ///<finished, with a successful response
+		Failed ///<finished, with an error response
+	};
+
+	Job():state(State::Pending),resultStatus(0){}
+
+	std::string id;
+	///The ID of the user who started the job
+	std::string owner;
+	///A short explanation of what the job does
+	std::string description;
+	State state;
+	std::string created;
+	std::string started;
+	std::string finished;
+	///The HTTP status of the response the operation produced, once finished
+	unsigned int resultStatus;
+	///The body of the response the operation produced, once finished
+	std::string resultBody;
+
+	explicit operator bool() const{ return !id.empty(); }
+};
+
+///\return the name of a job state, as used in the API
+std::string to_string(Job::State state);
+
+///Tracks the jobs which are pending or running, and those which have recently
+///finished. Finished jobs are discarded after a retention period.
+class JobTable{
+public:
+	///\param retention how long the results of finished jobs are kept
+	explicit JobTable(std::chrono::seconds retention=std::chrono::hours(1));
+	JobTable(const JobTable&)=delete;
+	JobTable& operator=(const JobTable&)=delete;
+
+	///Create a record for a new, pending job
+	///\param owner the user starting the job
+	///\param description a short explanation of what the job does
+	///\return the new job
+	Job create(const User& owner, const std::string& description);
+	///Note that a job has begun running
+	void markRunning(const std::string& id);
+	///Record the result of a job
+	///\param result the response produced by the operation
+	void markFinished(const std::string& id, const crow::response& result);
+	///\return the job with the given ID, or an invalid job if it does not
+	///        exist or has been discarded
+	Job find(const std::string& id) const;
+
+private:
+	///Remove finished jobs whose retention period has passed.
+	///Must be called with mutex held.
+	void discardExpired();
+
+	const std::chrono::seconds retention;
+	///Guards all following members
+	mutable std::mutex mutex;
+	std::map<std::string,Job> jobs;
+	///The times at which finished jobs should be discarded
+	std::multimap<std::chrono::steady_clock::time_point,std::string> expirations;
+};
+
+///Start running a slow request handler as a job, and respond immediately with
+///202 Accepted and the job's ID, so that the request need not wait for the
+///operation to finish. The handler performs its own authorization checks when
+///it runs, but the requesting user must be authenticated to start a job.
+///\param pool the threads on which to run the job
+///\param description a short explanation of what the job does
+///\param handler the function which performs the operation and produces the
+///               response which will be recorded as the job's result
+crow::response startJob(PersistentStore& store, JobTable& jobs, WorkerPool& pool,
+                        const crow::request& req, const std::string& description,
+                        std::function<crow::response()> handler);
+
+///Fetch the state of a job, and its result if it has finished
+crow::response getJob(PersistentStore& store, JobTable& jobs,
+                      const crow::request& req, const std::string& jobID);
+
+#endif //SLATE_JOB_COMMANDS_H
@@ -0,0 +1,51 @@
+#ifndef SLATE_KUBE_INFORMER_H
+#define SLATE_KUBE_INFORMER_H
+
+#include <chrono>
+#include <string>
+
+#include "FileHandle.h"
+#include "Process.h"
+
+namespace kubernetes{
+	///The kinds of kubernetes objects which can be listed from an in-memory
+	///cache
+	enum class ResourceKind{
+		Pods,
+		Services,
+		Deployments,
+		Ingresses
+	};
+
+	///Set how long cached objects may continue to be used after the cache has
+	///lost contact with the cluster they came from.
+	///\param maxStaleness the allowed staleness; zero disables caching, so that
+	///                    every listing is fetched directly from the cluster
+	void setInformerMaxStaleness(std::chrono::seconds maxStaleness);
+
+	///List the objects of one kind in a namespace on a cluster.
+	///The first use of each kind of object on a cluster starts a background
+	///watch which keeps an in-memory copy of all such objects in group
+	///namespaces current; later listings are answered from it. When the copy
+	///is not yet available, or has been out of contact with the cluster for
+	///longer than the allowed staleness, the cluster is queried directly.
+	///Watches which go unused for several minutes are stopped.
+	///\param clusterID the ID of the cluster whose objects should be listed
+	///\param configPath the kubernetes config file for the cluster
+	///\param kind the kind of objects to list
+	///\param nspace the namespace in which to list objects
+	///\param labelSelector a comma separated list of key=value label
+	///                     requirements which listed objects must match
+	///\return the same as kubernetes::apiGet: a JSON object with an items
+	///        member containing the matching objects, or error information
+	commandResult listObjects(const std::string& clusterID,
+	                          const SharedFileHandle& configPath,
+	                          ResourceKind kind, const std::string& nspace,
+	                          const std::string& labelSelector);
+
+	///\return a plain text report of how many listings have been answered from
+	///        cached data and how many clusters are being watched
+	std::string getInformerStatistics();
+}
+
+#endif //SLATE_KUBE_INFORMER_H
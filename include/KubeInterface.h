@@ -1,11 +1,44 @@
 #ifndef SLATE_KUBE_INTERFACE_H
 #define SLATE_KUBE_INTERFACE_H
 
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
+
 #include "Entities.h"
 #include "Process.h"
 
 namespace kubernetes{
+	///Set how many kubectl and helm processes may run at once. When either 
+	///limit is reached, further commands wait, with commands which only 
+	///inspect a cluster taking precedence over those which change it. 
+	///\param perClusterLimit the number of commands which may run at once 
+	///                       against any one cluster
+	///\param totalLimit the number of commands which may run at once against 
+	///                  all clusters combined
+	void setOperationLimits(std::size_t perClusterLimit, std::size_t totalLimit);
+	
+	///\return a plain text report of the number of kubectl and helm commands 
+	///        running and waiting for each cluster, how long they have waited,
+	///        and which clusters are believed to be unreachable
+	std::string getOperationStatistics();
+	
+	///Commands and API requests directed at a cluster which fail because it 
+	///cannot be contacted are counted, and after several consecutive failures
+	///further attempts fail immediately, rather than each waiting to time out.
+	///After a retry interval one attempt is allowed through, and its success 
+	///restores normal operation. 
+	///\param clusterID the ID of the cluster
+	///\return whether the cluster is believed to be reachable
+	bool clusterAvailable(const std::string& clusterID);
+	
+	///\param clusterID the ID of the cluster
+	///\return whether the cluster is believed to be unreachable but enough 
+	///        time has passed that it should be tried again
+	bool clusterRetryDue(const std::string& clusterID);
+	
 	commandResult kubectl(const std::string& configPath,
 	                      const std::vector<std::string>& arguments);
 	
@@ -13,6 +46,50 @@ namespace kubernetes{
 	                   const std::string& tillerNamespace,
 	                   const std::vector<std::string>& arguments);
 
+	///Perform a GET request directly against the API server of the cluster 
+	///described by a kubernetes config file, without running kubectl. 
+	///Connections are kept alive and reused by later requests which use the 
+	///same config file. 
+	///\param configPath path to the kubernetes config file corresponding to 
+	///                  the target cluster
+	///\param path the API path to request, e.g. /api/v1/namespaces/default/pods
+	///\param query query parameters for the request, such as labelSelector or 
+	///             fieldSelector
+	///\return the response body as the output with a zero status if the request
+	///        succeeded, otherwise a description of the problem as the error 
+	///        with the HTTP status code, or 1 if no response was received
+	commandResult apiGet(const std::string& configPath, const std::string& path, 
+	                     const std::map<std::string,std::string>& query={});
+	
+	///Perform a long-running GET request, such as a watch, directly against 
+	///the API server of the cluster described by a kubernetes config file, 
+	///handling the response one line at a time as it arrives. 
+	///\param configPath path to the kubernetes config file corresponding to 
+	///                  the target cluster
+	///\param path the API path to request
+	///\param query query parameters for the request
+	///\param lineHandler a function to be called with each line of a 
+	///                   successful response. It should return false if the 
+	///                   request should be ended early. 
+	///\param cancelled a function which is checked about once per second, and 
+	///                 which should return true if the request should be abandoned
+	///\param timeout the maximum number of seconds the request may last
+	///\return a zero status with empty output if the request succeeded, or was
+	///        ended by \p lineHandler or \p cancelled, otherwise the same 
+	///        error information as apiGet
+	commandResult apiStream(const std::string& configPath, const std::string& path, 
+	                        const std::map<std::string,std::string>& query,
+	                        const std::function<bool(const std::string&)>& lineHandler,
+	                        const std::function<bool()>& cancelled,
+	                        unsigned long timeout);
+	
+	///\param configPath path to the kubernetes config file corresponding to 
+	///                  the target cluster
+	///\return the namespace selected by the config's current context, which 
+	///        kubectl would use when no namespace is specified
+	///\throws std::runtime_error if the config file cannot be used
+	std::string defaultNamespace(const std::string& configPath);
+
 	///\param clusterConfig path to the kubernetes config file corresponding to 
 	///                     the target cluster
 	///\param group the Group whose namespace should be created
@@ -23,6 +100,41 @@ namespace kubernetes{
 	///\param group the Group whose namespace should be removed
 	void kubectl_delete_namespace(const std::string& clusterConfig, const Group& group);
 	
+	///A description of the behavior of the installed Helm, determined once by 
+	///probing it, so that individual helm operations need not each spawn extra 
+	///subprocesses to find out what arguments to use. 
+	struct HelmCapabilities{
+		///The major component of helm's version number
+		unsigned int majorVersion;
+		///Whether helm requires a tiller deployment (and the --tiller-namespace 
+		///and --tiller-connection-timeout flags)
+		bool usesTiller;
+		///Whether `helm delete` must be passed --purge to fully remove a release
+		bool deleteRequiresPurge;
+		///Whether `helm install` takes the release name via --name rather than 
+		///as a positional argument
+		bool installRequiresNameFlag;
+		///Whether chart searches must be performed with `helm search repo`
+		bool searchRequiresRepoSubcommand;
+		///The flag used to prevent helm from truncating search output columns
+		std::string searchColumnWidthFlag;
+		///The names of the chart repositories helm currently has configured
+		std::vector<std::string> repositories;
+		
+		///\return whether a repository with the given name is configured
+		bool hasRepository(const std::string& name) const;
+	};
+	
+	///Probe the installed helm and replace the process-wide capability 
+	///description with the result. 
+	///\throws std::runtime_error if helm's version cannot be determined
+	///\return the newly determined capabilities
+	std::shared_ptr<const HelmCapabilities> refreshHelmCapabilities();
+	
+	///\return the process-wide helm capability description, probing helm if 
+	///         this has not already been done
+	std::shared_ptr<const HelmCapabilities> getHelmCapabilities();
+	
 	///\return the major component of the installed Helm's current version number
 	unsigned int getHelmMajorVersion();
 }
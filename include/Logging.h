@@ -1,65 +1,199 @@
 #ifndef SLATE_LOGGING_H
 #define SLATE_LOGGING_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
 #include <iostream>
-#include <sstream>
 #include <mutex>
+#include <sstream>
+#include <string>
 #include <thread>
 
 #include "Utilities.h"
 #include "ServerUtilities.h"
 
-struct logTarget{
-	std::ostream& stream;
-	std::mutex mutex;
+///The severities of log messages, in increasing order
+enum class LogLevel{
+	Info,
+	Warn,
+	Error,
+	Fatal
+};
+
+///The least severe level of message which is logged
+extern std::atomic<LogLevel> minimumLogLevel;
+
+///Set the least severe level of message which should be logged. Fatal
+///messages are always logged.
+void setLogLevel(LogLevel level);
+
+///\return whether messages of the given level are logged
+inline bool logEnabled(LogLevel level){
+	return level>=minimumLogLevel.load(std::memory_order_relaxed);
+}
+
+///Write the current time to a stream, in the same form as timestamp().
+///Each thread keeps the formatted date and time to the second, so only the
+///fractional seconds need to be formatted for most messages.
+void logTimestamp(std::ostream& os);
+
+///A destination for log messages.
+///Once started, logging threads place messages into a fixed size, lock-free 
+///queue, from which a background thread writes them in batches, so that 
+///logging threads need not wait for each other or for output to complete. If
+///the queue is full, informational messages are dropped, while more severe 
+///messages wait for space. Before the background thread is started, messages
+///are written directly. 
+class logTarget{
+public:
+	explicit logTarget(std::ostream& stream);
+	///Writes all queued messages, then stops the background thread. Any 
+	///messages logged after this are written directly.
+	~logTarget();
+	logTarget(const logTarget&)=delete;
+	logTarget& operator=(const logTarget&)=delete;
+
+	///Start the background thread which writes queued messages. 
+	///This should not be called until any processes which must be forked from
+	///a single-threaded process have been started. 
+	void start();
+
+	///Queue a message to be written
+	///\param msg the complete text of the message
+	///\param level the severity of the message
+	void write(std::string msg, LogLevel level);
+	
+	///Wait for all messages queued so far to be written, for up to a second
+	void flush();
 	
-	void write(const std::string& msg){
-		std::lock_guard<std::mutex> guard(mutex);
-		stream << msg;
-		stream.flush();
-	}
+	///Write a message directly, after all messages queued so far, and wait 
+	///for it to be output
+	///\param msg the complete text of the message
+	void writeNow(const std::string& msg);
+
+	///\return the number of messages which have been written
+	std::size_t writtenCount() const{ return written.load(); }
+	///\return the number of messages which have been discarded because the
+	///        queue was full
+	std::size_t droppedCount() const{ return dropped.load(); }
+	///\return the number of messages which had to wait for space in the queue
+	std::size_t delayedCount() const{ return delayed.load(); }
+
+private:
+	struct Slot{
+		///Used to coordinate access between the producers and the consumer:
+		///equal to the slot's position when the slot is free to be filled, and
+		///to one more than its position when it holds a message
+		std::atomic<std::size_t> sequence;
+		std::string message;
+	};
+
+	///The number of messages the queue can hold; must be a power of two
+	static const std::size_t capacity=8192;
+
+	std::ostream& stream;
+	///Deliberately never freed, since threads which are still running during
+	///shutdown may log after this object has been destroyed
+	Slot* slots;
+	///The position at which the next message will be added
+	std::atomic<std::size_t> enqueuePosition;
+	///The position from which the next message will be taken; used only by
+	///the writer thread
+	std::size_t dequeuePosition;
+
+	///The position up to which messages have been written out
+	std::atomic<std::size_t> writtenPosition;
+
+	std::atomic<std::size_t> written;
+	std::atomic<std::size_t> dropped;
+	std::atomic<std::size_t> delayed;
+
+	std::thread writer;
+	std::atomic<bool> started;
+	std::atomic<bool> writerSleeping;
+	std::atomic<bool> stopping;
+	///Used by the writer thread to wait for new messages, and by flush to 
+	///wait for the writer
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable flushedCondition;
+	///Serializes output to the stream by the writer thread and direct writes
+	std::mutex streamMutex;
+
+	///\return whether the message was queued; it is not if the queue is full
+	bool tryPush(std::string& msg);
+	///\return whether a message was taken from the queue
+	bool tryPop(std::string& msg);
+	///\return whether a message is ready to be taken from the queue; used only
+	///        by the writer thread
+	bool messageReady() const;
+	///Write a message to the stream without queuing it
+	void writeDirectly(const std::string& msg);
+	void writeMessages();
 };
 
 extern logTarget logStdout;
 extern logTarget logStderr;
 
+///Start the background threads which write logStdout and logStderr. 
+///Until this is called, all messages are written synchronously. 
+void startLogWriters();
+
+///\return a plain text report of the numbers of messages logged, dropped, and
+///        delayed because the log queues were full
+std::string getLoggingStatistics();
+
 ///Log an informational message to stdout
 #define log_info(msg) \
 do{ \
+	if(!logEnabled(LogLevel::Info)) \
+		break; \
 	std::ostringstream str; \
-	str << "INFO: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << msg << std::endl; \
-	logStdout.write(str.str()); \
+	str << "INFO: ["; \
+	logTimestamp(str); \
+	str << "] (TID " << std::this_thread::get_id() << ") " << msg << '\n'; \
+	logStdout.write(str.str(),LogLevel::Info); \
 } while(0)
 
 ///Log that an error or problem has occurred to stderr
 #define log_warn(msg) \
 do{ \
+	if(!logEnabled(LogLevel::Warn)) \
+		break; \
 	std::ostringstream str; \
-	str << "WARN: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << msg << std::endl; \
-	logStderr.write(str.str()); \
+	str << "WARN: ["; \
+	logTimestamp(str); \
+	str << "] (TID " << std::this_thread::get_id() << ") " << msg << '\n'; \
+	logStderr.write(str.str(),LogLevel::Warn); \
 } while(0)
 
 ///Log that an error or problem has occurred to stderr
 #define log_error(msg) \
 do{ \
+	if(!logEnabled(LogLevel::Error)) \
+		break; \
 	std::ostringstream str; \
-	str << "ERROR: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << msg << std::endl; \
-	logStderr.write(str.str()); \
+	str << "ERROR: ["; \
+	logTimestamp(str); \
+	str << "] (TID " << std::this_thread::get_id() << ") " << msg << '\n'; \
+	logStderr.write(str.str(),LogLevel::Error); \
 } while(0)
 
-///Log an error to stderr and abort the current activity by throwing an exception
+///Log an error to stderr and abort the current activity by throwing an exception.
+///Since the exception may end the process, the message, and all messages 
+///logged before it, are written out before it is thrown.
 ///\throws std::runtime_error
 #define log_fatal(msg) \
 do{ \
 	std::ostringstream mstr; \
 	mstr << msg; \
 	std::ostringstream str; \
-	str << "FATAL: [" << timestamp() << "] (TID " \
-	<< std::this_thread::get_id() << ") " << mstr.str() << std::endl; \
-	logStderr.write(str.str()); \
+	str << "FATAL: ["; \
+	logTimestamp(str); \
+	str << "] (TID " << std::this_thread::get_id() << ") " << mstr.str() << '\n'; \
+	logStdout.flush(); \
+	logStderr.writeNow(str.str()); \
 	throw std::runtime_error(mstr.str()); \
 } while(0)
 
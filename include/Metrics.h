@@ -0,0 +1,123 @@
+#ifndef SLATE_METRICS_H
+#define SLATE_METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+///Counters and latency distributions which can be updated cheaply from any
+///thread, and exported in the Prometheus text format.
+namespace metrics{
+
+///The number of separate cells into which each metric is divided. Each thread
+///updates only one cell, so threads seldom contend for the same cache line.
+const std::size_t cellCount=8;
+
+///\return the cell which the current thread should update
+std::size_t currentCell();
+
+///A count which only increases
+class Counter{
+public:
+	Counter();
+	Counter(const Counter&)=delete;
+	Counter& operator=(const Counter&)=delete;
+
+	void add(std::uint64_t amount=1){
+		cells[currentCell()].count.fetch_add(amount,std::memory_order_relaxed);
+	}
+	///\return the sum of all cells
+	std::uint64_t value() const;
+
+private:
+	struct Cell{
+		std::atomic<std::uint64_t> count;
+		///keeps each cell in its own cache line
+		char padding[64-sizeof(std::atomic<std::uint64_t>)];
+	};
+	Cell cells[cellCount];
+};
+
+///A distribution of durations. Durations are counted in buckets whose widths
+///grow in proportion to their bounds, with four buckets per power of two
+///microseconds, so that the relative precision is the same at all scales, as
+///in an HDR histogram.
+class Histogram{
+public:
+	///The number of buckets, enough to cover durations up to about 19 hours;
+	///longer durations are counted in the last bucket
+	static const std::size_t bucketCount=144;
+
+	///The combined contents of all cells
+	struct Snapshot{
+		std::vector<std::uint64_t> buckets;
+		std::uint64_t count;
+		///The total of all recorded durations, in seconds
+		double sum;
+	};
+
+	Histogram();
+	Histogram(const Histogram&)=delete;
+	Histogram& operator=(const Histogram&)=delete;
+
+	///Add a duration to the distribution
+	void record(std::chrono::nanoseconds duration);
+	///\return the current contents of the distribution
+	Snapshot snapshot() const;
+
+	///\return the exclusive upper bound of a bucket, in seconds
+	static double bucketUpperBound(std::size_t index);
+	///\return the bucket into which a number of microseconds falls
+	static std::size_t bucketIndex(std::uint64_t micros);
+
+private:
+	struct Cell{
+		std::atomic<std::uint64_t> buckets[bucketCount];
+		///The total of all recorded durations, in nanoseconds
+		std::atomic<std::uint64_t> sum;
+	};
+	Cell cells[cellCount];
+};
+
+///Records the time from its construction to its destruction in a histogram
+class Timer{
+public:
+	explicit Timer(Histogram& histogram):
+	histogram(histogram),start(std::chrono::steady_clock::now()){}
+	~Timer(){ histogram.record(std::chrono::steady_clock::now()-start); }
+	Timer(const Timer&)=delete;
+	Timer& operator=(const Timer&)=delete;
+private:
+	Histogram& histogram;
+	std::chrono::steady_clock::time_point start;
+};
+
+///Names and values which distinguish the series of a metric
+using Labels=std::vector<std::pair<std::string,std::string>>;
+
+///Find or create a counter. Each call must look the counter up, so callers
+///which update the same series frequently should keep the reference.
+///\param name the name of the metric
+///\param help a description of the metric
+///\param labels the labels identifying this series of the metric
+///\return the counter, which remains valid for the life of the program
+Counter& counter(const std::string& name, const std::string& help,
+                 const Labels& labels={});
+
+///Find or create a histogram.
+///\param name the name of the metric, which should end in _seconds
+///\param help a description of the metric
+///\param labels the labels identifying this series of the metric
+///\return the histogram, which remains valid for the life of the program
+Histogram& histogram(const std::string& name, const std::string& help,
+                     const Labels& labels={});
+
+///\return all metrics in the Prometheus text exposition format
+std::string exportPrometheus();
+
+}
+
+#endif //SLATE_METRICS_H
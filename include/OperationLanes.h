@@ -0,0 +1,126 @@
+#ifndef SLATE_OPERATION_LANES_H
+#define SLATE_OPERATION_LANES_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+///The classes of operations which compete for slots, in decreasing order of
+///precedence
+enum class OperationPriority{
+	Read, ///<an operation which only inspects the target
+	Mutation ///<an operation which changes the target
+};
+
+///Limits how many operations may run at once, both against each target (lane)
+///and in total. Operations which cannot start immediately wait in their lane's
+///queue; when a slot becomes free it goes to the waiting operation with the
+///highest priority, and among those to the one which has waited longest, whose
+///lane is not already at its limit. So that a steady stream of reads cannot
+///starve mutations, a mutation which has waited longer than the aging limit
+///competes as though it were a read.
+class OperationLanes{
+public:
+	///Permission to run one operation, which is returned when this object is
+	///destroyed
+	class Slot{
+	public:
+		Slot(Slot&& other);
+		~Slot();
+		Slot(const Slot&)=delete;
+		Slot& operator=(const Slot&)=delete;
+		Slot& operator=(Slot&&)=delete;
+	private:
+		Slot(OperationLanes* lanes, std::string lane);
+		OperationLanes* lanes;
+		std::string lane;
+		friend class OperationLanes;
+	};
+
+	///A summary of the activity in one lane
+	struct LaneStatistics{
+		std::string lane;
+		///The number of operations currently running
+		std::size_t running;
+		///The number of operations currently waiting to start
+		std::size_t queued;
+		///The largest number of operations which have waited at once
+		std::size_t maxQueued;
+		///The number of operations which have been started
+		std::size_t started;
+		///The total and largest times operations spent waiting, in seconds
+		double totalWait, maxWait;
+	};
+
+	///\param laneLimit the number of operations which may run at once in each
+	///                 lane
+	///\param totalLimit the number of operations which may run at once in all
+	///                  lanes combined
+	///\param agingLimit how long a mutation may wait before it is given the 
+	///                  same precedence as reads
+	OperationLanes(std::size_t laneLimit, std::size_t totalLimit,
+	               std::chrono::milliseconds agingLimit=std::chrono::seconds(10));
+	OperationLanes(const OperationLanes&)=delete;
+	OperationLanes& operator=(const OperationLanes&)=delete;
+
+	///Change the concurrency limits. Operations already running are not
+	///affected, but no more will start until the counts fall below the new
+	///limits. Zero limits are treated as one.
+	void setLimits(std::size_t laneLimit, std::size_t totalLimit);
+
+	///Wait until an operation may run in the given lane
+	///\param lane the name of the lane, such as the ID of the target
+	///\param priority the class of the operation
+	///\return a slot which must be held for the duration of the operation
+	Slot acquire(const std::string& lane, OperationPriority priority);
+
+	///\return summaries of all lanes which have been used
+	std::vector<LaneStatistics> getStatistics() const;
+
+private:
+	using clock=std::chrono::steady_clock;
+
+	///An operation waiting to start
+	struct Waiter{
+		///The order in which waiters arrived, used to break priority ties
+		std::uint64_t sequence;
+		clock::time_point arrival;
+		bool granted;
+	};
+
+	struct Lane{
+		Lane():running(0),maxQueued(0),started(0),totalWait(0),maxWait(0){}
+		std::size_t running;
+		///Waiting operations, one queue per priority class
+		std::deque<Waiter*> waiting[2];
+		std::size_t maxQueued;
+		std::size_t started;
+		double totalWait, maxWait;
+
+		std::size_t queued() const{ return waiting[0].size()+waiting[1].size(); }
+	};
+
+	///Hand out as many free slots to waiting operations as the limits allow.
+	///Must be called with mutex held.
+	void dispatch();
+	///Give up a slot in the given lane
+	void release(const std::string& lane);
+
+	///Guards all following members
+	mutable std::mutex mutex;
+	///Signalled when waiting operations are granted slots
+	std::condition_variable grantedCondition;
+	std::size_t laneLimit;
+	std::size_t totalLimit;
+	const clock::duration agingLimit;
+	std::size_t running;
+	std::uint64_t nextSequence;
+	std::map<std::string,Lane> lanes;
+};
+
+#endif //SLATE_OPERATION_LANES_H
@@ -2,21 +2,30 @@
 #define SLATE_PERSISTENT_STORE_H
 
 #include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
+#include <thread>
 
 #include <aws/core/Aws.h>
 #include <aws/core/auth/AWSCredentialsProvider.h>
 #include <aws/dynamodb/DynamoDBClient.h>
+#include <aws/dynamodb/model/ScanRequest.h>
 #include <aws/route53/Route53Client.h>
 
 #include <libcuckoo/cuckoohash_map.hh>
 
+#include <CollectionSnapshot.h>
 #include <concurrent_multimap.h>
 #include <DNSManipulator.h>
 #include <Entities.h>
 #include <FileHandle.h>
+#include <SingleFlight.h>
+#include <WorkerPool.h>
 
 //In libstdc++ versions < 5 std::atomic seems to be broken for non-integral types
 //In that case, we must use our own, minimal replacement
@@ -34,7 +43,12 @@
 #endif
 
 ///A wrapper type for tracking cached records which must be considered 
-///expired after some time
+///expired after some time.
+///The cached data is held as a shared, immutable object, so copying a record 
+///(into several caches indexed by different keys, or out of a cache on a hit) 
+///copies only a pointer, and all copies refer to a single stored object.
+///The stored object also tracks approximately when it was last used, so that 
+///caches which grow too large can discard their least recently used records.
 template <typename RecordType>
 struct CacheRecord{
 	using steady_clock=std::chrono::steady_clock;
@@ -42,31 +56,35 @@ struct CacheRecord{
 	using value_type=RecordType;
 	
 	///default construct a record which is considered expired/invalid
-	CacheRecord():expirationTime(steady_clock::time_point::min()){}
+	CacheRecord():data(emptyRecord()),expirationTime(steady_clock::time_point::min()){}
 	
 	///construct a record which is considered expired but contains data
 	///\param record the cached data
 	CacheRecord(const value_type& record):
-	record(record),expirationTime(steady_clock::time_point::min()){}
+	data(std::make_shared<const Stored>(record)),
+	expirationTime(steady_clock::time_point::min()){}
 	
 	///\param record the cached data
 	///\param exprTime the time after which the record expires
 	CacheRecord(const value_type& record, steady_clock::time_point exprTime):
-	record(record),expirationTime(exprTime){}
+	data(std::make_shared<const Stored>(record)),expirationTime(exprTime){}
 	
 	///\param validity duration until the record expires
 	template <typename DurationType>
 	CacheRecord(const value_type& record, DurationType validity):
-	record(record),expirationTime(steady_clock::now()+validity){}
+	data(std::make_shared<const Stored>(record)),
+	expirationTime(steady_clock::now()+validity){}
 	
 	///\param exprTime the time after which the record expires
 	CacheRecord(value_type&& record, steady_clock::time_point exprTime):
-	record(std::move(record)),expirationTime(exprTime){}
+	data(std::make_shared<const Stored>(std::move(record))),
+	expirationTime(exprTime){}
 	
 	///\param validity duration until the record expires
 	template <typename DurationType>
 	CacheRecord(value_type&& record, DurationType validity):
-	record(std::move(record)),expirationTime(steady_clock::now()+validity){}
+	data(std::make_shared<const Stored>(std::move(record))),
+	expirationTime(steady_clock::now()+validity){}
 	
 	///\return whether the record's expiration time has passed and it should 
 	///        be discarded
@@ -74,15 +92,81 @@ struct CacheRecord{
 	///\return whether the record has not yet expired, so it is still valid
 	///        for use
 	operator bool() const{ return (steady_clock::now() <= expirationTime); }
+	///\param gracePeriod how long after expiring the record may still be used
+	///                   while a replacement is fetched
+	///\return whether the record has not expired, or has expired by less than 
+	///        the grace period
+	template <typename DurationType>
+	bool usableWithin(DurationType gracePeriod) const{ 
+		//subtract from the current time rather than adding to the expiration 
+		//time, which may be the minimum representable time
+		return (steady_clock::now()-gracePeriod <= expirationTime);
+	}
+	///Access the data stored in the record, without copying it, and note that 
+	///it has been used
+	///\return the stored data
+	const value_type& get() const{
+		data->touch();
+		return data->value;
+	}
+	///Access the data stored in the record without counting this as a use, 
+	///for bookkeeping such as hashing and size accounting
+	///\return the stored data
+	const value_type& peek() const{ return data->value; }
+	///Share the data stored in the record, without copying it, and note that 
+	///it has been used
+	///\return a pointer to the stored data which keeps it alive even if the 
+	///        record is later replaced or discarded
+	std::shared_ptr<const value_type> share() const{
+		data->touch();
+		return std::shared_ptr<const value_type>(data,&data->value);
+	}
+	///\return approximately when the stored data was last used
+	steady_clock::time_point lastUsed() const{ 
+		return steady_clock::time_point(steady_clock::duration(data->lastUsed.load(std::memory_order_relaxed)));
+	}
 	///Implicit conversion to value_type
-	///\return the data stored in the record
+	///\return a copy of the data stored in the record
 	///This function is not available when it would be ambiguous because the 
 	///stored data type is also bool.
 	template<typename ConvType = value_type>
-	operator typename std::enable_if<!std::is_same<ConvType,bool>::value,ConvType>::type() const{ return record; }
+	operator typename std::enable_if<!std::is_same<ConvType,bool>::value,ConvType>::type() const{ return get(); }
+	
+private:
+	///The data shared by all copies of a record
+	struct Stored{
+		template<typename... Args>
+		explicit Stored(Args&&... args):
+		value(std::forward<Args>(args)...),
+		lastUsed(steady_clock::now().time_since_epoch().count()){}
+		
+		///Record a use of the data. The time is only updated when it has 
+		///changed by a noticeable amount, so that frequently used records are 
+		///not constantly written by every thread which reads them.
+		void touch() const{
+			auto now=steady_clock::now().time_since_epoch();
+			auto last=steady_clock::duration(lastUsed.load(std::memory_order_relaxed));
+			if(now-last>std::chrono::seconds(1))
+				lastUsed.store(now.count(),std::memory_order_relaxed);
+		}
+		
+		const value_type value;
+		///The time of the last use, as a count of steady_clock ticks
+		mutable std::atomic<steady_clock::rep> lastUsed;
+	};
+	
+	///All default constructed records share a single empty object, so that 
+	///preparing a record to receive the result of a cache lookup does not 
+	///allocate.
+	static const std::shared_ptr<const Stored>& emptyRecord(){
+		static const std::shared_ptr<const Stored> empty=std::make_shared<const Stored>();
+		return empty;
+	}
+	
+	//The cached data, shared by all copies of the record
+	std::shared_ptr<const Stored> data;
 	
-	//The cached data
-	value_type record;
+public:
 	///The time at which the cached data should be discarded
 	steady_clock::time_point expirationTime;
 };
@@ -91,14 +175,20 @@ struct CacheRecord{
 ///of expiration times
 template <typename T>
 bool operator==(const CacheRecord<T>& r1, const CacheRecord<T>& r2){
-	return (const T&)r1==(const T&)r2;
+	return &r1.peek()==&r2.peek() || r1.peek()==r2.peek();
 }
 
 namespace std{
 ///The hash of a cache record is simply the hash of its stored data; the 
 ///expiration time is irrelevant.
 template<typename T>
-struct hash<CacheRecord<T>> : public std::hash<T>{};
+struct hash<CacheRecord<T>>{
+	using result_type=std::size_t;
+	using argument_type=CacheRecord<T>;
+	result_type operator()(const argument_type& r) const{
+		return std::hash<T>{}(r.peek());
+	}
+};
 	
 ///Define the hash of a set as the xor of the hashes of the items it contains. 
 template<typename T>
@@ -114,6 +204,36 @@ struct hash<std::set<T>>{
 };
 }
 
+///A DynamoDB client which records the time taken by, and the failures of, 
+///each type of database operation in the server's metrics
+class InstrumentedDynamoDBClient : public Aws::DynamoDB::DynamoDBClient{
+public:
+	using Aws::DynamoDB::DynamoDBClient::DynamoDBClient;
+	
+	Aws::DynamoDB::Model::GetItemOutcome GetItem(const Aws::DynamoDB::Model::GetItemRequest& request) const override;
+	Aws::DynamoDB::Model::PutItemOutcome PutItem(const Aws::DynamoDB::Model::PutItemRequest& request) const override;
+	Aws::DynamoDB::Model::UpdateItemOutcome UpdateItem(const Aws::DynamoDB::Model::UpdateItemRequest& request) const override;
+	Aws::DynamoDB::Model::DeleteItemOutcome DeleteItem(const Aws::DynamoDB::Model::DeleteItemRequest& request) const override;
+	Aws::DynamoDB::Model::QueryOutcome Query(const Aws::DynamoDB::Model::QueryRequest& request) const override;
+	Aws::DynamoDB::Model::ScanOutcome Scan(const Aws::DynamoDB::Model::ScanRequest& request) const override;
+	Aws::DynamoDB::Model::BatchGetItemOutcome BatchGetItem(const Aws::DynamoDB::Model::BatchGetItemRequest& request) const override;
+};
+
+///The measured size of a cache, and the number of records removed from it by
+///the most recent sweep
+struct CacheUsage{
+	CacheUsage():entries(0),bytes(0),expired(0),evicted(0){}
+	///The number of records in the cache
+	std::size_t entries;
+	///The approximate memory used by the cache's keys and records
+	std::size_t bytes;
+	///The number of records removed because they had expired
+	std::size_t expired;
+	///The number of unexpired records removed to keep the cache within its 
+	///budget
+	std::size_t evicted;
+};
+
 class PersistentStore{
 public:
 	///\param credentials the AWS credentials used for authenitcation with the 
@@ -127,12 +247,32 @@ public:
 	///                            send monitoring data
 	///\param appLoggingServerPort port to which application instances should 
 	///                            send monitoring data
+	///\param scanSegments the number of segments into which full table scans
+	///                    are divided to be read in parallel
+	///\param cacheEntryLimit the maximum number of records to keep in each 
+	///                       cache. This is applied to every cache separately, 
+	///                       not shared among them, and does not apply to 
+	///                       collections which have been loaded for listing. 
+	///\param cacheByteLimit the maximum approximate memory, in bytes, to use 
+	///                      for each cache, applied in the same way as 
+	///                      cacheEntryLimit
 	PersistentStore(const Aws::Auth::AWSCredentials& credentials, 
 	                const Aws::Client::ClientConfiguration& clientConfig,
 	                std::string bootstrapUserFile,
 	                std::string encryptionKeyFile,
 	                std::string appLoggingServerName,
-	                unsigned int appLoggingServerPort);
+	                unsigned int appLoggingServerPort,
+	                unsigned int scanSegments=8,
+	                std::size_t cacheEntryLimit=100000,
+	                std::size_t cacheByteLimit=std::size_t(64)<<20);
+	
+	///Stops background refreshing of cached data
+	~PersistentStore();
+	
+	///Read all user, group, cluster, application instance, and secret records 
+	///into the caches, so that early requests do not need to wait for the 
+	///database. The tables are read concurrently, each with a segmented scan.
+	void warmCaches();
 	
 	///Store a record for a new user
 	///\return Whether the user record was successfully added to the database
@@ -140,14 +280,25 @@ public:
 	
 	///Find information about the user with a given ID
 	///\param id the users ID
-	///\return the corresponding user or an invalid user object if the id is not known
-	User getUser(const std::string& id);
+	///\return the corresponding user or an invalid user object if the id is 
+	///        not known. The object is shared with the cache, and is never null.
+	std::shared_ptr<const User> getUser(const std::string& id);
+	
+	///Find information about several users at once. Records which are not 
+	///cached are fetched together, in batches.
+	///\param ids the IDs of the users to look up
+	///\return the users which were found, indexed by ID. IDs which do not 
+	///        correspond to any user are absent. 
+	std::map<std::string,User> getUsers(const std::vector<std::string>& ids);
 	
 	///Find the user who owns the given access token. Currently does not bother 
 	///to retreive the user's name, email address, or globus ID. 
+	///A cached record which has expired within the last userCacheGracePeriod 
+	///is returned immediately while a fresh copy is fetched in the background.
 	///\param token access token
-	///\return the token owner or an invalid user object if the token is not known
-	User findUserByToken(const std::string& token);
+	///\return the token owner or an invalid user object if the token is not 
+	///        known. The object is shared with the cache, and is never null.
+	std::shared_ptr<const User> findUserByToken(const std::string& token);
 	
 	///Find the user corresponding to the given Globus ID. Currently does not bother 
 	///to retreive the user's name, email address, or admin status. 
@@ -168,6 +319,8 @@ public:
 	
 	///Compile a list of all current user records
 	///\return all users, but with only IDs, names, and email addresses
+	///Once loaded, the list is kept current by a background thread, so that 
+	///only the first listing needs to wait for the database.
 	std::vector<User> listUsers();
 
 	///Compile a list of all current user records for the given group
@@ -229,6 +382,8 @@ public:
 	std::vector<std::string> clustersOwnedByGroup(const std::string groupID);
 	
 	///Find all current groups
+	///Once loaded, the list is kept current by a background thread, so that 
+	///only the first listing needs to wait for the database.
 	///\return all recorded groups
 	std::vector<Group> listGroups();
 
@@ -237,19 +392,31 @@ public:
 	std::vector<Group> listGroupsForUser(const std::string& user);
 	
 	///Find the group, if any, with the given ID
+	///A cached record which has expired within the last groupCacheGracePeriod 
+	///is returned immediately while a fresh copy is fetched in the background.
 	///\param name the ID to look up
 	///\return the group corresponding to the ID, or an invalid group if none exists
 	Group findGroupByID(const std::string& id);
 	
 	///Find the group, if any, with the given name
+	///A cached record which has expired within the last groupCacheGracePeriod 
+	///is returned immediately while a fresh copy is fetched in the background.
 	///\param name the name to look up
 	///\return the group corresponding to the name, or an invalid group if none exists
 	Group findGroupByName(const std::string& name);
 	
+	///Find several groups at once. Records which are not cached are fetched 
+	///together, in batches.
+	///\param ids the IDs of the groups to look up
+	///\return the groups which were found, indexed by ID. IDs which do not 
+	///        correspond to any group are absent. 
+	std::map<std::string,Group> getGroups(const std::vector<std::string>& ids);
+	
 	///Find the group, if any, with the given UUID or name
 	///\param idOrName the UUID or name of the group to look up
-	///\return the group corresponding to the name, or an invalid group if none exists
-	Group getGroup(const std::string& idOrName);
+	///\return the group corresponding to the name, or an invalid group if none 
+	///        exists. The object is shared with the cache, and is never null.
+	std::shared_ptr<const Group> getGroup(const std::string& idOrName);
 	
 	//----
 	
@@ -270,6 +437,8 @@ public:
 	bool updateCluster(const Cluster& cluster);
 	
 	///Find all current clusters
+	///Once loaded, the list is kept current by a background thread, so that 
+	///only the first listing needs to wait for the database.
 	///\return all recorded clusters
 	std::vector<Cluster> listClusters();
 
@@ -283,22 +452,34 @@ public:
 	SharedFileHandle configPathForCluster(const std::string& cID);
 	
 	///Find the cluster, if any, with the given ID
+	///A cached record which has expired within the last clusterCacheGracePeriod 
+	///is returned immediately while a fresh copy is fetched in the background.
 	///\param name the ID to look up
 	///\return the cluster corresponding to the ID, or an invalid cluster if 
 	///        none exists
 	Cluster findClusterByID(const std::string& id);
 	
 	///Find the cluster, if any, with the given name
+	///A cached record which has expired within the last clusterCacheGracePeriod 
+	///is returned immediately while a fresh copy is fetched in the background.
 	///\param name the name to look up
 	///\return the cluster corresponding to the name, or an invalid cluster if 
 	///        none exists
 	Cluster findClusterByName(const std::string& name);
 	
+	///Find several clusters at once. Records which are not cached are fetched 
+	///together, in batches.
+	///\param ids the IDs of the clusters to look up
+	///\return the clusters which were found, indexed by ID. IDs which do not 
+	///        correspond to any cluster are absent. 
+	std::map<std::string,Cluster> getClusters(const std::vector<std::string>& ids);
+	
 	///Find the cluster, if any, with the given UUID or name
 	///\param idOrName the UUID or name of the cluster to look up
 	///\return the cluster corresponding to the name, or an invalid cluster if 
-	///        none exists
-	Cluster getCluster(const std::string& idOrName);
+	///        none exists. The object is shared with the cache, and is never 
+	///        null.
+	std::shared_ptr<const Cluster> getCluster(const std::string& idOrName);
 	
 	///Grant a group access to use a cluster
 	///\param groupID the ID or name of the group
@@ -395,6 +576,13 @@ public:
 	///                 succeeded
 	void cacheClusterReachability(std::string idOrName, bool reachable);
 	
+	///Run a function on the refresh pool to replace an expired cached record,
+	///unless a refresh with the same key is already in progress.
+	///\param key a unique identifier for the record being refreshed
+	///\param refresh the function which fetches the record and updates the 
+	///               caches
+	void refreshInBackground(const std::string& key, std::function<void()> refresh);
+	
 	//----
 	
 	///Store a record for a new application instance
@@ -412,8 +600,9 @@ public:
 	///\return the corresponding instance or an invalid application instance 
 	///        object if the id is not known. If found, the instance's config
 	///        will not be set; it must be fetched using 
-	///        getApplicationInstanceConfig
-	ApplicationInstance getApplicationInstance(const std::string& id);
+	///        getApplicationInstanceConfig. The object is shared with the 
+	///        cache, and is never null.
+	std::shared_ptr<const ApplicationInstance> getApplicationInstance(const std::string& id);
 	
 	///Get the configuration information for an application instance with a 
 	///given ID
@@ -423,6 +612,8 @@ public:
 	std::string getApplicationInstanceConfig(const std::string& id);
 	
 	///Compile a list of all current application instance records
+	///Once loaded, the list is kept current by a background thread, so that 
+	///only the first listing needs to wait for the database.
 	///\return all instances, but with only IDs, names, owning groups, clusters, 
 	///        and creation times
 	std::vector<ApplicationInstance> listApplicationInstances();
@@ -440,8 +631,18 @@ public:
 	
 	//----
 	
+	///Encrypt secret data with a new, random data key, which is itself 
+	///encrypted with the master key and stored with the data
+	///\param s the data to encrypt
+	///\return the encrypted data, suitable for storing as the data of a Secret
 	std::string encryptSecret(const SecretData& s) const;
-	SecretData decryptSecret(const Secret& s) const;
+	///Decrypt the data of a secret. Secrets which were encrypted with the older
+	///scheme, which derived a key with scrypt for each secret, are still 
+	///decrypted, and are then re-encrypted and stored again in the background.
+	///\param s the secret whose data should be decrypted
+	///\return the decrypted data
+	///\throws std::runtime_error if the data cannot be decrypted
+	SecretData decryptSecret(const Secret& s);
 	
 	///Store a record for a new secret
 	///\param secret the secret to store
@@ -536,7 +737,7 @@ public:
 	
 private:
 	///Database interface object
-	Aws::DynamoDB::DynamoDBClient dbClient;
+	InstrumentedDynamoDBClient dbClient;
 	///Name of the users table in the database
 	const std::string userTableName;
 	///Name of the groups table in the database
@@ -601,6 +802,39 @@ private:
 	///This cache also contains data not directly managed by the persistent store
 	concurrent_multimap<std::string,CacheRecord<Application>> applicationCache;
 	
+	///How long after expiring cached user records may be used while they are 
+	///refreshed in the background
+	const std::chrono::seconds userCacheGracePeriod;
+	///How long after expiring cached group records may be used while they are 
+	///refreshed in the background
+	const std::chrono::seconds groupCacheGracePeriod;
+	///How long after expiring cached cluster records may be used while they 
+	///are refreshed in the background
+	const std::chrono::seconds clusterCacheGracePeriod;
+	///How long a lookup which found no record is remembered
+	const std::chrono::seconds missingRecordCacheValidity;
+	///Lookups which recently found that the requested record does not exist,
+	///keyed in the same way as the lookups in progress
+	cuckoohash_map<std::string,CacheRecord<bool>> missingRecordCache;
+	///Counts the records which have been created, so that a lookup which 
+	///began before a record was added does not then remember it as missing
+	std::atomic<unsigned long> missingRecordGeneration;
+	///Serializes adding entries to missingRecordCache with discarding them
+	std::mutex missingRecordMutex;
+	///The keys of the records currently being refreshed in the background
+	cuckoohash_map<std::string,bool> refreshesInProgress;
+	///Database lookups currently in progress, keyed by table, index, and key
+	SingleFlight<User> userLookups;
+	SingleFlight<Group> groupLookups;
+	SingleFlight<Cluster> clusterLookups;
+	SingleFlight<std::set<std::string>> applicationPermissionLookups;
+	///Copies of the full collections of listable records, which are rebuilt 
+	///only after the corresponding cache changes
+	CollectionSnapshot<User> userListing;
+	CollectionSnapshot<Group> groupListing;
+	CollectionSnapshot<Cluster> clusterListing;
+	CollectionSnapshot<ApplicationInstance> instanceListing;
+	
 	///Check that all necessary tables exist in the database, and create them if 
 	///they do not
 	void InitializeTables(std::string bootstrapUserFile);
@@ -613,6 +847,128 @@ private:
 	
 	void loadEncyptionKey(const std::string& fileName);
 	
+	///Look up a record, using the caches where possible.
+	///\return the record shared with the cache, or an invalid record if none 
+	///        exists; never null
+	std::shared_ptr<const Group> lookupGroupByID(const std::string& id);
+	std::shared_ptr<const Group> lookupGroupByName(const std::string& name);
+	std::shared_ptr<const Cluster> lookupClusterByID(const std::string& cID);
+	std::shared_ptr<const Cluster> lookupClusterByName(const std::string& name);
+	
+	///Fetch a record from the database, bypassing and then updating the caches.
+	///If the same record is already being fetched by another thread, wait for 
+	///and share that result rather than querying again.
+	User fetchUserByToken(const std::string& token);
+	Group fetchGroupByID(const std::string& id);
+	Group fetchGroupByName(const std::string& name);
+	Cluster fetchClusterByID(const std::string& cID);
+	Cluster fetchClusterByName(const std::string& name);
+	
+	///Query the database for a record, bypassing and then updating the caches
+	User queryUserByToken(const std::string& token);
+	Group queryGroupByID(const std::string& id);
+	Group queryGroupByName(const std::string& name);
+	Cluster queryClusterByID(const std::string& cID);
+	Cluster queryClusterByName(const std::string& name);
+	
+	///Check whether a lookup recently found no record
+	///\param key the identity of the lookup, formed from the table, index, 
+	///           and key
+	///\return whether the lookup should be considered to fail without 
+	///        querying the database
+	bool recentlyMissing(const std::string& key);
+	///Remember for a short time that a lookup found no record
+	///\param key the identity of the lookup
+	///\param generation the value of missingRecordGeneration when the lookup 
+	///                  began. If any record has been added since then, the 
+	///                  result of the lookup may be stale and is not recorded. 
+	void recordMissing(const std::string& key, unsigned long generation);
+	///Discard any record that a lookup found nothing, because a matching 
+	///record has been created
+	void forgetMissing(const std::string& key);
+	
+	///The type of the items returned by database reads
+	using DatabaseItem=Aws::Map<Aws::String,Aws::DynamoDB::Model::AttributeValue>;
+	
+	///Perform a full table scan, divided into scanSegments segments which are 
+	///read in parallel.
+	///\param request the scan to perform. Its segment settings will be replaced.
+	///\param description the kind of records being read, for error messages
+	///\param handleItem function to be called with each item read. Calls for 
+	///                  items from different segments may be made concurrently.
+	///\return whether all segments were read successfully
+	bool scanTable(const Aws::DynamoDB::Model::ScanRequest& request, 
+	               const std::string& description,
+	               const std::function<void(const DatabaseItem&)>& handleItem);
+	
+	///Read all records of each listable type into the caches, and mark the set
+	///of cached records as complete until the cache validity time passes.
+	///\return whether loading succeeded
+	bool loadUsers();
+	bool loadGroups();
+	bool loadClusters();
+	bool loadInstances();
+	///Secrets are not listed in full, so they are loaded only by warmCaches,
+	///filling the per-group caches
+	bool loadSecrets();
+	
+	///Perform a segmented scan, decoding each item and passing the result to
+	///a function which stores it. Calls to \p store may be concurrent.
+	///\param request the scan to perform
+	///\param description the kind of records being read, for log messages
+	///\param decode the function which converts an item to an entity
+	///\param store the function which records each entity
+	///\return whether the scan succeeded
+	template<typename EntityType>
+	bool scanEntities(const Aws::DynamoDB::Model::ScanRequest& request, 
+	                  const std::string& description,
+	                  EntityType (*decode)(const DatabaseItem&),
+	                  const std::function<void(const EntityType&)>& store);
+	
+	///Look up several records by ID, using cached copies where possible and 
+	///fetching the rest with batched reads
+	///\param tableName the table which holds the records
+	///\param description the kind of records being read, for log messages
+	///\param ids the IDs of the records to look up
+	///\param cache the cache of records by ID
+	///\param cacheName the name of the cache, for metrics
+	///\param decode the function which converts an item to an entity
+	///\param store the function which caches fetched entities
+	///\return the records which were found, indexed by ID
+	template<typename EntityType>
+	std::map<std::string,EntityType> batchGet(const std::string& tableName, 
+	                                          const std::string& description,
+	                                          const std::vector<std::string>& ids,
+	                                          cuckoohash_map<std::string,CacheRecord<EntityType>>& cache,
+	                                          const std::string& cacheName,
+	                                          EntityType (*decode)(const DatabaseItem&),
+	                                          void (PersistentStore::*store)(const EntityType&));
+	
+	///Insert records into all caches for their types: the main cache, and 
+	///every index by name, token, group, or cluster
+	void cacheUser(const User& user);
+	void cacheGroup(const Group& group);
+	void cacheCluster(const Cluster& cluster);
+	void cacheInstance(const ApplicationInstance& inst);
+	void cacheSecret(const Secret& secret);
+	
+	///Ensure that a listable type has been loaded at least once, so that its
+	///listing can be served from the cache. 
+	///\param loaded the flag which records whether the collection is loaded
+	///\param loadMutex the mutex which serializes loading the collection
+	///\param load the function which loads the collection
+	void ensureLoaded(std::atomic<bool>& loaded, std::mutex& loadMutex, 
+	                  bool (PersistentStore::*load)());
+	
+	///Body of the background thread which reloads listable collections 
+	///shortly before they expire, and periodically sweeps the caches
+	void refreshCollections();
+	///Remove expired records from all caches, evict records from any cache 
+	///which is over its budget, and update the recorded cache sizes. Records 
+	///of loaded listable collections are exempt from the budget, and a 
+	///listable collection which loses expired records is marked as not loaded. 
+	void sweepCaches();
+	
 	///For consumption by kubectl we store configs in the filesystem
 	///These files have implicit validity derived from the corresponding entries
 	///in clusterCache.
@@ -632,8 +988,21 @@ private:
 	///        could not be because it was neither a valid cluster ID nor name. 
 	bool normalizeClusterID(std::string& cID);
 	
-	///The encryption key used for secrets
+	///The encryption key used for secrets, as read from the key file. This is 
+	///used directly only to decrypt secrets stored in the legacy format.
 	SecretData secretKey;
+	///The key derived from secretKey which is used to encrypt the data keys of 
+	///individual secrets
+	SecretData masterKey;
+	
+	///Derive masterKey from secretKey
+	void deriveMasterKey();
+	///Replace the stored data of a secret which was encrypted in the legacy 
+	///format with a re-encryption of the same data
+	///\param secret the secret with its newly encrypted data
+	///\param oldData the previously stored data, which will only be replaced if 
+	///               it has not been changed in the meantime
+	void storeRewrappedSecret(const Secret& secret, const std::string& oldData);
 	
 	///The server to which application instances should send monitoring data
 	std::string appLoggingServerName;
@@ -641,10 +1010,44 @@ private:
 	unsigned int appLoggingServerPort;
 	
 	std::atomic<size_t> cacheHits, databaseQueries, databaseScans;
+	std::atomic<size_t> staleCacheHits, backgroundRefreshes, negativeCacheHits;
+	std::atomic<size_t> legacySecretDecryptions, secretsRewrapped;
+	
+	///The number of parallel segments into which full table scans are divided
+	const unsigned int scanSegments;
+	///Whether each listable collection has been completely read into the caches
+	std::atomic<bool> usersLoaded, groupsLoaded, clustersLoaded, instancesLoaded;
+	///Serialize loading of each listable collection, so that concurrent 
+	///requests wait for one scan rather than each performing their own
+	std::mutex userLoadMutex, groupLoadMutex, clusterLoadMutex, instanceLoadMutex;
+	///The maximum number of records kept in each cache, applied to each cache 
+	///separately, except that the records of loaded listable collections are 
+	///not evicted
+	const std::size_t cacheEntryLimit;
+	///The maximum approximate memory used by each cache, applied in the same 
+	///way as cacheEntryLimit
+	const std::size_t cacheByteLimit;
+	///Guards cacheUsage
+	mutable std::mutex cacheUsageMutex;
+	///The sizes of the caches, by name, as of the most recent sweep, with the 
+	///total numbers of records removed from each
+	std::map<std::string,CacheUsage> cacheUsage;
+	///Used to wake the refresh thread when the store is being destroyed
+	std::mutex refreshMutex;
+	std::condition_variable refreshCondition;
+	bool stopRefreshing;
+	///Background thread which reloads listable collections before they expire
+	std::thread refreshThread;
+	///Threads which refresh individual expired records. This is declared last
+	///so that it is destroyed, finishing all queued refreshes, before any of 
+	///the data those refreshes use.
+	WorkerPool refreshPool;
 };
 
 ///\param store the database in which to look up the user
 ///\param token the proffered authentication token. May be NULL if missing.
-const User authenticateUser(PersistentStore& store, const char* token);
+///\return the token owner, or an invalid user object. The object is shared 
+///        with the store's cache, and is never null.
+std::shared_ptr<const User> authenticateUser(PersistentStore& store, const char* token);
 
 #endif //SLATE_PERSISTENT_STORE_H
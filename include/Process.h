@@ -54,6 +54,11 @@ public:
 	///been called. 
 	void endInput();
 	
+	///Get the file descriptor from which this buffer reads, for use with 
+	///external polling mechanisms. Data read directly from this descriptor
+	///bypasses the buffer. 
+	int getReadFD() const{ return fd_out; }
+	
 private:
 	const static std::size_t bufferSize=4096;
 
@@ -119,6 +124,12 @@ public:
 	///Get the stream connected to the child process's stderr
 	///Not valid if the child was launched detachably
 	std::istream& getStderr(){ return(err); }
+	///Get the file descriptor connected to the child process's stdout
+	///Not valid if the child was launched detachably
+	int getStdoutFD() const{ return inoutBuf.getReadFD(); }
+	///Get the file descriptor connected to the child process's stderr
+	///Not valid if the child was launched detachably
+	int getStderrFD() const{ return errBuf.getReadFD(); }
 	///Close the stream to the child process's stdin
 	void endInput(){ inoutBuf.endInput(); }
 	///Give up responsibility for stopping the child process
@@ -147,12 +158,19 @@ private:
 	void setExitStatus(unsigned char status);
 	
 	///Allow the process reaper to call setExitStatus
-	friend void reapProcesses();
+	friend void recordChildExit(pid_t pid, unsigned char exitStatus);
 };
 
 ///Reap any child processes which have exited
 void reapProcesses();
-///Spawn a separate thread to periodically run reapProcesses()
+///Store the exit status of a child process and wake any threads waiting for it. 
+///This is done automatically for direct children by reapProcesses(), but must
+///be called for children started by a ProcessSpawner. 
+///\param pid the process which exited
+///\param exitStatus the process's exit status
+void recordChildExit(pid_t pid, unsigned char exitStatus);
+///Spawn a separate thread which runs reapProcesses() whenever a child exits, 
+///and which collects the output of children run via runCommand
 void startReaper();
 //Stop the background reaping thread
 void stopReaper();
@@ -181,6 +199,30 @@ ProcessHandle startProcessAsync(std::string exe,
                                 ForkCallbacks&& callbacks=ForkCallbacks{}, 
                                 bool detachable=false);
 
+///A mechanism for starting child processes on behalf of runCommand and 
+///runCommandWithInput more cheaply than by forking the current process
+struct ProcessSpawner{
+	virtual ~ProcessSpawner(){}
+	///Start a child process. 
+	///\param exe the full path to the executable to start
+	///\param args arguments to pass to \p exe, not including argv[0]
+	///\param env additions and changes to the child's environment
+	///\param stdinFD the file descriptor the child should use as its stdin
+	///\param stdoutFD the file descriptor the child should use as its stdout
+	///\param stderrFD the file descriptor the child should use as its stderr
+	///\return the child's pid, or -1 if it could not be started
+	virtual pid_t spawn(const std::string& exe, 
+	                    const std::vector<std::string>& args, 
+	                    const std::map<std::string,std::string>& env, 
+	                    int stdinFD, int stdoutFD, int stderrFD)=0;
+};
+
+///Set the mechanism which runCommand and runCommandWithInput will use to start
+///child processes. If the spawner fails to start a process, they will fall 
+///back to starting it directly. 
+///\param spawner the spawner to use, or nullptr to always start processes directly
+void setProcessSpawner(ProcessSpawner* spawner);
+
 struct commandResult{
 	std::string output;
 	std::string error;
@@ -0,0 +1,20 @@
+#ifndef SLATE_PROCESS_LAUNCHER_H
+#define SLATE_PROCESS_LAUNCHER_H
+
+#include <string>
+
+///Start a small helper process which forks and executes child processes on
+///behalf of runCommand and runCommandWithInput, communicating with this process
+///over a Unix socket, and install it as the process spawner.
+///This should be called as early as possible, before any other threads are
+///started and before large amounts of memory are allocated, so that the helper
+///is small and the cost of each fork it performs does not grow with the size
+///of this process.
+///\throws std::runtime_error if the helper cannot be started
+void startProcessLauncher();
+
+///\return a plain text report, by command name, of how long commands started
+///        by the helper spent waiting in its queue and being executed
+std::string getProcessLauncherStatistics();
+
+#endif //SLATE_PROCESS_LAUNCHER_H
@@ -6,8 +6,12 @@
 #include "rapidjson/writer.h"
 #include "rapidjson/stringbuffer.h"
 
+#include <algorithm>
+#include <memory>
+#include <set>
 #include <sstream>
 #include "Entities.h"
+#include "Tracing.h"
 #include "Utilities.h"
 
 ///\return a timestamp rendered as a string with format "YYYY-mmm-DD HH:MM:SS UTC"
@@ -81,12 +85,165 @@ std::string trim(const std::string& s);
 ///removed
 std::string reduceYAML(const std::string& input);
 
+namespace internal{
+///A rapidjson output stream which accumulates text in a std::string, so that 
+///the finished text can be moved into a response rather than copied
+class JSONStringStream{
+public:
+	typedef char Ch;
+	
+	///Reserves as much space as the last text taken from a stream on the 
+	///current thread, so that the string seldom needs to grow
+	JSONStringStream();
+	JSONStringStream(const JSONStringStream&)=delete;
+	JSONStringStream& operator=(const JSONStringStream&)=delete;
+	
+	void Put(char c){
+		Reserve(1);
+		*next++=c;
+	}
+	///Append a character for which space has already been reserved
+	void PutUnsafe(char c){ *next++=c; }
+	void Flush(){}
+	///Ensure that at least count more characters can be added without 
+	///reallocating
+	void Reserve(std::size_t count){
+		if(std::size_t(end-next)<count)
+			grow(count);
+	}
+	///\return the number of characters which have been written
+	std::size_t size() const{ return next-begin; }
+	///\return the accumulated text, leaving the stream empty
+	std::string take();
+	
+private:
+	///The text is written into the string's storage, beyond whose end the 
+	///string is extended with unused space
+	std::string text;
+	char* begin;
+	char* next;
+	char* end;
+	
+	///Extend the string by at least count characters
+	void grow(std::size_t count);
+	///Point to the string's storage after it has been resized
+	void setStorage(std::size_t used);
+};
+
+//Used by rapidjson::Writer in place of its generic versions, which do not 
+//reserve space in advance
+inline void PutReserve(JSONStringStream& stream, std::size_t count){ stream.Reserve(count); }
+inline void PutUnsafe(JSONStringStream& stream, char c){ stream.PutUnsafe(c); }
+
+///Holds the stream for a JSONStreamWriter, so that it is constructed before 
+///the writer which uses it
+struct JSONOutput{
+	JSONStringStream stream;
+};
+}
+
+///Writes JSON text directly, so that large responses can be serialized 
+///straight from entities, without first building a document. 
+///Text is accumulated in a string which can be moved into the response body 
+///once it is complete, so that the text is never copied. 
+class JSONStreamWriter : private internal::JSONOutput, 
+                         public rapidjson::Writer<internal::JSONStringStream>{
+public:
+	JSONStreamWriter():Writer(stream){}
+	
+	///\return the text which has been written, which is moved out of the 
+	///        writer, so this should be called only once the text is complete
+	std::string take(){ return stream.take(); }
+	///\return the number of bytes which have been written
+	std::size_t size() const{ return stream.size(); }
+};
+
+///Interpret a query parameter which acts as a flag. The flag is set if the 
+///parameter is present with no value, or with the value 'true', 'yes', or '1', 
+///and is clear if it is absent or has the value 'false', 'no', or '0'. 
+///\param req the request
+///\param name the name of the parameter
+///\throws std::runtime_error if the parameter has any other value
+bool getFlagParameter(const crow::request& req, const char* name);
+
+///The portion of a collection, and the fields of its items, requested from a 
+///listing endpoint
+struct ListingOptions{
+	ListingOptions():limit(0){}
+	
+	///The largest number of items to return, or zero for no limit
+	std::size_t limit;
+	///The cursor returned with the previous page, or empty to start from the
+	///beginning
+	std::string cursor;
+	///The metadata fields to include in each item, or empty to include all
+	std::set<std::string> fields;
+	
+	///\return whether the listing should be divided into pages
+	bool paged() const{ return limit || !cursor.empty(); }
+	///\return whether a metadata field should be included
+	bool includes(const char* field) const{ return fields.empty() || fields.count(field); }
+};
+
+///Interpret the 'limit', 'cursor', and 'fields' query parameters of a listing
+///request. 'fields' is a comma separated list of metadata field names.
+///\param req the request
+///\param knownFields the metadata fields which the endpoint can return
+///\throws std::runtime_error if the limit is not a positive integer, or a 
+///        requested field is not one of knownFields
+ListingOptions parseListingOptions(const crow::request& req, const std::set<std::string>& knownFields);
+
+///Reduce a collection to the page of it which was requested. 
+///Pages are taken in order of ID, so that they remain consistent with each 
+///other while items are added or removed, and the cursor is the ID of the 
+///last item on the page. Only the items on the page are fully sorted.
+///\param items the collection, which is replaced by the requested page
+///\param options the requested page
+///\return the cursor for the following page, or an empty string if this is 
+///        the last page
+template<typename Entity>
+std::string selectPage(std::vector<Entity>& items, const ListingOptions& options){
+	if(!options.paged())
+		return "";
+	if(!options.cursor.empty()){
+		items.erase(std::remove_if(items.begin(),items.end(),
+		                           [&options](const Entity& item){ return item.id<=options.cursor; }),
+		            items.end());
+	}
+	auto byID=[](const Entity& item1, const Entity& item2){ return item1.id<item2.id; };
+	if(!options.limit || items.size()<=options.limit){
+		std::sort(items.begin(),items.end(),byID);
+		return "";
+	}
+	std::partial_sort(items.begin(),items.begin()+options.limit,items.end(),byID);
+	items.resize(options.limit);
+	return items.back().id;
+}
+
+///Write a string member of an item's metadata, if it was requested
+inline void writeField(JSONStreamWriter& writer, const ListingOptions& options, 
+                       const char* name, const std::string& value){
+	if(!options.includes(name))
+		return;
+	writer.Key(name);
+	writer.String(value);
+}
+
+///Write the cursor for the following page, if there is one, as the 
+///'nextCursor' member of a listing
+inline void writeNextCursor(JSONStreamWriter& writer, const std::string& nextCursor){
+	if(nextCursor.empty())
+		return;
+	writer.Key("nextCursor");
+	writer.String(nextCursor);
+}
+
 template<typename JSONDocument>
 std::string to_string(const JSONDocument& json){
-	rapidjson::StringBuffer buf;
-	rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+	tracing::Span span("json");
+	JSONStreamWriter writer;
 	json.Accept(writer);
-	return buf.GetString();
+	return writer.take();
 }
 
 
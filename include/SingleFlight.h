@@ -0,0 +1,89 @@
+#ifndef SLATE_SINGLE_FLIGHT_H
+#define SLATE_SINGLE_FLIGHT_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "Tracing.h"
+
+///Coalesces concurrent requests for the same data, so that when several
+///threads need a value which is not available, only one of them fetches it
+///while the others wait and share its result.
+template<typename ResultType>
+class SingleFlight{
+public:
+	SingleFlight():started(0),shared(0){}
+	SingleFlight(const SingleFlight&)=delete;
+	SingleFlight& operator=(const SingleFlight&)=delete;
+
+	///Obtain a value, either by calling \p fetch, or, if another thread is
+	///already fetching the value with the same key, by waiting for it to finish.
+	///\param key the identity of the value being fetched
+	///\param fetch the function which obtains the value
+	///\return the result of the fetch
+	///\throws any exception thrown by the fetch, in all threads which waited
+	///        for it
+	ResultType run(const std::string& key, const std::function<ResultType()>& fetch){
+		std::unique_lock<std::mutex> lock(mut);
+		auto it=calls.find(key);
+		if(it!=calls.end()){
+			//some other thread is already fetching this value
+			std::shared_ptr<Call> call=it->second;
+			shared++;
+			tracing::Span span("wait","shared fetch");
+			call->finishedCondition.wait(lock,[&call]{ return call->finished; });
+			if(call->error)
+				std::rethrow_exception(call->error);
+			return call->result;
+		}
+		std::shared_ptr<Call> call=std::make_shared<Call>();
+		calls.emplace(key,call);
+		started++;
+		lock.unlock();
+
+		try{
+			call->result=fetch();
+		}catch(...){
+			call->error=std::current_exception();
+		}
+
+		lock.lock();
+		call->finished=true;
+		calls.erase(key);
+		lock.unlock();
+		call->finishedCondition.notify_all();
+		if(call->error)
+			std::rethrow_exception(call->error);
+		return call->result;
+	}
+
+	///\return the number of fetches which have been performed
+	std::size_t fetchesStarted() const{ return started.load(); }
+	///\return the number of times a thread used the result of another
+	///        thread's fetch rather than performing its own
+	std::size_t fetchesShared() const{ return shared.load(); }
+
+private:
+	///The state of one fetch in progress
+	struct Call{
+		Call():finished(false){}
+		bool finished;
+		ResultType result;
+		std::exception_ptr error;
+		std::condition_variable finishedCondition;
+	};
+
+	///Protects calls and all Call objects' finished flags
+	std::mutex mut;
+	///The fetches currently in progress
+	std::map<std::string,std::shared_ptr<Call>> calls;
+	std::atomic<std::size_t> started, shared;
+};
+
+#endif //SLATE_SINGLE_FLIGHT_H
@@ -0,0 +1,135 @@
+#ifndef SLATE_TRACING_H
+#define SLATE_TRACING_H
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+///Records where the time spent handling each request goes.
+///Each thread may have a current trace, to which the spans created on that
+///thread are added, nested within whichever span was current when they began.
+///When a thread has no current trace, creating a span does nothing.
+namespace tracing{
+
+using clock=std::chrono::steady_clock;
+
+///The operations performed while handling one request
+class Trace{
+public:
+	///The index used for the absence of a span
+	static const std::size_t noSpan=-1;
+	///The largest number of spans which are kept individually. Further spans
+	///are still included in the totals for their categories.
+	static const std::size_t maxSpans=1024;
+
+	///\param description a summary of the request, such as its method and URL
+	explicit Trace(std::string description);
+	Trace(const Trace&)=delete;
+	Trace& operator=(const Trace&)=delete;
+
+	///Record the start of a span
+	///\param category the kind of operation, which must be a valid HTTP token
+	///\param detail a more specific description of the operation
+	///\param parent the span within which this span occurs
+	///\param start when the span began
+	///\return the index of the new span, or noSpan if too many spans have
+	///        been recorded to keep this one
+	std::size_t begin(const char* category, std::string detail, std::size_t parent,
+	                  clock::time_point start);
+	///Record the end of a span
+	///\param span the index returned by begin
+	///\param category the span's category
+	///\param start when the span began
+	///\param end when the span ended
+	void end(std::size_t span, const char* category, clock::time_point start,
+	         clock::time_point end);
+	///Record a span which has already ended
+	void add(const char* category, std::string detail, std::size_t parent,
+	         clock::time_point start, clock::time_point end){
+		this->end(begin(category,std::move(detail),parent,start),category,start,end);
+	}
+
+	///\return the time since the trace began
+	clock::duration elapsed() const{ return clock::now()-start; }
+	const std::string& description() const{ return desc; }
+
+	///\param total the duration of the whole request
+	///\return the value of a Server-Timing header summarizing the total time
+	///        spent in each category of span
+	std::string serverTiming(clock::duration total) const;
+	///\param total the duration of the whole request
+	///\return a plain text rendering of all spans, indented by nesting
+	std::string format(clock::duration total) const;
+
+private:
+	struct SpanRecord{
+		const char* category;
+		std::string detail;
+		std::size_t parent;
+		clock::time_point start;
+		clock::time_point end;
+		bool finished;
+	};
+	struct CategoryTotal{
+		std::size_t count;
+		clock::duration time;
+	};
+
+	const std::string desc;
+	const clock::time_point start;
+	///Guards all following members, since a request may use several threads
+	mutable std::mutex mutex;
+	std::vector<SpanRecord> spans;
+	std::size_t droppedSpans;
+	///Totals for each category, in the order in which they first appeared
+	std::vector<std::pair<std::string,CategoryTotal>> totals;
+};
+
+///\return the current thread's trace, which may be null
+std::shared_ptr<Trace> currentTrace();
+///\return the current thread's innermost open span
+std::size_t currentSpan();
+///Set the current thread's trace, with no span open
+void setCurrentTrace(std::shared_ptr<Trace> trace);
+
+///Makes a trace current on this thread while it exists, for continuing the
+///trace of a request on another thread.
+class Scope{
+public:
+	///\param trace the trace to make current
+	///\param parent the span within which spans on this thread should nest
+	Scope(std::shared_ptr<Trace> trace, std::size_t parent);
+	~Scope();
+	Scope(const Scope&)=delete;
+	Scope& operator=(const Scope&)=delete;
+private:
+	std::shared_ptr<Trace> previousTrace;
+	std::size_t previousSpan;
+};
+
+///Records the time from its construction to its destruction in the current
+///thread's trace, if there is one
+class Span{
+public:
+	///\param category the kind of operation, such as db or kubectl; must be a
+	///                string literal
+	///\param detail a more specific description of the operation
+	explicit Span(const char* category, std::string detail=std::string());
+	~Span();
+	Span(const Span&)=delete;
+	Span& operator=(const Span&)=delete;
+private:
+	std::shared_ptr<Trace> trace;
+	const char* category;
+	std::size_t index;
+	std::size_t parent;
+	clock::time_point start;
+};
+
+}
+
+#endif //SLATE_TRACING_H
@@ -0,0 +1,57 @@
+#ifndef SLATE_WORKER_POOL_H
+#define SLATE_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+///A fixed set of threads which run submitted tasks.
+///Each thread has its own queue of tasks; tasks submitted by a worker thread
+///go to its own queue, while others are distributed among the queues in turn.
+///Threads take work from the backs of their own queues, and when those are
+///empty take work from the fronts of the others' queues.
+class WorkerPool{
+public:
+	///\param threads the number of worker threads to start; at least one will
+	///               always be started
+	explicit WorkerPool(std::size_t threads);
+	///Runs all tasks already submitted, then stops the worker threads
+	~WorkerPool();
+	WorkerPool(const WorkerPool&)=delete;
+	WorkerPool& operator=(const WorkerPool&)=delete;
+
+	///Queue a task to be run by one of the worker threads
+	void submit(std::function<void()> task);
+
+	///\return the number of worker threads
+	std::size_t size() const{ return threads.size(); }
+
+private:
+	struct TaskQueue{
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+	std::vector<std::thread> threads;
+	///The queue to which the next task from outside the pool will be added
+	std::atomic<std::size_t> nextQueue;
+	///The number of tasks waiting in all queues
+	std::atomic<std::size_t> pending;
+	std::atomic<bool> stopping;
+	///Used by idle workers to wait for new tasks
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+
+	void work(std::size_t index);
+	///Find a task for the given worker, preferring its own queue
+	///\return whether a task was found
+	bool takeTask(std::size_t index, std::function<void()>& task);
+};
+
+#endif //SLATE_WORKER_POOL_H
@@ -13,7 +13,8 @@
 ///in the underlying cuckoohash_map can proceed concurrently, however, operations
 ///involving different values with the same key are guaranteed to map to the same
 ///bucket and thus will block each other waiting for its lock. 
-///Does not currently have allocation or iteration support.
+///Does not currently have allocation support; iteration is possible only by 
+///locking the entire table.
 template<typename Key, typename Value, 
          typename KeyHash=std::hash<Key>, typename KeyEqual=std::equal_to<Key>, 
          typename ValueHash=std::hash<Value>, typename ValueEqual=std::equal_to<Value>>
@@ -30,6 +31,7 @@ public:
 	using mapped_type=Value;
 	using value_type=std::pair<const Key,category_type>;
 	using size_type=typename Table::size_type;
+	using locked_table=typename Table::locked_table;
 
 	concurrent_multimap(){}
 	///If other is being modified concurrently, behavior is unspecified.
@@ -255,6 +257,15 @@ public:
 		return found;
 	}
 
+	///Lock the entire table, blocking all other operations on it, to allow 
+	///iterating over and modifying the categories it contains. 
+	///\return an object which provides access to the table and releases the 
+	///        locks when destroyed or explicitly unlocked
+	locked_table lock_table(){ return data.lock_table(); }
+	
+	///\return the number of keys in the table
+	size_type size() const{ return data.size(); }
+
 private:
 	Table data;
 };
@@ -355,8 +355,10 @@ namespace crow
             
             if (!adaptor_.is_open())
             {
-                //CROW_LOG_DEBUG << this << " delete (socket is closed) " << is_reading << ' ' << is_writing;
-                //delete this;
+                // the read handler leaves destruction to this point when the 
+                // connection closed while a response was still pending
+                CROW_LOG_DEBUG << this << " from complete_request (socket is closed)";
+                check_destroy();
                 return;
             }
 
@@ -484,15 +486,21 @@ namespace crow
                         adaptor_.close();
                         is_reading = false;
                         CROW_LOG_DEBUG << this << " from read(1)";
-                        check_destroy();
+                        // a handler which completes its response later still 
+                        // holds a reference to it, so the connection must 
+                        // live until complete_request
+                        if (!need_to_call_after_handlers_)
+                            check_destroy();
                     }
                     else if (close_connection_)
                     {
                         cancel_deadline_timer();
                         parser_.done();
                         is_reading = false;
-                        check_destroy();
-                        // adaptor will close after write
+                        // adaptor will close after write, which is started by 
+                        // complete_request if the response is still pending
+                        if (!need_to_call_after_handlers_)
+                            check_destroy();
                     }
                     else if (!need_to_call_after_handlers_)
                     {
@@ -10,10 +10,12 @@ namespace crow
 {
     template <typename Adaptor, typename Handler, typename ... Middlewares>
     class Connection;
+    class Router;
     struct response
     {
         template <typename Adaptor, typename Handler, typename ... Middlewares>
         friend class crow::Connection;
+        friend class crow::Router;
 
         int code{200};
         std::string body;
@@ -79,6 +81,7 @@ namespace crow
 
         void clear()
         {
+            matched_route_.clear();
             body.clear();
             json_value.clear();
             code = 200;
@@ -121,8 +124,17 @@ namespace crow
             return is_alive_helper_ && is_alive_helper_();
         }
 
+        // The pattern of the rule which handled the request, or an empty string
+        // if no rule matched. Like the completion handler, this belongs to the
+        // connection, so it is kept when a handler assigns a new response.
+        const std::string& matched_route() const
+        {
+            return matched_route_;
+        }
+
         private:
             bool completed_{};
+            std::string matched_route_;
             std::function<void()> complete_request_handler_;
             std::function<bool()> is_alive_helper_;
 
@@ -1065,6 +1065,8 @@ public:
 
             CROW_LOG_DEBUG << "Matched rule '" << rules[rule_index]->rule_ << "' " << (uint32_t)req.method << " / " << rules[rule_index]->get_methods();
 
+            res.matched_route_ = rules[rule_index]->rule_;
+
             // any uncaught exceptions become 500s
             try
             {
@@ -11,6 +11,7 @@
 #include "yaml-cpp/node/detail/impl.h"
 #include <yaml-cpp/node/parse.h>
 
+#include "ClusterCommands.h"
 #include "KubeInterface.h"
 #include "Logging.h"
 #include "Archive.h"
@@ -58,7 +59,8 @@ std::string filterValuesFile(std::string data){
 crow::response listApplications(PersistentStore& store, const crow::request& req){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	if(!user) //non-users _are_ allowed to list applications
 		log_info("Anonymous user requested to list applications from " << req.remote_endpoint);
 	else
@@ -103,7 +105,8 @@ crow::response listApplications(PersistentStore& store, const crow::request& req
 }
 
 crow::response fetchApplicationConfig(PersistentStore& store, const crow::request& req, const std::string& appName){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	if(!user) //non-users _are_ allowed to obtain configurations for all applications
 		log_info("Anonymous user requested to fetch configuration for application " << appName << " from " << req.remote_endpoint);
 	else
@@ -149,7 +152,8 @@ crow::response fetchApplicationConfig(PersistentStore& store, const crow::reques
 }
 
 crow::response fetchApplicationDocumentation(PersistentStore& store, const crow::request& req, const std::string& appName){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	if(!user) //non-users _are_ allowed to get documentation
 		log_info("Anonymous user requested to fetch documentation for application " << appName << " from " << req.remote_endpoint);
 	else
@@ -286,10 +290,12 @@ crow::response installApplicationImpl(PersistentStore& store, const User& user,
 		return crow::response(400,generateError("Instance tags names may not end with a dash"));
 	
 	//validate input
-	const Group group=store.getGroup(groupID);
+	const auto groupRecord=store.getGroup(groupID);
+	const Group& group=*groupRecord;
 	if(!group)
 		return crow::response(400,generateError("Invalid Group"));
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(400,generateError("Invalid Cluster"));
 	//A user must belong to a Group to install applications on its behalf
@@ -305,6 +311,8 @@ crow::response installApplicationImpl(PersistentStore& store, const User& user,
 		if(!store.groupMayUseApplication(group.id, cluster.id, appName))
 			return crow::response(403,generateError("Not authorized"));
 	}
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
 
 	ApplicationInstance instance;
 	instance.valid=true;
@@ -376,13 +384,10 @@ crow::response installApplicationImpl(PersistentStore& store, const User& user,
 	   "--values",instanceConfig.path(),
 	   "--set",additionalValues,
 	   };
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
-	if(helmMajorVersion==2){
+	const auto helmCapabilities=kubernetes::getHelmCapabilities();
+	if(helmCapabilities->installRequiresNameFlag)
 		installArgs.insert(installArgs.begin()+1,"--name");
-		installArgs.push_back("--tiller-namespace");
-		installArgs.push_back(cluster.systemNamespace);
-	}
-	auto commandResult=runCommand("helm",installArgs,{{"KUBECONFIG",*clusterConfig}});
+	auto commandResult=kubernetes::helm(*clusterConfig,cluster.systemNamespace,installArgs);
 	
 	//if application instantiation fails, remove record from DB again
 	if(commandResult.status || 
@@ -393,12 +398,9 @@ crow::response installApplicationImpl(PersistentStore& store, const User& user,
 		store.removeApplicationInstance(instance.id);
 		//helm will (unhelpfully) keep broken 'releases' around, so clean up here
 		std::vector<std::string> deleteArgs={"delete",instance.name};
-		if(helmMajorVersion==2){
+		if(helmCapabilities->deleteRequiresPurge)
 			deleteArgs.insert(deleteArgs.begin()+1,"--purge");
-			deleteArgs.push_back("--tiller-namespace");
-			deleteArgs.push_back(cluster.systemNamespace);
-		}
-		runCommand("helm",deleteArgs,{{"KUBECONFIG",*clusterConfig}});
+		kubernetes::helm(*clusterConfig,cluster.systemNamespace,deleteArgs);
 		//TODO: include any other error information?
 		return crow::response(500,generateError(errMsg));
 	}
@@ -408,12 +410,11 @@ crow::response installApplicationImpl(PersistentStore& store, const User& user,
 
 	//TODO: figure out what this was for and whether it can be salvaged
 	/*std::vector<std::string> listArgs={"list",instance.name};
-	if(helmMajorVersion==2)
-		listArgs.push_back("--tiller-namespace");
-	else if(helmMajorVersion==3)
+	if(!helmCapabilities->usesTiller){
 		listArgs.push_back("--namespace");
-	listArgs.push_back(cluster.systemNamespace);
-	auto listResult = runCommand("helm",listArgs,{{"KUBECONFIG",*clusterConfig}});
+		listArgs.push_back(cluster.systemNamespace);
+	}
+	auto listResult = kubernetes::helm(*clusterConfig,cluster.systemNamespace,listArgs);
 	if(listResult.status){
 		log_error("helm list " << instance.name << " failed: [exit] " << listResult.status << " [err] " << listResult.error << " [out] " << listResult.output);
 		return crow::response(500,generateError("Failed to query helm for instance information"));
@@ -463,7 +464,8 @@ crow::response installApplication(PersistentStore& store, const crow::request& r
 	if(!application)
 		return crow::response(404,generateError("Application not found"));
 	
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to install an instance of " << application << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -502,7 +504,8 @@ std::pair<bool,std::string> extractChartName(const std::string& path){
 }
 
 crow::response installAdHocApplication(PersistentStore& store, const crow::request& req){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to install an instance of an ad-hoc application from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -572,7 +575,8 @@ crow::response installAdHocApplication(PersistentStore& store, const crow::reque
 }
 
 crow::response updateCatalog(PersistentStore& store, const crow::request& req){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to update the application catalog from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -588,3 +592,37 @@ crow::response updateCatalog(PersistentStore& store, const crow::request& req){
 	
 	return crow::response(200);
 }
+
+crow::response updateHelmCapabilities(PersistentStore& store, const crow::request& req){
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
+	log_info(user << " requested to refresh helm capabilities from " << req.remote_endpoint);
+	//only admins may trigger this, as it affects all helm operations
+	if(!user || !user.admin)
+		return crow::response(403,generateError("Not authorized"));
+	
+	std::shared_ptr<const kubernetes::HelmCapabilities> capabilities;
+	try{
+		capabilities=kubernetes::refreshHelmCapabilities();
+	}
+	catch(std::runtime_error& err){
+		log_error("Failed to probe helm capabilities: " << err.what());
+		return crow::response(500,generateError("Failed to probe helm capabilities"));
+	}
+	
+	rapidjson::Document result(rapidjson::kObjectType);
+	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+	
+	result.AddMember("apiVersion", "v1alpha3", alloc);
+	result.AddMember("kind", "HelmCapabilities", alloc);
+	rapidjson::Value metadata(rapidjson::kObjectType);
+	metadata.AddMember("majorVersion", capabilities->majorVersion, alloc);
+	metadata.AddMember("usesTiller", capabilities->usesTiller, alloc);
+	rapidjson::Value repositories(rapidjson::kArrayType);
+	for(const auto& repository : capabilities->repositories)
+		repositories.PushBack(rapidjson::Value(repository, alloc), alloc);
+	metadata.AddMember("repositories", repositories, alloc);
+	result.AddMember("metadata", metadata, alloc);
+	
+	return crow::response(to_string(result));
+}
@@ -11,21 +11,32 @@
 #include "yaml-cpp/node/detail/impl.h"
 #include <yaml-cpp/node/parse.h>
 
+#include "KubeInformer.h"
 #include "KubeInterface.h"
 #include "Logging.h"
 #include "ServerUtilities.h"
+#include "Utilities.h"
 #include "ApplicationCommands.h"
+#include "ClusterCommands.h"
 
 #include <chrono>
 
 crow::response listApplicationInstances(PersistentStore& store, const crow::request& req){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list application instances from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	//All users are allowed to list application instances
+	
+	ListingOptions options;
+	try{
+		options=parseListingOptions(req,{"id","name","application","group","cluster","created"});
+	}catch(std::runtime_error& err){
+		return crow::response(400,generateError(err.what()));
+	}
 
 	std::vector<ApplicationInstance> instances;
 
@@ -44,36 +55,72 @@ crow::response listApplicationInstances(PersistentStore& store, const crow::requ
 		instances=store.listApplicationInstancesByClusterOrGroup(groupFilter, clusterFilter);
 	} else
 		instances=store.listApplicationInstances();
+	const std::string nextCursor=selectPage(instances,options);
 	
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
-	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	rapidjson::Value resultItems(rapidjson::kArrayType);
-	resultItems.Reserve(instances.size(), alloc);
+	//look up all of the groups and clusters involved together, rather than 
+	//one at a time for each instance
+	std::vector<std::string> groupIDs, clusterIDs;
 	for(const ApplicationInstance& instance : instances){
-		rapidjson::Value instanceResult(rapidjson::kObjectType);
-		instanceResult.AddMember("apiVersion", "v1alpha3", alloc);
-		instanceResult.AddMember("kind", "ApplicationInstance", alloc);
-		rapidjson::Value instanceData(rapidjson::kObjectType);
-		instanceData.AddMember("id", instance.id, alloc);
-		instanceData.AddMember("name", instance.name, alloc);
-		std::string application=instance.application;
-		if(application.find('/')!=std::string::npos && application.find('/')<application.size()-1)
-			application=application.substr(application.find('/')+1);
-		instanceData.AddMember("application", application, alloc);
-		instanceData.AddMember("group", store.getGroup(instance.owningGroup).name, alloc);
-		instanceData.AddMember("cluster", store.getCluster(instance.cluster).name, alloc);
-		instanceData.AddMember("created", instance.ctime, alloc);
-		instanceResult.AddMember("metadata", instanceData, alloc);
-		resultItems.PushBack(instanceResult, alloc);
-		//TODO: query helm to get current status (helm list {instance.name})?
+		if(options.includes("group"))
+			groupIDs.push_back(instance.owningGroup);
+		if(options.includes("cluster"))
+			clusterIDs.push_back(instance.cluster);
 	}
-	result.AddMember("items", resultItems, alloc);
+	std::map<std::string,Group> groups=store.getGroups(groupIDs);
+	std::map<std::string,Cluster> clusters=store.getClusters(clusterIDs);
+	
+	JSONStreamWriter writer;
+	internal::writeApplicationInstanceListing(writer,instances,groups,clusters,options,nextCursor);
 
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
 	log_info("instance listing completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
-	return crow::response(to_string(result));
+	return crow::response(writer.take());
+}
+
+namespace internal{
+void writeApplicationInstanceListing(JSONStreamWriter& writer, 
+                                     const std::vector<ApplicationInstance>& instances,
+                                     const std::map<std::string,Group>& groups,
+                                     const std::map<std::string,Cluster>& clusters,
+                                     const ListingOptions& options,
+                                     const std::string& nextCursor){
+	tracing::Span span("json");
+	static const Group noGroup;
+	static const Cluster noCluster;
+	writer.StartObject();
+	writer.Key("apiVersion");
+	writer.String("v1alpha3");
+	writer.Key("items");
+	writer.StartArray();
+	for(const ApplicationInstance& instance : instances){
+		writer.StartObject();
+		writer.Key("apiVersion");
+		writer.String("v1alpha3");
+		writer.Key("kind");
+		writer.String("ApplicationInstance");
+		writer.Key("metadata");
+		writer.StartObject();
+		writeField(writer,options,"id",instance.id);
+		writeField(writer,options,"name",instance.name);
+		if(options.includes("application")){
+			writer.Key("application");
+			auto slash=instance.application.find('/');
+			if(slash!=std::string::npos && slash<instance.application.size()-1)
+				writer.String(instance.application.data()+slash+1,instance.application.size()-slash-1);
+			else
+				writer.String(instance.application);
+		}
+		writeField(writer,options,"group",findOrDefault(groups,instance.owningGroup,noGroup).name);
+		writeField(writer,options,"cluster",findOrDefault(clusters,instance.cluster,noCluster).name);
+		writeField(writer,options,"created",instance.ctime);
+		writer.EndObject();
+		writer.EndObject();
+		//TODO: query helm to get current status (helm list {instance.name})?
+	}
+	writer.EndArray();
+	writeNextCursor(writer,nextCursor);
+	writer.EndObject();
+}
 }
 
 struct ServiceInterface{
@@ -89,24 +136,25 @@ struct ServiceInterface{
 
 ///query helm and kubernetes to find out what services a given instance contains 
 ///and how to contact them
-std::multimap<std::string,ServiceInterface> getServices(const SharedFileHandle& configPath, 
+std::multimap<std::string,ServiceInterface> getServices(const std::string& clusterID,
+                                                   const SharedFileHandle& configPath, 
                                                    const std::string& releaseName, 
                                                    const std::string& nspace,
                                                    const std::string& systemNamespace){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
-	auto servicesResult=kubernetes::kubectl(*configPath,{"get","services","-l","release="+releaseName,"--namespace",nspace,"-o=json"});
+	auto servicesResult=kubernetes::listObjects(clusterID,configPath,kubernetes::ResourceKind::Services,nspace,"release="+releaseName);
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
-	log_info("kubectl get services completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
+	log_info("Listing services completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 	if(servicesResult.status){
-		log_error("kubectl get services failed for instance " << releaseName << ": " << servicesResult.error);
+		log_error("Listing services failed for instance " << releaseName << ": " << servicesResult.error);
 		return {};
 	}
 	rapidjson::Document servicesData;
 	try{
 		servicesData.Parse(servicesResult.output.c_str());
 	}catch(std::runtime_error& err){
-		log_error("Unable to parse kubectl get services JSON output for " << nspace << "::" << releaseName << ": " << err.what());
+		log_error("Unable to parse services JSON for " << nspace << "::" << releaseName << ": " << err.what());
 		return {};
 	}
 
@@ -142,11 +190,11 @@ std::multimap<std::string,ServiceInterface> getServices(const SharedFileHandle&
 			}
 			//now try to locate the pod in question
 			t1 = high_resolution_clock::now();
-			auto podResult=kubernetes::kubectl(*configPath,{"get","pod","-l",filter,"--namespace",nspace,"-o=json"});
+			auto podResult=kubernetes::listObjects(clusterID,configPath,kubernetes::ResourceKind::Pods,nspace,filter);
 			t2 = high_resolution_clock::now();
-			log_info("kubectl get pod completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
+			log_info("Listing pods completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 			if(podResult.status){
-				log_error("kubectl get pod -l " << filter << " --namespace " 
+				log_error("Listing pods with labels " << filter << " in namespace " 
 				          << nspace << " failed: " << podResult.error);
 				continue;
 			}
@@ -154,8 +202,8 @@ std::multimap<std::string,ServiceInterface> getServices(const SharedFileHandle&
 			try{
 				podData.Parse(podResult.output.c_str());
 			}catch(std::runtime_error& err){
-				log_error("Unable to parse kubectl get service JSON output for kubectl get pod -l " 
-				          << filter << " --namespace " << nspace << ": " << err.what());
+				log_error("Unable to parse pods JSON for pods with labels " 
+				          << filter << " in namespace " << nspace << ": " << err.what());
 				continue;
 			}
 			if(podData["items"].GetArray().Size()==0){
@@ -203,18 +251,18 @@ std::multimap<std::string,ServiceInterface> getServices(const SharedFileHandle&
 	}
 	
 	t1 = high_resolution_clock::now();
-	auto ingressesResult=kubernetes::kubectl(*configPath,{"get","ingresses","-l","release="+releaseName,"--namespace",nspace,"-o=json"});
+	auto ingressesResult=kubernetes::listObjects(clusterID,configPath,kubernetes::ResourceKind::Ingresses,nspace,"release="+releaseName);
 	t2 = high_resolution_clock::now();
-	log_info("kubectl get ingresses completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
+	log_info("Listing ingresses completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 	if(ingressesResult.status){
-		log_error("kubectl get ingresses failed for instance " << releaseName << ": " << servicesResult.error);
+		log_error("Listing ingresses failed for instance " << releaseName << ": " << ingressesResult.error);
 		return {};
 	}
 	rapidjson::Document ingressesData;
 	try{
 		ingressesData.Parse(ingressesResult.output.c_str());
 	}catch(std::runtime_error& err){
-		log_error("Unable to parse kubectl get ingresses JSON output for " << nspace << "::" << releaseName << ": " << err.what());
+		log_error("Unable to parse ingresses JSON for " << nspace << "::" << releaseName << ": " << err.what());
 		return {};
 	}
 	for(const auto& ingressData : ingressesData["items"].GetArray()){
@@ -262,7 +310,8 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 	rapidjson::Value instanceDetails(rapidjson::kObjectType);
 	rapidjson::Value podDetails(rapidjson::kArrayType);
 	
-	const Group group=store.getGroup(instance.owningGroup);
+	const auto groupRecord=store.getGroup(instance.owningGroup);
+	const Group& group=*groupRecord;
 	const std::string nspace=group.namespaceName();
 	auto configPath=store.configPathForCluster(instance.cluster);
 	
@@ -271,9 +320,9 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 	
 	//find out what pods make up this instance
 	t1 = high_resolution_clock::now();
-	auto result=kubernetes::kubectl(*configPath,{"get","pods","-l","release="+instance.name,"-n",nspace,"-o=json"});
+	auto result=kubernetes::listObjects(instance.cluster,configPath,kubernetes::ResourceKind::Pods,nspace,"release="+instance.name);
 	t2 = high_resolution_clock::now();
-	log_info("kubectl get pods completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
+	log_info("Listing pods completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 	if(result.status){
 		log_error("Failed to get pod information for " << instance);
 		rapidjson::Value podInfo(rapidjson::kObjectType);
@@ -290,7 +339,7 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 		podData.Parse(result.output.c_str());
 	}
 	catch(std::runtime_error& err){
-		log_error("Unable to parse kubectl output for " << instance << " pods");
+		log_error("Unable to parse pods JSON for " << instance);
 		throw std::runtime_error("Could not find pods for instance");
 	}
 	std::size_t podIndex=0;
@@ -341,11 +390,11 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 		//Also try to fetch events associated with the pod
 		auto getPodEvents=[&nspace,&configPath](std::size_t podIndex, const std::string podName)->std::pair<std::size_t,std::string>{
 			high_resolution_clock::time_point t1 = high_resolution_clock::now();
-			auto result=kubernetes::kubectl(*configPath,{"get","event","--field-selector","involvedObject.name="+podName,"-n",nspace,"-o=json"});
+			auto result=kubernetes::apiGet(*configPath,"/api/v1/namespaces/"+nspace+"/events",{{"fieldSelector","involvedObject.name="+podName}});
 			high_resolution_clock::time_point t2 = high_resolution_clock::now();
-			log_info("kubectl get event completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
+			log_info("Listing events completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 			if(result.status)
-				log_warn("kubectl get event failed for pod " << podName << " in namespace " << nspace);
+				log_warn("Listing events failed for pod " << podName << " in namespace " << nspace << ": " << result.error);
 			return std::make_pair(podIndex,std::move(result.output));
 		};
 		eventData.emplace_back(std::async(std::launch::async,getPodEvents,podIndex++,podName));
@@ -387,12 +436,13 @@ rapidjson::Value fetchInstanceDetails(PersistentStore& store,
 }
 
 crow::response fetchApplicationInstanceInfo(PersistentStore& store, const crow::request& req, const std::string& instanceID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested information about " << instanceID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	auto instance=store.getApplicationInstance(instanceID);
+	ApplicationInstance instance=*store.getApplicationInstance(instanceID);
 	if(!instance)
 		return crow::response(404,generateError("Application instance not found"));
 	
@@ -400,71 +450,97 @@ crow::response fetchApplicationInstanceInfo(PersistentStore& store, const crow::
 	if(!user.admin && !store.userInGroup(user.id,instance.owningGroup))
 		return crow::response(403,generateError("Not authorized"));
 	
+	const auto clusterRecord=store.getCluster(instance.cluster);
+	const Cluster& cluster=*clusterRecord;
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
+	
 	//fetch the full configuration for the instance
 	instance.config=store.getApplicationInstanceConfig(instanceID);
 	
 	//get information on the owning Group, needed to look up services, etc.
-	const Group group=store.getGroup(instance.owningGroup);
+	const auto groupRecord=store.getGroup(instance.owningGroup);
+	const Group& group=*groupRecord;
 	
 	//TODO: serialize the instance configuration as JSON
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
-	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	result.AddMember("kind", "ApplicationInstance", alloc);
-	rapidjson::Value instanceData(rapidjson::kObjectType);
-	instanceData.AddMember("id", rapidjson::StringRef(instance.id.c_str()), alloc);
-	instanceData.AddMember("name", rapidjson::StringRef(instance.name.c_str()), alloc);
+	JSONStreamWriter writer;
+	writer.StartObject();
+	writer.Key("apiVersion");
+	writer.String("v1alpha3");
+	writer.Key("kind");
+	writer.String("ApplicationInstance");
+	writer.Key("metadata");
+	writer.StartObject();
+	writer.Key("id");
+	writer.String(instance.id);
+	writer.Key("name");
+	writer.String(instance.name);
 	std::string application=instance.application;
 	if(application.find('/')!=std::string::npos && application.find('/')<application.size()-1)
 			application=application.substr(application.find('/')+1);
-	instanceData.AddMember("application", application, alloc);
-	instanceData.AddMember("group", store.getGroup(instance.owningGroup).name, alloc);
-	instanceData.AddMember("cluster", store.getCluster(instance.cluster).name, alloc);
-	instanceData.AddMember("created", rapidjson::StringRef(instance.ctime.c_str()), alloc);
-	instanceData.AddMember("configuration", rapidjson::StringRef(instance.config.c_str()),
-			       alloc);
-	result.AddMember("metadata", instanceData, alloc);
-
+	writer.Key("application");
+	writer.String(application);
+	writer.Key("group");
+	writer.String(group.name);
+	writer.Key("cluster");
+	writer.String(cluster.name);
+	writer.Key("created");
+	writer.String(instance.ctime);
+	writer.Key("configuration");
+	writer.String(instance.config);
+	writer.EndObject();
 	
 	auto configPath=store.configPathForCluster(instance.cluster);
-	auto systemNamespace=store.getCluster(instance.cluster).systemNamespace;
-	auto services=getServices(configPath,instance.name,group.namespaceName(),systemNamespace);
-	rapidjson::Value serviceData(rapidjson::kArrayType);
+	auto systemNamespace=cluster.systemNamespace;
+	auto services=getServices(instance.cluster,configPath,instance.name,group.namespaceName(),systemNamespace);
+	writer.Key("services");
+	writer.StartArray();
 	for(const auto& service : services){
-		rapidjson::Value serviceEntry(rapidjson::kObjectType);
-		serviceEntry.AddMember("name", rapidjson::StringRef(service.first.c_str()), alloc);
-		serviceEntry.AddMember("clusterIP", rapidjson::StringRef(service.second.clusterIP.c_str()),
-				       alloc);
-		serviceEntry.AddMember("externalIP", rapidjson::StringRef(service.second.externalIP.c_str()),
-				       alloc);
-		serviceEntry.AddMember("ports", rapidjson::StringRef(service.second.ports.c_str()), alloc);
-		serviceEntry.AddMember("url", rapidjson::StringRef(service.second.netPathRef.c_str()), alloc);
-		serviceData.PushBack(serviceEntry, alloc);
-	}
-	result.AddMember("services", serviceData, alloc);
+		writer.StartObject();
+		writer.Key("name");
+		writer.String(service.first);
+		writer.Key("clusterIP");
+		writer.String(service.second.clusterIP);
+		writer.Key("externalIP");
+		writer.String(service.second.externalIP);
+		writer.Key("ports");
+		writer.String(service.second.ports);
+		writer.Key("url");
+		writer.String(service.second.netPathRef);
+		writer.EndObject();
+	}
+	writer.EndArray();
 	
 	if(req.url_params.get("detailed")){
+		writer.Key("details");
+		//the details are assembled from kubernetes's own JSON output, so they 
+		//are still built as a document, which only needs an allocator
+		rapidjson::Document details;
 		try{
-			result.AddMember("details",fetchInstanceDetails(store,instance,systemNamespace,alloc),alloc);
+			fetchInstanceDetails(store,instance,systemNamespace,details.GetAllocator()).Accept(writer);
 		}catch(std::runtime_error& err){
-			rapidjson::Value error(rapidjson::kObjectType);
-			error.AddMember("kind", "Error", alloc);
-			error.AddMember("message", std::string("Failed to detailed information for instance: ")+err.what(), alloc);
-			result.AddMember("details",error,alloc);
+			writer.StartObject();
+			writer.Key("kind");
+			writer.String("Error");
+			writer.Key("message");
+			writer.String(std::string("Failed to detailed information for instance: ")+err.what());
+			writer.EndObject();
 		}
 	}
+	writer.EndObject();
 
-	return crow::response(to_string(result));
+	return crow::response(writer.take());
 }
 
 crow::response deleteApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to delete " << instanceID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	auto instance=store.getApplicationInstance(instanceID);
+	const auto instanceRecord=store.getApplicationInstance(instanceID);
+	const ApplicationInstance& instance=*instanceRecord;
 	if(!instance)
 		return crow::response(404,generateError("Application instance not found"));
 	//only admins or member of the Group which owns an instance may delete it
@@ -483,14 +559,14 @@ namespace internal{
 std::string deleteApplicationInstance(PersistentStore& store, const ApplicationInstance& instance, bool force){
 	log_info("Deleting " << instance);
 	try{
-		const Group group=store.getGroup(instance.owningGroup);
+		const auto groupRecord=store.getGroup(instance.owningGroup);
+		const Group& group=*groupRecord;
 		auto configPath=store.configPathForCluster(instance.cluster);
-		auto systemNamespace=store.getCluster(instance.cluster).systemNamespace;
+		auto systemNamespace=store.getCluster(instance.cluster)->systemNamespace;
 		std::vector<std::string> deleteArgs={"delete",instance.name};
-		unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
-		if(helmMajorVersion==2)
+		if(kubernetes::getHelmCapabilities()->deleteRequiresPurge)
 			deleteArgs.insert(deleteArgs.begin()+1,"--purge");
-		else if(helmMajorVersion==3){
+		else{
 			deleteArgs.push_back("--namespace");
 			deleteArgs.push_back(group.namespaceName());
 		}
@@ -524,24 +600,29 @@ std::string deleteApplicationInstance(PersistentStore& store, const ApplicationI
 }
 
 crow::response restartApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to restart " << instanceID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	auto instance=store.getApplicationInstance(instanceID);
+	ApplicationInstance instance=*store.getApplicationInstance(instanceID);
 	if(!instance)
 		return crow::response(404,generateError("Application instance not found"));
 	//only admins or members of the Group which owns an instance may restart it
 	if(!user.admin && !store.userInGroup(user.id,instance.owningGroup))
 		return crow::response(403,generateError("Not authorized"));
 		
-	const Group group=store.getGroup(instance.owningGroup);
+	const auto groupRecord=store.getGroup(instance.owningGroup);
+	const Group& group=*groupRecord;
 	if(!group)
 		return crow::response(500,generateError("Invalid Group"));
-	const Cluster cluster=store.getCluster(instance.cluster);
+	const auto clusterRecord=store.getCluster(instance.cluster);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(500,generateError("Invalid Cluster"));
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
 	
 	instance.config=store.getApplicationInstanceConfig(instance.id);
 
@@ -552,12 +633,11 @@ crow::response restartApplicationInstance(PersistentStore& store, const crow::re
 	//      with restarting in that case
 	log_info("Stopping old " << instance);
 	try{
-		auto systemNamespace=store.getCluster(instance.cluster).systemNamespace;
+		auto systemNamespace=store.getCluster(instance.cluster)->systemNamespace;
 		std::vector<std::string> deleteArgs={"delete",instance.name};
-		unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
-		if(helmMajorVersion==2)
+		if(kubernetes::getHelmCapabilities()->deleteRequiresPurge)
 			deleteArgs.insert(deleteArgs.begin()+1,"--purge");
-		else if(helmMajorVersion==3){
+		else{
 			deleteArgs.push_back("--namespace");
 			deleteArgs.push_back(group.namespaceName());
 		}
@@ -643,14 +723,11 @@ crow::response restartApplicationInstance(PersistentStore& store, const crow::re
 	   "--values",instanceConfig.path(),
 	   "--set",additionalValues,
 	   };
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
-	if(helmMajorVersion==2){
+	const auto helmCapabilities=kubernetes::getHelmCapabilities();
+	if(helmCapabilities->installRequiresNameFlag)
 		installArgs.insert(installArgs.begin()+1,"--name");
-		installArgs.push_back("--tiller-namespace");
-		installArgs.push_back(cluster.systemNamespace);
-	}
 	   
-	auto commandResult=runCommand("helm",installArgs,{{"KUBECONFIG",*clusterConfig}});
+	auto commandResult=kubernetes::helm(*clusterConfig,cluster.systemNamespace,installArgs);
 	if(commandResult.status || 
 	   (commandResult.output.find("STATUS: DEPLOYED")==std::string::npos &&
 	    commandResult.output.find("STATUS: deployed")==std::string::npos)){
@@ -658,7 +735,7 @@ crow::response restartApplicationInstance(PersistentStore& store, const crow::re
 		log_error(errMsg);
 		//helm will (unhelpfully) keep broken 'releases' around, so clean up here
 		std::vector<std::string> deleteArgs={"delete",instance.name,"--namespace",group.namespaceName()};
-		if(kubernetes::getHelmMajorVersion()==2)
+		if(helmCapabilities->deleteRequiresPurge)
 			deleteArgs.insert(deleteArgs.begin()+1,"--purge");
 		auto helmResult=kubernetes::helm(*clusterConfig,cluster.systemNamespace,deleteArgs);
 		//TODO: include any other error information?
@@ -699,20 +776,27 @@ crow::response restartApplicationInstance(PersistentStore& store, const crow::re
 }
 
 crow::response getApplicationInstanceScale(PersistentStore& store, const crow::request& req, const std::string& instanceID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to check the scale of " << instanceID << " from " << req.remote_endpoint);
 	if (!user)
 		return crow::response(403,generateError("Not authorized"));
 
-	auto instance=store.getApplicationInstance(instanceID);
+	const auto instanceRecord=store.getApplicationInstance(instanceID);
+	const ApplicationInstance& instance=*instanceRecord;
 	if(!instance)
 		return crow::response(404,generateError("Application instance not found"));
 
 	//only admins or member of the Group which owns an instance examine it
 	if(!user.admin && !store.userInGroup(user.id,instance.owningGroup))
 		return crow::response(403,generateError("Not authorized"));
+	const auto clusterRecord=store.getCluster(instance.cluster);
+	const Cluster& cluster=*clusterRecord;
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
 
-	const Group group=store.getGroup(instance.owningGroup);
+	const auto groupRecord=store.getGroup(instance.owningGroup);
+	const Group& group=*groupRecord;
 	const std::string nspace=group.namespaceName();
 
 	std::string depName;
@@ -722,17 +806,17 @@ crow::response getApplicationInstanceScale(PersistentStore& store, const crow::r
 	auto configPath=store.configPathForCluster(instance.cluster);
 
 	const std::string name=instance.name;
-	auto deploymentResult=kubernetes::kubectl(*configPath,{"get","deployment","-l","release="+name,"--namespace",nspace,"-o=json"});
+	auto deploymentResult=kubernetes::listObjects(instance.cluster,configPath,kubernetes::ResourceKind::Deployments,nspace,"release="+name);
 	if (deploymentResult.status) {
-		log_error("kubectl get deployment -l release=" << name << " --namespace " 
-				   << nspace << "failed :" << deploymentResult.error);
+		log_error("Listing deployments with label release=" << name << " in namespace " 
+				   << nspace << " failed: " << deploymentResult.error);
 	}
 
 	rapidjson::Document deploymentData;
 	try{
 		deploymentData.Parse(deploymentResult.output.c_str());
 	}catch(std::runtime_error& err){
-		log_error("Unable to parse kubectl get deployment JSON output for " << name << ": " << err.what());
+		log_error("Unable to parse deployments JSON for " << name << ": " << err.what());
 	}
 	
 	rapidjson::Document result(rapidjson::kObjectType);
@@ -773,20 +857,27 @@ crow::response getApplicationInstanceScale(PersistentStore& store, const crow::r
 }
 
 crow::response scaleApplicationInstance(PersistentStore& store, const crow::request& req, const std::string& instanceID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to rescale " << instanceID << " from " << req.remote_endpoint);
 	if (!user)
 		return crow::response(403,generateError("Not authorized"));
 
-	auto instance=store.getApplicationInstance(instanceID);
+	const auto instanceRecord=store.getApplicationInstance(instanceID);
+	const ApplicationInstance& instance=*instanceRecord;
 	if(!instance)
 		return crow::response(404,generateError("Application instance not found"));
 
 	//only admins or member of the Group which owns an instance may scale it
 	if(!user.admin && !store.userInGroup(user.id,instance.owningGroup))
 		return crow::response(403,generateError("Not authorized"));
+	const auto clusterRecord=store.getCluster(instance.cluster);
+	const Cluster& cluster=*clusterRecord;
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
 
-	const Group group=store.getGroup(instance.owningGroup);
+	const auto groupRecord=store.getGroup(instance.owningGroup);
+	const Group& group=*groupRecord;
 	const std::string nspace=group.namespaceName();
 
 	uint64_t replicas;
@@ -807,17 +898,17 @@ crow::response scaleApplicationInstance(PersistentStore& store, const crow::requ
 
 	const std::string name=instance.name;
 	//collect all of the current deployment info
-	auto deploymentResult=kubernetes::kubectl(*configPath,{"get","deployment","-l","release="+name,"--namespace",nspace,"-o=json"});
+	auto deploymentResult=kubernetes::listObjects(instance.cluster,configPath,kubernetes::ResourceKind::Deployments,nspace,"release="+name);
 	if (deploymentResult.status) {
-		log_error("kubectl get deployment -l release=" << name << " --namespace " 
-				   << nspace << "failed :" << deploymentResult.error);
+		log_error("Listing deployments with label release=" << name << " in namespace " 
+				   << nspace << " failed: " << deploymentResult.error);
 	}
 
 	rapidjson::Document deploymentData;
 	try{
 		deploymentData.Parse(deploymentResult.output.c_str());
 	}catch(std::runtime_error& err){
-		log_error("Unable to parse kubectl get deployment JSON output for " << name << ": " << err.what());
+		log_error("Unable to parse deployments JSON for " << name << ": " << err.what());
 	}
 	
 	if(depName.empty() && deploymentData["items"].GetArray().Size()!=1)
@@ -873,18 +964,24 @@ crow::response scaleApplicationInstance(PersistentStore& store, const crow::requ
 crow::response getApplicationInstanceLogs(PersistentStore& store, 
                                           const crow::request& req, 
                                           const std::string& instanceID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested logs from " << instanceID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	auto instance=store.getApplicationInstance(instanceID);
+	const auto instanceRecord=store.getApplicationInstance(instanceID);
+	const ApplicationInstance& instance=*instanceRecord;
 	if(!instance)
 		return crow::response(404,generateError("Application instance not found"));
 	
 	//only admins or member of the Group which owns an instance may delete it
 	if(!user.admin && !store.userInGroup(user.id,instance.owningGroup))
 		return crow::response(403,generateError("Not authorized"));
+	const auto clusterRecord=store.getCluster(instance.cluster);
+	const Cluster& cluster=*clusterRecord;
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
 	
 	unsigned long maxLines=20; //default is 20
 	{
@@ -908,14 +1005,15 @@ crow::response getApplicationInstanceLogs(PersistentStore& store,
 	
 	log_info("Sending logs from " << instance << " to " << user);
 	auto configPath=store.configPathForCluster(instance.cluster);
-	auto systemNamespace=store.getCluster(instance.cluster).systemNamespace;
+	auto systemNamespace=cluster.systemNamespace;
 	
-	const Group group=store.getGroup(instance.owningGroup);
+	const auto groupRecord=store.getGroup(instance.owningGroup);
+	const Group& group=*groupRecord;
 	const std::string nspace=group.namespaceName();
 	
 	//Make a list of all containers in all pods, including any filtering requested by the user
 	std::vector<std::pair<std::string,std::string>> allContainers;
-	auto podsResult=kubernetes::kubectl(*configPath,{"get","pods","-l release="+instance.name,"-n",nspace,"-o=json"});
+	auto podsResult=kubernetes::listObjects(instance.cluster,configPath,kubernetes::ResourceKind::Pods,nspace,"release="+instance.name);
 	if(podsResult.status){
 		log_error("Failed to look up pods for " << instance << ": " << podsResult.error);
 		return crow::response(500,generateError("Failed to look up pods"));
@@ -925,7 +1023,7 @@ crow::response getApplicationInstanceLogs(PersistentStore& store,
 		podData.Parse(podsResult.output.c_str());
 	}
 	catch(std::runtime_error& err){
-		log_error("Unable to parse kubectl output for " << instance << " pods");
+		log_error("Unable to parse pods JSON for " << instance);
 		throw std::runtime_error("Could not find pods for instance");
 	}
 	for(const auto& pod : podData["items"].GetArray()){
@@ -945,19 +1043,19 @@ crow::response getApplicationInstanceLogs(PersistentStore& store,
 		high_resolution_clock::time_point t1,t2;
 		t1 = high_resolution_clock::now();
 		std::string logData=std::string(40,'=')+"\nPod: "+pod+" Container: "+container+'\n';
-		std::vector<std::string> args={"logs",pod,"-c",container,"-n",nspace};
+		std::map<std::string,std::string> query={{"container",container}};
 		if(maxLines)
-			args.push_back("--tail="+std::to_string(maxLines));
+			query["tailLines"]=std::to_string(maxLines);
 		if(previousLogs)
-			args.push_back("-p");
-		auto logResult=kubernetes::kubectl(*configPath,args);
+			query["previous"]="true";
+		auto logResult=kubernetes::apiGet(*configPath,"/api/v1/namespaces/"+nspace+"/pods/"+pod+"/log",query);
 		if(logResult.status){
 			logData+="Failed to get logs: ";
 			logData+=logResult.error;
 			logData+='\n';
 		}
 		else
-			logData+=logResult.output;
+			logData+=removeShellEscapeSequences(logResult.output);
 		t2 = high_resolution_clock::now();
 		log_info("Log fetch completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
 		return logData;
@@ -978,8 +1076,8 @@ crow::response getApplicationInstanceLogs(PersistentStore& store,
 	instanceData.AddMember("id", instance.id, alloc);
 	instanceData.AddMember("name", instance.name, alloc);
 	instanceData.AddMember("application", instance.application, alloc);
-	instanceData.AddMember("group", store.getGroup(instance.owningGroup).name, alloc);
-	instanceData.AddMember("cluster", store.getCluster(instance.cluster).name, alloc);
+	instanceData.AddMember("group", store.getGroup(instance.owningGroup)->name, alloc);
+	instanceData.AddMember("cluster", store.getCluster(instance.cluster)->name, alloc);
 	instanceData.AddMember("created", instance.ctime, alloc);
 	instanceData.AddMember("configuration", instance.config, alloc);
 	result.AddMember("metadata", instanceData, alloc);
@@ -0,0 +1,86 @@
+#include "CircuitBreaker.h"
+
+CircuitBreaker::CircuitBreaker(unsigned int failureThreshold, std::chrono::seconds retryInterval):
+failureThreshold(failureThreshold ? failureThreshold : 1),
+retryInterval(retryInterval){}
+
+bool CircuitBreaker::allow(const std::string& target){
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it=circuits.find(target);
+	if(it==circuits.end()) //no failures have been seen, so the circuit is closed
+		return true;
+	Circuit& circuit=it->second;
+	if(circuit.state==State::Closed)
+		return true;
+	auto now=clock::now();
+	if(now<circuit.since+retryInterval){
+		circuit.refused++;
+		return false;
+	}
+	//this attempt becomes the trial
+	circuit.state=State::HalfOpen;
+	circuit.since=now;
+	return true;
+}
+
+void CircuitBreaker::record(const std::string& target, bool success){
+	std::lock_guard<std::mutex> lock(mutex);
+	if(success){
+		auto it=circuits.find(target);
+		if(it!=circuits.end()){
+			it->second.state=State::Closed;
+			it->second.failures=0;
+		}
+		return;
+	}
+	Circuit& circuit=circuits[target];
+	circuit.failures++;
+	if(circuit.state==State::HalfOpen || circuit.state==State::Open
+	   || circuit.failures>=failureThreshold)
+		open(circuit);
+}
+
+CircuitBreaker::State CircuitBreaker::state(const std::string& target) const{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it=circuits.find(target);
+	if(it==circuits.end())
+		return State::Closed;
+	return it->second.state;
+}
+
+bool CircuitBreaker::retryDue(const std::string& target) const{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it=circuits.find(target);
+	if(it==circuits.end() || it->second.state==State::Closed)
+		return false;
+	return clock::now()>=it->second.since+retryInterval;
+}
+
+std::vector<CircuitBreaker::TargetStatistics> CircuitBreaker::getStatistics() const{
+	std::vector<TargetStatistics> stats;
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const auto& entry : circuits){
+		const Circuit& circuit=entry.second;
+		if(circuit.state==State::Closed && !circuit.trips)
+			continue;
+		stats.push_back(TargetStatistics{entry.first,circuit.state,circuit.failures,
+		                                 circuit.trips,circuit.refused});
+	}
+	return stats;
+}
+
+void CircuitBreaker::open(Circuit& circuit){
+	if(circuit.state!=State::Open)
+		circuit.trips++;
+	circuit.state=State::Open;
+	circuit.since=clock::now();
+}
+
+std::string to_string(CircuitBreaker::State state){
+	switch(state){
+		case CircuitBreaker::State::Closed: return "closed";
+		case CircuitBreaker::State::Open: return "open";
+		case CircuitBreaker::State::HalfOpen: return "half-open";
+	}
+	return "unknown";
+}
@@ -25,50 +25,77 @@ crow::response listClusters(PersistentStore& store, const crow::request& req){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
 	std::vector<Cluster> clusters;
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list clusters from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	//All users are allowed to list clusters
+	
+	ListingOptions options;
+	try{
+		options=parseListingOptions(req,{"id","name","owningGroup","owningOrganization","location"});
+	}catch(std::runtime_error& err){
+		return crow::response(400,generateError(err.what()));
+	}
 
 	if (auto group = req.url_params.get("group"))
 		clusters=store.listClustersByGroup(group);
 	else
 		clusters=store.listClusters();
-
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+	const std::string nextCursor=selectPage(clusters,options);
 	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	rapidjson::Value resultItems(rapidjson::kArrayType);
-	resultItems.Reserve(clusters.size(), alloc);
+	//look up the names of all owning groups together
+	std::vector<std::string> groupIDs;
+	if(options.includes("owningGroup")){
+		for(const Cluster& cluster : clusters)
+			groupIDs.push_back(cluster.owningGroup);
+	}
+	std::map<std::string,Group> groups=store.getGroups(groupIDs);
+	static const Group noGroup;
+
+	JSONStreamWriter writer;
+	writer.StartObject();
+	writer.Key("apiVersion");
+	writer.String("v1alpha3");
+	writer.Key("items");
+	writer.StartArray();
 	for(const Cluster& cluster : clusters){
-		rapidjson::Value clusterResult(rapidjson::kObjectType);
-		clusterResult.AddMember("apiVersion", "v1alpha3", alloc);
-		clusterResult.AddMember("kind", "Cluster", alloc);
-		rapidjson::Value clusterData(rapidjson::kObjectType);
-		clusterData.AddMember("id", cluster.id, alloc);
-		clusterData.AddMember("name", cluster.name, alloc);
-		clusterData.AddMember("owningGroup", store.findGroupByID(cluster.owningGroup).name, alloc);
-		clusterData.AddMember("owningOrganization", cluster.owningOrganization, alloc);
-		std::vector<GeoLocation> locations=store.getLocationsForCluster(cluster.id);
-		rapidjson::Value clusterLocation(rapidjson::kArrayType);
-		clusterLocation.Reserve(locations.size(), alloc);
-		for(const auto& location : locations){
-			rapidjson::Value entry(rapidjson::kObjectType);
-			entry.AddMember("lat",location.lat, alloc);
-			entry.AddMember("lon",location.lon, alloc);
-			clusterLocation.PushBack(entry, alloc);
+		writer.StartObject();
+		writer.Key("apiVersion");
+		writer.String("v1alpha3");
+		writer.Key("kind");
+		writer.String("Cluster");
+		writer.Key("metadata");
+		writer.StartObject();
+		writeField(writer,options,"id",cluster.id);
+		writeField(writer,options,"name",cluster.name);
+		writeField(writer,options,"owningGroup",findOrDefault(groups,cluster.owningGroup,noGroup).name);
+		writeField(writer,options,"owningOrganization",cluster.owningOrganization);
+		//locations are stored separately, so are only looked up if needed
+		if(options.includes("location")){
+			writer.Key("location");
+			writer.StartArray();
+			for(const auto& location : store.getLocationsForCluster(cluster.id)){
+				writer.StartObject();
+				writer.Key("lat");
+				writer.Double(location.lat);
+				writer.Key("lon");
+				writer.Double(location.lon);
+				writer.EndObject();
+			}
+			writer.EndArray();
 		}
-		clusterData.AddMember("location", clusterLocation, alloc);
-		clusterResult.AddMember("metadata", clusterData, alloc);
-		resultItems.PushBack(clusterResult, alloc);
+		writer.EndObject();
+		writer.EndObject();
 	}
-	result.AddMember("items", resultItems, alloc);
+	writer.EndArray();
+	writeNextCursor(writer,nextCursor);
+	writer.EndObject();
 
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
 	log_info("cluster listing completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
-	return crow::response(to_string(result));
+	return crow::response(writer.take());
 }
 
 namespace internal{
@@ -187,12 +214,10 @@ std::string ensureClusterSetup(PersistentStore& store, const Cluster& cluster){
 	std::string resultMessage;
 	
 	//As long as we are stuck with helm 2, we need tiller running on the cluster
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
 	//Make sure that is is.
-	if(helmMajorVersion==2){
-		auto commandResult = runCommand("helm",
-		  {"init","--service-account",cluster.systemNamespace,"--tiller-namespace",cluster.systemNamespace},
-		  {{"KUBECONFIG",*configPath}});
+	if(kubernetes::getHelmCapabilities()->usesTiller){
+		auto commandResult = kubernetes::helm(*configPath,cluster.systemNamespace,
+		  {"init","--service-account",cluster.systemNamespace});
 		auto expected="Tiller (the Helm server-side component) has been installed";
 		auto already="Tiller is already installed";
 		if(commandResult.status || 
@@ -283,7 +308,8 @@ std::string ensureClusterSetup(PersistentStore& store, const Cluster& cluster){
 }
 
 crow::response createCluster(PersistentStore& store, const crow::request& req){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to create a cluster from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -525,13 +551,15 @@ namespace internal{
 
 crow::response getClusterInfo(PersistentStore& store, const crow::request& req,
                               const std::string clusterID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested information about " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	//all users are allowed to query all clusters?
 	
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
@@ -591,12 +619,14 @@ crow::response getClusterInfo(PersistentStore& store, const crow::request& req,
 
 crow::response deleteCluster(PersistentStore& store, const crow::request& req, 
                              const std::string& clusterID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to delete " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
@@ -709,12 +739,13 @@ std::string deleteCluster(PersistentStore& store, const Cluster& cluster, bool f
 
 crow::response updateCluster(PersistentStore& store, const crow::request& req, 
                              const std::string& clusterID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to update " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	Cluster cluster=store.getCluster(clusterID);
+	Cluster cluster=*store.getCluster(clusterID);
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
@@ -805,13 +836,15 @@ crow::response updateCluster(PersistentStore& store, const crow::request& req,
 
 crow::response listClusterAllowedgroups(PersistentStore& store, const crow::request& req, 
                                      const std::string& clusterID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list groups with access to cluster " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	//All users are allowed to list allowed groups
 	
-	Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
@@ -864,13 +897,15 @@ crow::response listClusterAllowedgroups(PersistentStore& store, const crow::requ
 
 crow::response grantGroupClusterAccess(PersistentStore& store, const crow::request& req, 
                                     const std::string& clusterID, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to grant Group " << groupID << " access to cluster " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
@@ -886,7 +921,8 @@ crow::response grantGroupClusterAccess(PersistentStore& store, const crow::reque
 		success=store.addGroupToCluster(PersistentStore::wildcard,cluster.id);
 	}
 	else{
-		const Group group=store.getGroup(groupID);
+		const auto groupRecord=store.getGroup(groupID);
+		const Group& group=*groupRecord;
 		if(!group)
 			return crow::response(404,generateError("Group not found"));
 		if(group.id==cluster.owningGroup)
@@ -905,13 +941,15 @@ crow::response grantGroupClusterAccess(PersistentStore& store, const crow::reque
 
 crow::response revokeGroupClusterAccess(PersistentStore& store, const crow::request& req, 
                                      const std::string& clusterID, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to revoke Group " << groupID << " access to cluster " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
@@ -926,7 +964,8 @@ crow::response revokeGroupClusterAccess(PersistentStore& store, const crow::requ
 		success=store.removeGroupFromCluster(PersistentStore::wildcard,cluster.id);
 	}
 	else{
-		const Group group=store.getGroup(groupID);
+		const auto groupRecord=store.getGroup(groupID);
+		const Group& group=*groupRecord;
 		if(!group)
 			return crow::response(404,generateError("Group not found"));
 		
@@ -946,18 +985,21 @@ crow::response listClusterGroupAllowedApplications(PersistentStore& store,
                                                 const crow::request& req, 
                                                 const std::string& clusterID, 
 												const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list applications Group " << groupID 
 	         << " may use on cluster " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
-	const Group group=store.getGroup(groupID);
+	const auto groupRecord=store.getGroup(groupID);
+	const Group& group=*groupRecord;
 	if(!group)
 		return crow::response(404,generateError("Group not found"));
 	
@@ -983,7 +1025,8 @@ crow::response listClusterGroupAllowedApplications(PersistentStore& store,
 crow::response allowGroupUseOfApplication(PersistentStore& store, const crow::request& req, 
                                        const std::string& clusterID, const std::string& groupID,
                                        const std::string& applicationName){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to grant Group " << groupID 
 	         << " permission to use application " << applicationName 
 	         << " on cluster " << clusterID << " from " << req.remote_endpoint);
@@ -991,11 +1034,13 @@ crow::response allowGroupUseOfApplication(PersistentStore& store, const crow::re
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
-	const Group group=store.getGroup(groupID);
+	const auto groupRecord=store.getGroup(groupID);
+	const Group& group=*groupRecord;
 	if(!group)
 		return crow::response(404,generateError("Group not found"));
 	
@@ -1015,7 +1060,8 @@ crow::response allowGroupUseOfApplication(PersistentStore& store, const crow::re
 crow::response denyGroupUseOfApplication(PersistentStore& store, const crow::request& req, 
                                       const std::string& clusterID, const std::string& groupID,
                                       const std::string& applicationName){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to remove Group " << groupID 
 	         << " permission to use application " << applicationName 
 	         << " on cluster " << clusterID << " from " << req.remote_endpoint);
@@ -1023,11 +1069,13 @@ crow::response denyGroupUseOfApplication(PersistentStore& store, const crow::req
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
-	const Group group=store.getGroup(groupID);
+	const auto groupRecord=store.getGroup(groupID);
+	const Group& group=*groupRecord;
 	if(!group)
 		return crow::response(404,generateError("Group not found"));
 	
@@ -1070,16 +1118,47 @@ struct ClusterConsistencyResult{
 	rapidjson::Document toJSON() const;
 };
 
+namespace{
+
+///Extract the names of all objects in a kubernetes list
+///\param listResult the result of listing some kind of objects via the 
+///                  kubernetes API
+///\return the names of the listed objects, or nothing if the list could not
+///        be fetched or parsed
+std::vector<std::string> listedObjectNames(const commandResult& listResult){
+	std::vector<std::string> names;
+	if(listResult.status)
+		return names;
+	rapidjson::Document data;
+	data.Parse(listResult.output.c_str());
+	if(data.HasParseError() || !data.IsObject() || !data.HasMember("items") 
+	   || !data["items"].IsArray())
+		return names;
+	for(const auto& item : data["items"].GetArray()){
+		if(item.IsObject() && item.HasMember("metadata") && item["metadata"].IsObject()
+		   && item["metadata"].HasMember("name") && item["metadata"]["name"].IsString())
+			names.push_back(item["metadata"]["name"].GetString());
+	}
+	return names;
+}
+
+}
+
 namespace internal{
 
 bool pingCluster(PersistentStore& store, const Cluster& cluster){
 	auto configPath=store.configPathForCluster(cluster.id);
 
-	bool contactable=false;
 	//check that the cluster can be reached
-	auto clusterInfo=kubernetes::kubectl(*configPath,{"get","serviceaccounts","-o=jsonpath={.items[*].metadata.name}"});
+	commandResult clusterInfo;
+	try{
+		clusterInfo=kubernetes::apiGet(*configPath,"/api/v1/namespaces/"+kubernetes::defaultNamespace(*configPath)+"/serviceaccounts");
+	}catch(std::runtime_error& err){
+		clusterInfo=commandResult{"",err.what(),1};
+	}
+	auto accountNames=listedObjectNames(clusterInfo);
 	if(clusterInfo.status || 
-	   clusterInfo.output.find("default")==std::string::npos){
+	   std::find(accountNames.begin(),accountNames.end(),"default")==accountNames.end()){
 		log_info("Unable to contact " << cluster);
 		return false;
 	}
@@ -1091,6 +1170,18 @@ bool pingCluster(PersistentStore& store, const Cluster& cluster){
 
 }
 
+bool checkClusterReachable(PersistentStore& store, const Cluster& cluster){
+	if(kubernetes::clusterAvailable(cluster.id))
+		return true;
+	if(kubernetes::clusterRetryDue(cluster.id)){
+		store.refreshInBackground("ping:"+cluster.id,[&store,cluster]{
+			store.cacheClusterReachability(cluster.id,internal::pingCluster(store,cluster));
+		});
+	}
+	log_info("Not contacting " << cluster << " because it has recently been unreachable");
+	return false;
+}
+
 ClusterConsistencyResult::ClusterConsistencyResult(PersistentStore& store, const Cluster& cluster){
 	auto configPath=store.configPathForCluster(cluster.id);
 	
@@ -1149,8 +1240,10 @@ ClusterConsistencyResult::ClusterConsistencyResult(PersistentStore& store, const
 	
 	//figure out what secrets currently exist
 	//start by learning which namespaces we can see, in which we should search for secrets
-	auto namespaceInfo=kubernetes::kubectl(*configPath,{"get","clusternamespaces","-o=jsonpath={.items[*].metadata.name}"});
-	std::vector<std::string> namespaceNames=string_split_columns(namespaceInfo.output,' ',false);
+	auto namespaceInfo=kubernetes::apiGet(*configPath,"/apis/nrp-nautilus.io/v1alpha1/clusternamespaces");
+	if(namespaceInfo.status)
+		log_error("Unable to list namespaces on " << cluster << ": " << namespaceInfo.error);
+	std::vector<std::string> namespaceNames=listedObjectNames(namespaceInfo);
 	//iterate over namespaces, listing secrets
 	for(const auto& namespaceName : namespaceNames){
 		if(namespaceName.find(Group::namespacePrefix())!=0){
@@ -1158,8 +1251,8 @@ ClusterConsistencyResult::ClusterConsistencyResult(PersistentStore& store, const
 			continue;
 		}
 		std::string groupName=namespaceName.substr(Group::namespacePrefix().size());
-		auto secretsInfo=kubernetes::kubectl(*configPath,{"get","secrets","-n",namespaceName,"-o=jsonpath={.items[*].metadata.name}"});
-		for(const auto& secretName : string_split_columns(secretsInfo.output,' ',false)){
+		auto secretsInfo=kubernetes::apiGet(*configPath,"/api/v1/namespaces/"+namespaceName+"/secrets");
+		for(const auto& secretName : listedObjectNames(secretsInfo)){
 			if(secretName.find("default-token-")==0)
 				continue; //ignore kubernetes infrastructure
 			existingSecretNames.insert(groupName+":"+secretName);
@@ -1247,13 +1340,15 @@ rapidjson::Document ClusterConsistencyResult::toJSON() const{
 
 crow::response pingCluster(PersistentStore& store, const crow::request& req,
                            const std::string& clusterID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to ping cluster " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 		
@@ -1265,7 +1360,7 @@ crow::response pingCluster(PersistentStore& store, const crow::request& req,
 	
 	bool reachable;
 	if(cacheResult) //if we got a valid result it can only be because we asked for it
-		reachable=cacheResult.record;
+		reachable=cacheResult.get();
 	else{ //if we either didn't use the cache, it was empty, or expired, get a fresh result
 		reachable=internal::pingCluster(store, cluster);
 		//update the cache
@@ -1283,28 +1378,34 @@ crow::response pingCluster(PersistentStore& store, const crow::request& req,
 
 crow::response verifyCluster(PersistentStore& store, const crow::request& req,
                              const std::string& clusterID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to verify the state of cluster " << clusterID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
 	
 	return crow::response(to_string(ClusterConsistencyResult(store, cluster).toJSON()));
 }
 
 crow::response repairCluster(PersistentStore& store, const crow::request& req,
                              const std::string& clusterID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to repair cluster " << clusterID << " from " << req.remote_endpoint);
 	if(!user || !user.admin) //only admins can perform this action
 		return crow::response(403,generateError("Not authorized"));
 	
 	//validate input
-	const Cluster cluster=store.getCluster(clusterID);
+	const auto clusterRecord=store.getCluster(clusterID);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	
@@ -108,6 +108,7 @@ const std::string IDGenerator::clusterIDPrefix="cluster_";
 const std::string IDGenerator::groupIDPrefix="group_";
 const std::string IDGenerator::instanceIDPrefix="instance_";
 const std::string IDGenerator::secretIDPrefix="secret_";
+const std::string IDGenerator::jobIDPrefix="job_";
 
 std::string IDGenerator::generateRawID(){
 	uint64_t value;
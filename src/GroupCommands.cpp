@@ -103,11 +103,19 @@ namespace{
 crow::response listGroups(PersistentStore& store, const crow::request& req){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list groups from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	//All users are allowed to list groups
+	
+	ListingOptions options;
+	try{
+		options=parseListingOptions(req,{"id","name","email","phone","scienceField","description"});
+	}catch(std::runtime_error& err){
+		return crow::response(400,generateError(err.what()));
+	}
 
 	std::vector<Group> vos;
 
@@ -115,37 +123,43 @@ crow::response listGroups(PersistentStore& store, const crow::request& req){
 		vos=store.listGroupsForUser(user.id);
 	else
 		vos=store.listGroups();
+	const std::string nextCursor=selectPage(vos,options);
 
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
-	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	rapidjson::Value resultItems(rapidjson::kArrayType);
-	resultItems.Reserve(vos.size(), alloc);
+	JSONStreamWriter writer;
+	writer.StartObject();
+	writer.Key("apiVersion");
+	writer.String("v1alpha3");
+	writer.Key("items");
+	writer.StartArray();
 	for (const Group& group : vos){
-		rapidjson::Value metadata(rapidjson::kObjectType);
-		metadata.AddMember("id", rapidjson::StringRef(group.id.c_str()), alloc);
-		metadata.AddMember("name", rapidjson::StringRef(group.name.c_str()), alloc);
-		metadata.AddMember("email", rapidjson::StringRef(group.email.c_str()), alloc);
-		metadata.AddMember("phone", rapidjson::StringRef(group.phone.c_str()), alloc);
-		metadata.AddMember("scienceField", rapidjson::StringRef(group.scienceField.c_str()), alloc);
-		metadata.AddMember("description", rapidjson::StringRef(group.description.c_str()), alloc);
-
-		rapidjson::Value groupResult(rapidjson::kObjectType);
-		groupResult.AddMember("apiVersion", "v1alpha3", alloc);
-		groupResult.AddMember("kind", "Group", alloc);
-		groupResult.AddMember("metadata", metadata, alloc);
-		resultItems.PushBack(groupResult, alloc);
+		writer.StartObject();
+		writer.Key("apiVersion");
+		writer.String("v1alpha3");
+		writer.Key("kind");
+		writer.String("Group");
+		writer.Key("metadata");
+		writer.StartObject();
+		writeField(writer,options,"id",group.id);
+		writeField(writer,options,"name",group.name);
+		writeField(writer,options,"email",group.email);
+		writeField(writer,options,"phone",group.phone);
+		writeField(writer,options,"scienceField",group.scienceField);
+		writeField(writer,options,"description",group.description);
+		writer.EndObject();
+		writer.EndObject();
 	}
-	result.AddMember("items", resultItems, alloc);
+	writer.EndArray();
+	writeNextCursor(writer,nextCursor);
+	writer.EndObject();
 	
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
 	log_info("group listing completed in " << duration_cast<duration<double>>(t2-t1).count() << " seconds");
-	return crow::response(to_string(result));
+	return crow::response(writer.take());
 }
 
 crow::response createGroup(PersistentStore& store, const crow::request& req){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to create a Group from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -266,13 +280,15 @@ crow::response createGroup(PersistentStore& store, const crow::request& req){
 }
 
 crow::response getGroupInfo(PersistentStore& store, const crow::request& req, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested information about " << groupID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	//Any user in the system may query a Group's information
 	
-	Group group = store.getGroup(groupID);
+	const auto groupRecord = store.getGroup(groupID);
+	const Group& group = *groupRecord;
 	
 	if(!group)
 		return crow::response(404,generateError("Group not found"));
@@ -295,7 +311,8 @@ crow::response getGroupInfo(PersistentStore& store, const crow::request& req, co
 }
 
 crow::response updateGroup(PersistentStore& store, const crow::request& req, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to update " << groupID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -303,7 +320,7 @@ crow::response updateGroup(PersistentStore& store, const crow::request& req, con
 	if(!user.admin && !store.userInGroup(user.id,groupID))
 		return crow::response(403,generateError("Not authorized"));
 	
-	Group targetGroup = store.getGroup(groupID);
+	Group targetGroup = *store.getGroup(groupID);
 	
 	if(!targetGroup)
 		return crow::response(404,generateError("Group not found"));
@@ -367,7 +384,8 @@ crow::response updateGroup(PersistentStore& store, const crow::request& req, con
 }
 
 crow::response deleteGroup(PersistentStore& store, const crow::request& req, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to delete " << groupID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -375,7 +393,8 @@ crow::response deleteGroup(PersistentStore& store, const crow::request& req, con
 	if(!user.admin && !store.userInGroup(user.id,groupID))
 		return crow::response(403,generateError("Not authorized"));
 	
-	Group targetGroup = store.getGroup(groupID);
+	const auto targetGroupRecord = store.getGroup(groupID);
+	const Group& targetGroup = *targetGroupRecord;
 	
 	if(!targetGroup)
 		return crow::response(404,generateError("Group not found"));
@@ -432,12 +451,14 @@ crow::response deleteGroup(PersistentStore& store, const crow::request& req, con
 }
 
 crow::response listGroupMembers(PersistentStore& store, const crow::request& req, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list members of " << groupID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	Group targetGroup = store.getGroup(groupID);
+	const auto targetGroupRecord = store.getGroup(groupID);
+	const Group& targetGroup = *targetGroupRecord;
 	if(!targetGroup)
 		return crow::response(404,generateError("Group not found"));
 	//Only admins and members of a Group can list its members
@@ -445,6 +466,7 @@ crow::response listGroupMembers(PersistentStore& store, const crow::request& req
 		return crow::response(403,generateError("Not authorized"));
 	
 	auto userIDs=store.getMembersOfGroup(targetGroup.id);
+	auto members=store.getUsers(userIDs);
 	
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
@@ -453,7 +475,7 @@ crow::response listGroupMembers(PersistentStore& store, const crow::request& req
 	rapidjson::Value resultItems(rapidjson::kArrayType);
 	resultItems.Reserve(userIDs.size(), alloc);
 	for(const std::string& userID : userIDs){
-		User user=store.getUser(userID);
+		const User& user=members[userID];
 		rapidjson::Value userResult(rapidjson::kObjectType);
 		userResult.AddMember("apiVersion", "v1alpha3", alloc);
 		userResult.AddMember("kind", "User", alloc);
@@ -472,12 +494,14 @@ crow::response listGroupMembers(PersistentStore& store, const crow::request& req
 }
 
 crow::response listGroupClusters(PersistentStore& store, const crow::request& req, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list clusters owned by " << groupID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	Group targetGroup = store.getGroup(groupID);
+	const auto targetGroupRecord = store.getGroup(groupID);
+	const Group& targetGroup = *targetGroupRecord;
 	if(!targetGroup)
 		return crow::response(404,generateError("Group not found"));
 	//anyone can list a Group's clusters?
@@ -491,7 +515,8 @@ crow::response listGroupClusters(PersistentStore& store, const crow::request& re
 	rapidjson::Value resultItems(rapidjson::kArrayType);
 	resultItems.Reserve(clusterIDs.size(), alloc);
 	for(const std::string& clusterID : clusterIDs){
-		Cluster cluster=store.getCluster(clusterID);
+		const auto clusterRecord=store.getCluster(clusterID);
+		const Cluster& cluster=*clusterRecord;
 		rapidjson::Value clusterResult(rapidjson::kObjectType);
 		clusterResult.AddMember("apiVersion", "v1alpha3", alloc);
 		clusterResult.AddMember("kind", "Cluster", alloc);
@@ -0,0 +1,158 @@
+#include "JobCommands.h"
+
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#include "Logging.h"
+#include "ServerUtilities.h"
+
+std::string to_string(Job::State state){
+	switch(state){
+		case Job::State::Pending: return "Pending";
+		case Job::State::Running: return "Running";
+		case Job::State::Succeeded: return "Succeeded";
+		case Job::State::Failed: return "Failed";
+	}
+	return "Unknown";
+}
+
+JobTable::JobTable(std::chrono::seconds retention):retention(retention){}
+
+Job JobTable::create(const User& owner, const std::string& description){
+	Job job;
+	job.id=idGenerator.generateJobID();
+	job.owner=owner.id;
+	job.description=description;
+	job.created=timestamp();
+	std::lock_guard<std::mutex> lock(mutex);
+	discardExpired();
+	jobs.emplace(job.id,job);
+	return job;
+}
+
+void JobTable::markRunning(const std::string& id){
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it=jobs.find(id);
+	if(it==jobs.end())
+		return;
+	it->second.state=Job::State::Running;
+	it->second.started=timestamp();
+}
+
+void JobTable::markFinished(const std::string& id, const crow::response& result){
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it=jobs.find(id);
+	if(it==jobs.end())
+		return;
+	Job& job=it->second;
+	job.state=(result.code<400 ? Job::State::Succeeded : Job::State::Failed);
+	job.finished=timestamp();
+	job.resultStatus=result.code;
+	job.resultBody=result.body;
+	expirations.emplace(std::chrono::steady_clock::now()+retention,id);
+}
+
+Job JobTable::find(const std::string& id) const{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it=jobs.find(id);
+	if(it==jobs.end())
+		return Job();
+	return it->second;
+}
+
+void JobTable::discardExpired(){
+	auto now=std::chrono::steady_clock::now();
+	while(!expirations.empty() && expirations.begin()->first<now){
+		jobs.erase(expirations.begin()->second);
+		expirations.erase(expirations.begin());
+	}
+}
+
+namespace{
+	///Render a job as a JSON object
+	rapidjson::Document jobToJSON(const Job& job){
+		rapidjson::Document result(rapidjson::kObjectType);
+		rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+
+		result.AddMember("apiVersion", "v1alpha3", alloc);
+		result.AddMember("kind", "Job", alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("id", job.id, alloc);
+		metadata.AddMember("description", job.description, alloc);
+		metadata.AddMember("state", to_string(job.state), alloc);
+		metadata.AddMember("created", job.created, alloc);
+		if(!job.started.empty())
+			metadata.AddMember("started", job.started, alloc);
+		if(!job.finished.empty())
+			metadata.AddMember("finished", job.finished, alloc);
+		result.AddMember("metadata", metadata, alloc);
+
+		if(job.state==Job::State::Succeeded || job.state==Job::State::Failed){
+			rapidjson::Value jobResult(rapidjson::kObjectType);
+			jobResult.AddMember("status", job.resultStatus, alloc);
+			//include the response body as a JSON object if it is one, or as a
+			//string otherwise
+			rapidjson::Document body(rapidjson::kObjectType,&alloc);
+			body.Parse(job.resultBody.c_str());
+			if(!body.HasParseError())
+				jobResult.AddMember("body", body, alloc);
+			else
+				jobResult.AddMember("body", job.resultBody, alloc);
+			result.AddMember("result", jobResult, alloc);
+		}
+		return result;
+	}
+}
+
+crow::response startJob(PersistentStore& store, JobTable& jobs, WorkerPool& pool,
+                        const crow::request& req, const std::string& description,
+                        std::function<crow::response()> handler){
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
+	if(!user)
+		return crow::response(403,generateError("Not authorized"));
+
+	Job job=jobs.create(user,description);
+	log_info(user << " started job " << job.id << " to " << description << " from " << req.remote_endpoint);
+	const std::string jobID=job.id;
+	pool.submit([&jobs,jobID,handler]{
+		jobs.markRunning(jobID);
+		//mirror crow's own treatment of exceptions thrown by handlers
+		crow::response result;
+		try{
+			result=handler();
+		}catch(std::exception& ex){
+			log_error("An uncaught exception occurred in job " << jobID << ": " << ex.what());
+			result=crow::response(500);
+		}catch(...){
+			log_error("An uncaught exception occurred in job " << jobID << ": Unknown exception type");
+			result=crow::response(500);
+		}
+		log_info("Job " << jobID << " finished with status " << result.code);
+		jobs.markFinished(jobID,result);
+	});
+
+	crow::response response(202,to_string(jobToJSON(job)));
+	response.set_header("Location","/v1alpha3/jobs/"+jobID);
+	return response;
+}
+
+crow::response getJob(PersistentStore& store, JobTable& jobs,
+                      const crow::request& req, const std::string& jobID){
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
+	log_info(user << " requested to get job " << jobID << " from " << req.remote_endpoint);
+	if(!user)
+		return crow::response(403,generateError("Not authorized"));
+
+	Job job=jobs.find(jobID);
+	if(!job)
+		return crow::response(404,generateError("Job not found"));
+
+	//only the user who started a job, or an admin, may view it
+	if(job.owner!=user.id && !user.admin)
+		return crow::response(403,generateError("Not authorized"));
+
+	return crow::response(to_string(jobToJSON(job)));
+}
@@ -0,0 +1,471 @@
+#include "KubeInformer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#include "Entities.h"
+#include "KubeInterface.h"
+#include "Logging.h"
+#include "ServerUtilities.h"
+
+namespace kubernetes{
+
+namespace{
+
+using Clock=std::chrono::steady_clock;
+
+///How long a watch may go unused before it is stopped
+const std::chrono::minutes informerIdleLimit(10);
+///How long each watch request is asked to last before being renewed
+const unsigned long watchSeconds=60;
+
+std::atomic<long long> maxStalenessSeconds(30);
+std::atomic<unsigned long long> cachedListings(0);
+std::atomic<unsigned long long> directListings(0);
+
+long long now(){
+	return std::chrono::duration_cast<std::chrono::seconds>(Clock::now().time_since_epoch()).count();
+}
+
+///Where the API serves a kind of object
+struct KindInfo{
+	const char* name;
+	///The API group/version prefixes under which the objects may be found, in
+	///order of preference
+	std::vector<std::string> prefixes;
+};
+
+const KindInfo& kindInfo(ResourceKind kind){
+	static const KindInfo pods{"pods",{"/api/v1"}};
+	static const KindInfo services{"services",{"/api/v1"}};
+	static const KindInfo deployments{"deployments",{"/apis/apps/v1"}};
+	static const KindInfo ingresses{"ingresses",{"/apis/networking.k8s.io/v1beta1","/apis/extensions/v1beta1"}};
+	switch(kind){
+		case ResourceKind::Pods: return pods;
+		case ResourceKind::Services: return services;
+		case ResourceKind::Deployments: return deployments;
+		case ResourceKind::Ingresses: return ingresses;
+	}
+	throw std::logic_error("Invalid resource kind");
+}
+
+///A label selector reduced to the key=value requirements it contains
+using LabelRequirements=std::vector<std::pair<std::string,std::string>>;
+
+///\param selector the selector to parse
+///\param requirements the parsed requirements
+///\return whether the selector could be represented as simple equalities
+bool parseLabelSelector(const std::string& selector, LabelRequirements& requirements){
+	for(const auto& term : string_split_columns(selector,',',false)){
+		auto eqPos=term.find('=');
+		if(eqPos==std::string::npos || eqPos==0 || term[eqPos-1]=='!')
+			return false;
+		std::string key=trim(term.substr(0,eqPos));
+		std::string value=trim(term.substr(term[eqPos+1]=='=' ? eqPos+2 : eqPos+1));
+		if(key.empty() || key.find_first_of(" ()")!=std::string::npos)
+			return false;
+		requirements.emplace_back(key,value);
+	}
+	return true;
+}
+
+///A cached copy of one object
+struct CachedObject{
+	///The object's serialized JSON
+	std::string json;
+	std::map<std::string,std::string> labels;
+
+	bool matches(const LabelRequirements& requirements) const{
+		for(const auto& requirement : requirements){
+			auto it=labels.find(requirement.first);
+			if(it==labels.end() || it->second!=requirement.second)
+				return false;
+		}
+		return true;
+	}
+};
+
+///Objects keyed by (namespace, name)
+using ObjectMap=std::map<std::pair<std::string,std::string>,CachedObject>;
+///Object names keyed by (namespace, release label)
+using ReleaseIndex=std::map<std::pair<std::string,std::string>,std::set<std::string>>;
+
+///Keeps a copy of all objects of one kind on one cluster current, by listing
+///them once and then watching for changes.
+class Informer : public std::enable_shared_from_this<Informer>{
+public:
+	Informer(const std::string& clusterID, ResourceKind kind, SharedFileHandle configPath):
+	clusterID(clusterID),kind(kind),configPath(configPath),
+	synced(false),watching(false),stopped(false),
+	lastContact(0),lastAccess(now()){}
+
+	///Begin watching in a background thread
+	void start(){
+		std::thread(&Informer::run,shared_from_this()).detach();
+	}
+
+	///Record a use of the informer with the current config for its cluster
+	void touch(const SharedFileHandle& currentConfig){
+		lastAccess=now();
+		std::lock_guard<std::mutex> lock(mutex);
+		configPath=currentConfig;
+	}
+
+	///\return whether the background thread has ended
+	bool isStopped() const{ return stopped; }
+
+	///Try to list objects from the cache
+	///\param nspace the namespace in which to list objects
+	///\param requirements the labels the objects must have
+	///\param result the JSON list of matching objects
+	///\return whether the cache was sufficiently current to be used
+	bool list(const std::string& nspace, const LabelRequirements& requirements, std::string& result) const{
+		if(!synced)
+			return false;
+		if(!watching && now()-lastContact>maxStalenessSeconds)
+			return false;
+
+		result="{\"apiVersion\":\"v1\",\"kind\":\"List\",\"items\":[";
+		bool first=true;
+		auto append=[&](const CachedObject& object){
+			if(!object.matches(requirements))
+				return;
+			if(!first)
+				result+=',';
+			result+=object.json;
+			first=false;
+		};
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto release=std::find_if(requirements.begin(),requirements.end(),
+		  [](const std::pair<std::string,std::string>& r){ return r.first=="release"; });
+		if(release!=requirements.end()){
+			auto names=byRelease.find(std::make_pair(nspace,release->second));
+			if(names!=byRelease.end()){
+				for(const auto& name : names->second){
+					auto object=objects.find(std::make_pair(nspace,name));
+					if(object!=objects.end())
+						append(object->second);
+				}
+			}
+		}
+		else{
+			for(auto it=objects.lower_bound(std::make_pair(nspace,std::string()));
+			    it!=objects.end() && it->first.first==nspace; it++)
+				append(it->second);
+		}
+		result+="]}";
+		return true;
+	}
+
+private:
+	const std::string clusterID;
+	const ResourceKind kind;
+
+	///Guards configPath, objects, and byRelease
+	mutable std::mutex mutex;
+	SharedFileHandle configPath;
+	ObjectMap objects;
+	ReleaseIndex byRelease;
+
+	///Only used by the background thread
+	std::string prefix;
+	std::string resourceVersion;
+
+	///Whether a complete listing has been obtained
+	std::atomic<bool> synced;
+	///Whether a watch request is currently open
+	std::atomic<bool> watching;
+	///Whether the background thread has ended
+	std::atomic<bool> stopped;
+	///The last time the cluster was known to have no changes unseen by this
+	///informer
+	std::atomic<long long> lastContact;
+	std::atomic<long long> lastAccess;
+
+	bool shouldStop() const{
+		return now()-lastAccess>std::chrono::duration_cast<std::chrono::seconds>(informerIdleLimit).count();
+	}
+
+	std::string describe() const{
+		return std::string(kindInfo(kind).name)+" informer for cluster "+clusterID;
+	}
+
+	void run(){
+		log_info("Starting " << describe());
+		unsigned int backoff=1;
+		while(!shouldStop()){
+			SharedFileHandle config;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				config=configPath;
+			}
+			bool success;
+			if(resourceVersion.empty())
+				success=relist(*config);
+			else
+				success=watch(*config);
+			if(success){
+				backoff=1;
+				continue;
+			}
+			std::this_thread::sleep_for(std::chrono::seconds(backoff));
+			backoff=std::min(2*backoff,60u);
+		}
+		log_info("Stopping idle " << describe());
+		synced=false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			objects.clear();
+			byRelease.clear();
+		}
+		stopped=true;
+	}
+
+	///Fetch a complete listing of objects, replacing all cached data
+	bool relist(const std::string& config){
+		const KindInfo& info=kindInfo(kind);
+		commandResult result;
+		std::string listPrefix;
+		for(const auto& candidate : info.prefixes){
+			listPrefix=candidate;
+			result=apiGet(config,candidate+"/"+info.name);
+			if(result.status!=404)
+				break;
+		}
+		if(result.status){
+			log_warn("Unable to list " << info.name << " on cluster " << clusterID << ": " << result.error);
+			return false;
+		}
+
+		rapidjson::Document data;
+		data.Parse(result.output.c_str());
+		if(data.HasParseError() || !data.IsObject() || !data.HasMember("items") || !data["items"].IsArray()
+		   || !data.HasMember("metadata") || !data["metadata"].HasMember("resourceVersion")
+		   || !data["metadata"]["resourceVersion"].IsString()){
+			log_warn("Unexpected structure in listing of " << info.name << " on cluster " << clusterID);
+			return false;
+		}
+		ObjectMap newObjects;
+		ReleaseIndex newIndex;
+		for(auto& item : data["items"].GetArray())
+			storeObject(item,newObjects,newIndex);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			objects.swap(newObjects);
+			byRelease.swap(newIndex);
+		}
+		resourceVersion=data["metadata"]["resourceVersion"].GetString();
+		//watches must use the same API group which served the list
+		prefix=listPrefix;
+		lastContact=now();
+		synced=true;
+		return true;
+	}
+
+	///Follow changes from resourceVersion until the server ends the watch
+	bool watch(const std::string& config){
+		const KindInfo& info=kindInfo(kind);
+		std::string path=prefix+"/"+info.name;
+		auto handleEvent=[this](const std::string& line)->bool{
+			rapidjson::Document event;
+			event.Parse(line.c_str());
+			if(event.HasParseError() || !event.IsObject() || !event.HasMember("type")
+			   || !event["type"].IsString() || !event.HasMember("object") || !event["object"].IsObject())
+				return true; //ignore anything unintelligible
+			std::string type=event["type"].GetString();
+			rapidjson::Value& object=event["object"];
+			if(type=="ERROR"){
+				//410 Gone means our resourceVersion is too old to resume from
+				if(object.HasMember("code") && object["code"].IsInt() && object["code"].GetInt()==410)
+					resourceVersion.clear();
+				return false;
+			}
+			if(object.HasMember("metadata") && object["metadata"].IsObject()
+			   && object["metadata"].HasMember("resourceVersion")
+			   && object["metadata"]["resourceVersion"].IsString())
+				resourceVersion=object["metadata"]["resourceVersion"].GetString();
+			if(type=="ADDED" || type=="MODIFIED"){
+				std::lock_guard<std::mutex> lock(mutex);
+				removeObject(object);
+				storeObject(object,objects,byRelease);
+			}
+			else if(type=="DELETED"){
+				std::lock_guard<std::mutex> lock(mutex);
+				removeObject(object);
+			}
+			lastContact=now();
+			return true;
+		};
+
+		watching=true;
+		auto result=apiStream(config,path,
+		                      {{"watch","1"},{"resourceVersion",resourceVersion},
+		                       {"allowWatchBookmarks","true"},
+		                       {"timeoutSeconds",std::to_string(watchSeconds)}},
+		                      handleEvent,[this]{ return shouldStop(); },watchSeconds+30);
+		watching=false;
+		if(result.status==410)
+			resourceVersion.clear();
+		if(result.status){
+			log_warn("Watching " << info.name << " on cluster " << clusterID << " failed: " << result.error);
+			return false;
+		}
+		lastContact=now();
+		return true;
+	}
+
+	///\pre mutex must be held if the target containers are the live ones
+	static void storeObject(rapidjson::Value& object, ObjectMap& objects, ReleaseIndex& byRelease){
+		if(!object.IsObject() || !object.HasMember("metadata") || !object["metadata"].IsObject())
+			return;
+		rapidjson::Value& metadata=object["metadata"];
+		if(!metadata.HasMember("namespace") || !metadata["namespace"].IsString()
+		   || !metadata.HasMember("name") || !metadata["name"].IsString())
+			return;
+		std::string nspace=metadata["namespace"].GetString();
+		//only group namespaces are ever queried
+		if(nspace.find(Group::namespacePrefix())!=0)
+			return;
+		std::string name=metadata["name"].GetString();
+		//field management records are large and never used
+		metadata.RemoveMember("managedFields");
+
+		CachedObject cached;
+		if(metadata.HasMember("labels") && metadata["labels"].IsObject()){
+			for(const auto& label : metadata["labels"].GetObject()){
+				if(label.value.IsString())
+					cached.labels.emplace(label.name.GetString(),label.value.GetString());
+			}
+		}
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+		object.Accept(writer);
+		cached.json=buffer.GetString();
+
+		auto release=cached.labels.find("release");
+		if(release!=cached.labels.end())
+			byRelease[std::make_pair(nspace,release->second)].insert(name);
+		objects[std::make_pair(nspace,name)]=std::move(cached);
+	}
+
+	///\pre mutex must be held
+	void removeObject(const rapidjson::Value& object){
+		if(!object.HasMember("metadata") || !object["metadata"].IsObject())
+			return;
+		const rapidjson::Value& metadata=object["metadata"];
+		if(!metadata.HasMember("namespace") || !metadata["namespace"].IsString()
+		   || !metadata.HasMember("name") || !metadata["name"].IsString())
+			return;
+		auto key=std::make_pair(std::string(metadata["namespace"].GetString()),
+		                        std::string(metadata["name"].GetString()));
+		auto it=objects.find(key);
+		if(it==objects.end())
+			return;
+		auto release=it->second.labels.find("release");
+		if(release!=it->second.labels.end()){
+			auto indexKey=std::make_pair(key.first,release->second);
+			auto names=byRelease.find(indexKey);
+			if(names!=byRelease.end()){
+				names->second.erase(key.second);
+				if(names->second.empty())
+					byRelease.erase(names);
+			}
+		}
+		objects.erase(it);
+	}
+};
+
+///Guards informers
+std::mutex informersMutex;
+std::map<std::pair<std::string,ResourceKind>,std::shared_ptr<Informer>> informers;
+
+std::shared_ptr<Informer> getInformer(const std::string& clusterID, ResourceKind kind,
+                                      const SharedFileHandle& configPath){
+	std::lock_guard<std::mutex> lock(informersMutex);
+	auto key=std::make_pair(clusterID,kind);
+	auto it=informers.find(key);
+	if(it!=informers.end() && !it->second->isStopped()){
+		it->second->touch(configPath);
+		return it->second;
+	}
+	//forget informers which have stopped, such as those for deleted clusters
+	for(auto entry=informers.begin(); entry!=informers.end();){
+		if(entry->second->isStopped())
+			entry=informers.erase(entry);
+		else
+			entry++;
+	}
+	auto informer=std::make_shared<Informer>(clusterID,kind,configPath);
+	informers[key]=informer;
+	informer->start();
+	return informer;
+}
+
+///Fetch a listing directly from the cluster
+commandResult directList(const std::string& configPath, ResourceKind kind,
+                         const std::string& nspace, const std::string& labelSelector){
+	const KindInfo& info=kindInfo(kind);
+	std::map<std::string,std::string> query;
+	if(!labelSelector.empty())
+		query["labelSelector"]=labelSelector;
+	commandResult result;
+	for(const auto& prefix : info.prefixes){
+		result=apiGet(configPath,prefix+"/namespaces/"+nspace+"/"+info.name,query);
+		if(result.status!=404)
+			break;
+	}
+	return result;
+}
+
+} //anonymous namespace
+
+void setInformerMaxStaleness(std::chrono::seconds maxStaleness){
+	maxStalenessSeconds=maxStaleness.count();
+}
+
+commandResult listObjects(const std::string& clusterID, const SharedFileHandle& configPath,
+                          ResourceKind kind, const std::string& nspace,
+                          const std::string& labelSelector){
+	LabelRequirements requirements;
+	if(maxStalenessSeconds>0 && nspace.find(Group::namespacePrefix())==0
+	   && parseLabelSelector(labelSelector,requirements)){
+		auto informer=getInformer(clusterID,kind,configPath);
+		std::string result;
+		if(informer->list(nspace,requirements,result)){
+			cachedListings++;
+			return commandResult{std::move(result),"",0};
+		}
+	}
+	directListings++;
+	return directList(*configPath,kind,nspace,labelSelector);
+}
+
+std::string getInformerStatistics(){
+	std::size_t active=0;
+	{
+		std::lock_guard<std::mutex> lock(informersMutex);
+		for(const auto& informer : informers){
+			if(!informer.second->isStopped())
+				active++;
+		}
+	}
+	std::ostringstream os;
+	os << "Cached kubernetes listings: " << cachedListings.load() << "\n";
+	os << "Direct kubernetes listings: " << directListings.load() << "\n";
+	os << "Active informers: " << active << "\n";
+	return os.str();
+}
+
+} //namespace kubernetes
@@ -1,14 +1,199 @@
 #include "KubeInterface.h"
 
+#include <algorithm>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
 
+#include <unistd.h>
+
+#include <curl/curl.h>
+#include <yaml-cpp/yaml.h>
+
+#include "rapidjson/document.h"
+
+#include "Archive.h"
+#include "CircuitBreaker.h"
 #include "Logging.h"
+#include "Metrics.h"
+#include "OperationLanes.h"
+#include "Tracing.h"
+#include "ServerUtilities.h"
 #include "Utilities.h"
 #include "FileHandle.h"
 
 namespace kubernetes{
+
+namespace{
+	///Limits the number of kubectl and helm processes run against each 
+	///cluster, and in total
+	OperationLanes operationLanes(4,32);
+	
+	///Tracks which clusters have stopped responding, using the same names as 
+	///operationLanes
+	CircuitBreaker clusterCircuits(3,std::chrono::seconds(30));
+	
+	///The lane used for commands which do not contact any cluster, such as 
+	///inspecting a local chart. These are limited only by the total limit in 
+	///practice, and never by a circuit breaker. 
+	const std::string localLane="local";
+	
+	///Determine the lane for operations using a kubeconfig file. 
+	///PersistentStore names cluster config files <cluster ID>_v<random suffix>, 
+	///so this recovers the cluster ID, which stays the same when a cluster's 
+	///config is replaced; other files are given lanes of their own. 
+	std::string operationLane(const std::string& configPath){
+		if(configPath.empty())
+			return localLane;
+		std::string name=configPath;
+		auto slash=name.rfind('/');
+		if(slash!=std::string::npos)
+			name=name.substr(slash+1);
+		auto suffix=name.rfind("_v");
+		if(suffix!=std::string::npos && suffix>0)
+			name=name.substr(0,suffix);
+		return name;
+	}
+	
+	///\return the subcommand of a kubectl or helm command: the first argument 
+	///        which is neither a flag nor the value of a preceding flag, or an 
+	///        empty string if there is none
+	std::string subcommand(const std::vector<std::string>& arguments){
+		//global flags which take their values as separate arguments, unless 
+		//written as --flag=value
+		static const std::set<std::string> valueFlags={
+			"-n","--namespace","--kubeconfig","--context","--kube-context",
+			"--cluster","--user","-s","--server","--token","--as",
+			"--request-timeout","--tiller-namespace","--tiller-connection-timeout",
+			"--home","--host","--registry-config","--repository-config",
+			"--repository-cache","-o","--output","-l","--selector"
+		};
+		for(auto arg=arguments.begin(); arg!=arguments.end(); arg++){
+			if(arg->empty())
+				continue;
+			if((*arg)[0]!='-')
+				return *arg;
+			if(valueFlags.count(*arg) && arg+1!=arguments.end())
+				arg++;
+		}
+		return "";
+	}
+	
+	///Determine whether a kubectl or helm command only inspects the cluster, 
+	///based on its subcommand
+	OperationPriority operationPriority(const std::vector<std::string>& arguments){
+		static const std::set<std::string> readCommands={
+			//kubectl
+			"get","describe","logs","explain","top","version","api-resources",
+			"api-versions","cluster-info","auth",
+			//helm
+			"list","ls","status","history","search","inspect","show","version"
+		};
+		return readCommands.count(subcommand(arguments)) ? OperationPriority::Read : OperationPriority::Mutation;
+	}
+	
+	///Wait for permission to run a kubectl or helm command against a cluster
+	OperationLanes::Slot acquireOperationSlot(const std::string& lane,
+	                                          const std::vector<std::string>& arguments){
+		tracing::Span span("wait","operation slot for "+lane);
+		return operationLanes.acquire(lane,operationPriority(arguments));
+	}
+	
+	///Run a kubectl or helm command, recording how long it takes and whether
+	///it fails, by subcommand. Unfamiliar subcommands are grouped together so 
+	///that the number of series stays bounded.
+	commandResult runMeasuredCommand(const std::string& program,
+	                                 const std::vector<std::string>& arguments,
+	                                 const std::vector<std::string>& fullArgs,
+	                                 const std::map<std::string,std::string>& environment={}){
+		static const std::set<std::string> knownCommands={
+			"get","describe","logs","explain","top","version","api-resources",
+			"api-versions","cluster-info","auth","apply","create","delete","scale",
+			"rollout","patch","label","annotate","exec","replace","edit",
+			"list","ls","status","history","search","inspect","show","install",
+			"upgrade","uninstall","rollback","repo","fetch","pull","dependency"
+		};
+		std::string command=subcommand(arguments);
+		if(!knownCommands.count(command))
+			command="other";
+		const metrics::Labels labels={{"program",program},{"subcommand",command}};
+		commandResult result;
+		{
+			metrics::Timer timer(metrics::histogram("slate_command_duration_seconds",
+			  "Time taken by kubectl and helm commands",labels));
+			result=runCommand(program,fullArgs,environment);
+		}
+		if(result.status)
+			metrics::counter("slate_command_failures_total",
+			  "kubectl and helm commands which exited with an error",labels).add();
+		return result;
+	}
+	
+	///Determine whether a kubectl or helm command failed because the cluster 
+	///could not be contacted, rather than because of a problem with the 
+	///request itself
+	bool lostContact(const commandResult& result){
+		if(!result.status)
+			return false;
+		static const char* const symptoms[]={
+			"Unable to connect to the server",
+			"dial tcp",
+			"i/o timeout",
+			"connection refused",
+			"no route to host",
+			"context deadline exceeded",
+			"Client.Timeout exceeded",
+			"TLS handshake timeout",
+			"Kubernetes cluster unreachable",
+			"could not find tiller",
+			"could not find a ready tiller pod",
+		};
+		for(const char* symptom : symptoms){
+			if(result.error.find(symptom)!=std::string::npos)
+				return true;
+		}
+		return false;
+	}
+	
+	///The result reported for commands which are not attempted because the 
+	///cluster is known to be unreachable
+	commandResult unreachableResult(const std::string& lane){
+		return commandResult{"","Not contacting "+lane+" because it has recently been unreachable",1};
+	}
+}
+
+bool clusterAvailable(const std::string& clusterID){
+	return clusterCircuits.state(clusterID)==CircuitBreaker::State::Closed;
+}
+
+bool clusterRetryDue(const std::string& clusterID){
+	return clusterCircuits.retryDue(clusterID);
+}
+
+void setOperationLimits(std::size_t perClusterLimit, std::size_t totalLimit){
+	operationLanes.setLimits(perClusterLimit,totalLimit);
+}
+
+std::string getOperationStatistics(){
+	std::ostringstream os;
+	for(const auto& lane : operationLanes.getStatistics()){
+		os << "Cluster operations " << lane.lane << ": " << lane.running << " running"
+		   << ", " << lane.queued << " queued (max " << lane.maxQueued << ")"
+		   << ", " << lane.started << " started"
+		   << ", wait mean " << (lane.started ? lane.totalWait/lane.started*1e3 : 0) << " ms"
+		   << " max " << lane.maxWait*1e3 << " ms\n";
+	}
+	for(const auto& circuit : clusterCircuits.getStatistics()){
+		os << "Cluster circuit " << circuit.target << ": " << to_string(circuit.state)
+		   << ", " << circuit.failures << " consecutive failures"
+		   << ", opened " << circuit.trips << " times"
+		   << ", " << circuit.refused << " commands refused\n";
+	}
+	return os.str();
+}
 	
 commandResult kubectl(const std::string& configPath,
                       const std::vector<std::string>& arguments){
@@ -16,11 +201,407 @@ commandResult kubectl(const std::string& configPath,
 	fullArgs.push_back("--request-timeout=10s");
 	fullArgs.push_back("--kubeconfig="+configPath);
 	std::copy(arguments.begin(),arguments.end(),std::back_inserter(fullArgs));
-	auto result=runCommand("kubectl",fullArgs);
+	const std::string lane=operationLane(configPath);
+	const bool remote=lane!=localLane;
+	tracing::Span span("kubectl",subcommand(arguments)+" on "+lane);
+	if(remote && !clusterCircuits.allow(lane))
+		return unreachableResult(lane);
+	auto slot=acquireOperationSlot(lane,arguments);
+	auto result=runMeasuredCommand("kubectl",arguments,fullArgs);
+	if(remote)
+		clusterCircuits.record(lane,!lostContact(result));
 	return commandResult{removeShellEscapeSequences(result.output),
 	                     removeShellEscapeSequences(result.error),result.status};
 }
 
+namespace{
+	///The information needed to make requests to one cluster's API server, 
+	///derived from a kubeconfig file, together with a pool of idle curl handles
+	///whose open connections can be reused by later requests. 
+	struct APIEndpoint{
+		///The base URL of the API server
+		std::string server;
+		///The namespace selected by the config's current context
+		std::string defaultNamespace;
+		///Whether the server's certificate should go unchecked
+		bool insecure=false;
+		std::string caPath;
+		std::string certPath;
+		std::string keyPath;
+		std::string userPassword;
+		///Headers sent with every request, including any bearer token
+		curl_slist* headers=nullptr;
+		///Files holding credentials which were embedded in the kubeconfig
+		std::vector<FileHandle> credentialFiles;
+		
+		///Guards idleHandles
+		std::mutex idleMutex;
+		std::vector<CURL*> idleHandles;
+		
+		///The largest number of idle handles (and so connections) to keep
+		const static std::size_t maxIdleHandles=8;
+		
+		APIEndpoint()=default;
+		APIEndpoint(const APIEndpoint&)=delete;
+		APIEndpoint& operator=(const APIEndpoint&)=delete;
+		~APIEndpoint(){
+			for(CURL* handle : idleHandles)
+				curl_easy_cleanup(handle);
+			curl_slist_free_all(headers);
+		}
+		
+		///Get a handle configured to talk to this endpoint, which may already 
+		///have a connection open
+		///\throws std::runtime_error
+		CURL* acquireHandle();
+		///Return a handle for reuse
+		void releaseHandle(CURL* handle);
+	};
+	
+	size_t appendResponseData(char* data, size_t size, size_t nmemb, void* userp){
+		static_cast<std::string*>(userp)->append(data,size*nmemb);
+		return size*nmemb;
+	}
+	
+	CURL* APIEndpoint::acquireHandle(){
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			if(!idleHandles.empty()){
+				CURL* handle=idleHandles.back();
+				idleHandles.pop_back();
+				return handle;
+			}
+		}
+		CURL* handle=curl_easy_init();
+		if(!handle)
+			throw std::runtime_error("Failed to initialize curl handle");
+		//requests are made from many threads, so signals must not be used for timeouts
+		curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(handle, CURLOPT_TIMEOUT, 10L); //same as kubectl's --request-timeout
+		curl_easy_setopt(handle, CURLOPT_HTTPHEADER, headers);
+		curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &appendResponseData);
+		if(!caPath.empty())
+			curl_easy_setopt(handle, CURLOPT_CAINFO, caPath.c_str());
+		if(insecure){
+			curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
+			curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L);
+		}
+		if(!certPath.empty())
+			curl_easy_setopt(handle, CURLOPT_SSLCERT, certPath.c_str());
+		if(!keyPath.empty())
+			curl_easy_setopt(handle, CURLOPT_SSLKEY, keyPath.c_str());
+		if(!userPassword.empty())
+			curl_easy_setopt(handle, CURLOPT_USERPWD, userPassword.c_str());
+		return handle;
+	}
+	
+	void APIEndpoint::releaseHandle(CURL* handle){
+		{
+			std::lock_guard<std::mutex> lock(idleMutex);
+			if(idleHandles.size()<maxIdleHandles){
+				idleHandles.push_back(handle);
+				return;
+			}
+		}
+		curl_easy_cleanup(handle);
+	}
+	
+	///Find the contents of the entry with the given name in one of a kubeconfig's 
+	///lists of clusters, contexts, or users
+	///\param list the list to search
+	///\param name the name of the entry to find
+	///\param field the key under which the entry stores its contents
+	///\throws std::runtime_error if no such entry exists
+	YAML::Node findNamedEntry(const YAML::Node& list, const std::string& name, 
+	                          const std::string& field){
+		if(list && list.IsSequence()){
+			for(const auto& entry : list){
+				if(entry["name"] && entry["name"].as<std::string>()==name && entry[field])
+					return entry[field];
+			}
+		}
+		throw std::runtime_error("No "+field+" named "+name);
+	}
+	
+	///\throws std::runtime_error if the config has no usable current context
+	YAML::Node findCurrentContext(const YAML::Node& config){
+		if(config["current-context"] && !config["current-context"].as<std::string>().empty())
+			return findNamedEntry(config["contexts"],config["current-context"].as<std::string>(),"context");
+		//with no current context, an unambiguous choice is still acceptable
+		if(config["contexts"] && config["contexts"].IsSequence() 
+		   && config["contexts"].size()==1 && config["contexts"][0]["context"])
+			return config["contexts"][0]["context"];
+		throw std::runtime_error("No current context is set");
+	}
+	
+	///Write credential data embedded in a kubeconfig to a file, so that it can 
+	///be passed to curl. The file will be removed with the endpoint. 
+	///\param endpoint the endpoint which will use the credential
+	///\param configPath the kubeconfig from which the data came
+	///\param encoded the base64 encoded credential data
+	///\return the path to the file
+	std::string storeEmbeddedCredential(APIEndpoint& endpoint, const std::string& configPath, 
+	                                    const std::string& encoded){
+		FileHandle file=makeTemporaryFile(configPath+"_cred_");
+		std::ofstream out(file.path());
+		out << decodeBase64(encoded);
+		out.close();
+		if(!out)
+			throw std::runtime_error("Unable to write credential file "+file.path());
+		std::string path=file.path();
+		endpoint.credentialFiles.push_back(std::move(file));
+		return path;
+	}
+	
+	///\throws std::runtime_error if the config cannot be read or requires 
+	///        features which only kubectl supports
+	std::shared_ptr<APIEndpoint> loadEndpoint(const std::string& configPath){
+		auto endpoint=std::make_shared<APIEndpoint>();
+		
+		YAML::Node config;
+		try{
+			config=YAML::LoadFile(configPath);
+		}catch(YAML::Exception& ex){
+			throw std::runtime_error(std::string("Unable to parse config: ")+ex.what());
+		}
+		const YAML::Node context=findCurrentContext(config);
+		if(!context["cluster"])
+			throw std::runtime_error("Current context has no cluster");
+		const YAML::Node cluster=findNamedEntry(config["clusters"],context["cluster"].as<std::string>(),"cluster");
+		if(context["namespace"])
+			endpoint->defaultNamespace=context["namespace"].as<std::string>();
+		else
+			endpoint->defaultNamespace="default";
+		
+		if(!cluster["server"])
+			throw std::runtime_error("Cluster has no server address");
+		endpoint->server=cluster["server"].as<std::string>();
+		while(!endpoint->server.empty() && endpoint->server.back()=='/')
+			endpoint->server.pop_back();
+		if(cluster["insecure-skip-tls-verify"])
+			endpoint->insecure=cluster["insecure-skip-tls-verify"].as<bool>();
+		if(cluster["certificate-authority-data"])
+			endpoint->caPath=storeEmbeddedCredential(*endpoint,configPath,cluster["certificate-authority-data"].as<std::string>());
+		else if(cluster["certificate-authority"])
+			endpoint->caPath=cluster["certificate-authority"].as<std::string>();
+		
+		std::string token;
+		if(context["user"]){
+			const YAML::Node user=findNamedEntry(config["users"],context["user"].as<std::string>(),"user");
+			if(user["exec"] || user["auth-provider"])
+				throw std::runtime_error("Authentication plugins are not supported");
+			if(user["token"])
+				token=user["token"].as<std::string>();
+			else if(user["tokenFile"]){
+				std::ifstream tokenFile(user["tokenFile"].as<std::string>());
+				if(!tokenFile)
+					throw std::runtime_error("Unable to read token file "+user["tokenFile"].as<std::string>());
+				std::getline(tokenFile,token);
+			}
+			if(user["client-certificate-data"])
+				endpoint->certPath=storeEmbeddedCredential(*endpoint,configPath,user["client-certificate-data"].as<std::string>());
+			else if(user["client-certificate"])
+				endpoint->certPath=user["client-certificate"].as<std::string>();
+			if(user["client-key-data"])
+				endpoint->keyPath=storeEmbeddedCredential(*endpoint,configPath,user["client-key-data"].as<std::string>());
+			else if(user["client-key"])
+				endpoint->keyPath=user["client-key"].as<std::string>();
+			if(user["username"] && user["password"])
+				endpoint->userPassword=user["username"].as<std::string>()+":"+user["password"].as<std::string>();
+		}
+		
+		endpoint->headers=curl_slist_append(endpoint->headers,"Accept: application/json, */*");
+		if(!token.empty())
+			endpoint->headers=curl_slist_append(endpoint->headers,("Authorization: Bearer "+trim(token)).c_str());
+		return endpoint;
+	}
+	
+	///Guards endpoints
+	std::mutex endpointsMutex;
+	///Loaded endpoints, indexed by the path of the config file from which each 
+	///was loaded
+	std::map<std::string,std::shared_ptr<APIEndpoint>> endpoints;
+	
+	///\throws std::runtime_error
+	std::shared_ptr<APIEndpoint> getEndpoint(const std::string& configPath){
+		std::lock_guard<std::mutex> lock(endpointsMutex);
+		auto it=endpoints.find(configPath);
+		if(it!=endpoints.end())
+			return it->second;
+		//Cluster config files are rewritten under new names whenever cluster 
+		//records are refreshed, so this is a good time to forget endpoints 
+		//whose files have since been removed.
+		for(auto entry=endpoints.begin(); entry!=endpoints.end();){
+			if(access(entry->first.c_str(),F_OK)!=0)
+				entry=endpoints.erase(entry);
+			else
+				entry++;
+		}
+		auto endpoint=loadEndpoint(configPath);
+		endpoints.emplace(configPath,endpoint);
+		return endpoint;
+	}
+	
+	std::string escapeQueryComponent(CURL* handle, const std::string& raw){
+		char* escaped=curl_easy_escape(handle,raw.c_str(),raw.size());
+		if(!escaped)
+			throw std::runtime_error("Failed to escape query parameter");
+		std::string result(escaped);
+		curl_free(escaped);
+		return result;
+	}
+	
+	///Get the message from a kubernetes Status object returned in place of a 
+	///requested resource, or the whole response if it is not one
+	std::string extractStatusMessage(const std::string& body){
+		rapidjson::Document status;
+		status.Parse(body.c_str());
+		if(!status.HasParseError() && status.IsObject() && status.HasMember("message")
+		   && status["message"].IsString())
+			return status["message"].GetString();
+		return body;
+	}
+}
+
+commandResult apiGet(const std::string& configPath, const std::string& path, 
+                     const std::map<std::string,std::string>& query){
+	std::shared_ptr<APIEndpoint> endpoint;
+	CURL* handle=nullptr;
+	std::string url;
+	try{
+		endpoint=getEndpoint(configPath);
+		handle=endpoint->acquireHandle();
+		url=endpoint->server+path;
+		char separator='?';
+		for(const auto& parameter : query){
+			url+=separator;
+			url+=escapeQueryComponent(handle,parameter.first)+"="+escapeQueryComponent(handle,parameter.second);
+			separator='&';
+		}
+	}catch(std::runtime_error& err){
+		if(handle)
+			endpoint->releaseHandle(handle);
+		return commandResult{"","Unable to use "+configPath+" to contact the cluster: "+err.what(),1};
+	}
+	
+	const std::string lane=operationLane(configPath);
+	tracing::Span span("kubeapi",path);
+	if(!clusterCircuits.allow(lane)){
+		endpoint->releaseHandle(handle);
+		return unreachableResult(lane);
+	}
+	std::string body;
+	curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, &body);
+	CURLcode err=curl_easy_perform(handle);
+	long code=0;
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
+	endpoint->releaseHandle(handle);
+	//any response at all shows that the cluster can be reached
+	clusterCircuits.record(lane,err==CURLE_OK);
+	
+	if(err!=CURLE_OK)
+		return commandResult{"","Request to "+url+" failed: "+curl_easy_strerror(err),1};
+	if(code!=200)
+		return commandResult{"",extractStatusMessage(body),(int)code};
+	return commandResult{std::move(body),"",0};
+}
+
+namespace{
+	///The progress of a streaming request
+	struct StreamState{
+		CURL* handle;
+		const std::function<bool(const std::string&)>& lineHandler;
+		const std::function<bool()>& cancelled;
+		///Data received but not yet passed to the handler, or the error 
+		///response body
+		std::string pending;
+		///Whether the handler asked for the request to end
+		bool finished;
+	};
+	
+	size_t streamResponseData(char* data, size_t size, size_t nmemb, void* userp){
+		StreamState& state=*static_cast<StreamState*>(userp);
+		state.pending.append(data,size*nmemb);
+		long code=0;
+		curl_easy_getinfo(state.handle, CURLINFO_RESPONSE_CODE, &code);
+		if(code!=200) //keep the whole body to report as an error
+			return size*nmemb;
+		std::size_t start=0, end;
+		while((end=state.pending.find('\n',start))!=std::string::npos){
+			if(end>start && !state.lineHandler(state.pending.substr(start,end-start))){
+				state.finished=true;
+				return 0;
+			}
+			start=end+1;
+		}
+		state.pending.erase(0,start);
+		return size*nmemb;
+	}
+	
+	int checkStreamCancelled(void* userp, curl_off_t, curl_off_t, curl_off_t, curl_off_t){
+		StreamState& state=*static_cast<StreamState*>(userp);
+		return state.cancelled() ? 1 : 0;
+	}
+}
+
+commandResult apiStream(const std::string& configPath, const std::string& path, 
+                        const std::map<std::string,std::string>& query,
+                        const std::function<bool(const std::string&)>& lineHandler,
+                        const std::function<bool()>& cancelled,
+                        unsigned long timeout){
+	std::shared_ptr<APIEndpoint> endpoint;
+	CURL* handle=nullptr;
+	std::string url;
+	try{
+		endpoint=getEndpoint(configPath);
+		handle=endpoint->acquireHandle();
+		url=endpoint->server+path;
+		char separator='?';
+		for(const auto& parameter : query){
+			url+=separator;
+			url+=escapeQueryComponent(handle,parameter.first)+"="+escapeQueryComponent(handle,parameter.second);
+			separator='&';
+		}
+	}catch(std::runtime_error& err){
+		if(handle)
+			curl_easy_cleanup(handle);
+		return commandResult{"","Unable to use "+configPath+" to contact the cluster: "+err.what(),1};
+	}
+	
+	StreamState state{handle,lineHandler,cancelled,"",false};
+	curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(handle, CURLOPT_TIMEOUT, (long)timeout);
+	curl_easy_setopt(handle, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, &streamResponseData);
+	curl_easy_setopt(handle, CURLOPT_WRITEDATA, &state);
+	curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, &checkStreamCancelled);
+	curl_easy_setopt(handle, CURLOPT_XFERINFODATA, &state);
+	curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+	CURLcode err=curl_easy_perform(handle);
+	long code=0;
+	curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &code);
+	//this handle's settings no longer match the rest of the pool, so it is not 
+	//returned to it
+	curl_easy_cleanup(handle);
+	
+	if(state.finished || err==CURLE_ABORTED_BY_CALLBACK)
+		return commandResult{"","",0};
+	//running out of time after the response has started is an ordinary end
+	if(err!=CURLE_OK && !(err==CURLE_OPERATION_TIMEDOUT && code==200))
+		return commandResult{"","Request to "+url+" failed: "+curl_easy_strerror(err),1};
+	if(code!=200)
+		return commandResult{"",extractStatusMessage(state.pending),(int)code};
+	if(!state.pending.empty())
+		lineHandler(state.pending);
+	return commandResult{"","",0};
+}
+
+std::string defaultNamespace(const std::string& configPath){
+	return getEndpoint(configPath)->defaultNamespace;
+}
+
 void kubectl_create_namespace(const std::string& clusterConfig, const Group& group) {
 	std::string input=
 R"(apiVersion: nrp-nautilus.io/v1alpha1
@@ -33,7 +614,7 @@ metadata:
 	tmpfile << input;
 	tmpfile.close();
 	
-	auto result=runCommand("kubectl",{"--kubeconfig",clusterConfig,"create","-f",tmpFile});
+	auto result=kubectl(clusterConfig,{"create","-f",tmpFile});
 	if(result.status){
 		//if the namespace already existed we do not have a problem, otherwise we do
 		if(result.error.find("AlreadyExists")==std::string::npos)
@@ -42,8 +623,7 @@ metadata:
 }
 
 void kubectl_delete_namespace(const std::string& clusterConfig, const Group& group) {
-	auto result=runCommand("kubectl",{"--kubeconfig",clusterConfig,
-		"delete","clusternamespace",group.namespaceName()});
+	auto result=kubectl(clusterConfig,{"delete","clusternamespace",group.namespaceName()});
 	if(result.status){
 		//if the namespace did not exist we do not have a problem, otherwise we do
 		if(result.error.find("NotFound")==std::string::npos)
@@ -55,41 +635,106 @@ commandResult helm(const std::string& configPath,
                    const std::string& tillerNamespace,
                    const std::vector<std::string>& arguments){
 	std::vector<std::string> fullArgs;
-	if(getHelmMajorVersion()==2){
+	if(getHelmCapabilities()->usesTiller){
 		fullArgs.push_back("--tiller-namespace="+tillerNamespace);
 		fullArgs.push_back("--tiller-connection-timeout=10");
 	}
 	std::copy(arguments.begin(),arguments.end(),std::back_inserter(fullArgs));
-	return runCommand("helm",fullArgs,{{"KUBECONFIG",configPath}});
+	const std::string lane=operationLane(configPath);
+	const bool remote=lane!=localLane;
+	tracing::Span span("helm",subcommand(arguments)+" on "+lane);
+	if(remote && !clusterCircuits.allow(lane))
+		return unreachableResult(lane);
+	auto slot=acquireOperationSlot(lane,arguments);
+	auto result=runMeasuredCommand("helm",arguments,fullArgs,{{"KUBECONFIG",configPath}});
+	if(remote)
+		clusterCircuits.record(lane,!lostContact(result));
+	return result;
 }
 
-unsigned int getHelmMajorVersion(){
-	auto commandResult = runCommand("helm",{"version"});
-	unsigned int helmMajorVersion=0;
-	for(const auto line : string_split_lines(commandResult.output)){
-		if(line.find("Server: ")==0) //ignore tiller version
-			continue;
-		std::string marker="SemVer:\"v";
-		auto startPos=line.find(marker);
-		if(startPos==std::string::npos){
-			marker="Version:\"v";
-			startPos=line.find(marker);
-			if(startPos==std::string::npos)
-				continue; //give up :(
-		}
-		startPos+=marker.size();
-		if(startPos>=line.size()-1) //also weird
-			continue;
-		auto endPos=line.find('.',startPos+1);
-		try{
-			helmMajorVersion=std::stoul(line.substr(startPos,endPos-startPos));
-		}catch(std::exception& ex){
+namespace{
+	///The most recently probed helm capabilities, if any
+	std::shared_ptr<const HelmCapabilities> helmCapabilities;
+	///Serializes probing, and guards helmCapabilities
+	std::mutex helmCapabilitiesMutex;
+	
+	unsigned int extractHelmMajorVersion(const std::string& versionOutput){
+		unsigned int helmMajorVersion=0;
+		for(const auto line : string_split_lines(versionOutput)){
+			if(line.find("Server: ")==0) //ignore tiller version
+				continue;
+			std::string marker="SemVer:\"v";
+			auto startPos=line.find(marker);
+			if(startPos==std::string::npos){
+				marker="Version:\"v";
+				startPos=line.find(marker);
+				if(startPos==std::string::npos)
+					continue; //give up :(
+			}
+			startPos+=marker.size();
+			if(startPos>=line.size()-1) //also weird
+				continue;
+			auto endPos=line.find('.',startPos+1);
+			try{
+				helmMajorVersion=std::stoul(line.substr(startPos,endPos-startPos));
+			}catch(std::exception& ex){
+				throw std::runtime_error("Unable to extract helm version");
+			}
+		}
+		if(!helmMajorVersion)
 			throw std::runtime_error("Unable to extract helm version");
+		return helmMajorVersion;
+	}
+	
+	std::shared_ptr<const HelmCapabilities> probeHelmCapabilities(){
+		std::shared_ptr<HelmCapabilities> capabilities=std::make_shared<HelmCapabilities>();
+		
+		capabilities->majorVersion=extractHelmMajorVersion(runCommand("helm",{"version"}).output);
+		capabilities->usesTiller=capabilities->majorVersion==2;
+		capabilities->deleteRequiresPurge=capabilities->majorVersion==2;
+		capabilities->installRequiresNameFlag=capabilities->majorVersion==2;
+		capabilities->searchRequiresRepoSubcommand=capabilities->majorVersion>=3;
+		capabilities->searchColumnWidthFlag=(capabilities->majorVersion==2 ? 
+		                                     "--col-width=1024" : "--max-col-width=1024");
+		
+		//helm 3 treats having no repositories as an error, so a failure here 
+		//just leaves the list empty
+		auto repoResult=runCommand("helm",{"repo","list"});
+		if(repoResult.status==0){
+			auto lines=string_split_lines(repoResult.output);
+			//skip headers on first line
+			for(std::size_t i=1; i<lines.size(); i++){
+				auto tokens=string_split_columns(lines[i],'\t');
+				if(!tokens.empty() && !trim(tokens[0]).empty())
+					capabilities->repositories.push_back(trim(tokens[0]));
+			}
 		}
+		
+		log_info("Helm major version is " << capabilities->majorVersion << ", with " 
+		         << capabilities->repositories.size() << " repositories configured");
+		return capabilities;
 	}
-	if(!helmMajorVersion)
-		throw std::runtime_error("Unable to extract helm version");
-	return helmMajorVersion;
+}
+
+bool HelmCapabilities::hasRepository(const std::string& name) const{
+	return std::find(repositories.begin(),repositories.end(),name)!=repositories.end();
+}
+
+std::shared_ptr<const HelmCapabilities> refreshHelmCapabilities(){
+	std::lock_guard<std::mutex> lock(helmCapabilitiesMutex);
+	helmCapabilities=probeHelmCapabilities();
+	return helmCapabilities;
+}
+
+std::shared_ptr<const HelmCapabilities> getHelmCapabilities(){
+	std::lock_guard<std::mutex> lock(helmCapabilitiesMutex);
+	if(!helmCapabilities)
+		helmCapabilities=probeHelmCapabilities();
+	return helmCapabilities;
+}
+
+unsigned int getHelmMajorVersion(){
+	return getHelmCapabilities()->majorVersion;
 }
 
 }
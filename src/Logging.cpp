@@ -1,4 +1,214 @@
 #include <Logging.h>
 
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
 logTarget logStdout{std::cout};
 logTarget logStderr{std::cerr};
+
+std::atomic<LogLevel> minimumLogLevel(LogLevel::Info);
+
+void setLogLevel(LogLevel level){
+	//fatal messages cannot be suppressed
+	if(level>LogLevel::Fatal)
+		level=LogLevel::Fatal;
+	minimumLogLevel.store(level);
+}
+
+void logTimestamp(std::ostream& os){
+	thread_local std::time_t cachedSecond=-1;
+	thread_local char cachedDateTime[32];
+
+	auto now=std::chrono::duration_cast<std::chrono::microseconds>(
+	  std::chrono::system_clock::now().time_since_epoch()).count();
+	std::time_t second=now/1000000;
+	if(second!=cachedSecond){
+		std::tm parts;
+		gmtime_r(&second,&parts);
+		std::strftime(cachedDateTime,sizeof(cachedDateTime),"%Y-%b-%d %H:%M:%S",&parts);
+		cachedSecond=second;
+	}
+	char fraction[16];
+	std::snprintf(fraction,sizeof(fraction),".%06ld UTC",(long)(now%1000000));
+	os << cachedDateTime << fraction;
+}
+
+const std::size_t logTarget::capacity;
+
+logTarget::logTarget(std::ostream& stream):
+stream(stream),slots(new Slot[capacity]),enqueuePosition(0),dequeuePosition(0),
+writtenPosition(0),written(0),dropped(0),delayed(0),
+started(false),writerSleeping(false),stopping(false){
+	for(std::size_t i=0; i<capacity; i++)
+		slots[i].sequence.store(i,std::memory_order_relaxed);
+}
+
+logTarget::~logTarget(){
+	if(writer.joinable()){
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			stopping=true;
+		}
+		wakeCondition.notify_one();
+		writer.join();
+	}
+	stopping=true;
+	//write anything which was never picked up
+	std::lock_guard<std::mutex> lock(streamMutex);
+	std::string msg;
+	while(tryPop(msg))
+		stream << msg;
+	stream.flush();
+}
+
+void logTarget::start(){
+	if(started.load() || stopping.load())
+		return;
+	writer=std::thread(&logTarget::writeMessages,this);
+	started=true;
+}
+
+void logTarget::write(std::string msg, LogLevel level){
+	if(!started.load() || stopping.load()){
+		writeDirectly(msg);
+		return;
+	}
+	if(!tryPush(msg)){
+		if(level==LogLevel::Info){
+			dropped++;
+			return;
+		}
+		delayed++;
+		do{
+			std::this_thread::yield();
+		}while(!tryPush(msg));
+	}
+	//Either the writer sees the new message before it sleeps, or this sees 
+	//that it is sleeping. Taking the lock ensures that the writer cannot be 
+	//between checking for messages and waiting when it is notified. 
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(writerSleeping.load()){
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wakeCondition.notify_one();
+	}
+}
+
+void logTarget::flush(){
+	if(!started.load() || stopping.load())
+		return;
+	const std::size_t target=enqueuePosition.load();
+	std::unique_lock<std::mutex> lock(wakeMutex);
+	wakeCondition.notify_one();
+	flushedCondition.wait_for(lock,std::chrono::seconds(1),
+	                          [this,target]{ return writtenPosition.load()>=target; });
+}
+
+void logTarget::writeNow(const std::string& msg){
+	flush();
+	writeDirectly(msg);
+}
+
+void logTarget::writeDirectly(const std::string& msg){
+	std::lock_guard<std::mutex> lock(streamMutex);
+	stream << msg;
+	stream.flush();
+}
+
+bool logTarget::tryPush(std::string& msg){
+	Slot* slot;
+	std::size_t position=enqueuePosition.load(std::memory_order_relaxed);
+	while(true){
+		slot=&slots[position&(capacity-1)];
+		std::size_t sequence=slot->sequence.load(std::memory_order_acquire);
+		std::ptrdiff_t difference=(std::ptrdiff_t)sequence-(std::ptrdiff_t)position;
+		if(difference==0){
+			//the slot is free; try to claim it
+			if(enqueuePosition.compare_exchange_weak(position,position+1,std::memory_order_relaxed))
+				break;
+		}
+		else if(difference<0) //the slot still holds a message from the last cycle
+			return false;
+		else //another thread claimed the slot first
+			position=enqueuePosition.load(std::memory_order_relaxed);
+	}
+	slot->message=std::move(msg);
+	slot->sequence.store(position+1,std::memory_order_release);
+	return true;
+}
+
+bool logTarget::messageReady() const{
+	const Slot& slot=slots[dequeuePosition&(capacity-1)];
+	return slot.sequence.load(std::memory_order_acquire)==dequeuePosition+1;
+}
+
+bool logTarget::tryPop(std::string& msg){
+	Slot& slot=slots[dequeuePosition&(capacity-1)];
+	std::size_t sequence=slot.sequence.load(std::memory_order_acquire);
+	if(sequence!=dequeuePosition+1)
+		return false;
+	msg=std::move(slot.message);
+	slot.message=std::string();
+	slot.sequence.store(dequeuePosition+capacity,std::memory_order_release);
+	dequeuePosition++;
+	return true;
+}
+
+void logTarget::writeMessages(){
+	//the largest amount of text to collect before writing it out
+	const std::size_t maxBatchSize=1<<16;
+	std::string batch, msg;
+	std::size_t reportedDrops=0;
+	while(true){
+		std::size_t count=0;
+		batch.clear();
+		while(batch.size()<maxBatchSize && tryPop(msg)){
+			batch+=msg;
+			count++;
+		}
+		//note in the log itself where messages are missing
+		std::size_t drops=dropped.load();
+		if(drops!=reportedDrops){
+			std::ostringstream note;
+			note << "WARN: [";
+			logTimestamp(note);
+			note << "] " << (drops-reportedDrops) << " log messages were dropped because the log queue was full\n";
+			batch+=note.str();
+			reportedDrops=drops;
+		}
+		if(!batch.empty()){
+			{
+				std::lock_guard<std::mutex> lock(streamMutex);
+				stream.write(batch.data(),batch.size());
+				stream.flush();
+			}
+			written+=count;
+			writtenPosition=dequeuePosition;
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			flushedCondition.notify_all();
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		if(stopping)
+			break;
+		writerSleeping=true;
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		wakeCondition.wait(lock,[this,reportedDrops]{
+			return stopping.load() || messageReady() || dropped.load()!=reportedDrops;
+		});
+		writerSleeping=false;
+	}
+}
+
+void startLogWriters(){
+	logStdout.start();
+	logStderr.start();
+}
+
+std::string getLoggingStatistics(){
+	std::ostringstream os;
+	os << "Log messages written: " << (logStdout.writtenCount()+logStderr.writtenCount()) << "\n";
+	os << "Log messages dropped: " << (logStdout.droppedCount()+logStderr.droppedCount()) << "\n";
+	os << "Log messages delayed by full queues: " << (logStdout.delayedCount()+logStderr.delayedCount()) << "\n";
+	return os.str();
+}
@@ -0,0 +1,226 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include <libcuckoo/cuckoohash_map.hh>
+
+namespace metrics{
+
+namespace{
+	///The cell which will be assigned to the next thread which needs one
+	std::atomic<std::size_t> nextCell(0);
+}
+
+std::size_t currentCell(){
+	thread_local std::size_t cell=nextCell++%cellCount;
+	return cell;
+}
+
+Counter::Counter(){
+	for(auto& cell : cells)
+		cell.count.store(0,std::memory_order_relaxed);
+}
+
+std::uint64_t Counter::value() const{
+	std::uint64_t total=0;
+	for(const auto& cell : cells)
+		total+=cell.count.load(std::memory_order_relaxed);
+	return total;
+}
+
+const std::size_t Histogram::bucketCount;
+
+Histogram::Histogram(){
+	for(auto& cell : cells){
+		for(auto& bucket : cell.buckets)
+			bucket.store(0,std::memory_order_relaxed);
+		cell.sum.store(0,std::memory_order_relaxed);
+	}
+}
+
+std::size_t Histogram::bucketIndex(std::uint64_t micros){
+	//the first four buckets are each one microsecond wide
+	if(micros<4)
+		return micros;
+	//after that, each power of two is divided into four buckets
+	unsigned int exponent=63-__builtin_clzll(micros);
+	std::size_t subBucket=(micros>>(exponent-2))&3;
+	return std::min(4*(exponent-1)+subBucket,bucketCount-1);
+}
+
+double Histogram::bucketUpperBound(std::size_t index){
+	if(index<4)
+		return (index+1)/1e6;
+	unsigned int exponent=index/4+1;
+	std::uint64_t subBucket=index%4;
+	return ((5+subBucket)<<(exponent-2))/1e6;
+}
+
+void Histogram::record(std::chrono::nanoseconds duration){
+	std::uint64_t nanos=std::max(duration.count(),(std::chrono::nanoseconds::rep)0);
+	Cell& cell=cells[currentCell()];
+	cell.buckets[bucketIndex(nanos/1000)].fetch_add(1,std::memory_order_relaxed);
+	cell.sum.fetch_add(nanos,std::memory_order_relaxed);
+}
+
+Histogram::Snapshot Histogram::snapshot() const{
+	Snapshot result;
+	result.buckets.assign(bucketCount,0);
+	result.count=0;
+	std::uint64_t sum=0;
+	for(const auto& cell : cells){
+		for(std::size_t i=0; i<bucketCount; i++){
+			std::uint64_t count=cell.buckets[i].load(std::memory_order_relaxed);
+			result.buckets[i]+=count;
+			result.count+=count;
+		}
+		sum+=cell.sum.load(std::memory_order_relaxed);
+	}
+	result.sum=sum/1e9;
+	return result;
+}
+
+namespace{
+	enum class MetricType{ Counter, Histogram };
+
+	///One series of a metric
+	struct Series{
+		std::string name;
+		std::string help;
+		Labels labels;
+		MetricType type;
+		std::unique_ptr<Counter> counter;
+		std::unique_ptr<Histogram> histogram;
+	};
+
+	///All series, keyed by their names and labels
+	cuckoohash_map<std::string,std::shared_ptr<Series>> registry;
+
+	///Format labels as they appear in the exposition format, excluding the
+	///enclosing braces
+	std::string formatLabels(const Labels& labels){
+		std::string result;
+		for(const auto& label : labels){
+			if(!result.empty())
+				result+=',';
+			result+=label.first;
+			result+="=\"";
+			for(char c : label.second){
+				switch(c){
+					case '\\': result+="\\\\"; break;
+					case '"': result+="\\\""; break;
+					case '\n': result+="\\n"; break;
+					default: result+=c;
+				}
+			}
+			result+='"';
+		}
+		return result;
+	}
+
+	///Find a series, creating it if it does not exist
+	///\throws std::runtime_error if the metric already exists with another type
+	Series& findSeries(const std::string& name, const std::string& help,
+	                   const Labels& labels, MetricType type){
+		const std::string key=name+'{'+formatLabels(labels)+'}';
+		std::shared_ptr<Series> series;
+		if(!registry.find(key,series)){
+			std::shared_ptr<Series> created=std::make_shared<Series>();
+			created->name=name;
+			created->help=help;
+			created->labels=labels;
+			created->type=type;
+			if(type==MetricType::Counter)
+				created->counter.reset(new Counter);
+			else
+				created->histogram.reset(new Histogram);
+			//if another thread created the series first, use its copy
+			registry.insert(key,created);
+			registry.find(key,series);
+		}
+		if(series->type!=type)
+			throw std::runtime_error("Metric "+name+" used with inconsistent types");
+		return *series;
+	}
+
+	///The bucket bounds included in exported histograms: every second power
+	///of two, from 16 microseconds to about 4.5 minutes, each of which is the
+	///upper bound of an internal bucket
+	std::vector<std::size_t> exportedBuckets(){
+		std::vector<std::size_t> indices;
+		for(std::size_t i=4; i<Histogram::bucketCount; i++){
+			double bound=Histogram::bucketUpperBound(i);
+			//the last sub-bucket of each power of two ends at the next power
+			if(i%4==3 && (i/4)%2==0 && bound>=16e-6 && bound<300)
+				indices.push_back(i);
+		}
+		return indices;
+	}
+}
+
+Counter& counter(const std::string& name, const std::string& help, const Labels& labels){
+	return *findSeries(name,help,labels,MetricType::Counter).counter;
+}
+
+Histogram& histogram(const std::string& name, const std::string& help, const Labels& labels){
+	return *findSeries(name,help,labels,MetricType::Histogram).histogram;
+}
+
+std::string exportPrometheus(){
+	//collect all series, sorted so that those of each metric are together
+	std::map<std::string,std::shared_ptr<Series>> sorted;
+	{
+		auto table=registry.lock_table();
+		for(const auto& entry : table)
+			sorted.emplace(entry.first,entry.second);
+	}
+	static const std::vector<std::size_t> bucketIndices=exportedBuckets();
+
+	std::ostringstream os;
+	//bucket bounds must be written exactly
+	os.precision(12);
+	std::string currentName;
+	for(const auto& entry : sorted){
+		const Series& series=*entry.second;
+		if(series.name!=currentName){
+			os << "# HELP " << series.name << ' ' << series.help << '\n';
+			os << "# TYPE " << series.name << ' '
+			   << (series.type==MetricType::Counter ? "counter" : "histogram") << '\n';
+			currentName=series.name;
+		}
+		const std::string labels=formatLabels(series.labels);
+		if(series.type==MetricType::Counter){
+			os << series.name;
+			if(!labels.empty())
+				os << '{' << labels << '}';
+			os << ' ' << series.counter->value() << '\n';
+			continue;
+		}
+		const std::string prefix=labels.empty() ? "" : labels+",";
+		Histogram::Snapshot snapshot=series.histogram->snapshot();
+		std::uint64_t cumulative=0;
+		std::size_t next=0;
+		for(std::size_t index : bucketIndices){
+			for(; next<=index; next++)
+				cumulative+=snapshot.buckets[next];
+			os << series.name << "_bucket{" << prefix << "le=\""
+			   << Histogram::bucketUpperBound(index) << "\"} " << cumulative << '\n';
+		}
+		os << series.name << "_bucket{" << prefix << "le=\"+Inf\"} " << snapshot.count << '\n';
+		os << series.name << "_sum";
+		if(!labels.empty())
+			os << '{' << labels << '}';
+		os << ' ' << snapshot.sum << '\n';
+		os << series.name << "_count";
+		if(!labels.empty())
+			os << '{' << labels << '}';
+		os << ' ' << snapshot.count << '\n';
+	}
+	return os.str();
+}
+
+}
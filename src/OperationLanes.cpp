@@ -0,0 +1,110 @@
+#include "OperationLanes.h"
+
+#include <algorithm>
+#include <tuple>
+
+OperationLanes::Slot::Slot(OperationLanes* lanes, std::string lane):
+lanes(lanes),lane(std::move(lane)){}
+
+OperationLanes::Slot::Slot(Slot&& other):
+lanes(other.lanes),lane(std::move(other.lane)){
+	other.lanes=nullptr;
+}
+
+OperationLanes::Slot::~Slot(){
+	if(lanes)
+		lanes->release(lane);
+}
+
+OperationLanes::OperationLanes(std::size_t laneLimit, std::size_t totalLimit,
+                               std::chrono::milliseconds agingLimit):
+laneLimit(std::max(laneLimit,std::size_t(1))),
+totalLimit(std::max(totalLimit,std::size_t(1))),
+agingLimit(agingLimit),running(0),nextSequence(0){}
+
+void OperationLanes::setLimits(std::size_t laneLimit, std::size_t totalLimit){
+	std::lock_guard<std::mutex> lock(mutex);
+	this->laneLimit=std::max(laneLimit,std::size_t(1));
+	this->totalLimit=std::max(totalLimit,std::size_t(1));
+	//raising the limits may allow waiting operations to start
+	dispatch();
+}
+
+OperationLanes::Slot OperationLanes::acquire(const std::string& laneName, OperationPriority priority){
+	std::unique_lock<std::mutex> lock(mutex);
+	Lane& lane=lanes[laneName];
+	Waiter waiter{nextSequence++,clock::now(),false};
+	lane.waiting[static_cast<int>(priority)].push_back(&waiter);
+	lane.maxQueued=std::max(lane.maxQueued,lane.queued());
+	//even if a slot is free, enqueueing and dispatching ensures that this
+	//operation cannot overtake others with higher priority
+	dispatch();
+	grantedCondition.wait(lock,[&waiter]{ return waiter.granted; });
+	return Slot(this,laneName);
+}
+
+std::vector<OperationLanes::LaneStatistics> OperationLanes::getStatistics() const{
+	std::vector<LaneStatistics> stats;
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const auto& entry : lanes){
+		const Lane& lane=entry.second;
+		stats.push_back(LaneStatistics{entry.first,lane.running,lane.queued(),
+		                               lane.maxQueued,lane.started,
+		                               lane.totalWait,lane.maxWait});
+	}
+	return stats;
+}
+
+void OperationLanes::dispatch(){
+	bool grantedAny=false;
+	auto now=clock::now();
+	while(running<totalLimit){
+		//find the most deserving waiter in any lane which has room
+		Lane* bestLane=nullptr;
+		int bestQueue=0, bestPriority=0;
+		std::uint64_t bestSequence=0;
+		for(auto& entry : lanes){
+			Lane& lane=entry.second;
+			if(lane.running>=laneLimit)
+				continue;
+			//only the oldest waiter of each class can be the best in its lane
+			for(int p=0; p<2; p++){
+				if(lane.waiting[p].empty())
+					continue;
+				const Waiter* candidate=lane.waiting[p].front();
+				int priority=p;
+				if(p==static_cast<int>(OperationPriority::Mutation) 
+				   && now-candidate->arrival>=agingLimit)
+					priority=static_cast<int>(OperationPriority::Read);
+				if(!bestLane || std::tie(priority,candidate->sequence)<std::tie(bestPriority,bestSequence)){
+					bestLane=&lane;
+					bestQueue=p;
+					bestPriority=priority;
+					bestSequence=candidate->sequence;
+				}
+			}
+		}
+		if(!bestLane)
+			break;
+		Waiter* waiter=bestLane->waiting[bestQueue].front();
+		bestLane->waiting[bestQueue].pop_front();
+		waiter->granted=true;
+		grantedAny=true;
+		bestLane->running++;
+		running++;
+		bestLane->started++;
+		double wait=std::chrono::duration_cast<std::chrono::duration<double>>(now-waiter->arrival).count();
+		bestLane->totalWait+=wait;
+		bestLane->maxWait=std::max(bestLane->maxWait,wait);
+	}
+	if(grantedAny)
+		grantedCondition.notify_all();
+}
+
+void OperationLanes::release(const std::string& laneName){
+	std::lock_guard<std::mutex> lock(mutex);
+	Lane& lane=lanes[laneName];
+	lane.running--;
+	running--;
+	dispatch();
+}
@@ -5,6 +5,8 @@
 #include <cstdio>
 #include <cstring>
 #include <fstream>
+#include <limits>
+#include <set>
 #include <thread>
 
 #include <unistd.h>
@@ -12,6 +14,7 @@
 #include <boost/lexical_cast.hpp>
 
 #include <aws/core/utils/Outcome.h>
+#include <aws/dynamodb/model/BatchGetItemRequest.h>
 #include <aws/dynamodb/model/DeleteItemRequest.h>
 #include <aws/dynamodb/model/GetItemRequest.h>
 #include <aws/dynamodb/model/PutItemRequest.h>
@@ -26,9 +29,14 @@
 #include <aws/dynamodb/model/UpdateTableRequest.h>
 
 #include <Logging.h>
+#include <Metrics.h>
+#include <Tracing.h>
 #include <ServerUtilities.h>
 #include <Process.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
 extern "C"{
+	#include <scrypt/crypto/crypto_scrypt.h>
 	#include <scrypt/scryptenc/scryptenc.h>
 }
 #include <KubeInterface.h>
@@ -152,8 +160,433 @@ void replaceCacheRecord(Cache& cache, const Key& key, const Value& value){
 	cache.upsert(key,[&value](Value& existing){ existing=value; },value);
 }
 
+///\return whether two records hold the same data in every field, unlike 
+///        operator==, which compares only IDs
+bool sameContents(const User& u1, const User& u2){
+	return u1.valid==u2.valid && u1.id==u2.id && u1.name==u2.name && u1.email==u2.email 
+	  && u1.phone==u2.phone && u1.institution==u2.institution && u1.token==u2.token 
+	  && u1.globusID==u2.globusID && u1.admin==u2.admin;
+}
+bool sameContents(const Group& g1, const Group& g2){
+	return g1.valid==g2.valid && g1.id==g2.id && g1.name==g2.name && g1.email==g2.email 
+	  && g1.phone==g2.phone && g1.scienceField==g2.scienceField && g1.description==g2.description;
+}
+bool sameContents(const Cluster& c1, const Cluster& c2){
+	return c1.valid==c2.valid && c1.id==c2.id && c1.name==c2.name && c1.config==c2.config 
+	  && c1.systemNamespace==c2.systemNamespace && c1.owningGroup==c2.owningGroup 
+	  && c1.owningOrganization==c2.owningOrganization;
+}
+bool sameContents(const ApplicationInstance& i1, const ApplicationInstance& i2){
+	return i1.valid==i2.valid && i1.id==i2.id && i1.name==i2.name && i1.application==i2.application 
+	  && i1.owningGroup==i2.owningGroup && i1.cluster==i2.cluster && i1.config==i2.config 
+	  && i1.ctime==i2.ctime;
+}
+
+///Replace a cached record, like replaceCacheRecord, for a cache from which 
+///listings are built, so that the listing need only be rebuilt when the 
+///refreshed record actually differs from the one it replaces. 
+///\return whether the cache did not already hold a record with the same data
+template<typename Cache, typename Key=typename Cache::key_type, typename Value=typename Cache::mapped_type>
+bool updateCacheRecord(Cache& cache, const Key& key, const Value& value){
+	bool changed=true;
+	cache.upsert(key,[&value,&changed](Value& existing){
+		changed=!sameContents(existing.peek(),value.peek());
+		existing=value;
+	},value);
+	return changed;
+}
+
+///\return a shared pointer to a record which was fetched rather than found in 
+///        a cache. Invalid records all share a single empty object.
+template<typename T>
+std::shared_ptr<const T> shareRecord(T&& record){
+	if(!record)
+		return CacheRecord<T>().share();
+	return std::make_shared<const T>(std::move(record));
+}
+
+///Copy all of the records in a cache. This locks the whole cache while the 
+///copy is made, so it should be used only to build snapshots which can then be 
+///shared by many readers.
+template<typename Cache, typename Value=typename Cache::mapped_type::value_type>
+std::vector<Value> snapshotCache(Cache& cache){
+	std::vector<Value> collected;
+	auto table = cache.lock_table();
+	collected.reserve(table.size());
+	for(auto itr = table.cbegin(); itr != table.cend(); itr++)
+		collected.push_back(itr->second.peek());
+	return collected;
+}
+
+///Form a string which identifies a lookup of a record
+///\param table the table in which the record is stored
+///\param index the index used for the lookup, or empty if the lookup is by 
+///             primary key
+///\param key the value for which to search
+std::string lookupKey(const std::string& table, const std::string& index, const std::string& key){
+	return table+"/"+index+"/"+key;
+}
+
+using DatabaseItem=Aws::Map<Aws::String,Aws::DynamoDB::Model::AttributeValue>;
+
+User decodeUser(const DatabaseItem& item){
+	User user;
+	user.valid=true;
+	user.id=findOrThrow(item,"ID","user record missing ID attribute").GetS();
+	user.globusID=findOrThrow(item,"globusID","user record missing globusID attribute").GetS();
+	user.token=findOrThrow(item,"token","user record missing token attribute").GetS();
+	user.name=findOrThrow(item,"name","user record missing name attribute").GetS();
+	user.email=findOrThrow(item,"email","user record missing email attribute").GetS();
+	user.phone=findOrDefault(item,"phone",missingString).GetS();
+	user.institution=findOrDefault(item,"institution",missingString).GetS();
+	user.admin=findOrThrow(item,"admin","user record missing admin attribute").GetBool();
+	return user;
+}
+
+Group decodeGroup(const DatabaseItem& item){
+	Group group;
+	group.valid=true;
+	group.id=findOrThrow(item,"ID","Group record missing ID attribute").GetS();
+	group.name=findOrThrow(item,"name","Group record missing name attribute").GetS();
+	group.email=findOrDefault(item,"email",missingString).GetS();
+	group.phone=findOrDefault(item,"phone",missingString).GetS();
+	group.scienceField=findOrDefault(item,"scienceField",missingString).GetS();
+	group.description=findOrDefault(item,"description",missingString).GetS();
+	return group;
+}
+
+Cluster decodeCluster(const DatabaseItem& item){
+	Cluster cluster;
+	cluster.valid=true;
+	cluster.id=findOrThrow(item,"ID","Cluster record missing ID attribute").GetS();
+	cluster.name=findOrThrow(item,"name","Cluster record missing name attribute").GetS();
+	cluster.owningGroup=findOrThrow(item,"owningGroup","Cluster record missing owningGroup attribute").GetS();
+	cluster.config=findOrThrow(item,"config","Cluster record missing config attribute").GetS();
+	cluster.systemNamespace=findOrThrow(item,"systemNamespace","Cluster record missing systemNamespace attribute").GetS();
+	cluster.owningOrganization=findOrDefault(item,"owningOrganization",missingString).GetS();
+	return cluster;
+}
+
+ApplicationInstance decodeInstance(const DatabaseItem& item){
+	ApplicationInstance inst;
+	inst.valid=true;
+	inst.id=findOrThrow(item,"ID","Instance record missing ID attribute").GetS();
+	inst.name=findOrThrow(item,"name","Instance record missing name attribute").GetS();
+	inst.application=findOrThrow(item,"application","Instance record missing application attribute").GetS();
+	inst.owningGroup=findOrThrow(item,"owningGroup","Instance record missing owningGroup attribute").GetS();
+	inst.cluster=findOrThrow(item,"cluster","Instance record missing cluster attribute").GetS();
+	inst.ctime=findOrThrow(item,"ctime","Instance record missing ctime attribute").GetS();
+	return inst;
+}
+
+Secret decodeSecret(const DatabaseItem& item){
+	Secret secret;
+	secret.valid=true;
+	secret.id=findOrThrow(item,"ID","Secret record missing ID attribute").GetS();
+	secret.name=findOrThrow(item,"name","Secret record missing name attribute").GetS();
+	secret.group=findOrThrow(item,"owningGroup","Secret record missing owning group attribute").GetS();
+	secret.cluster=findOrThrow(item,"cluster","Secret record missing cluster attribute").GetS();
+	secret.ctime=findOrThrow(item,"ctime","Secret record missing ctime attribute").GetS();
+	const auto& secret_data=findOrThrow(item,"contents","Secret record missing contents attribute").GetB();
+	secret.data=std::string((const std::string::value_type*)secret_data.GetUnderlyingData(),secret_data.GetLength());
+	return secret;
+}
+
+///Thread-safe accumulation of the keys of the categories, or records, seen 
+///during a scan
+class CategorySet{
+public:
+	void insert(const std::string& key){
+		std::lock_guard<std::mutex> lock(mut);
+		keys.insert(key);
+	}
+	bool contains(const std::string& key) const{
+		std::lock_guard<std::mutex> lock(mut);
+		return keys.count(key);
+	}
+	///Mark every seen category in a cache as complete until the given time
+	template<typename Cache>
+	void markComplete(Cache& cache, std::chrono::steady_clock::time_point expirationTime) const{
+		std::lock_guard<std::mutex> lock(mut);
+		for(const auto& key : keys)
+			cache.update_expiration(key,expirationTime);
+	}
+private:
+	mutable std::mutex mut;
+	std::set<std::string> keys;
+};
+
+///Remove from a cache the records which a complete scan of the corresponding 
+///table did not return, because they have been deleted from the database by 
+///some means other than this server. Records cached after the scan began are 
+///kept, since they may have been added concurrently. 
+///\param cache the cache holding all records of the scanned table
+///\param seen the IDs of the records returned by the scan
+///\param scanExpiration the expiration time of records cached as the scan 
+///                      began
+///\param removed the records removed from the cache are added to this 
+///               collection, so that their secondary entries can be removed
+template<typename Value>
+void removeUnseen(cuckoohash_map<std::string,CacheRecord<Value>>& cache, const CategorySet& seen, 
+                  std::chrono::steady_clock::time_point scanExpiration,
+                  std::vector<CacheRecord<Value>>& removed){
+	auto table=cache.lock_table();
+	for(auto itr=table.begin(); itr!=table.end();){
+		if(itr->second.expirationTime<scanExpiration && !seen.contains(itr->first)){
+			removed.push_back(itr->second);
+			itr=table.erase(itr);
+		}
+		else
+			itr++;
+	}
+}
+
+///\return the approximate amount of memory used by an object, including any
+///        storage it owns outside of itself
+std::size_t approximateSize(bool){ return sizeof(bool); }
+std::size_t approximateSize(const std::string& s){ return sizeof(s)+s.capacity(); }
+
+///\return the total memory owned by a collection of strings outside of the 
+///        objects themselves
+std::size_t ownedSize(){ return 0; }
+template<typename... Strings>
+std::size_t ownedSize(const std::string& s, const Strings&... rest){
+	return s.capacity()+ownedSize(rest...);
+}
+
+std::size_t approximateSize(const User& u){
+	return sizeof(u)+ownedSize(u.id,u.name,u.email,u.phone,u.institution,u.token,u.globusID);
+}
+std::size_t approximateSize(const Group& g){
+	return sizeof(g)+ownedSize(g.id,g.name,g.email,g.phone,g.scienceField,g.description);
+}
+std::size_t approximateSize(const Cluster& c){
+	return sizeof(c)+ownedSize(c.id,c.name,c.config,c.systemNamespace,c.owningGroup,c.owningOrganization);
+}
+std::size_t approximateSize(const ApplicationInstance& i){
+	return sizeof(i)+ownedSize(i.id,i.name,i.application,i.owningGroup,i.cluster,i.config,i.ctime);
+}
+std::size_t approximateSize(const Secret& s){
+	return sizeof(s)+ownedSize(s.id,s.name,s.group,s.cluster,s.ctime,s.data);
+}
+std::size_t approximateSize(const Application& a){
+	return sizeof(a)+ownedSize(a.name,a.version,a.chartVersion,a.description);
+}
+std::size_t approximateSize(const std::set<std::string>& s){
+	std::size_t size=sizeof(s);
+	for(const auto& item : s)
+		size+=approximateSize(item)+4*sizeof(void*); //include the tree node
+	return size;
+}
+std::size_t approximateSize(const std::vector<GeoLocation>& v){
+	return sizeof(v)+v.capacity()*sizeof(GeoLocation);
+}
+template<typename T>
+std::size_t approximateSize(const CacheRecord<T>& record){
+	//include the shared control block and last use time
+	return sizeof(record)+approximateSize(record.peek())+4*sizeof(void*);
+}
+
+///Remove old records from a cache, and if it is still over budget, evict its
+///least recently used records until it is not. The whole cache is locked while
+///this is done. 
+///Records shared with other caches are counted in full in each of them, so 
+///the memory use is an overestimate when records are indexed in several ways.
+///\param cache the cache to sweep
+///\param gracePeriod how long after expiring records are kept, because they 
+///                   may still be used while being refreshed
+///\param entryLimit the maximum number of records to keep
+///\param byteLimit the maximum approximate memory use to allow
+///\param removed if not null, the records removed from the cache are added 
+///               to this collection
+///\return the size of the cache after sweeping, and the number of records 
+///        removed
+template<typename Value, typename DurationType>
+CacheUsage sweepCache(cuckoohash_map<std::string,CacheRecord<Value>>& cache, 
+                      DurationType gracePeriod, std::size_t entryLimit, std::size_t byteLimit,
+                      std::vector<CacheRecord<Value>>* removed=nullptr){
+	CacheUsage usage;
+	auto table=cache.lock_table();
+	for(auto itr=table.begin(); itr!=table.end();){
+		if(!itr->second.usableWithin(gracePeriod)){
+			if(removed)
+				removed->push_back(itr->second);
+			itr=table.erase(itr);
+			usage.expired++;
+			continue;
+		}
+		usage.entries++;
+		usage.bytes+=approximateSize(itr->first)+approximateSize(itr->second);
+		itr++;
+	}
+	if(usage.entries<=entryLimit && usage.bytes<=byteLimit)
+		return usage;
+	
+	struct Candidate{
+		std::chrono::steady_clock::time_point lastUsed;
+		std::string key;
+		std::size_t size;
+	};
+	std::vector<Candidate> candidates;
+	candidates.reserve(usage.entries);
+	for(auto itr=table.cbegin(); itr!=table.cend(); itr++)
+		candidates.push_back(Candidate{itr->second.lastUsed(),itr->first,
+		                               approximateSize(itr->first)+approximateSize(itr->second)});
+	std::sort(candidates.begin(),candidates.end(),
+	          [](const Candidate& c1, const Candidate& c2){ return c1.lastUsed<c2.lastUsed; });
+	for(const auto& candidate : candidates){
+		if(usage.entries<=entryLimit && usage.bytes<=byteLimit)
+			break;
+		if(removed){
+			auto itr=table.find(candidate.key);
+			if(itr!=table.end())
+				removed->push_back(itr->second);
+		}
+		table.erase(candidate.key);
+		usage.entries--;
+		usage.bytes-=candidate.size;
+		usage.evicted++;
+	}
+	return usage;
+}
+
+///Remove old records from a multimap cache, and if it is still over budget, 
+///evict the categories whose records were least recently used until it is 
+///not. Expired records are removed only from categories which are no longer
+///complete, since a complete category must continue to list all of its 
+///members. Each record is counted as one entry. 
+///\param cache the cache to sweep
+///\param entryLimit the maximum number of records to keep
+///\param byteLimit the maximum approximate memory use to allow
+///\return the size of the cache after sweeping, and the number of records 
+///        removed
+template<typename Value>
+CacheUsage sweepCache(concurrent_multimap<std::string,CacheRecord<Value>>& cache, 
+                      std::size_t entryLimit, std::size_t byteLimit){
+	using steady_clock=std::chrono::steady_clock;
+	CacheUsage usage;
+	const auto now=steady_clock::now();
+	auto table=cache.lock_table();
+	for(auto itr=table.begin(); itr!=table.end();){
+		auto& category=itr->second;
+		if(category.second<now){
+			for(auto rItr=category.first.begin(); rItr!=category.first.end();){
+				if(rItr->expired()){
+					rItr=category.first.erase(rItr);
+					usage.expired++;
+				}
+				else
+					rItr++;
+			}
+			if(category.first.empty()){
+				itr=table.erase(itr);
+				continue;
+			}
+		}
+		usage.entries+=category.first.size();
+		usage.bytes+=approximateSize(itr->first);
+		for(const auto& record : category.first)
+			usage.bytes+=approximateSize(record);
+		itr++;
+	}
+	if(usage.entries<=entryLimit && usage.bytes<=byteLimit)
+		return usage;
+	
+	struct Candidate{
+		steady_clock::time_point lastUsed;
+		std::string key;
+		std::size_t entries, size;
+	};
+	std::vector<Candidate> candidates;
+	for(auto itr=table.cbegin(); itr!=table.cend(); itr++){
+		Candidate candidate{steady_clock::time_point::min(),itr->first,
+		                    itr->second.first.size(),approximateSize(itr->first)};
+		for(const auto& record : itr->second.first){
+			candidate.lastUsed=std::max(candidate.lastUsed,record.lastUsed());
+			candidate.size+=approximateSize(record);
+		}
+		candidates.push_back(candidate);
+	}
+	std::sort(candidates.begin(),candidates.end(),
+	          [](const Candidate& c1, const Candidate& c2){ return c1.lastUsed<c2.lastUsed; });
+	for(const auto& candidate : candidates){
+		if(usage.entries<=entryLimit && usage.bytes<=byteLimit)
+			break;
+		table.erase(candidate.key);
+		usage.entries-=candidate.entries;
+		usage.bytes-=candidate.size;
+		usage.evicted+=candidate.entries;
+	}
+	return usage;
+}
+
+///\param cache the name of a cache
+///\param result the result of lookups: hit, stale, or miss
+///\return the counter of lookups in the cache with that result
+metrics::Counter& cacheLookups(const std::string& cache, const std::string& result){
+	return metrics::counter("slate_cache_lookups_total","Lookups of records in the persistent store's caches",
+	                        {{"cache",cache},{"result",result}});
+}
+
+template<typename Outcome, typename Operation>
+Outcome timeDatabaseOperation(const std::string& operation, Operation run){
+	static const std::string durationName="slate_dynamodb_operation_duration_seconds";
+	static const std::string errorName="slate_dynamodb_operation_errors_total";
+	//each operation type has its own instantiation, so these are looked up once per type
+	static metrics::Histogram& duration=metrics::histogram(durationName,"Time taken by database operations",{{"operation",operation}});
+	static metrics::Counter& errors=metrics::counter(errorName,"Database operations which failed",{{"operation",operation}});
+	metrics::Timer timer(duration);
+	tracing::Span span("db",operation);
+	Outcome outcome=run();
+	if(!outcome.IsSuccess())
+		errors.add();
+	return outcome;
+}
+
 } //anonymous namespace
 
+#define instrumentedDatabaseOperation(Operation) \
+Aws::DynamoDB::Model::Operation##Outcome \
+InstrumentedDynamoDBClient::Operation(const Aws::DynamoDB::Model::Operation##Request& request) const{ \
+	return timeDatabaseOperation<Aws::DynamoDB::Model::Operation##Outcome>(#Operation, \
+	  [&]{ return DynamoDBClient::Operation(request); }); \
+}
+
+instrumentedDatabaseOperation(GetItem)
+instrumentedDatabaseOperation(PutItem)
+instrumentedDatabaseOperation(UpdateItem)
+instrumentedDatabaseOperation(DeleteItem)
+instrumentedDatabaseOperation(Query)
+instrumentedDatabaseOperation(Scan)
+instrumentedDatabaseOperation(BatchGetItem)
+
+#undef instrumentedDatabaseOperation
+
+///Count records found in a cache, both in the overall total and for the 
+///particular cache
+#define countCacheHits(cache,n) \
+do{ \
+	static metrics::Counter& hits=cacheLookups(#cache,"hit"); \
+	std::size_t count=(n); \
+	hits.add(count); \
+	cacheHits+=count; \
+}while(0)
+
+///Count a lookup which found an expired record which was used anyway
+#define countStaleCacheHit(cache) \
+do{ \
+	static metrics::Counter& hits=cacheLookups(#cache,"stale"); \
+	hits.add(); \
+	staleCacheHits++; \
+}while(0)
+
+///Count a lookup which did not find a usable record in a cache
+#define countCacheMiss(cache) \
+do{ \
+	static metrics::Counter& misses=cacheLookups(#cache,"miss"); \
+	misses.add(); \
+}while(0)
+
 ///Check whether the set of cached records for a category is up to date, and if
 ///so return only those which are not stale. 
 #define maybeReturnCachedCategoryMembers(cache,key) \
@@ -163,13 +596,13 @@ do{ \
 	std::vector<ResultType> results; \
 	if(cachedCategory.second > std::chrono::steady_clock::now()){ \
 		for(const auto record : cachedCategory.first){ \
-			if(record){ \
+			if(record) \
 				results.push_back(record); \
-				cacheHits++; \
-			} \
 		} \
+		countCacheHits(cache,results.size()); \
 		return results; \
 	} \
+	countCacheMiss(cache); \
 }while(0)
 
 const std::string PersistentStore::wildcard="*";
@@ -180,7 +613,10 @@ PersistentStore::PersistentStore(const Aws::Auth::AWSCredentials& credentials,
                                  std::string bootstrapUserFile,
                                  std::string encryptionKeyFile,
                                  std::string appLoggingServerName,
-                                 unsigned int appLoggingServerPort):
+                                 unsigned int appLoggingServerPort,
+                                 unsigned int scanSegments,
+                                 std::size_t cacheEntryLimit,
+                                 std::size_t cacheByteLimit):
 	dbClient(credentials,clientConfig),
 	userTableName("SLATE_users"),
 	groupTableName("SLATE_groups"),
@@ -199,17 +635,495 @@ PersistentStore::PersistentStore(const Aws::Auth::AWSCredentials& credentials,
 	instanceCacheValidity(std::chrono::minutes(5)),
 	instanceCacheExpirationTime(std::chrono::steady_clock::now()),
 	secretCacheValidity(std::chrono::minutes(5)),
+	userCacheGracePeriod(std::chrono::minutes(5)),
+	groupCacheGracePeriod(std::chrono::minutes(30)),
+	clusterCacheGracePeriod(std::chrono::minutes(30)),
+	missingRecordCacheValidity(std::chrono::seconds(30)),
+	missingRecordGeneration(0),
 	secretKey(1024),
+	masterKey(32), //AES-256 key
 	appLoggingServerName(appLoggingServerName),
 	appLoggingServerPort(appLoggingServerPort),
-	cacheHits(0),databaseQueries(0),databaseScans(0)
+	cacheHits(0),databaseQueries(0),databaseScans(0),
+	staleCacheHits(0),backgroundRefreshes(0),negativeCacheHits(0),
+	legacySecretDecryptions(0),secretsRewrapped(0),
+	scanSegments(std::max(scanSegments,1u)),
+	usersLoaded(false),groupsLoaded(false),clustersLoaded(false),instancesLoaded(false),
+	cacheEntryLimit(cacheEntryLimit),cacheByteLimit(cacheByteLimit),
+	stopRefreshing(false),
+	refreshPool(4)
 {
 	loadEncyptionKey(encryptionKeyFile);
+	deriveMasterKey();
 	log_info("Starting database client");
 	InitializeTables(bootstrapUserFile);
+	refreshThread=std::thread(&PersistentStore::refreshCollections,this);
 	log_info("Database client ready");
 }
 
+PersistentStore::~PersistentStore(){
+	{
+		std::lock_guard<std::mutex> lock(refreshMutex);
+		stopRefreshing=true;
+	}
+	refreshCondition.notify_all();
+	if(refreshThread.joinable())
+		refreshThread.join();
+}
+
+bool PersistentStore::scanTable(const Aws::DynamoDB::Model::ScanRequest& baseRequest, 
+                                const std::string& description,
+                                const std::function<void(const DatabaseItem&)>& handleItem){
+	databaseScans++;
+	std::atomic<bool> success(true);
+	auto scanSegment=[&](unsigned int segment){
+		Aws::DynamoDB::Model::ScanRequest request=baseRequest;
+		request.SetSegment(segment);
+		request.SetTotalSegments(scanSegments);
+		bool keepGoing=false;
+		try{
+			do{
+				auto outcome=dbClient.Scan(request);
+				if(!outcome.IsSuccess()){
+					auto err=outcome.GetError();
+					log_error("Failed to fetch " << description << " records: " << err.GetMessage());
+					success=false;
+					return;
+				}
+				const auto& result=outcome.GetResult();
+				//set up fetching the next page if necessary
+				if(!result.GetLastEvaluatedKey().empty()){
+					keepGoing=true;
+					request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
+				}
+				else
+					keepGoing=false;
+				for(const auto& item : result.GetItems())
+					handleItem(item);
+			}while(keepGoing && success);
+		}catch(std::exception& ex){
+			log_error("Failed to decode " << description << " records: " << ex.what());
+			success=false;
+		}
+	};
+	//this thread reads the first segment while others read the rest
+	std::vector<std::thread> segmentThreads;
+	for(unsigned int i=1; i<scanSegments; i++)
+		segmentThreads.emplace_back(scanSegment,i);
+	scanSegment(0);
+	for(auto& thread : segmentThreads)
+		thread.join();
+	return success;
+}
+
+bool PersistentStore::recentlyMissing(const std::string& key){
+	CacheRecord<bool> record;
+	if(missingRecordCache.find(key,record) && record){
+		negativeCacheHits++;
+		return true;
+	}
+	return false;
+}
+
+void PersistentStore::recordMissing(const std::string& key, unsigned long generation){
+	std::lock_guard<std::mutex> lock(missingRecordMutex);
+	if(generation!=missingRecordGeneration)
+		return;
+	//rather than growing without bound until the next sweep, stop remembering 
+	//new misses once the cache is full
+	if(missingRecordCache.size()>=cacheEntryLimit)
+		return;
+	CacheRecord<bool> record(true,missingRecordCacheValidity);
+	replaceCacheRecord(missingRecordCache,key,record);
+}
+
+void PersistentStore::forgetMissing(const std::string& key){
+	std::lock_guard<std::mutex> lock(missingRecordMutex);
+	missingRecordGeneration++;
+	missingRecordCache.erase(key);
+}
+
+void PersistentStore::refreshInBackground(const std::string& key, std::function<void()> refresh){
+	//if a refresh of this record is already in progress, there is no need to 
+	//start another
+	if(!refreshesInProgress.insert(key,true))
+		return;
+	backgroundRefreshes++;
+	refreshPool.submit([this,key,refresh]{
+		try{
+			refresh();
+		}catch(std::exception& ex){
+			log_error("Background refresh of " << key << " failed: " << ex.what());
+		}
+		refreshesInProgress.erase(key);
+	});
+}
+
+template<typename EntityType>
+bool PersistentStore::scanEntities(const Aws::DynamoDB::Model::ScanRequest& request, 
+                                   const std::string& description,
+                                   EntityType (*decode)(const DatabaseItem&),
+                                   const std::function<void(const EntityType&)>& store){
+	auto start=std::chrono::steady_clock::now();
+	std::atomic<std::size_t> count(0);
+	bool success=scanTable(request,description,[&](const DatabaseItem& item){
+		store(decode(item));
+		count++;
+	});
+	if(success)
+		log_info("Read " << count.load() << ' ' << description << " records in " 
+		         << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count()
+		         << " ms using " << scanSegments << " segments");
+	return success;
+}
+
+template<typename EntityType>
+std::map<std::string,EntityType> PersistentStore::batchGet(const std::string& tableName, 
+                                                           const std::string& description,
+                                                           const std::vector<std::string>& ids,
+                                                           cuckoohash_map<std::string,CacheRecord<EntityType>>& cache,
+                                                           const std::string& cacheName,
+                                                           EntityType (*decode)(const DatabaseItem&),
+                                                           void (PersistentStore::*store)(const EntityType&)){
+	std::map<std::string,EntityType> results;
+	//use cached records where possible, collecting the IDs which are missing
+	std::vector<std::string> missing;
+	std::set<std::string> seen;
+	std::size_t hits=0;
+	for(const auto& id : ids){
+		if(!seen.insert(id).second)
+			continue;
+		CacheRecord<EntityType> record;
+		if(cache.find(id,record) && record){
+			hits++;
+			results.emplace(id,record.get());
+		}
+		else
+			missing.push_back(id);
+	}
+	cacheHits+=hits;
+	cacheLookups(cacheName,"hit").add(hits);
+	cacheLookups(cacheName,"miss").add(missing.size());
+	
+	using Aws::DynamoDB::Model::AttributeValue;
+	//BatchGetItem accepts at most this many keys per request
+	const std::size_t maxBatchSize=100;
+	//the number of times keys which the database did not process are 
+	//requested again before falling back to reading them individually
+	const unsigned int maxBatchAttempts=4;
+	for(std::size_t start=0; start<missing.size(); start+=maxBatchSize){
+		const std::size_t end=std::min(start+maxBatchSize,missing.size());
+		Aws::DynamoDB::Model::KeysAndAttributes keys;
+		for(std::size_t i=start; i<end; i++)
+			keys.AddKeys({{"ID",AttributeValue(missing[i])},
+			              {"sortKey",AttributeValue(missing[i])}});
+		Aws::DynamoDB::Model::BatchGetItemRequest request;
+		request.AddRequestItems(tableName,keys);
+		//the database may not process all keys in one request, in which case
+		//the remaining ones must be requested again
+		bool complete=false;
+		for(unsigned int attempt=0; attempt<maxBatchAttempts; attempt++){
+			if(attempt) //back off, since unprocessed keys usually indicate throttling
+				std::this_thread::sleep_for(std::chrono::milliseconds(50<<attempt));
+			databaseQueries++;
+			auto outcome=dbClient.BatchGetItem(request);
+			if(!outcome.IsSuccess()){
+				auto err=outcome.GetError();
+				log_error("Failed to fetch " << description << " records: " << err.GetMessage());
+				break;
+			}
+			const auto& result=outcome.GetResult();
+			auto responses=result.GetResponses().find(tableName);
+			if(responses!=result.GetResponses().end()){
+				for(const auto& item : responses->second){
+					EntityType entity=decode(item);
+					(this->*store)(entity);
+					results.emplace(entity.id,entity);
+				}
+			}
+			if(result.GetUnprocessedKeys().empty()){
+				complete=true;
+				break;
+			}
+			request.SetRequestItems(result.GetUnprocessedKeys());
+		}
+		if(complete)
+			continue;
+		//Read whatever the batches did not return one at a time, so that 
+		//persistent throttling delays this request by a bounded amount. Records
+		//which do not exist are simply looked for again. 
+		for(std::size_t i=start; i<end; i++){
+			if(results.count(missing[i]))
+				continue;
+			databaseQueries++;
+			auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
+			                              .WithTableName(tableName)
+			                              .WithKey({{"ID",AttributeValue(missing[i])},
+			                                        {"sortKey",AttributeValue(missing[i])}}));
+			if(!outcome.IsSuccess()){
+				auto err=outcome.GetError();
+				log_error("Failed to fetch " << description << " record " << missing[i] << ": " << err.GetMessage());
+				continue;
+			}
+			const auto& item=outcome.GetResult().GetItem();
+			if(item.empty())
+				continue;
+			EntityType entity=decode(item);
+			(this->*store)(entity);
+			results.emplace(entity.id,entity);
+		}
+	}
+	return results;
+}
+
+std::map<std::string,User> PersistentStore::getUsers(const std::vector<std::string>& ids){
+	return batchGet<User>(userTableName,"user",ids,userCache,"userCache",&decodeUser,&PersistentStore::cacheUser);
+}
+
+std::map<std::string,Group> PersistentStore::getGroups(const std::vector<std::string>& ids){
+	return batchGet<Group>(groupTableName,"Group",ids,groupCache,"groupCache",&decodeGroup,&PersistentStore::cacheGroup);
+}
+
+std::map<std::string,Cluster> PersistentStore::getClusters(const std::vector<std::string>& ids){
+	return batchGet<Cluster>(clusterTableName,"cluster",ids,clusterCache,"clusterCache",&decodeCluster,&PersistentStore::cacheCluster);
+}
+
+void PersistentStore::cacheUser(const User& user){
+	CacheRecord<User> record(user,userCacheValidity);
+	if(updateCacheRecord(userCache,user.id,record))
+		userListing.invalidate();
+	replaceCacheRecord(userByTokenCache,user.token,record);
+	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
+}
+
+void PersistentStore::cacheGroup(const Group& group){
+	CacheRecord<Group> record(group,groupCacheValidity);
+	if(updateCacheRecord(groupCache,group.id,record))
+		groupListing.invalidate();
+	replaceCacheRecord(groupByNameCache,group.name,record);
+}
+
+void PersistentStore::cacheCluster(const Cluster& cluster){
+	CacheRecord<Cluster> record(cluster,clusterCacheValidity);
+	if(updateCacheRecord(clusterCache,cluster.id,record))
+		clusterListing.invalidate();
+	clusterByNameCache.insert_or_assign(cluster.name,record);
+	clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
+	writeClusterConfigToDisk(cluster);
+}
+
+void PersistentStore::cacheInstance(const ApplicationInstance& inst){
+	CacheRecord<ApplicationInstance> record(inst,instanceCacheValidity);
+	if(updateCacheRecord(instanceCache,inst.id,record))
+		instanceListing.invalidate();
+	instanceByNameCache.insert_or_assign(inst.name,record);
+	instanceByGroupCache.insert_or_assign(inst.owningGroup,record);
+	instanceByClusterCache.insert_or_assign(inst.cluster,record);
+	instanceByGroupAndClusterCache.insert_or_assign(inst.owningGroup+":"+inst.cluster,record);
+}
+
+void PersistentStore::cacheSecret(const Secret& secret){
+	CacheRecord<Secret> record(secret,secretCacheValidity);
+	replaceCacheRecord(secretCache,secret.id,record);
+	secretByGroupCache.insert_or_assign(secret.group,record);
+	secretByGroupAndClusterCache.insert_or_assign(secret.group+":"+secret.cluster,record);
+}
+
+void PersistentStore::warmCaches(){
+	log_info("Loading database records into caches");
+	auto start=std::chrono::steady_clock::now();
+	//each table is loaded concurrently with the others
+	std::vector<std::thread> loaders;
+	loaders.emplace_back([this]{ ensureLoaded(usersLoaded,userLoadMutex,&PersistentStore::loadUsers); });
+	loaders.emplace_back([this]{ ensureLoaded(groupsLoaded,groupLoadMutex,&PersistentStore::loadGroups); });
+	loaders.emplace_back([this]{ ensureLoaded(clustersLoaded,clusterLoadMutex,&PersistentStore::loadClusters); });
+	loaders.emplace_back([this]{ ensureLoaded(instancesLoaded,instanceLoadMutex,&PersistentStore::loadInstances); });
+	loaders.emplace_back([this]{ loadSecrets(); });
+	for(auto& loader : loaders)
+		loader.join();
+	log_info("Cache warmup finished in " 
+	         << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count() << " ms");
+}
+
+void PersistentStore::ensureLoaded(std::atomic<bool>& loaded, std::mutex& loadMutex, 
+                                   bool (PersistentStore::*load)()){
+	if(loaded)
+		return;
+	std::lock_guard<std::mutex> lock(loadMutex);
+	//another thread may have finished loading while this one waited
+	if(loaded)
+		return;
+	if((this->*load)())
+		loaded=true;
+}
+
+void PersistentStore::refreshCollections(){
+	using steady_clock=std::chrono::steady_clock;
+	struct Collection{
+		const char* name;
+		std::atomic<bool>& loaded;
+		std::mutex& loadMutex;
+		slate_atomic<steady_clock::time_point>& expirationTime;
+		std::chrono::seconds validity;
+		bool (PersistentStore::*load)();
+	};
+	Collection collections[]={
+		{"user",usersLoaded,userLoadMutex,userCacheExpirationTime,userCacheValidity,&PersistentStore::loadUsers},
+		{"group",groupsLoaded,groupLoadMutex,groupCacheExpirationTime,groupCacheValidity,&PersistentStore::loadGroups},
+		{"cluster",clustersLoaded,clusterLoadMutex,clusterCacheExpirationTime,clusterCacheValidity,&PersistentStore::loadClusters},
+		{"instance",instancesLoaded,instanceLoadMutex,instanceCacheExpirationTime,instanceCacheValidity,&PersistentStore::loadInstances},
+	};
+	const std::chrono::seconds checkInterval(10);
+	const std::chrono::seconds sweepInterval(60);
+	auto nextSweep=steady_clock::now()+sweepInterval;
+	
+	std::unique_lock<std::mutex> lock(refreshMutex);
+	while(!stopRefreshing){
+		refreshCondition.wait_for(lock,checkInterval);
+		if(stopRefreshing)
+			break;
+		lock.unlock();
+		for(auto& collection : collections){
+			//collections which have never been listed are not worth keeping 
+			//current
+			if(!collection.loaded)
+				continue;
+			//reload once the collection is within the last fifth of its 
+			//validity, leaving time for the scan to finish before it expires
+			if(steady_clock::now()+collection.validity/5 < collection.expirationTime.load())
+				continue;
+			std::lock_guard<std::mutex> loadLock(collection.loadMutex);
+			if(!(this->*collection.load)())
+				log_warn("Failed to reload " << collection.name << " records; cached data will continue to be used");
+		}
+		if(steady_clock::now()>=nextSweep){
+			sweepCaches();
+			nextSweep=steady_clock::now()+sweepInterval;
+		}
+		lock.lock();
+	}
+}
+
+void PersistentStore::sweepCaches(){
+	using std::chrono::seconds;
+	std::map<std::string,CacheUsage> usage;
+	
+	//Secondary entries are deleted by finding the corresponding records in the 
+	//primary caches, so removing a record from a primary cache must also 
+	//remove its secondary entries. Categories are discarded entirely, since 
+	//they can no longer be complete. Records of a listable collection which 
+	//has been loaded are never evicted to meet the cache budget, since the 
+	//listing must include all of them; they are only removed once expired 
+	//beyond their grace period, which happens only if reloading has been 
+	//failing, and then the collection must be read again before it is next 
+	//listed. The collection's load lock is held to avoid racing with a load in 
+	//progress.
+	const std::size_t noLimit=std::numeric_limits<std::size_t>::max();
+	{
+		std::vector<CacheRecord<User>> removed;
+		std::lock_guard<std::mutex> lock(userLoadMutex);
+		const bool loaded=usersLoaded;
+		usage["userCache"]=sweepCache(userCache,userCacheGracePeriod,loaded?noLimit:cacheEntryLimit,
+		                               loaded?noLimit:cacheByteLimit,&removed);
+		for(const auto& record : removed){
+			userByTokenCache.erase(record.peek().token);
+			userByGlobusIDCache.erase(record.peek().globusID);
+		}
+		if(!removed.empty()){
+			usersLoaded=false;
+			userListing.invalidate();
+		}
+	}
+	{
+		std::vector<CacheRecord<Group>> removed;
+		std::lock_guard<std::mutex> lock(groupLoadMutex);
+		const bool loaded=groupsLoaded;
+		usage["groupCache"]=sweepCache(groupCache,groupCacheGracePeriod,loaded?noLimit:cacheEntryLimit,
+		                               loaded?noLimit:cacheByteLimit,&removed);
+		for(const auto& record : removed)
+			groupByNameCache.erase(record.peek().name);
+		if(!removed.empty()){
+			groupsLoaded=false;
+			groupListing.invalidate();
+		}
+	}
+	{
+		std::vector<CacheRecord<Cluster>> removed;
+		std::lock_guard<std::mutex> lock(clusterLoadMutex);
+		const bool loaded=clustersLoaded;
+		usage["clusterCache"]=sweepCache(clusterCache,clusterCacheGracePeriod,loaded?noLimit:cacheEntryLimit,
+		                               loaded?noLimit:cacheByteLimit,&removed);
+		for(const auto& record : removed){
+			clusterByNameCache.erase(record.peek().name);
+			clusterByGroupCache.erase(record.peek().owningGroup);
+		}
+		if(!removed.empty()){
+			clustersLoaded=false;
+			clusterListing.invalidate();
+		}
+	}
+	{
+		std::vector<CacheRecord<ApplicationInstance>> removed;
+		std::lock_guard<std::mutex> lock(instanceLoadMutex);
+		const bool loaded=instancesLoaded;
+		usage["instanceCache"]=sweepCache(instanceCache,seconds(0),loaded?noLimit:cacheEntryLimit,
+		                               loaded?noLimit:cacheByteLimit,&removed);
+		for(const auto& record : removed){
+			const ApplicationInstance& instance=record.peek();
+			instanceByGroupCache.erase(instance.owningGroup);
+			instanceByNameCache.erase(instance.name);
+			instanceByClusterCache.erase(instance.cluster);
+			instanceByGroupAndClusterCache.erase(instance.owningGroup+":"+instance.cluster);
+		}
+		if(!removed.empty()){
+			instancesLoaded=false;
+			instanceListing.invalidate();
+		}
+	}
+	{
+		std::vector<CacheRecord<Secret>> removed;
+		usage["secretCache"]=sweepCache(secretCache,seconds(0),cacheEntryLimit,cacheByteLimit,&removed);
+		for(const auto& record : removed){
+			secretByGroupCache.erase(record.peek().group);
+			secretByGroupAndClusterCache.erase(record.peek().group+":"+record.peek().cluster);
+		}
+	}
+	
+	//Other caches can be swept independently
+	usage["userByTokenCache"]=sweepCache(userByTokenCache,userCacheGracePeriod,cacheEntryLimit,cacheByteLimit);
+	usage["userByGlobusIDCache"]=sweepCache(userByGlobusIDCache,userCacheGracePeriod,cacheEntryLimit,cacheByteLimit);
+	usage["groupByNameCache"]=sweepCache(groupByNameCache,groupCacheGracePeriod,cacheEntryLimit,cacheByteLimit);
+	usage["clusterByNameCache"]=sweepCache(clusterByNameCache,clusterCacheGracePeriod,cacheEntryLimit,cacheByteLimit);
+	usage["clusterGroupApplicationCache"]=sweepCache(clusterGroupApplicationCache,seconds(0),cacheEntryLimit,cacheByteLimit);
+	usage["clusterLocationCache"]=sweepCache(clusterLocationCache,seconds(0),cacheEntryLimit,cacheByteLimit);
+	usage["clusterConnectivityCache"]=sweepCache(clusterConnectivityCache,seconds(0),cacheEntryLimit,cacheByteLimit);
+	usage["instanceConfigCache"]=sweepCache(instanceConfigCache,seconds(0),cacheEntryLimit,cacheByteLimit);
+	usage["missingRecordCache"]=sweepCache(missingRecordCache,seconds(0),cacheEntryLimit,cacheByteLimit);
+	usage["userByGroupCache"]=sweepCache(userByGroupCache,cacheEntryLimit,cacheByteLimit);
+	usage["groupByUserCache"]=sweepCache(groupByUserCache,cacheEntryLimit,cacheByteLimit);
+	usage["clusterByGroupCache"]=sweepCache(clusterByGroupCache,cacheEntryLimit,cacheByteLimit);
+	usage["clusterGroupAccessCache"]=sweepCache(clusterGroupAccessCache,cacheEntryLimit,cacheByteLimit);
+	usage["instanceByGroupCache"]=sweepCache(instanceByGroupCache,cacheEntryLimit,cacheByteLimit);
+	usage["instanceByNameCache"]=sweepCache(instanceByNameCache,cacheEntryLimit,cacheByteLimit);
+	usage["instanceByClusterCache"]=sweepCache(instanceByClusterCache,cacheEntryLimit,cacheByteLimit);
+	usage["instanceByGroupAndClusterCache"]=sweepCache(instanceByGroupAndClusterCache,cacheEntryLimit,cacheByteLimit);
+	usage["secretByGroupCache"]=sweepCache(secretByGroupCache,cacheEntryLimit,cacheByteLimit);
+	usage["secretByGroupAndClusterCache"]=sweepCache(secretByGroupAndClusterCache,cacheEntryLimit,cacheByteLimit);
+	usage["applicationCache"]=sweepCache(applicationCache,cacheEntryLimit,cacheByteLimit);
+	
+	std::lock_guard<std::mutex> lock(cacheUsageMutex);
+	for(const auto& entry : usage){
+		if(entry.second.evicted)
+			log_info("Evicted " << entry.second.evicted << " records from " << entry.first
+			         << " to keep it within its budget");
+		CacheUsage& total=cacheUsage[entry.first];
+		total.entries=entry.second.entries;
+		total.bytes=entry.second.bytes;
+		total.expired+=entry.second.expired;
+		total.evicted+=entry.second.evicted;
+	}
+}
+
 void PersistentStore::InitializeUserTable(std::string bootstrapUserFile){
 	using namespace Aws::DynamoDB::Model;
 	using AttDef=Aws::DynamoDB::Model::AttributeDefinition;
@@ -889,28 +1803,36 @@ bool PersistentStore::addUser(const User& user){
 	}
 	
 	//update caches
+	forgetMissing(lookupKey(userTableName,"",user.id));
+	forgetMissing(lookupKey(userTableName,"ByToken",user.token));
 	CacheRecord<User> record(user,userCacheValidity);
-	replaceCacheRecord(userCache,user.id,record);
+	if(updateCacheRecord(userCache,user.id,record))
+		userListing.invalidate();
 	replaceCacheRecord(userByTokenCache,user.token,record);
 	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
 	
 	return true;
 }
 
-User PersistentStore::getUser(const std::string& id){
+std::shared_ptr<const User> PersistentStore::getUser(const std::string& id){
 	//first see if we have this cached
 	{
 		CacheRecord<User> record;
 		if(userCache.find(id,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
-				return record;
+				countCacheHits(userCache,1);
+				return record.share();
 			}
 		}
 	}
+	//if the record was recently found not to exist, don't look again
+	if(recentlyMissing(lookupKey(userTableName,"",id)))
+		return CacheRecord<User>().share();
 	//need to query the database
+	countCacheMiss(userCache);
 	databaseQueries++;
+	auto missingGeneration=missingRecordGeneration.load();
 	log_info("Querying database for user " << id);
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
@@ -920,11 +1842,13 @@ User PersistentStore::getUser(const std::string& id){
 	if(!outcome.IsSuccess()){
 		auto err=outcome.GetError();
 		log_error("Failed to fetch user record: " << err.GetMessage());
-		return User();
+		return CacheRecord<User>().share();
 	}
 	const auto& item=outcome.GetResult().GetItem();
-	if(item.empty()) //no match found
-		return User{};
+	if(item.empty()){ //no match found
+		recordMissing(lookupKey(userTableName,"",id),missingGeneration);
+		return CacheRecord<User>().share();
+	}
 	User user;
 	user.valid=true;
 	user.id=id;
@@ -938,27 +1862,48 @@ User PersistentStore::getUser(const std::string& id){
 	
 	//update caches
 	CacheRecord<User> record(user,userCacheValidity);
-	replaceCacheRecord(userCache,user.id,record);
+	if(updateCacheRecord(userCache,user.id,record))
+		userListing.invalidate();
 	replaceCacheRecord(userByTokenCache,user.token,record);
 	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
 	
-	return user;
+	return record.share();
 }
 
-User PersistentStore::findUserByToken(const std::string& token){
+std::shared_ptr<const User> PersistentStore::findUserByToken(const std::string& token){
 	//first see if we have this cached
 	{
 		CacheRecord<User> record;
 		if(userByTokenCache.find(token,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
-				return record;
+				countCacheHits(userByTokenCache,1);
+				return record.share();
+			}
+			//if it is only somewhat out of date, use it while a replacement 
+			//is fetched in the background
+			if(record.usableWithin(userCacheGracePeriod)){
+				countStaleCacheHit(userByTokenCache);
+				refreshInBackground("token:"+token,[this,token]{ fetchUserByToken(token); });
+				return record.share();
 			}
 		}
 	}
+	//if the record was recently found not to exist, don't look again
+	if(recentlyMissing(lookupKey(userTableName,"ByToken",token)))
+		return CacheRecord<User>().share();
+	countCacheMiss(userByTokenCache);
+	return shareRecord(fetchUserByToken(token));
+}
+
+User PersistentStore::fetchUserByToken(const std::string& token){
+	return userLookups.run(lookupKey(userTableName,"ByToken",token),[&]{ return queryUserByToken(token); });
+}
+
+User PersistentStore::queryUserByToken(const std::string& token){
 	//need to query the database
 	databaseQueries++;
+	auto missingGeneration=missingRecordGeneration.load();
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto request=Aws::DynamoDB::Model::QueryRequest()
 	.WithTableName(userTableName)
@@ -977,8 +1922,12 @@ User PersistentStore::findUserByToken(const std::string& token){
 		return User();
 	}
 	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
+	if(queryResult.GetCount()==0){
+		//discard any stale record which is still cached
+		userByTokenCache.erase(token);
+		recordMissing(lookupKey(userTableName,"ByToken",token),missingGeneration);
 		return User();
+	}
 	if(queryResult.GetCount()>1)
 		log_fatal("Multiple user records are associated with token " << token << '!');
 	
@@ -996,7 +1945,8 @@ User PersistentStore::findUserByToken(const std::string& token){
 	
 	//update caches
 	CacheRecord<User> record(user,userCacheValidity);
-	replaceCacheRecord(userCache,user.id,record);
+	if(updateCacheRecord(userCache,user.id,record))
+		userListing.invalidate();
 	replaceCacheRecord(userByTokenCache,user.token,record);
 	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
 	
@@ -1010,12 +1960,13 @@ User PersistentStore::findUserByGlobusID(const std::string& globusID){
 		if(userByGlobusIDCache.find(globusID,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(userByGlobusIDCache,1);
 				return record;
 			}
 		}
 	}
 	//need to query the database
+	countCacheMiss(userByGlobusIDCache);
 	databaseQueries++;
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	auto outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
@@ -1050,7 +2001,8 @@ User PersistentStore::findUserByGlobusID(const std::string& globusID){
 	
 	//update caches
 	CacheRecord<User> record(user,userCacheValidity);
-	replaceCacheRecord(userCache,user.id,record);
+	if(updateCacheRecord(userCache,user.id,record))
+		userListing.invalidate();
 	replaceCacheRecord(userByTokenCache,user.token,record);
 	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
 	
@@ -1081,10 +2033,15 @@ bool PersistentStore::updateUser(const User& user, const User& oldUser){
 	
 	//update caches
 	CacheRecord<User> record(user,userCacheValidity);
-	replaceCacheRecord(userCache,user.id,record);
-	//if the token has changed, ensure that any old cache record is removed
-	if(oldUser.token!=user.token)
+	if(updateCacheRecord(userCache,user.id,record))
+		userListing.invalidate();
+	//if the token has changed, ensure that any old cache record is removed, 
+	//and remember that the old token is no longer valid
+	if(oldUser.token!=user.token){
 		userByTokenCache.erase(oldUser.token);
+		recordMissing(lookupKey(userTableName,"ByToken",oldUser.token),missingRecordGeneration);
+	}
+	forgetMissing(lookupKey(userTableName,"ByToken",user.token));
 	replaceCacheRecord(userByTokenCache,user.token,record);
 	replaceCacheRecord(userByGlobusIDCache,user.globusID,record);
 	
@@ -1105,10 +2062,11 @@ bool PersistentStore::removeUser(const std::string& id){
 			//don't particularly care whether the record is expired; if it is 
 			//all that will happen is that we will delete the equally stale 
 			//record in the other cache
-			userByTokenCache.erase(record.record.token);
-			userByGlobusIDCache.erase(record.record.globusID);
+			userByTokenCache.erase(record.get().token);
+			userByGlobusIDCache.erase(record.get().globusID);
 		}
-		userCache.erase(id);
+		if(userCache.erase(id))
+			userListing.invalidate();
 	}
 	
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -1124,118 +2082,89 @@ bool PersistentStore::removeUser(const std::string& id){
 	return true;
 }
 
-std::vector<User> PersistentStore::listUsers(){
-	std::vector<User> collected;
-	//First check if users are cached
-	if(userCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-		auto table = userCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-			auto user = itr->second;
-			cacheHits++;
-			collected.push_back(user);
-		}
-		table.unlock();
-		return collected;
-	}
-	
-	databaseScans++;
+bool PersistentStore::loadUsers(){
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(userTableName);
-	//request.SetAttributesToGet({"ID","name","email"});
 	request.SetFilterExpression("attribute_not_exists(#groupID)");
 	request.SetExpressionAttributeNames({{"#groupID", "groupID"}});
-	bool keepGoing=false;
+	auto expirationTime=std::chrono::steady_clock::now()+userCacheValidity;
 	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch user records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
+	CategorySet seen;
+	bool success=scanEntities<User>(request,"user",&decodeUser,
+	                                [&](const User& user){
+		cacheUser(user);
+		seen.insert(user.id);
+	});
+	if(success){
+		std::vector<CacheRecord<User>> removed;
+		removeUnseen(userCache,seen,expirationTime,removed);
+		for(const auto& record : removed){
+			userByTokenCache.erase(record.peek().token);
+			userByGlobusIDCache.erase(record.peek().globusID);
 		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			User user;
-			user.valid=true;
-			user.id=item.find("ID")->second.GetS();
-			user.globusID=item.find("globusID")->second.GetS();
-			user.token=item.find("token")->second.GetS();
-			user.name=item.find("name")->second.GetS();
-			user.email=item.find("email")->second.GetS();
-			user.phone=findOrDefault(item,"phone",missingString).GetS();
-			user.institution=findOrDefault(item,"institution",missingString).GetS();
-			user.admin=item.find("admin")->second.GetBool();
-			collected.push_back(user);
-
-			CacheRecord<User> record(user,userCacheValidity);
-	replaceCacheRecord(		userCache,user.id,record);
-		}
-	}while(keepGoing);
-	userCacheExpirationTime=std::chrono::steady_clock::now()+userCacheValidity;
+		if(!removed.empty())
+			userListing.invalidate();
+		userCacheExpirationTime=expirationTime;
+	}
+	return success;
+}
+
+std::vector<User> PersistentStore::listUsers(){
+	ensureLoaded(usersLoaded,userLoadMutex,&PersistentStore::loadUsers);
 	
-	return collected;
+	auto snapshot=userListing.get([this]{ return snapshotCache(userCache); });
+	countCacheHits(userListing,snapshot->size());
+	return *snapshot;
 }
 
 std::vector<User> PersistentStore::listUsersByGroup(const std::string& group){
+	std::vector<std::string> memberIDs;
 	//first check if list of users is cached
 	auto cached = userByGroupCache.find(group);
 	if (cached.second > std::chrono::steady_clock::now()) {
-		auto records = cached.first;
-		std::vector<User> users;
-		for (auto record : records) {
-			cacheHits++;
-			auto user = getUser(record);
-			users.push_back(user);
+		for (const auto& record : cached.first) {
+			countCacheHits(userByGroupCache,1);
+			memberIDs.push_back(record);
 		}
-		return users;
-	}
-
-	std::vector<User> users;
-	using AV=Aws::DynamoDB::Model::AttributeValue;
-	databaseQueries++;
-
-	Aws::DynamoDB::Model::QueryOutcome outcome;
-	outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
-			       .WithTableName(userTableName)
-			       .WithIndexName("ByGroup")
-			       .WithKeyConditionExpression("#groupID = :group_val")
-			       .WithExpressionAttributeNames({{"#groupID", "groupID"}})
-			       .WithExpressionAttributeValues({{":group_val", AV(group)}})
-			       );
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to list Users by Group: " << err.GetMessage());
-		return users;
 	}
-
-	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
-		return users;
-
-	for(const auto& item : queryResult.GetItems()){
-		User user;
-		user.id=findOrThrow(item, "ID", "User record missing ID attribute").GetS();
-		user=getUser(user.id);
-		users.push_back(user);
-
-		//update caches
-		CacheRecord<User> record(user,userCacheValidity);
-		replaceCacheRecord(userCache,user.id,record);
-		CacheRecord<std::string> groupRecord(user.id,userCacheValidity);
-		userByGroupCache.insert_or_assign(group,groupRecord);
+	else{
+		using AV=Aws::DynamoDB::Model::AttributeValue;
+		countCacheMiss(userByGroupCache);
+		databaseQueries++;
+		
+		Aws::DynamoDB::Model::QueryOutcome outcome;
+		outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
+		                       .WithTableName(userTableName)
+		                       .WithIndexName("ByGroup")
+		                       .WithKeyConditionExpression("#groupID = :group_val")
+		                       .WithExpressionAttributeNames({{"#groupID", "groupID"}})
+		                       .WithExpressionAttributeValues({{":group_val", AV(group)}})
+		                       );
+		if(!outcome.IsSuccess()){
+			auto err=outcome.GetError();
+			log_error("Failed to list Users by Group: " << err.GetMessage());
+			return {};
+		}
+		
+		for(const auto& item : outcome.GetResult().GetItems()){
+			std::string uID=findOrThrow(item, "ID", "User record missing ID attribute").GetS();
+			memberIDs.push_back(uID);
+			CacheRecord<std::string> groupRecord(uID,userCacheValidity);
+			userByGroupCache.insert_or_assign(group,groupRecord);
+		}
+		userByGroupCache.update_expiration(group,std::chrono::steady_clock::now()+userCacheValidity);
 	}
-	userByGroupCache.update_expiration(group,std::chrono::steady_clock::now()+userCacheValidity);
 	
-	return users;	
+	//fetch all of the member records together
+	auto members=getUsers(memberIDs);
+	std::vector<User> users;
+	users.reserve(members.size());
+	for(const auto& uID : memberIDs){
+		auto member=members.find(uID);
+		if(member!=members.end())
+			users.push_back(member->second);
+	}
+	return users;
 }
 
 bool PersistentStore::addUserToGroup(const std::string& uID, std::string groupID){
@@ -1244,7 +2173,8 @@ bool PersistentStore::addUserToGroup(const std::string& uID, std::string groupID
 		return false;
 
 	Group group = findGroupByID(groupID);
-	User user = getUser(uID);
+	auto userRecord = getUser(uID);
+	const User& user = *userRecord;
 	
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto request=Aws::DynamoDB::Model::PutItemRequest()
@@ -1353,12 +2283,13 @@ bool PersistentStore::userInGroup(const std::string& uID, std::string groupID){
 		if(userByGroupCache.find(groupID,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(userByGroupCache,1);
 				return record;
 			}
 		}
 	}
 	//need to query the database
+	countCacheMiss(userByGroupCache);
 	databaseQueries++;
 	log_info("Querying database for user " << uID << " membership in Group " << groupID);
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -1411,8 +2342,11 @@ bool PersistentStore::addGroup(const Group& group){
 	}
 	
 	//update caches
+	forgetMissing(lookupKey(groupTableName,"",group.id));
+	forgetMissing(lookupKey(groupTableName,"ByName",group.name));
 	CacheRecord<Group> record(group,groupCacheValidity);
-	replaceCacheRecord(groupCache,group.id,record);
+	if(updateCacheRecord(groupCache,group.id,record))
+		groupListing.invalidate();
 	replaceCacheRecord(groupByNameCache,group.name,record);
         
 	return true;
@@ -1440,9 +2374,10 @@ bool PersistentStore::removeGroup(const std::string& groupID){
 			//don't particularly care whether the record is expired; if it is 
 			//all that will happen is that we will delete the equally stale 
 			//record in the other cache
-			groupByNameCache.erase(record.record.name);
+			groupByNameCache.erase(record.get().name);
 		}
-		groupCache.erase(groupID);
+		if(groupCache.erase(groupID))
+			groupListing.invalidate();
 	}
 	
 	//delete the Group record itself
@@ -1480,8 +2415,10 @@ bool PersistentStore::updateGroup(const Group& group){
 	}
 	
 	//update caches
+	forgetMissing(lookupKey(groupTableName,"ByName",group.name));
 	CacheRecord<Group> record(group,groupCacheValidity);
-	replaceCacheRecord(groupCache,group.id,record);
+	if(updateCacheRecord(groupCache,group.id,record))
+		groupListing.invalidate();
 	replaceCacheRecord(groupByNameCache,group.name,record);
 	//in principle we should update the groupByUserCache here, but we don't know 
 	//which users are the keys. However, that cache is used only for Group properties 
@@ -1540,64 +2477,37 @@ std::vector<std::string> PersistentStore::clustersOwnedByGroup(const std::string
 	return clusters;
 }
 
-std::vector<Group> PersistentStore::listGroups(){
-	//First check if vos are cached
-	std::vector<Group> collected;
-	if(groupCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-	        auto table = groupCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-		        auto group = itr->second;
-			cacheHits++;
-			collected.push_back(group);
-		}
-	
-		table.unlock();
-		return collected;
-	}	
-
-	databaseScans++;
+bool PersistentStore::loadGroups(){
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(groupTableName);
 	request.SetFilterExpression("attribute_exists(#name)");
 	request.SetExpressionAttributeNames({{"#name","name"}});
-	bool keepGoing=false;
+	auto expirationTime=std::chrono::steady_clock::now()+groupCacheValidity;
 	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch Group records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			Group group;
-			group.valid=true;
-			group.id=findOrThrow(item,"ID","Group record missing ID attribute").GetS();
-			group.name=findOrThrow(item,"name","Group record missing name attribute").GetS();
-			group.email=findOrDefault(item,"email",missingString).GetS();
-			group.phone=findOrDefault(item,"phone",missingString).GetS();
-			group.scienceField=findOrDefault(item,"scienceField",missingString).GetS();
-			group.description=findOrDefault(item,"description",missingString).GetS();
-			collected.push_back(group);
-
-			CacheRecord<Group> record(group,groupCacheValidity);
-			replaceCacheRecord(groupCache,group.id,record);
-			replaceCacheRecord(groupByNameCache,group.name,record);
-		}
-	}while(keepGoing);
-	groupCacheExpirationTime=std::chrono::steady_clock::now()+groupCacheValidity;
+	CategorySet seen;
+	bool success=scanEntities<Group>(request,"Group",&decodeGroup,
+	                                 [&](const Group& group){
+		cacheGroup(group);
+		seen.insert(group.id);
+	});
+	if(success){
+		std::vector<CacheRecord<Group>> removed;
+		removeUnseen(groupCache,seen,expirationTime,removed);
+		for(const auto& record : removed)
+			groupByNameCache.erase(record.peek().name);
+		if(!removed.empty())
+			groupListing.invalidate();
+		groupCacheExpirationTime=expirationTime;
+	}
+	return success;
+}
+
+std::vector<Group> PersistentStore::listGroups(){
+	ensureLoaded(groupsLoaded,groupLoadMutex,&PersistentStore::loadGroups);
 	
-	return collected;
+	auto snapshot=groupListing.get([this]{ return snapshotCache(groupCache); });
+	countCacheHits(groupListing,snapshot->size());
+	return *snapshot;
 }
 
 std::vector<Group> PersistentStore::listGroupsForUser(const std::string& user){
@@ -1635,7 +2545,8 @@ std::vector<Group> PersistentStore::listGroupsForUser(const std::string& user){
 		
 		//update caches
 		CacheRecord<Group> record(group,groupCacheValidity);
-		replaceCacheRecord(groupCache,group.id,record);
+		if(updateCacheRecord(groupCache,group.id,record))
+			groupListing.invalidate();
 		groupByNameCache.insert_or_assign(group.name,record);
 		groupByUserCache.insert_or_assign(user,record);
 	}
@@ -1644,20 +2555,44 @@ std::vector<Group> PersistentStore::listGroupsForUser(const std::string& user){
 	return vos;
 }
 
-Group PersistentStore::findGroupByID(const std::string& id){
+std::shared_ptr<const Group> PersistentStore::lookupGroupByID(const std::string& id){
 	//first see if we have this cached
 	{
 		CacheRecord<Group> record;
 		if(groupCache.find(id,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
-				return record;
+				countCacheHits(groupCache,1);
+				return record.share();
+			}
+			//if it is only somewhat out of date, use it while a replacement 
+			//is fetched in the background
+			if(record.usableWithin(groupCacheGracePeriod)){
+				countStaleCacheHit(groupCache);
+				refreshInBackground("group:"+id,[this,id]{ fetchGroupByID(id); });
+				return record.share();
 			}
 		}
 	}
+	//if the record was recently found not to exist, don't look again
+	if(recentlyMissing(lookupKey(groupTableName,"",id)))
+		return CacheRecord<Group>().share();
+	countCacheMiss(groupCache);
+	return shareRecord(fetchGroupByID(id));
+}
+
+Group PersistentStore::findGroupByID(const std::string& id){
+	return *lookupGroupByID(id);
+}
+
+Group PersistentStore::fetchGroupByID(const std::string& id){
+	return groupLookups.run(lookupKey(groupTableName,"",id),[&]{ return queryGroupByID(id); });
+}
+
+Group PersistentStore::queryGroupByID(const std::string& id){
 	//need to query the database
 	databaseQueries++;
+	auto missingGeneration=missingRecordGeneration.load();
 	log_info("Querying database for Group " << id);
 	using Aws::DynamoDB::Model::AttributeValue;
 	auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
@@ -1670,8 +2605,13 @@ Group PersistentStore::findGroupByID(const std::string& id){
 		return Group();
 	}
 	const auto& item=outcome.GetResult().GetItem();
-	if(item.empty()) //no match found
+	if(item.empty()){ //no match found
+		//discard any stale record which is still cached
+		if(groupCache.erase(id))
+			groupListing.invalidate();
+		recordMissing(lookupKey(groupTableName,"",id),missingGeneration);
 		return Group{};
+	}
 	Group group;
 	group.valid=true;
 	group.id=id;
@@ -1683,26 +2623,51 @@ Group PersistentStore::findGroupByID(const std::string& id){
 	
 	//update caches
 	CacheRecord<Group> record(group,groupCacheValidity);
-	replaceCacheRecord(groupCache,group.id,record);
+	if(updateCacheRecord(groupCache,group.id,record))
+		groupListing.invalidate();
 	replaceCacheRecord(groupByNameCache,group.name,record);
 	
 	return group;
 }
 
-Group PersistentStore::findGroupByName(const std::string& name){
+std::shared_ptr<const Group> PersistentStore::lookupGroupByName(const std::string& name){
 	//first see if we have this cached
 	{
 		CacheRecord<Group> record;
 		if(groupByNameCache.find(name,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
-				return record;
+				countCacheHits(groupByNameCache,1);
+				return record.share();
+			}
+			//if it is only somewhat out of date, use it while a replacement 
+			//is fetched in the background
+			if(record.usableWithin(groupCacheGracePeriod)){
+				countStaleCacheHit(groupByNameCache);
+				refreshInBackground("groupName:"+name,[this,name]{ fetchGroupByName(name); });
+				return record.share();
 			}
 		}
 	}
+	//if the record was recently found not to exist, don't look again
+	if(recentlyMissing(lookupKey(groupTableName,"ByName",name)))
+		return CacheRecord<Group>().share();
+	countCacheMiss(groupByNameCache);
+	return shareRecord(fetchGroupByName(name));
+}
+
+Group PersistentStore::findGroupByName(const std::string& name){
+	return *lookupGroupByName(name);
+}
+
+Group PersistentStore::fetchGroupByName(const std::string& name){
+	return groupLookups.run(lookupKey(groupTableName,"ByName",name),[&]{ return queryGroupByName(name); });
+}
+
+Group PersistentStore::queryGroupByName(const std::string& name){
 	//need to query the database
 	databaseQueries++;
+	auto missingGeneration=missingRecordGeneration.load();
 	log_info("Querying database for Group " << name);
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	auto outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
@@ -1718,8 +2683,12 @@ Group PersistentStore::findGroupByName(const std::string& name){
 		return Group();
 	}
 	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
+	if(queryResult.GetCount()==0){
+		//discard any stale record which is still cached
+		groupByNameCache.erase(name);
+		recordMissing(lookupKey(groupTableName,"ByName",name),missingGeneration);
 		return Group();
+	}
 	if(queryResult.GetCount()>1)
 		log_fatal("Group name \"" << name << "\" is not unique!");
 	
@@ -1735,16 +2704,17 @@ Group PersistentStore::findGroupByName(const std::string& name){
 	
 	//update caches
 	CacheRecord<Group> record(group,groupCacheValidity);
-	replaceCacheRecord(groupCache,group.id,record);
+	if(updateCacheRecord(groupCache,group.id,record))
+		groupListing.invalidate();
 	replaceCacheRecord(groupByNameCache,group.name,record);
 	
 	return group;
 }
 
-Group PersistentStore::getGroup(const std::string& idOrName){
+std::shared_ptr<const Group> PersistentStore::getGroup(const std::string& idOrName){
 	if(idOrName.find(IDGenerator::groupIDPrefix)==0)
-		return findGroupByID(idOrName);
-	return findGroupByName(idOrName);
+		return lookupGroupByID(idOrName);
+	return lookupGroupByName(idOrName);
 }
 
 //----
@@ -1775,8 +2745,11 @@ bool PersistentStore::addCluster(const Cluster& cluster){
 		return false;
 	}
 	
+	forgetMissing(lookupKey(clusterTableName,"",cluster.id));
+	forgetMissing(lookupKey(clusterTableName,"ByName",cluster.name));
 	CacheRecord<Cluster> record(cluster,clusterCacheValidity);
-	replaceCacheRecord(clusterCache,cluster.id,record);
+	if(updateCacheRecord(clusterCache,cluster.id,record))
+		clusterListing.invalidate();
 	replaceCacheRecord(clusterByNameCache,cluster.name,record);
 	clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
 	writeClusterConfigToDisk(cluster);
@@ -1796,21 +2769,45 @@ void PersistentStore::writeClusterConfigToDisk(const Cluster& cluster){
 	replaceCacheRecord(clusterConfigs,cluster.id,std::make_shared<FileHandle>(std::move(file)));
 }
 
-Cluster PersistentStore::findClusterByID(const std::string& cID){
+std::shared_ptr<const Cluster> PersistentStore::lookupClusterByID(const std::string& cID){
 	//first see if we have this cached
 	{
 		CacheRecord<Cluster> record;
 		if(clusterCache.find(cID,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
-				return record;
+				countCacheHits(clusterCache,1);
+				return record.share();
+			}
+			//if it is only somewhat out of date, use it while a replacement 
+			//is fetched in the background
+			if(record.usableWithin(clusterCacheGracePeriod)){
+				countStaleCacheHit(clusterCache);
+				refreshInBackground("cluster:"+cID,[this,cID]{ fetchClusterByID(cID); });
+				return record.share();
 			}
 		}
 	}
+	//if the record was recently found not to exist, don't look again
+	if(recentlyMissing(lookupKey(clusterTableName,"",cID)))
+		return CacheRecord<Cluster>().share();
+	countCacheMiss(clusterCache);
+	return shareRecord(fetchClusterByID(cID));
+}
+
+Cluster PersistentStore::findClusterByID(const std::string& cID){
+	return *lookupClusterByID(cID);
+}
+
+Cluster PersistentStore::fetchClusterByID(const std::string& cID){
+	return clusterLookups.run(lookupKey(clusterTableName,"",cID),[&]{ return queryClusterByID(cID); });
+}
+
+Cluster PersistentStore::queryClusterByID(const std::string& cID){
 	//need to query the database
 	using Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
+	auto missingGeneration=missingRecordGeneration.load();
 	log_info("Querying database for cluster " << cID);
 	auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
 								  .WithTableName(clusterTableName)
@@ -1822,8 +2819,13 @@ Cluster PersistentStore::findClusterByID(const std::string& cID){
 		return Cluster();
 	}
 	const auto& item=outcome.GetResult().GetItem();
-	if(item.empty()) //no match found
+	if(item.empty()){ //no match found
+		//discard any stale record which is still cached
+		if(clusterCache.erase(cID))
+			clusterListing.invalidate();
+		recordMissing(lookupKey(clusterTableName,"",cID),missingGeneration);
 		return Cluster{};
+	}
 	Cluster cluster;
 	cluster.valid=true;
 	cluster.id=cID;
@@ -1835,7 +2837,8 @@ Cluster PersistentStore::findClusterByID(const std::string& cID){
 	
 	//cache this result for reuse
 	CacheRecord<Cluster> record(cluster,clusterCacheValidity);
-	replaceCacheRecord(clusterCache,cluster.id,record);
+	if(updateCacheRecord(clusterCache,cluster.id,record))
+		clusterListing.invalidate();
 	clusterByNameCache.insert_or_assign(cluster.name,record);
 	clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
 	writeClusterConfigToDisk(cluster);
@@ -1843,21 +2846,45 @@ Cluster PersistentStore::findClusterByID(const std::string& cID){
 	return cluster;
 }
 
-Cluster PersistentStore::findClusterByName(const std::string& name){
+std::shared_ptr<const Cluster> PersistentStore::lookupClusterByName(const std::string& name){
 	//first see if we have this cached
 	{
 		CacheRecord<Cluster> record;
 		if(clusterByNameCache.find(name,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
-				return record;
+				countCacheHits(clusterByNameCache,1);
+				return record.share();
+			}
+			//if it is only somewhat out of date, use it while a replacement 
+			//is fetched in the background
+			if(record.usableWithin(clusterCacheGracePeriod)){
+				countStaleCacheHit(clusterByNameCache);
+				refreshInBackground("clusterName:"+name,[this,name]{ fetchClusterByName(name); });
+				return record.share();
 			}
 		}
 	}
+	//if the record was recently found not to exist, don't look again
+	if(recentlyMissing(lookupKey(clusterTableName,"ByName",name)))
+		return CacheRecord<Cluster>().share();
+	countCacheMiss(clusterByNameCache);
+	return shareRecord(fetchClusterByName(name));
+}
+
+Cluster PersistentStore::findClusterByName(const std::string& name){
+	return *lookupClusterByName(name);
+}
+
+Cluster PersistentStore::fetchClusterByName(const std::string& name){
+	return clusterLookups.run(lookupKey(clusterTableName,"ByName",name),[&]{ return queryClusterByName(name); });
+}
+
+Cluster PersistentStore::queryClusterByName(const std::string& name){
 	//need to query the database
 	using AV=Aws::DynamoDB::Model::AttributeValue;
 	databaseQueries++;
+	auto missingGeneration=missingRecordGeneration.load();
 	log_info("Querying database for cluster " << name);
 	auto outcome=dbClient.Query(Aws::DynamoDB::Model::QueryRequest()
 	                            .WithTableName(clusterTableName)
@@ -1872,8 +2899,12 @@ Cluster PersistentStore::findClusterByName(const std::string& name){
 		return Cluster();
 	}
 	const auto& queryResult=outcome.GetResult();
-	if(queryResult.GetCount()==0)
+	if(queryResult.GetCount()==0){
+		//discard any stale record which is still cached
+		clusterByNameCache.erase(name);
+		recordMissing(lookupKey(clusterTableName,"ByName",name),missingGeneration);
 		return Cluster();
+	}
 	if(queryResult.GetCount()>1)
 		log_fatal("Cluster name \"" << name << "\" is not unique!");
 	
@@ -1893,7 +2924,8 @@ Cluster PersistentStore::findClusterByName(const std::string& name){
 	
 	//cache this result for reuse
 	CacheRecord<Cluster> record(cluster,clusterCacheValidity);
-	replaceCacheRecord(clusterCache,cluster.id,record);
+	if(updateCacheRecord(clusterCache,cluster.id,record))
+		clusterListing.invalidate();
 	clusterByNameCache.insert_or_assign(cluster.name,record);
 	clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
 	writeClusterConfigToDisk(cluster);
@@ -1901,10 +2933,10 @@ Cluster PersistentStore::findClusterByName(const std::string& name){
 	return cluster;
 }
 
-Cluster PersistentStore::getCluster(const std::string& idOrName){
+std::shared_ptr<const Cluster> PersistentStore::getCluster(const std::string& idOrName){
 	if(idOrName.find(IDGenerator::clusterIDPrefix)==0)
-		return findClusterByID(idOrName);
-	return findClusterByName(idOrName);
+		return lookupClusterByID(idOrName);
+	return lookupClusterByName(idOrName);
 }
 
 bool PersistentStore::removeCluster(const std::string& cID){
@@ -1925,11 +2957,12 @@ bool PersistentStore::removeCluster(const std::string& cID){
 			//don't particularly care whether the record is expired; if it is 
 			//all that will happen is that we will delete the equally stale 
 			//record in the other cache
-			clusterByNameCache.erase(record.record.name);
-			clusterByGroupCache.erase(record.record.owningGroup,record);
+			clusterByNameCache.erase(record.get().name);
+			clusterByGroupCache.erase(record.get().owningGroup,record);
 		}
 	}
-	clusterCache.erase(cID);
+	if(clusterCache.erase(cID))
+		clusterListing.invalidate();
 	clusterConfigs.erase(cID);
 	clusterLocationCache.erase(cID);
 	
@@ -1976,8 +3009,10 @@ bool PersistentStore::updateCluster(const Cluster& cluster){
 	}
 	
 	//update caches
+	forgetMissing(lookupKey(clusterTableName,"ByName",cluster.name));
 	CacheRecord<Cluster> record(cluster,clusterCacheValidity);
-	replaceCacheRecord(clusterCache,cluster.id,record);
+	if(updateCacheRecord(clusterCache,cluster.id,record))
+		clusterListing.invalidate();
 	clusterByNameCache.insert_or_assign(cluster.name,record);
 	clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
 	writeClusterConfigToDisk(cluster);
@@ -1986,67 +3021,40 @@ bool PersistentStore::updateCluster(const Cluster& cluster){
 }
 
 
-std::vector<Cluster> PersistentStore::listClusters(){
-	std::vector<Cluster> collected;
-
-	// first check if clusters are cached
-	if(clusterCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-		auto table = clusterCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-			auto cluster = itr->second;
-			cacheHits++;
-			collected.push_back(cluster);
-		 }
-		
-		table.unlock();
-		return collected;
-	}
-
-	databaseScans++;
+bool PersistentStore::loadClusters(){
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(clusterTableName);
 	request.SetFilterExpression("attribute_not_exists(#groupID) AND attribute_exists(#name)");
 	request.SetExpressionAttributeNames({{"#groupID", "groupID"},{"#name","name"}});
-	bool keepGoing=false;
+	auto expirationTime=std::chrono::steady_clock::now()+clusterCacheValidity;
 	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch cluster records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
-		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			Cluster cluster;
-			cluster.valid=true;
-			cluster.id=findOrThrow(item,"ID","Cluster record missing ID attribute").GetS();
-			cluster.name=findOrThrow(item,"name","Cluster record missing name attribute").GetS();
-			cluster.owningGroup=findOrThrow(item,"owningGroup","Cluster record missing owningGroup attribute").GetS();
-			cluster.config=findOrThrow(item,"config","Cluster record missing config attribute").GetS();
-			cluster.systemNamespace=findOrThrow(item,"systemNamespace","Cluster record missing systemNamespace attribute").GetS();
-			cluster.owningOrganization=findOrDefault(item,"owningOrganization",missingString).GetS();
-			collected.push_back(cluster);
-			
-			CacheRecord<Cluster> record(cluster,clusterCacheValidity);
-			replaceCacheRecord(clusterCache,cluster.id,record);
-			clusterByNameCache.insert_or_assign(cluster.name,record);
-			clusterByGroupCache.insert_or_assign(cluster.owningGroup,record);
-			writeClusterConfigToDisk(cluster);
+	CategorySet seen;
+	bool success=scanEntities<Cluster>(request,"cluster",&decodeCluster,
+	                                   [&](const Cluster& cluster){
+		cacheCluster(cluster);
+		seen.insert(cluster.id);
+	});
+	if(success){
+		std::vector<CacheRecord<Cluster>> removed;
+		removeUnseen(clusterCache,seen,expirationTime,removed);
+		for(const auto& record : removed){
+			clusterByNameCache.erase(record.peek().name);
+			clusterByGroupCache.erase(record.peek().owningGroup,record);
+			clusterLocationCache.erase(record.peek().id);
 		}
-	}while(keepGoing);
-	clusterCacheExpirationTime=std::chrono::steady_clock::now()+clusterCacheValidity;
+		if(!removed.empty())
+			clusterListing.invalidate();
+		clusterCacheExpirationTime=expirationTime;
+	}
+	return success;
+}
+
+std::vector<Cluster> PersistentStore::listClusters(){
+	ensureLoaded(clustersLoaded,clusterLoadMutex,&PersistentStore::loadClusters);
 	
-	return collected;
+	auto snapshot=clusterListing.get([this]{ return snapshotCache(clusterCache); });
+	countCacheHits(clusterListing,snapshot->size());
+	return *snapshot;
 }
 
 std::vector<Cluster> PersistentStore::listClustersByGroup(std::string group){
@@ -2201,12 +3209,13 @@ bool PersistentStore::groupAllowedOnCluster(std::string groupID, std::string cID
 		if(clusterGroupAccessCache.find(cID,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(clusterGroupAccessCache,1);
 				return record;
 			}
 		}
 	}
 	//need to query the database
+	countCacheMiss(clusterGroupAccessCache);
 	databaseQueries++;
 	log_info("Querying database for Group " << groupID << " access to cluster " << cID);
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -2236,12 +3245,13 @@ bool PersistentStore::clusterAllowsAllgroups(std::string cID){
 		if(clusterGroupAccessCache.find(cID,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(clusterGroupAccessCache,1);
 				return record;
 			}
 		}
 	}
 	//query the database
+	countCacheMiss(clusterGroupAccessCache);
 	databaseQueries++;
 	log_info("Querying database for wildcard access to cluster " << cID);
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -2279,41 +3289,45 @@ std::set<std::string> PersistentStore::listApplicationsGroupMayUseOnCluster(std:
 		if(clusterGroupApplicationCache.find(sortKey,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(clusterGroupApplicationCache,1);
 				return record;
 			}
 		}
 	}
-	//query the database
-	databaseQueries++;
-	log_info("Querying database for applications " << groupID << " may use on " << cID);
-	using Aws::DynamoDB::Model::AttributeValue;
-	auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
-								  .WithTableName(clusterTableName)
-								  .WithKey({{"ID",AttributeValue(cID)},
-	                                        {"sortKey",AttributeValue(sortKey)}}));
-	if(!outcome.IsSuccess()){
-		auto err=outcome.GetError();
-		log_error("Failed to fetch Group application use record: " << err.GetMessage());
-		return {};
-	}
-	std::set<std::string> result;
-	const auto& item=outcome.GetResult().GetItem();
-	if(item.empty()){ //no record found, treat this as all allowed
-		log_info("Found no record of allowed applications for " << groupID << " on " << cID << ", treating as universal");
-		result={wildcardName};
-	}
-	else{
-		auto applications=findOrThrow(item,"applications","Cluster record missing applications attribute").GetSS();
-		result=std::set<std::string>(applications.begin(),applications.end());
-		if(result.count("<none>"))
-			result={};
-	}
-	//update cache
-	CacheRecord<std::set<std::string>> record(result,clusterCacheValidity);
-	replaceCacheRecord(clusterGroupApplicationCache,sortKey,record);
+	//query the database, unless another thread is already doing so
+	countCacheMiss(clusterGroupApplicationCache);
+	return applicationPermissionLookups.run(lookupKey(clusterTableName,"",cID+"/"+sortKey),
+	  [&]()->std::set<std::string>{
+		databaseQueries++;
+		log_info("Querying database for applications " << groupID << " may use on " << cID);
+		using Aws::DynamoDB::Model::AttributeValue;
+		auto outcome=dbClient.GetItem(Aws::DynamoDB::Model::GetItemRequest()
+									  .WithTableName(clusterTableName)
+									  .WithKey({{"ID",AttributeValue(cID)},
+		                                        {"sortKey",AttributeValue(sortKey)}}));
+		if(!outcome.IsSuccess()){
+			auto err=outcome.GetError();
+			log_error("Failed to fetch Group application use record: " << err.GetMessage());
+			return {};
+		}
+		std::set<std::string> result;
+		const auto& item=outcome.GetResult().GetItem();
+		if(item.empty()){ //no record found, treat this as all allowed
+			log_info("Found no record of allowed applications for " << groupID << " on " << cID << ", treating as universal");
+			result={wildcardName};
+		}
+		else{
+			auto applications=findOrThrow(item,"applications","Cluster record missing applications attribute").GetSS();
+			result=std::set<std::string>(applications.begin(),applications.end());
+			if(result.count("<none>"))
+				result={};
+		}
+		//update cache
+		CacheRecord<std::set<std::string>> record(result,clusterCacheValidity);
+		replaceCacheRecord(clusterGroupApplicationCache,sortKey,record);
 	
-	return result;
+		return result;
+	});
 }
 
 bool PersistentStore::allowVoToUseApplication(std::string groupID, std::string cID, std::string appName){
@@ -2445,13 +3459,14 @@ std::vector<GeoLocation> PersistentStore::getLocationsForCluster(std::string cID
 		if(clusterLocationCache.find(cID,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(clusterLocationCache,1);
 				return record;
 			}
 		}
 	}
 	
 	//query the database
+	countCacheMiss(clusterLocationCache);
 	databaseQueries++;
 	log_info("Querying database for locations associated with cluster " << cID);
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -2580,7 +3595,8 @@ bool PersistentStore::addApplicationInstance(const ApplicationInstance& inst){
 	
 	//update caches
 	CacheRecord<ApplicationInstance> record(inst,instanceCacheValidity);
-	replaceCacheRecord(instanceCache,inst.id,record);
+	if(updateCacheRecord(instanceCache,inst.id,record))
+		instanceListing.invalidate();
 	instanceByGroupCache.insert_or_assign(inst.owningGroup,record);
 	instanceByNameCache.insert_or_assign(inst.name,record);
 	instanceByClusterCache.insert_or_assign(inst.cluster,record);
@@ -2604,12 +3620,13 @@ bool PersistentStore::removeApplicationInstance(const std::string& id){
 			//don't particularly care whether the record is expired; if it is 
 			//all that will happen is that we will delete the equally stale 
 			//record in the other cache
-			instanceByGroupCache.erase(record.record.owningGroup,record);
-			instanceByNameCache.erase(record.record.name,record);
-			instanceByClusterCache.erase(record.record.cluster,record);
-			instanceByGroupAndClusterCache.erase(record.record.owningGroup+":"+record.record.cluster,record);
+			instanceByGroupCache.erase(record.get().owningGroup,record);
+			instanceByNameCache.erase(record.get().name,record);
+			instanceByClusterCache.erase(record.get().cluster,record);
+			instanceByGroupAndClusterCache.erase(record.get().owningGroup+":"+record.get().cluster,record);
 		}
-		instanceCache.erase(id);
+		if(instanceCache.erase(id))
+			instanceListing.invalidate();
 		instanceConfigCache.erase(id);
 	}
 	
@@ -2635,19 +3652,20 @@ bool PersistentStore::removeApplicationInstance(const std::string& id){
 	return true;
 }
 
-ApplicationInstance PersistentStore::getApplicationInstance(const std::string& id){
+std::shared_ptr<const ApplicationInstance> PersistentStore::getApplicationInstance(const std::string& id){
 	//first see if we have this cached
 	{
 		CacheRecord<ApplicationInstance> record;
 		if(instanceCache.find(id,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
-				return record;
+				countCacheHits(instanceCache,1);
+				return record.share();
 			}
 		}
 	}
 	//need to query the database
+	countCacheMiss(instanceCache);
 	databaseQueries++;
 	log_info("Querying database for instance " << id);
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -2658,11 +3676,11 @@ ApplicationInstance PersistentStore::getApplicationInstance(const std::string& i
 	if(!outcome.IsSuccess()){
 		auto err=outcome.GetError();
 		log_error("Failed to fetch application instance record: " << err.GetMessage());
-		return ApplicationInstance();
+		return CacheRecord<ApplicationInstance>().share();
 	}
 	const auto& item=outcome.GetResult().GetItem();
 	if(item.empty()) //no match found
-		return ApplicationInstance{};
+		return CacheRecord<ApplicationInstance>().share();
 	ApplicationInstance inst;
 	inst.valid=true;
 	inst.id=id;
@@ -2674,12 +3692,13 @@ ApplicationInstance PersistentStore::getApplicationInstance(const std::string& i
 	
 	//update caches
 	CacheRecord<ApplicationInstance> record(inst,instanceCacheValidity);
-	replaceCacheRecord(instanceCache,inst.id,record);
+	if(updateCacheRecord(instanceCache,inst.id,record))
+		instanceListing.invalidate();
 	instanceByGroupCache.insert_or_assign(inst.owningGroup,record);
 	instanceByNameCache.insert_or_assign(inst.name,record);
 	instanceByClusterCache.insert_or_assign(inst.cluster,record);
 	instanceByGroupAndClusterCache.insert_or_assign(inst.owningGroup+":"+inst.cluster,record);
-	return inst;
+	return record.share();
 }
 
 std::string PersistentStore::getApplicationInstanceConfig(const std::string& id){
@@ -2689,12 +3708,13 @@ std::string PersistentStore::getApplicationInstanceConfig(const std::string& id)
 		if(instanceConfigCache.find(id,record)){
 			//we have a cached record; is it still valid?
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(instanceConfigCache,1);
 				return record;
 			}
 		}
 	}
 	//need to query the database
+	countCacheMiss(instanceConfigCache);
 	databaseQueries++;
 	log_info("Querying database for instance " << id << " config");
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -2719,66 +3739,70 @@ std::string PersistentStore::getApplicationInstanceConfig(const std::string& id)
 	return config;
 }
 
-std::vector<ApplicationInstance> PersistentStore::listApplicationInstances(){
-	//First check if instances are cached
-	std::vector<ApplicationInstance> collected;
-	if(instanceCacheExpirationTime.load() > std::chrono::steady_clock::now()){
-		auto table = instanceCache.lock_table();
-		for(auto itr = table.cbegin(); itr != table.cend(); itr++){
-			auto instance = itr->second;
-			cacheHits++;
-			collected.push_back(instance);
-		 }
-		
-		table.unlock();
-		return collected;
-	}
-
-	databaseScans++;
+bool PersistentStore::loadInstances(){
 	Aws::DynamoDB::Model::ScanRequest request;
 	request.SetTableName(instanceTableName);
 	request.SetFilterExpression("attribute_exists(ctime)");
-	bool keepGoing=false;
-	
-	do{
-		auto outcome=dbClient.Scan(request);
-		if(!outcome.IsSuccess()){
-			//TODO: more principled logging or reporting of the nature of the error
-			auto err=outcome.GetError();
-			log_error("Failed to fetch application instance records: " << err.GetMessage());
-			return collected;
-		}
-		const auto& result=outcome.GetResult();
-		//set up fetching the next page if necessary
-		if(!result.GetLastEvaluatedKey().empty()){
-			keepGoing=true;
-			request.SetExclusiveStartKey(result.GetLastEvaluatedKey());
+	auto expirationTime=std::chrono::steady_clock::now()+instanceCacheValidity;
+	
+	//Since every instance is read, the per-group and per-cluster sets of 
+	//instances which were seen are known to be complete.
+	CategorySet seen, groups, clusters, groupsAndClusters;
+	bool success=scanEntities<ApplicationInstance>(request,"application instance",&decodeInstance,
+	  [&](const ApplicationInstance& inst){
+		cacheInstance(inst);
+		seen.insert(inst.id);
+		groups.insert(inst.owningGroup);
+		clusters.insert(inst.cluster);
+		groupsAndClusters.insert(inst.owningGroup+":"+inst.cluster);
+	});
+	if(success){
+		std::vector<CacheRecord<ApplicationInstance>> removed;
+		removeUnseen(instanceCache,seen,expirationTime,removed);
+		for(const auto& record : removed){
+			const ApplicationInstance& instance=record.peek();
+			instanceByGroupCache.erase(instance.owningGroup,record);
+			instanceByNameCache.erase(instance.name,record);
+			instanceByClusterCache.erase(instance.cluster,record);
+			instanceByGroupAndClusterCache.erase(instance.owningGroup+":"+instance.cluster,record);
+			instanceConfigCache.erase(instance.id);
 		}
-		else
-			keepGoing=false;
-		//collect results from this page
-		for(const auto& item : result.GetItems()){
-			ApplicationInstance inst;
-			inst.valid=true;
-			inst.id=findOrThrow(item,"ID","Instance record missing ID attribute").GetS();
-			inst.name=findOrThrow(item,"name","Instance record missing name attribute").GetS();
-			inst.application=findOrThrow(item,"application","Instance record missing application attribute").GetS();
-			inst.owningGroup=findOrThrow(item,"owningGroup","Instance record missing ID attribute").GetS();
-			inst.cluster=findOrThrow(item,"cluster","Instance record missing ID attribute").GetS();
-			inst.ctime=findOrThrow(item,"ctime","Instance record missing ID attribute").GetS();
-			collected.push_back(inst);
-
-			CacheRecord<ApplicationInstance> record(inst,instanceCacheValidity);
-			replaceCacheRecord(instanceCache,inst.id,record);
-			instanceByNameCache.insert_or_assign(inst.name,record);
-			instanceByGroupCache.insert_or_assign(inst.owningGroup,record);
-			instanceByClusterCache.insert_or_assign(inst.cluster,record);
-			instanceByGroupAndClusterCache.insert_or_assign(inst.owningGroup+":"+inst.cluster,record);
-		}
-	}while(keepGoing);
-	instanceCacheExpirationTime=std::chrono::steady_clock::now()+instanceCacheValidity;
+		if(!removed.empty())
+			instanceListing.invalidate();
+		instanceCacheExpirationTime=expirationTime;
+		groups.markComplete(instanceByGroupCache,expirationTime);
+		clusters.markComplete(instanceByClusterCache,expirationTime);
+		groupsAndClusters.markComplete(instanceByGroupAndClusterCache,expirationTime);
+	}
+	return success;
+}
+
+bool PersistentStore::loadSecrets(){
+	Aws::DynamoDB::Model::ScanRequest request;
+	request.SetTableName(secretTableName);
+	request.SetFilterExpression("attribute_exists(contents)");
+	auto expirationTime=std::chrono::steady_clock::now()+secretCacheValidity;
+	
+	CategorySet groups, groupsAndClusters;
+	bool success=scanEntities<Secret>(request,"secret",&decodeSecret,
+	  [&](const Secret& secret){
+		cacheSecret(secret);
+		groups.insert(secret.group);
+		groupsAndClusters.insert(secret.group+":"+secret.cluster);
+	});
+	if(success){
+		groups.markComplete(secretByGroupCache,expirationTime);
+		groupsAndClusters.markComplete(secretByGroupAndClusterCache,expirationTime);
+	}
+	return success;
+}
+
+std::vector<ApplicationInstance> PersistentStore::listApplicationInstances(){
+	ensureLoaded(instancesLoaded,instanceLoadMutex,&PersistentStore::loadInstances);
 	
-	return collected;
+	auto snapshot=instanceListing.get([this]{ return snapshotCache(instanceCache); });
+	countCacheHits(instanceListing,snapshot->size());
+	return *snapshot;
 }
 
 std::vector<ApplicationInstance> PersistentStore::listApplicationInstancesByClusterOrGroup(std::string group, std::string cluster){
@@ -2854,7 +3878,8 @@ std::vector<ApplicationInstance> PersistentStore::listApplicationInstancesByClus
 		
 		//update caches
 		CacheRecord<ApplicationInstance> record(instance,instanceCacheValidity);
-		replaceCacheRecord(instanceCache,instance.id,record);
+		if(updateCacheRecord(instanceCache,instance.id,record))
+			instanceListing.invalidate();
 		instanceByGroupCache.insert_or_assign(instance.owningGroup,record);
 		instanceByNameCache.insert_or_assign(instance.name,record);
 		instanceByClusterCache.insert_or_assign(instance.cluster,record);
@@ -2912,7 +3937,8 @@ std::vector<ApplicationInstance> PersistentStore::findInstancesByName(const std:
 		
 		//update caches since we bothered to pull stuff directly from the DB
 		CacheRecord<ApplicationInstance> record(instance,instanceCacheValidity);
-		replaceCacheRecord(instanceCache,instance.id,record);
+		if(updateCacheRecord(instanceCache,instance.id,record))
+			instanceListing.invalidate();
 		instanceByGroupCache.insert_or_assign(instance.owningGroup,record);
 		instanceByNameCache.insert_or_assign(instance.name,record);
 		instanceByClusterCache.insert_or_assign(instance.cluster,record);
@@ -2921,35 +3947,200 @@ std::vector<ApplicationInstance> PersistentStore::findInstancesByName(const std:
 	return instances;
 }
 
-std::string PersistentStore::encryptSecret(const SecretData& s) const{
-	std::size_t outLen=s.dataSize+128;
-	std::string result(outLen,'\0');
-	int err=scryptenc_buf((const uint8_t*)s.data.get(),s.dataSize,
-	                      (uint8_t*)&result.front(),
-	                      (const uint8_t*)secretKey.data.get(),secretKey.dataSize,
-	                      17,8,1);
+namespace{
+
+///Secrets encrypted with the legacy scheme, using a key derived with scrypt
+///for each secret, begin with this
+const std::string legacySecretMagic="scrypt";
+///The size of the header and trailer added by scryptenc_buf
+const std::size_t legacySecretOverhead=128;
+
+///Secrets encrypted with a per-secret data key, which is itself encrypted 
+///with the master key, begin with this
+const std::string envelopeSecretMagic="slenv1";
+const std::size_t aesKeySize=32;
+const std::size_t gcmNonceSize=12;
+const std::size_t gcmTagSize=16;
+///Layout of an envelope encrypted secret:
+///magic | key nonce | encrypted data key | key tag | data nonce | encrypted data | data tag
+const std::size_t envelopeSecretOverhead=envelopeSecretMagic.size()
+	+gcmNonceSize+aesKeySize+gcmTagSize+gcmNonceSize+gcmTagSize;
+
+using CipherContext=std::unique_ptr<EVP_CIPHER_CTX,void(*)(EVP_CIPHER_CTX*)>;
+
+CipherContext makeCipherContext(){
+	CipherContext ctx(EVP_CIPHER_CTX_new(),&EVP_CIPHER_CTX_free);
+	if(!ctx)
+		throw std::runtime_error("Failed to allocate cipher context");
+	return ctx;
+}
+
+///Encrypt data with AES-256-GCM, authenticating the envelope magic string as 
+///additional data
+///\param key the 32 byte key
+///\param input the data to encrypt
+///\param inputSize the length of the data to encrypt
+///\param output the destination for the nonce, followed by the encrypted 
+///              data, followed by the tag, which must have space for 
+///              inputSize+gcmNonceSize+gcmTagSize bytes
+void gcmEncrypt(const uint8_t* key, const uint8_t* input, std::size_t inputSize, uint8_t* output){
+	uint8_t* nonce=output;
+	uint8_t* cipherText=output+gcmNonceSize;
+	uint8_t* tag=cipherText+inputSize;
+	if(RAND_bytes(nonce,gcmNonceSize)!=1)
+		throw std::runtime_error("Failed to generate encryption nonce");
+	CipherContext ctx=makeCipherContext();
+	int len=0;
+	if(EVP_EncryptInit_ex(ctx.get(),EVP_aes_256_gcm(),nullptr,key,nonce)!=1
+	   || EVP_EncryptUpdate(ctx.get(),nullptr,&len,(const uint8_t*)envelopeSecretMagic.data(),envelopeSecretMagic.size())!=1
+	   || EVP_EncryptUpdate(ctx.get(),cipherText,&len,input,inputSize)!=1
+	   || EVP_EncryptFinal_ex(ctx.get(),cipherText+len,&len)!=1
+	   || EVP_CIPHER_CTX_ctrl(ctx.get(),EVP_CTRL_GCM_GET_TAG,gcmTagSize,tag)!=1)
+		throw std::runtime_error("Failed to encrypt with AES-GCM");
+}
+
+///Decrypt and authenticate data encrypted by gcmEncrypt
+///\param key the 32 byte key
+///\param input the nonce, encrypted data, and tag
+///\param inputSize the total length of the input
+///\param output the destination for the decrypted data, which must have space 
+///              for inputSize-gcmNonceSize-gcmTagSize bytes
+void gcmDecrypt(const uint8_t* key, const uint8_t* input, std::size_t inputSize, uint8_t* output){
+	if(inputSize<gcmNonceSize+gcmTagSize)
+		throw std::runtime_error("Invalid encrypted data: too short");
+	const std::size_t cipherTextSize=inputSize-gcmNonceSize-gcmTagSize;
+	const uint8_t* nonce=input;
+	const uint8_t* cipherText=input+gcmNonceSize;
+	//EVP_CIPHER_CTX_ctrl does not take a const pointer, although it does not 
+	//modify the tag when setting it
+	uint8_t tag[gcmTagSize];
+	std::copy(cipherText+cipherTextSize,cipherText+cipherTextSize+gcmTagSize,tag);
+	CipherContext ctx=makeCipherContext();
+	int len=0;
+	if(EVP_DecryptInit_ex(ctx.get(),EVP_aes_256_gcm(),nullptr,key,nonce)!=1
+	   || EVP_DecryptUpdate(ctx.get(),nullptr,&len,(const uint8_t*)envelopeSecretMagic.data(),envelopeSecretMagic.size())!=1
+	   || EVP_DecryptUpdate(ctx.get(),output,&len,cipherText,cipherTextSize)!=1
+	   || EVP_CIPHER_CTX_ctrl(ctx.get(),EVP_CTRL_GCM_SET_TAG,gcmTagSize,tag)!=1
+	   || EVP_DecryptFinal_ex(ctx.get(),output+len,&len)!=1)
+		throw std::runtime_error("Failed to decrypt with AES-GCM: data is corrupt or the key is incorrect");
+}
+
+///\return whether the data is a secret encrypted with the legacy scheme
+bool isLegacySecret(const std::string& data){
+	return data.size()>=legacySecretOverhead && data.compare(0,legacySecretMagic.size(),legacySecretMagic)==0;
+}
+
+///\return whether the data is a secret encrypted with a data key
+bool isEnvelopeSecret(const std::string& data){
+	return data.size()>=envelopeSecretOverhead && data.compare(0,envelopeSecretMagic.size(),envelopeSecretMagic)==0;
+}
+
+} //anonymous namespace
+
+void PersistentStore::deriveMasterKey(){
+	//The expensive derivation is done only once, when the server starts; 
+	//individual secrets are then protected by data keys encrypted with the 
+	//result. The salt is fixed so that the same key file always produces the 
+	//same master key.
+	const std::string salt="SLATE secret master key";
+	auto start=std::chrono::steady_clock::now();
+	int err=crypto_scrypt((const uint8_t*)secretKey.data.get(),secretKey.dataSize,
+	                      (const uint8_t*)salt.data(),salt.size(),
+	                      uint64_t(1)<<17,8,1,
+	                      (uint8_t*)masterKey.data.get(),masterKey.dataSize);
 	if(err)
-		throw std::runtime_error("Failed to encrypt with scrypt: error " + std::to_string(err));
+		log_fatal("Failed to derive master encryption key");
+	auto end=std::chrono::steady_clock::now();
+	log_info("Derived master encryption key in " 
+	         << std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count() << " ms");
+}
+
+std::string PersistentStore::encryptSecret(const SecretData& s) const{
+	//generate a fresh data key for this secret
+	SecretData dataKey(aesKeySize);
+	if(RAND_bytes((uint8_t*)dataKey.data.get(),aesKeySize)!=1)
+		throw std::runtime_error("Failed to generate data encryption key");
+	
+	std::string result(envelopeSecretOverhead+s.dataSize,'\0');
+	uint8_t* out=(uint8_t*)&result.front();
+	std::copy(envelopeSecretMagic.begin(),envelopeSecretMagic.end(),out);
+	out+=envelopeSecretMagic.size();
+	//wrap the data key with the master key
+	gcmEncrypt((const uint8_t*)masterKey.data.get(),(const uint8_t*)dataKey.data.get(),aesKeySize,out);
+	out+=gcmNonceSize+aesKeySize+gcmTagSize;
+	//encrypt the data with the data key
+	gcmEncrypt((const uint8_t*)dataKey.data.get(),(const uint8_t*)s.data.get(),s.dataSize,out);
 	return result;
 }
 
-SecretData PersistentStore::decryptSecret(const Secret& s) const{
-	if(s.data.size()<128)
-		throw std::runtime_error("Invalid encrypted data: too short to contain header");
-	std::size_t outLen=s.data.size()-128;
+SecretData PersistentStore::decryptSecret(const Secret& s){
+	if(isEnvelopeSecret(s.data)){
+		const uint8_t* in=(const uint8_t*)s.data.data()+envelopeSecretMagic.size();
+		SecretData dataKey(aesKeySize);
+		gcmDecrypt((const uint8_t*)masterKey.data.get(),in,gcmNonceSize+aesKeySize+gcmTagSize,
+		           (uint8_t*)dataKey.data.get());
+		in+=gcmNonceSize+aesKeySize+gcmTagSize;
+		SecretData output(s.data.size()-envelopeSecretOverhead);
+		gcmDecrypt((const uint8_t*)dataKey.data.get(),in,output.dataSize+gcmNonceSize+gcmTagSize,
+		           (uint8_t*)output.data.get());
+		return output;
+	}
+	
+	if(!isLegacySecret(s.data))
+		throw std::runtime_error("Invalid encrypted data: unrecognized header");
+	std::size_t outLen=s.data.size()-legacySecretOverhead;
 	SecretData output(outLen);
 	int err=scryptdec_buf((const uint8_t *)&s.data.front(),s.data.size(),
 						  (uint8_t*)output.data.get(),&outLen,
 						  (const uint8_t*)secretKey.data.get(),secretKey.dataSize);
 	if(err)
 		throw std::runtime_error("Failed to decrypt with scrypt: error " + std::to_string(err));
+	legacySecretDecryptions++;
+	//Replace the stored data with the cheaper format, so that this secret does
+	//not need to be decrypted with scrypt again
+	if(!s.id.empty()){
+		Secret rewrapped=s;
+		rewrapped.data=encryptSecret(output);
+		const std::string oldData=s.data;
+		refreshInBackground("rewrap:"+s.id,[this,rewrapped,oldData]{ storeRewrappedSecret(rewrapped,oldData); });
+	}
 	return output;
 }
 
+void PersistentStore::storeRewrappedSecret(const Secret& secret, const std::string& oldData){
+	using AV=Aws::DynamoDB::Model::AttributeValue;
+	databaseQueries++;
+	//only replace the data if it has not changed since it was read, and the 
+	//secret has not been deleted
+	auto outcome=dbClient.UpdateItem(Aws::DynamoDB::Model::UpdateItemRequest()
+	                                 .WithTableName(secretTableName)
+	                                 .WithKey({{"ID",AV(secret.id)},
+	                                           {"sortKey",AV(secret.id)}})
+	                                 .WithUpdateExpression("SET #contents = :new")
+	                                 .WithConditionExpression("#contents = :old")
+	                                 .WithExpressionAttributeNames({{"#contents","contents"}})
+	                                 .WithExpressionAttributeValues({
+	                                   {":new",AV().SetB(Aws::Utils::ByteBuffer((const unsigned char*)secret.data.data(),secret.data.size()))},
+	                                   {":old",AV().SetB(Aws::Utils::ByteBuffer((const unsigned char*)oldData.data(),oldData.size()))}
+	                                 }));
+	if(!outcome.IsSuccess()){
+		auto err=outcome.GetError();
+		log_warn("Failed to re-encrypt secret " << secret.id << ": " << err.GetMessage());
+		return;
+	}
+	secretsRewrapped++;
+	//replace the cached copy if it is the one which was re-encrypted
+	CacheRecord<Secret> record;
+	if(secretCache.find(secret.id,record) && record.peek().data==oldData){
+		CacheRecord<Secret> updated(secret,record.expirationTime);
+		replaceCacheRecord(secretCache,secret.id,updated);
+		secretByGroupCache.insert_or_assign(secret.group,updated);
+		secretByGroupAndClusterCache.insert_or_assign(secret.group+":"+secret.cluster,updated);
+	}
+}
+
 bool PersistentStore::addSecret(const Secret& secret){
-	if(secret.data.substr(0,6)!="scrypt")
-		throw std::runtime_error("Secret data does not have valid encryption header");
-	if(secret.data.size()<128)
+	if(!isEnvelopeSecret(secret.data) && !isLegacySecret(secret.data))
 		throw std::runtime_error("Secret data does not have valid encryption header");
 	
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -2994,8 +4185,8 @@ bool PersistentStore::removeSecret(const std::string& id){
 			//don't particularly care whether the record is expired; if it is 
 			//all that will happen is that we will delete the equally stale 
 			//record in the other cache
-			secretByGroupCache.erase(record.record.group,record);
-			secretByGroupAndClusterCache.erase(record.record.group+":"+record.record.cluster);
+			secretByGroupCache.erase(record.get().group,record);
+			secretByGroupAndClusterCache.erase(record.get().group+":"+record.get().cluster);
 		}
 		secretCache.erase(id);
 	}
@@ -3022,12 +4213,13 @@ Secret PersistentStore::getSecret(const std::string& id){
 			//we have a cached record; is it still valid?
 			log_info("Found record of " << id << " in cache");
 			if(record){ //it is, just return it
-				cacheHits++;
+				countCacheHits(secretCache,1);
 				return record;
 			}
 		}
 	}
 	//need to query the database
+	countCacheMiss(secretCache);
 	databaseQueries++;
 	log_info("Querying database for secret " << id);
 	using Aws::DynamoDB::Model::AttributeValue;
@@ -3169,7 +4361,7 @@ Application PersistentStore::findApplication(const std::string& repository, cons
 		if(cached.second > std::chrono::steady_clock::now()){
 			auto records = cached.first;
 			for(const auto& record : records){
-				if(record.record.name==appName && record)
+				if(record.get().name==appName && record)
 					return record;
 			}
 		}
@@ -3178,7 +4370,7 @@ Application PersistentStore::findApplication(const std::string& repository, cons
 	log_info("Querying helm for application " << appName);
 	std::string target=repository+"/"+appName;
 	std::vector<std::string> searchArgs={"search",target};
-	if(kubernetes::getHelmMajorVersion()==3)
+	if(kubernetes::getHelmCapabilities()->searchRequiresRepoSubcommand)
 		searchArgs.insert(searchArgs.begin()+1,"repo");
 	auto result=runCommand("helm", searchArgs);
 	if(result.status)
@@ -3214,14 +4406,11 @@ Application PersistentStore::findApplication(const std::string& repository, cons
 std::vector<Application> PersistentStore::fetchApplications(const std::string& repository){
 	//Tell helm the terminal is rather wide to prevent truncation of results 
 	//(unless they are rather long).
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
+	const auto helmCapabilities=kubernetes::getHelmCapabilities();
 	std::vector<std::string> searchArgs={"search",repository+"/"};
-	if(helmMajorVersion==2)
-		searchArgs.push_back("--col-width=1024");
-	else if(helmMajorVersion==3){
+	if(helmCapabilities->searchRequiresRepoSubcommand)
 		searchArgs.insert(searchArgs.begin()+1,"repo");
-		searchArgs.push_back("--max-col-width=1024");
-	}
+	searchArgs.push_back(helmCapabilities->searchColumnWidthFlag);
 	auto commandResult=runCommand("helm", searchArgs);
 	if(commandResult.status)
 		log_fatal("helm search failed: [err] " << commandResult.error << " [out] " << commandResult.output);
@@ -3256,6 +4445,29 @@ std::string PersistentStore::getStatistics() const{
 	os << "Cache hits: " << cacheHits.load() << "\n";
 	os << "Database queries: " << databaseQueries.load() << "\n";
 	os << "Database scans: " << databaseScans.load() << "\n";
+	os << "Stale cache hits: " << staleCacheHits.load() << "\n";
+	os << "Negative cache hits: " << negativeCacheHits.load() << "\n";
+	os << "Legacy secret decryptions: " << legacySecretDecryptions.load() << "\n";
+	os << "Secrets re-encrypted with data keys: " << secretsRewrapped.load() << "\n";
+	os << "Background refreshes: " << backgroundRefreshes.load() << "\n";
+	os << "Listing snapshot rebuilds: " << (userListing.rebuildCount()+groupListing.rebuildCount()
+	                                        +clusterListing.rebuildCount()+instanceListing.rebuildCount()) << "\n";
+	{
+		std::lock_guard<std::mutex> lock(cacheUsageMutex);
+		for(const auto& entry : cacheUsage){
+			os << "Cache " << entry.first << ": " << entry.second.entries << " records, ~" 
+			   << (entry.second.bytes+1023)/1024 << " KB; " << entry.second.expired 
+			   << " expired records removed, " << entry.second.evicted << " records evicted\n";
+		}
+	}
+	std::size_t lookupsStarted=userLookups.fetchesStarted()+groupLookups.fetchesStarted()
+	                           +clusterLookups.fetchesStarted()+applicationPermissionLookups.fetchesStarted();
+	std::size_t lookupsShared=userLookups.fetchesShared()+groupLookups.fetchesShared()
+	                          +clusterLookups.fetchesShared()+applicationPermissionLookups.fetchesShared();
+	os << "Coalesced database lookups: " << lookupsShared << " of " << (lookupsStarted+lookupsShared);
+	if(lookupsStarted+lookupsShared)
+		os << " (" << (100*lookupsShared)/(lookupsStarted+lookupsShared) << "%)";
+	os << "\n";
 	return os.str();
 }
 
@@ -3297,8 +4509,8 @@ std::string PersistentStore::dnsNameForCluster(const Cluster& cluster) const{
 	return cluster.name+'.'+baseDomain;
 }
 
-const User authenticateUser(PersistentStore& store, const char* token){
+std::shared_ptr<const User> authenticateUser(PersistentStore& store, const char* token){
 	if(token==nullptr) //no token => no way of identifying a valid user
-		return User{};
+		return CacheRecord<User>().share();
 	return store.findUserByToken(token);
 }
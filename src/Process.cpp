@@ -1,22 +1,33 @@
 #include "Process.h"
 
+#include <condition_variable>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <thread>
 
 #include <fcntl.h>
 #include <paths.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 
 #include <libcuckoo/cuckoohash_map.hh>
 
+#include <Tracing.h>
 #include <Utilities.h>
 
+//needed to select whether epoll is available
+#include "OSDetection.h"
+
+#if BOOST_OS_LINUX
+#include <sys/epoll.h>
+#endif
+
 void setNonblocking(int fd){
 	int flags = fcntl(fd, F_GETFL);
 	if(flags==-1){
@@ -31,16 +42,56 @@ void setNonblocking(int fd){
 }
 
 namespace{
+///Create a pipe neither of whose ends will be inherited by child processes
+///\return zero on success, or -1 on failure with errno set
+int makePipe(int fds[2]){
+#if BOOST_OS_LINUX
+	return pipe2(fds,O_CLOEXEC);
+#else
+	int err=pipe(fds);
+	if(!err){
+		fcntl(fds[0],F_SETFD,FD_CLOEXEC);
+		fcntl(fds[1],F_SETFD,FD_CLOEXEC);
+	}
+	return err;
+#endif
+}
+
 sig_atomic_t reapFlag=0;
+///A pipe used to wake the reaper thread. A byte is written to it by the SIGCHLD 
+///handler and when the reaper is asked to stop. 
+int wakePipe[2]={-1,-1};
 
 void handleSIGCHLD(int, siginfo_t* info, void* uap){
 	reapFlag=1;
-	//const char msg[]="We get signal!\n";
-	//write(1,msg,sizeof(msg));
+	int savedErrno=errno;
+	//if the pipe is full the reaper already has a wake up pending, so failure 
+	//to write is harmless
+	ssize_t unused=write(wakePipe[1],"",1);
+	(void)unused;
+	errno=savedErrno;
+}
+
+///Wake the reaper thread so that it re-examines its state
+void wakeReaper(){
+	ssize_t unused=write(wakePipe[1],"",1);
+	(void)unused;
+}
+
+///Discard all pending wake up notifications
+void drainWakePipe(){
+	char buf[64];
+	while(read(wakePipe[0],buf,sizeof(buf))>0);
 }
 	
 struct PrepareForSignals{
 	PrepareForSignals(){
+		if(makePipe(wakePipe)){
+			auto err=errno;
+			throw std::runtime_error("reaper wake pipe: "+std::to_string(err));
+		}
+		setNonblocking(wakePipe[0]);
+		setNonblocking(wakePipe[1]);
 		struct sigaction act;
 		act.sa_flags=SA_RESTART | SA_NOCLDSTOP | SA_SIGINFO;
 		act.sa_sigaction=handleSIGCHLD;
@@ -60,7 +111,164 @@ struct PrepareForSignals{
 } signalPrep;
 	
 std::atomic<bool> reaperStop;
+///Used to signal the stopping of the reaper thread
+std::mutex reaperStateMutex;
+std::condition_variable reaperStopped;
 cuckoohash_map<pid_t,ProcessRecord> processTable;
+///The alternative mechanism, if any, used to start children for runCommand
+std::atomic<ProcessSpawner*> processSpawner(nullptr);
+
+///Used to signal threads waiting for child processes that exit statuses have 
+///been collected
+std::mutex exitMutex;
+std::condition_variable exitCondition;
+
+///Read all currently available data from a non-blocking file descriptor
+///\param fd the descriptor to read
+///\param data the destination to which data should be appended
+///\return whether the end of the data was reached
+bool drainStream(int fd, std::string& data){
+	char buf[4096];
+	while(true){
+		ssize_t result=read(fd,buf,sizeof(buf));
+		if(result>0)
+			data.append(buf,result);
+		else if(result==0)
+			return true;
+		else{
+			int err=errno;
+			if(err==EINTR)
+				continue;
+			if(err==EAGAIN || err==EWOULDBLOCK)
+				return false;
+			std::cerr << "read gave error " << err << std::endl;
+			return true; //nothing more can be read
+		}
+	}
+}
+
+///Read from several non-blocking file descriptors simultaneously until all 
+///reach their ends, without relying on the reaper thread. 
+///\param streams pairs of file descriptors and destinations for their data
+void drainStreamsLocally(std::vector<std::pair<int,std::string*>> streams){
+	std::vector<struct pollfd> fds;
+	while(!streams.empty()){
+		fds.resize(streams.size());
+		for(std::size_t i=0; i<streams.size(); i++){
+			fds[i].fd=streams[i].first;
+			fds[i].events=POLLIN;
+			fds[i].revents=0;
+		}
+		int result=poll(fds.data(),fds.size(),-1);
+		if(result==-1){
+			int err=errno;
+			if(err==EINTR || err==EAGAIN)
+				continue;
+			throw std::runtime_error("poll failed: "+std::to_string(err));
+		}
+		for(std::size_t i=fds.size(); i>0; i--){
+			if(!fds[i-1].revents)
+				continue;
+			if(drainStream(streams[i-1].first,*streams[i-1].second))
+				streams.erase(streams.begin()+(i-1));
+		}
+	}
+}
+
+#if BOOST_OS_LINUX
+///The epoll instance on which the reaper thread waits both for child processes
+///to exit and for output from child processes
+int reaperPoll=-1;
+#endif
+
+///Collects the standard output and error of a child process. On systems with 
+///epoll this is done by the reaper thread, so that the output of all children
+///is multiplexed together; elsewhere it is done by the thread which calls wait().
+struct ChildOutputCollector{
+	///One of the child's output streams
+	struct Stream{
+		int fd;
+		std::string& data;
+		ChildOutputCollector& owner;
+	};
+	
+	ChildOutputCollector(ProcessHandle& child, commandResult& result):
+	child(child),
+	out{child.getStdoutFD(),result.output,*this},
+	err{child.getStderrFD(),result.error,*this},
+	openStreams(0){
+#if BOOST_OS_LINUX
+		for(Stream* stream : {&out,&err}){
+			if(stream->fd==-1) //the child could not be started
+				continue;
+			struct epoll_event event;
+			event.events=EPOLLIN;
+			event.data.ptr=stream;
+			std::lock_guard<std::mutex> lock(mutex);
+			if(epoll_ctl(reaperPoll,EPOLL_CTL_ADD,stream->fd,&event)==0)
+				openStreams++;
+			else{
+				int err=errno;
+				std::cerr << "Unable to watch child output: Error " << err << std::endl;
+				unwatched.emplace_back(stream->fd,&stream->data);
+			}
+		}
+#else
+		for(Stream* stream : {&out,&err}){
+			if(stream->fd!=-1)
+				unwatched.emplace_back(stream->fd,&stream->data);
+		}
+#endif
+	}
+	
+	~ChildOutputCollector(){
+		//The reaper may still be writing to our streams if we did not finish 
+		//waiting, so the child must be stopped and its output allowed to end.
+		if(!finishedCollection){
+			child.kill();
+			waitForOutput();
+		}
+	}
+	
+	///Wait until all output has been collected and the child has exited
+	///\return the child's exit status
+	int wait(){
+		waitForOutput();
+		if(!child) //the child could not be started
+			return -1;
+		std::unique_lock<std::mutex> lock(exitMutex);
+		exitCondition.wait(lock,[this]{ return child.done(); });
+		return child.exitStatus();
+	}
+	
+	///Called by the reaper thread when one of the streams has ended
+	void streamEnded(){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(!--openStreams)
+			allStreamsEnded.notify_all();
+	}
+	
+private:
+	ProcessHandle& child;
+	Stream out, err;
+	///The number of streams being read by the reaper thread
+	unsigned int openStreams;
+	///Streams which must be read by this object's owner
+	std::vector<std::pair<int,std::string*>> unwatched;
+	bool finishedCollection=false;
+	std::mutex mutex;
+	std::condition_variable allStreamsEnded;
+	
+	void waitForOutput(){
+		if(!unwatched.empty()){
+			drainStreamsLocally(unwatched);
+			unwatched.clear();
+		}
+		std::unique_lock<std::mutex> lock(mutex);
+		allStreamsEnded.wait(lock,[this]{ return openStreams==0; });
+		finishedCollection=true;
+	}
+};
 } //anonymous namespace
 
 ProcessIOBuffer::ProcessIOBuffer():
@@ -340,20 +548,19 @@ void ProcessHandle::setExitStatus(unsigned char status){
 void reapProcesses(){
 	if(!reapFlag)
 		return;
+	//clear the flag before checking so that a signal which arrives while we are 
+	//working cannot be lost
+	reapFlag=0;
 	int stat;
 	pid_t p;
 	while(true){
 		p=waitpid(-1,&stat,WNOHANG);
-		if(!p){ //great, done
-			reapFlag=0;
+		if(!p) //great, done
 			return;
-		}
 		if(p==-1){
 			auto err=errno;
-			if(err==ECHILD){ //great, done
-				reapFlag=0;
+			if(err==ECHILD) //great, done
 				return;
-			}
 			if(err==EINTR)
 				continue;
 			else
@@ -365,40 +572,159 @@ void reapProcesses(){
 				exitStatus=WEXITSTATUS(stat);
 			else //on termination by a signal or similar treat status as 255
 				exitStatus=255;
-			processTable.uprase_fn(p,[exitStatus,p](ProcessRecord& record){
-				if(record.handle){
-					//if the handle exists we can put the exit status into it
-					record.handle->setExitStatus(exitStatus);
-				}
-				return true; //delete record
-			},ProcessRecord(exitStatus));
+			recordChildExit(p,exitStatus);
 		}
 	}
 }
 
+void recordChildExit(pid_t pid, unsigned char exitStatus){
+	processTable.uprase_fn(pid,[exitStatus](ProcessRecord& record){
+		if(record.handle){
+			//if the handle exists we can put the exit status into it
+			record.handle->setExitStatus(exitStatus);
+		}
+		return true; //delete record
+	},ProcessRecord(exitStatus));
+	//taking the lock ensures that no waiter is between checking its predicate 
+	//and going to sleep
+	{ std::lock_guard<std::mutex> lock(exitMutex); }
+	exitCondition.notify_all();
+}
+
+void setProcessSpawner(ProcessSpawner* spawner){
+	processSpawner.store(spawner);
+}
+
+namespace{
+	///Sleep until woken by a SIGCHLD, a stop request, or (where supported) 
+	///output from a child process, and handle whichever occurred. 
+	void reaperWaitForEvents(){
+#if BOOST_OS_LINUX
+		const static int maxEvents=64;
+		struct epoll_event events[maxEvents];
+		int nEvents=epoll_wait(reaperPoll,events,maxEvents,-1);
+		if(nEvents==-1){
+			int err=errno;
+			if(err!=EINTR)
+				std::cerr << "epoll_wait gave error " << err << std::endl;
+			return;
+		}
+		for(int i=0; i<nEvents; i++){
+			if(events[i].data.ptr==nullptr){ //the wake pipe
+				drainWakePipe();
+				reapProcesses();
+				continue;
+			}
+			auto& stream=*static_cast<ChildOutputCollector::Stream*>(events[i].data.ptr);
+			if(drainStream(stream.fd,stream.data)){
+				epoll_ctl(reaperPoll,EPOLL_CTL_DEL,stream.fd,nullptr);
+				//the collector may be destroyed as soon as this returns
+				stream.owner.streamEnded();
+			}
+		}
+#else
+		struct pollfd fd;
+		fd.fd=wakePipe[0];
+		fd.events=POLLIN;
+		fd.revents=0;
+		int result=poll(&fd,1,-1);
+		if(result==-1){
+			int err=errno;
+			if(err!=EINTR)
+				std::cerr << "poll gave error " << err << std::endl;
+			return;
+		}
+		drainWakePipe();
+		reapProcesses();
+#endif
+	}
+}
+
 void startReaper(){
+#if BOOST_OS_LINUX
+	if(reaperPoll==-1){
+		reaperPoll=epoll_create1(EPOLL_CLOEXEC);
+		if(reaperPoll==-1){
+			auto err=errno;
+			throw std::runtime_error("Unable to create reaper epoll instance: Error "+std::to_string(err));
+		}
+		struct epoll_event event;
+		event.events=EPOLLIN;
+		event.data.ptr=nullptr;
+		if(epoll_ctl(reaperPoll,EPOLL_CTL_ADD,wakePipe[0],&event)){
+			auto err=errno;
+			throw std::runtime_error("Unable to watch reaper wake pipe: Error "+std::to_string(err));
+		}
+	}
+#endif
 	reaperStop.store(false);
 	std::thread reaper([](){
-		while(!reaperStop.load()){
-			reapProcesses();
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		}
+		//pick up any children which exited before we started
+		reapFlag=1;
+		reapProcesses();
+		while(!reaperStop.load())
+			reaperWaitForEvents();
 		//set the flag back to its original state to signal stopping
-		reaperStop.store(false);
+		{
+			std::lock_guard<std::mutex> lock(reaperStateMutex);
+			reaperStop.store(false);
+		}
+		reaperStopped.notify_all();
 	});
 	reaper.detach();
 }
 
 void stopReaper(){
+	std::unique_lock<std::mutex> lock(reaperStateMutex);
 	reaperStop.store(true);
+	wakeReaper();
 	//wait for background thread to signal that it has indeed stopped
-	while(!reaperStop.load()){
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
-	}
+	reaperStopped.wait(lock,[]{ return !reaperStop.load(); });
 }
 
 extern char **environ;
 
+namespace{
+	///Find the full path to an executable
+	///\param exe the name of the executable. If it contains no slashes, a search 
+	///           will be performed in all entries of $PATH (or _PATH_DEFPATH if 
+	///           $PATH is not set) for a file with a matching name. 
+	///\return the path to the executable
+	std::string locateExecutable(std::string exe){
+		if(exe.find('/')==std::string::npos){
+			//no slash; search through the path
+			std::string defPath=_PATH_DEFPATH;
+			fetchFromEnvironment("PATH",defPath);
+			std::size_t idx=0, next;
+			while(true){
+				next=defPath.find(':',idx);
+				std::string dir=defPath.substr(idx,next==std::string::npos?next:next-idx);
+				std::string posExe=dir+'/'+exe;
+				struct stat info;
+				int err=stat(posExe.c_str(),&info);
+				if(!err){
+					exe=posExe;
+					break;
+				}
+				if(next==std::string::npos)
+					throw std::runtime_error("Unable to locate "+exe+" in default path ("+defPath+')');
+				idx=next+1;
+			}
+		}
+		else{
+			//exe contains a slash, so we assume it a usable path. 
+			//Check that the file exists.
+			struct stat info;
+			int err=stat(exe.c_str(),&info);
+			if(err){
+				err=errno;
+				throw std::runtime_error("Cannot stat "+exe+": Error "+std::to_string(err));
+			}
+		}
+		return exe;
+	}
+}
+
 ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>& args, 
                                 const std::map<std::string,std::string>& env, 
                                 ForkCallbacks&& callbacks, bool detachable){
@@ -450,37 +776,7 @@ ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>&
 		assert(idx==nVars);
 		newEnv=newEnvData.get();
 	}
-	//locate executable
-	if(exe.find('/')==std::string::npos){
-		//no slash; search through the path
-		std::string defPath=_PATH_DEFPATH;
-		fetchFromEnvironment("PATH",defPath);
-		std::size_t idx=0, next;
-		while(true){
-			next=defPath.find(':',idx);
-			std::string dir=defPath.substr(idx,next==std::string::npos?next:next-idx);
-			std::string posExe=dir+'/'+exe;
-			struct stat info;
-			int err=stat(posExe.c_str(),&info);
-			if(!err){
-				exe=posExe;
-				break;
-			}
-			if(next==std::string::npos)
-				throw std::runtime_error("Unable to locate "+exe+" in default path ("+defPath+')');
-			idx=next+1;
-		}
-	}
-	else{
-		//exe contains a slash, so we assume it a usable path. 
-		//Check that the file exists.
-		struct stat info;
-		int err=stat(exe.c_str(),&info);
-		if(err){
-			err=errno;
-			throw std::runtime_error("Cannot stat "+exe+": Error "+std::to_string(err));
-		}
-	}
+	exe=locateExecutable(exe);
 	//set argv[0] now that we are sure we know what it is
 	rawArgs[0]=exe.c_str();
 	
@@ -489,18 +785,21 @@ ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>&
 	int inpipe[2];
 	int outpipe[2];
 	int errpipe[2];
+	//The pipes are created close-on-exec so that children do not inherit each 
+	//other's pipes, which would delay the ends of their outputs. The ends which
+	//are duplicated onto the child's standard streams remain open. 
 	if(!detachable){
-	err=pipe(inpipe);
+		err=makePipe(inpipe);
 		if(err){
 			err=errno;
 			throw std::runtime_error("Unable to allocate pipe: Error "+std::to_string(err));
 		}
-		err=pipe(outpipe);
+		err=makePipe(outpipe);
 		if(err){
 			err=errno;
 			throw std::runtime_error("Unable to allocate pipe: Error "+std::to_string(err));
 		}
-		err=pipe(errpipe);
+		err=makePipe(errpipe);
 		if(err){
 			err=errno;
 			throw std::runtime_error("Unable to allocate pipe: Error "+std::to_string(err));
@@ -551,44 +850,56 @@ ProcessHandle startProcessAsync(std::string exe, const std::vector<std::string>&
 
 
 namespace{
-	void collectChildOutput(ProcessHandle& child, commandResult& result){
-		std::unique_ptr<char[]> buf(new char[1024]);
-		char* bufptr=buf.get();
-		//collect stdout
-		//std::cout << "collecting child stdout" << std::endl;
-		std::istream& child_stdout=child.getStdout();
-		while(!child_stdout.eof()){
-			char* ptr=bufptr;
-			child_stdout.read(ptr,1);
-			ptr+=child_stdout.gcount();
-			child_stdout.readsome(ptr,1023);
-			ptr+=child_stdout.gcount();
-			result.output.append(bufptr,ptr-bufptr);
-		}
-		//collect stderr
-		//std::cout << "collecting child stderr" << std::endl;
-		std::istream& child_stderr=child.getStderr();
-		while(!child_stderr.eof()){
-			char* ptr=bufptr;
-			child_stderr.read(ptr,1);
-			ptr+=child_stderr.gcount();
-			child_stderr.readsome(ptr,1023);
-			ptr+=child_stderr.gcount();
-			result.error.append(bufptr,ptr-bufptr);
-		}
-		//std::cout << "waiting for child exit" << std::endl;
-		while(!child.done())
-			std::this_thread::sleep_for(std::chrono::milliseconds(1));
-		result.status=child.exitStatus();
+	///Start a child process for runCommand or runCommandWithInput, using the 
+	///process spawner if one is set and falling back to forking this process
+	ProcessHandle startCommand(const std::string& command, 
+	                           const std::vector<std::string>& args,
+	                           const std::map<std::string,std::string>& env){
+		ProcessSpawner* spawner=processSpawner.load();
+		if(!spawner)
+			return startProcessAsync(command,args,env);
+		
+		std::string exe=locateExecutable(command);
+		int inpipe[2];
+		int outpipe[2];
+		int errpipe[2];
+		if(makePipe(inpipe))
+			return startProcessAsync(command,args,env);
+		if(makePipe(outpipe)){
+			close(inpipe[0]);
+			close(inpipe[1]);
+			return startProcessAsync(command,args,env);
+		}
+		if(makePipe(errpipe)){
+			close(inpipe[0]);
+			close(inpipe[1]);
+			close(outpipe[0]);
+			close(outpipe[1]);
+			return startProcessAsync(command,args,env);
+		}
+		pid_t child=spawner->spawn(exe,args,env,inpipe[0],outpipe[1],errpipe[1]);
+		//close ends of pipes we will not use
+		close(inpipe[0]);
+		close(outpipe[1]);
+		close(errpipe[1]);
+		if(child<=0){ //the spawner is not working, so do it ourselves
+			close(inpipe[1]);
+			close(outpipe[0]);
+			close(errpipe[0]);
+			return startProcessAsync(command,args,env);
+		}
+		return ProcessHandle(child,inpipe[1],outpipe[0],errpipe[0]);
 	}
 }
 
 commandResult runCommand(const std::string& command, 
                          const std::vector<std::string>& args,
                          const std::map<std::string,std::string>& env){
+	tracing::Span span("process",command);
 	commandResult result;
-	ProcessHandle child=startProcessAsync(command,args,env);
-	collectChildOutput(child,result);
+	ProcessHandle child=startCommand(command,args,env);
+	ChildOutputCollector collector(child,result);
+	result.status=collector.wait();
 	return result;
 }
 
@@ -596,11 +907,15 @@ commandResult runCommandWithInput(const std::string& command,
                                   const std::string& input,
                                   const std::vector<std::string>& args,
                                   const std::map<std::string,std::string>& env){
+	tracing::Span span("process",command);
 	commandResult result;
-	ProcessHandle child=startProcessAsync(command,args,env);
+	ProcessHandle child=startCommand(command,args,env);
+	//begin collecting output before sending input, so that the child cannot 
+	//block writing output while we are blocked writing its input
+	ChildOutputCollector collector(child,result);
 	child.getStdin() << input;
 	child.getStdin().flush();
 	child.endInput();
-	collectChildOutput(child,result);
+	result.status=collector.wait();
 	return result;
 }
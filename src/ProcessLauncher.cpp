@@ -0,0 +1,502 @@
+#include "ProcessLauncher.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Logging.h"
+#include "Process.h"
+
+namespace{
+
+///The largest request which will be sent to the helper. Larger requests are
+///instead handled by starting the child process directly.
+const std::size_t maxMessageSize=1<<16;
+
+///The number of file descriptors passed with each request: the child's stdin,
+///stdout, and stderr
+const std::size_t passedDescriptors=3;
+
+enum class ReplyType : uint8_t{
+	///A requested child process has been started
+	Launched,
+	///A child process started by the helper has exited
+	Exited
+};
+
+///Sent from the helper to the server
+struct LauncherReply{
+	ReplyType type;
+	///For Launched replies, the request being answered
+	uint64_t requestID;
+	///The child process, or -1 if a Launched request failed
+	pid_t pid;
+	///For Exited replies, the child's exit status
+	unsigned char exitStatus;
+	///For Launched replies, the time between the request being sent and the
+	///helper beginning to handle it
+	int64_t queueNanos;
+	///For Launched replies, the time taken to fork and execute the child
+	int64_t execNanos;
+};
+
+int64_t monotonicNanos(){
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+template<typename T>
+void appendValue(std::string& message, T value){
+	message.append(reinterpret_cast<const char*>(&value),sizeof(T));
+}
+
+void appendString(std::string& message, const std::string& value){
+	appendValue<uint32_t>(message,value.size());
+	message.append(value);
+}
+
+///Sequential decoding of a request message
+struct MessageReader{
+	const char* pos;
+	const char* end;
+
+	template<typename T>
+	T readValue(){
+		if(end-pos<(std::ptrdiff_t)sizeof(T))
+			throw std::runtime_error("Truncated launcher message");
+		T value;
+		std::memcpy(&value,pos,sizeof(T));
+		pos+=sizeof(T);
+		return value;
+	}
+
+	std::string readString(){
+		uint32_t size=readValue<uint32_t>();
+		if((std::size_t)(end-pos)<size)
+			throw std::runtime_error("Truncated launcher message");
+		std::string value(pos,size);
+		pos+=size;
+		return value;
+	}
+};
+
+// ---- Helper process side ----
+
+///Written to by the helper's SIGCHLD handler
+int helperChildPipe[2]={-1,-1};
+
+void helperHandleSIGCHLD(int){
+	int savedErrno=errno;
+	ssize_t unused=write(helperChildPipe[1],"",1);
+	(void)unused;
+	errno=savedErrno;
+}
+
+void helperSendReply(int sock, const LauncherReply& reply){
+	while(send(sock,&reply,sizeof(reply),MSG_NOSIGNAL)==-1){
+		if(errno!=EINTR) //the server is gone
+			_exit(0);
+	}
+}
+
+///Start one child process in the helper
+///\param request the encoded request
+///\param fds the child's standard stream descriptors
+///\param reply the reply to be filled in with the result
+void helperLaunch(MessageReader request, const int fds[passedDescriptors], LauncherReply& reply){
+	int64_t receiveTime=monotonicNanos();
+	reply.requestID=request.readValue<uint64_t>();
+	reply.queueNanos=receiveTime-request.readValue<int64_t>();
+	if(fds[0]==-1 || fds[1]==-1 || fds[2]==-1)
+		return;
+	std::string exe=request.readString();
+	std::vector<std::string> args(request.readValue<uint32_t>());
+	for(auto& arg : args)
+		arg=request.readString();
+	std::vector<std::pair<std::string,std::string>> env(request.readValue<uint32_t>());
+	for(auto& var : env){
+		var.first=request.readString();
+		var.second=request.readString();
+	}
+
+	std::unique_ptr<const char*[]> rawArgs(new const char*[2+args.size()]);
+	rawArgs[0]=exe.c_str();
+	for(std::size_t i=0; i<args.size(); i++)
+		rawArgs[i+1]=args[i].c_str();
+	rawArgs[args.size()+1]=nullptr;
+
+	//This pipe is closed by the successful exec, which allows us to measure
+	//how long the exec took
+	int execPipe[2];
+	if(pipe2(execPipe,O_CLOEXEC)){
+		reply.pid=-1;
+		return;
+	}
+
+	pid_t child=fork();
+	if(child==0){
+		dup2(fds[0],0);
+		dup2(fds[1],1);
+		dup2(fds[2],2);
+		//all other descriptors are close-on-exec
+		signal(SIGCHLD,SIG_DFL);
+		//the helper is single threaded, so modifying the environment is safe
+		for(const auto& var : env)
+			setenv(var.first.c_str(),var.second.c_str(),1);
+		execv(exe.c_str(),(char *const *)rawArgs.get());
+		int err=errno;
+		fprintf(stderr,"Exec failed: Error %i\n",err);
+		_exit(127);
+	}
+	close(execPipe[1]);
+	if(child>0){
+		char buf;
+		while(read(execPipe[0],&buf,1)==-1 && errno==EINTR);
+	}
+	close(execPipe[0]);
+	reply.execNanos=monotonicNanos()-receiveTime;
+	reply.pid=(child>0?child:-1);
+}
+
+///Report the exits of all children which have finished
+void helperReapChildren(int sock){
+	int stat;
+	pid_t p;
+	while((p=waitpid(-1,&stat,WNOHANG))>0){
+		LauncherReply reply{};
+		reply.type=ReplyType::Exited;
+		reply.pid=p;
+		//on termination by a signal or similar treat status as 255
+		reply.exitStatus=(WIFEXITED(stat)?WEXITSTATUS(stat):255);
+		helperSendReply(sock,reply);
+	}
+}
+
+void runHelper(int sock, pid_t serverPid){
+	//exit when the server does
+	prctl(PR_SET_PDEATHSIG,SIGTERM);
+	if(getppid()!=serverPid)
+		_exit(0);
+
+	if(pipe2(helperChildPipe,O_CLOEXEC|O_NONBLOCK))
+		_exit(1);
+	struct sigaction act;
+	std::memset(&act,0,sizeof(act));
+	act.sa_flags=SA_RESTART | SA_NOCLDSTOP;
+	act.sa_handler=helperHandleSIGCHLD;
+	sigemptyset(&act.sa_mask);
+	if(sigaction(SIGCHLD,&act,nullptr))
+		_exit(1);
+
+	std::unique_ptr<char[]> buffer(new char[maxMessageSize]);
+	while(true){
+		struct pollfd fds[2];
+		fds[0].fd=sock;
+		fds[0].events=POLLIN;
+		fds[0].revents=0;
+		fds[1].fd=helperChildPipe[0];
+		fds[1].events=POLLIN;
+		fds[1].revents=0;
+		if(poll(fds,2,-1)==-1)
+			continue;
+
+		if(fds[1].revents){
+			char buf[64];
+			while(read(helperChildPipe[0],buf,sizeof(buf))>0);
+			helperReapChildren(sock);
+		}
+
+		if(fds[0].revents){
+			struct iovec iov;
+			iov.iov_base=buffer.get();
+			iov.iov_len=maxMessageSize;
+			char control[CMSG_SPACE(passedDescriptors*sizeof(int))];
+			struct msghdr msg;
+			std::memset(&msg,0,sizeof(msg));
+			msg.msg_iov=&iov;
+			msg.msg_iovlen=1;
+			msg.msg_control=control;
+			msg.msg_controllen=sizeof(control);
+			ssize_t size=recvmsg(sock,&msg,MSG_CMSG_CLOEXEC);
+			if(size==0) //the server has closed its end
+				_exit(0);
+			if(size<0){
+				if(errno==EINTR || errno==EAGAIN)
+					continue;
+				_exit(1);
+			}
+
+			int passed[passedDescriptors]={-1,-1,-1};
+			struct cmsghdr* cmsg=CMSG_FIRSTHDR(&msg);
+			if(cmsg && cmsg->cmsg_level==SOL_SOCKET && cmsg->cmsg_type==SCM_RIGHTS)
+				std::memcpy(passed,CMSG_DATA(cmsg),
+				            std::min(passedDescriptors*sizeof(int),(std::size_t)(cmsg->cmsg_len-CMSG_LEN(0))));
+
+			LauncherReply reply{};
+			reply.type=ReplyType::Launched;
+			reply.pid=-1;
+			try{
+				helperLaunch(MessageReader{buffer.get(),buffer.get()+size},passed,reply);
+			}catch(std::exception& ex){
+				reply.pid=-1;
+			}
+			for(int fd : passed){
+				if(fd!=-1)
+					close(fd);
+			}
+			helperSendReply(sock,reply);
+		}
+	}
+}
+
+// ---- Server side ----
+
+class ProcessLauncher : public ProcessSpawner{
+public:
+	ProcessLauncher(pid_t helperPid, int sock):
+	helper(helperPid),sock(sock),nextRequestID(0),alive(true){}
+
+	pid_t spawn(const std::string& exe,
+	            const std::vector<std::string>& args,
+	            const std::map<std::string,std::string>& env,
+	            int stdinFD, int stdoutFD, int stderrFD) override{
+		if(!alive.load())
+			return -1;
+		uint64_t id=nextRequestID++;
+
+		std::string message;
+		appendValue<uint64_t>(message,id);
+		appendValue<int64_t>(message,monotonicNanos());
+		appendString(message,exe);
+		appendValue<uint32_t>(message,args.size());
+		for(const auto& arg : args)
+			appendString(message,arg);
+		appendValue<uint32_t>(message,env.size());
+		for(const auto& var : env){
+			appendString(message,var.first);
+			appendString(message,var.second);
+		}
+		if(message.size()>maxMessageSize)
+			return -1;
+
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			PendingLaunch& launch=pending[id];
+			launch.command=exe.substr(exe.rfind('/')+1);
+		}
+
+		struct iovec iov;
+		iov.iov_base=&message[0];
+		iov.iov_len=message.size();
+		char control[CMSG_SPACE(passedDescriptors*sizeof(int))];
+		std::memset(control,0,sizeof(control));
+		struct msghdr msg;
+		std::memset(&msg,0,sizeof(msg));
+		msg.msg_iov=&iov;
+		msg.msg_iovlen=1;
+		msg.msg_control=control;
+		msg.msg_controllen=sizeof(control);
+		struct cmsghdr* cmsg=CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level=SOL_SOCKET;
+		cmsg->cmsg_type=SCM_RIGHTS;
+		cmsg->cmsg_len=CMSG_LEN(passedDescriptors*sizeof(int));
+		int fds[passedDescriptors]={stdinFD,stdoutFD,stderrFD};
+		std::memcpy(CMSG_DATA(cmsg),fds,sizeof(fds));
+
+		bool sent=false;
+		{
+			std::lock_guard<std::mutex> lock(sendMutex);
+			while(true){
+				if(sendmsg(sock,&msg,MSG_NOSIGNAL)!=-1){
+					sent=true;
+					break;
+				}
+				if(errno!=EINTR)
+					break;
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(pendingMutex);
+		if(!sent){
+			int err=errno;
+			log_error("Failed to send request to process launcher: Error " << err);
+			pending.erase(id);
+			return -1;
+		}
+		launchComplete.wait(lock,[this,id]{ return pending[id].complete || !alive.load(); });
+		pid_t pid=(pending[id].complete ? pending[id].pid : -1);
+		pending.erase(id);
+		return pid;
+	}
+
+	///Process replies from the helper until it exits
+	void receiveReplies(){
+		while(true){
+			LauncherReply reply;
+			ssize_t size=recv(sock,&reply,sizeof(reply),0);
+			if(size==-1 && errno==EINTR)
+				continue;
+			if(size!=sizeof(reply))
+				break;
+			if(reply.type==ReplyType::Launched)
+				handleLaunched(reply);
+			else if(reply.type==ReplyType::Exited)
+				handleExited(reply);
+		}
+
+		log_error("Process launcher has stopped; child processes will be started directly");
+		setProcessSpawner(nullptr);
+		std::set<pid_t> orphans;
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			alive.store(false);
+			std::swap(orphans,running);
+		}
+		launchComplete.notify_all();
+		//we will never learn how these children exited
+		for(pid_t pid : orphans)
+			recordChildExit(pid,255);
+	}
+
+	std::string getStatistics(){
+		std::ostringstream os;
+		std::lock_guard<std::mutex> lock(statsMutex);
+		for(const auto& entry : stats){
+			const CommandLatencies& latencies=entry.second;
+			os << "Launcher " << entry.first << ": " << latencies.count << " started"
+			   << ", queue mean " << latencies.totalQueueNanos/latencies.count/1e6 << " ms"
+			   << " max " << latencies.maxQueueNanos/1e6 << " ms"
+			   << ", exec mean " << latencies.totalExecNanos/latencies.count/1e6 << " ms"
+			   << " max " << latencies.maxExecNanos/1e6 << " ms\n";
+		}
+		return os.str();
+	}
+
+private:
+	struct PendingLaunch{
+		PendingLaunch():complete(false),pid(-1){}
+		bool complete;
+		pid_t pid;
+		std::string command;
+	};
+
+	struct CommandLatencies{
+		CommandLatencies():count(0),totalQueueNanos(0),maxQueueNanos(0),
+		                   totalExecNanos(0),maxExecNanos(0){}
+		std::size_t count;
+		double totalQueueNanos, maxQueueNanos;
+		double totalExecNanos, maxExecNanos;
+	};
+
+	///Owns the helper process, so that it will be stopped with this object
+	ProcessHandle helper;
+	int sock;
+	std::atomic<uint64_t> nextRequestID;
+	std::atomic<bool> alive;
+	///Serializes sending requests
+	std::mutex sendMutex;
+	///Guards pending and running
+	std::mutex pendingMutex;
+	std::condition_variable launchComplete;
+	///Requests which have not yet been answered
+	std::map<uint64_t,PendingLaunch> pending;
+	///Children started by the helper which have not yet exited
+	std::set<pid_t> running;
+	///Guards stats
+	std::mutex statsMutex;
+	std::map<std::string,CommandLatencies> stats;
+
+	void handleLaunched(const LauncherReply& reply){
+		std::string command;
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			auto it=pending.find(reply.requestID);
+			if(it==pending.end())
+				return;
+			it->second.complete=true;
+			it->second.pid=reply.pid;
+			command=it->second.command;
+			if(reply.pid>0)
+				running.insert(reply.pid);
+		}
+		launchComplete.notify_all();
+		if(reply.pid>0){
+			std::lock_guard<std::mutex> lock(statsMutex);
+			CommandLatencies& latencies=stats[command];
+			latencies.count++;
+			latencies.totalQueueNanos+=reply.queueNanos;
+			latencies.maxQueueNanos=std::max(latencies.maxQueueNanos,(double)reply.queueNanos);
+			latencies.totalExecNanos+=reply.execNanos;
+			latencies.maxExecNanos=std::max(latencies.maxExecNanos,(double)reply.execNanos);
+		}
+	}
+
+	void handleExited(const LauncherReply& reply){
+		{
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			running.erase(reply.pid);
+		}
+		recordChildExit(reply.pid,reply.exitStatus);
+	}
+};
+
+///Deliberately never destroyed, since its receiving thread runs until this 
+///process exits
+ProcessLauncher* launcher=nullptr;
+
+} //anonymous namespace
+
+void startProcessLauncher(){
+	if(launcher)
+		return;
+	int socks[2];
+	if(socketpair(AF_UNIX,SOCK_SEQPACKET|SOCK_CLOEXEC,0,socks)){
+		int err=errno;
+		throw std::runtime_error("Unable to create process launcher socket: Error "+std::to_string(err));
+	}
+	pid_t serverPid=getpid();
+	pid_t helperPid=fork();
+	if(helperPid<0){
+		int err=errno;
+		close(socks[0]);
+		close(socks[1]);
+		throw std::runtime_error("Unable to start process launcher: Error "+std::to_string(err));
+	}
+	if(helperPid==0){
+		close(socks[0]);
+		runHelper(socks[1],serverPid);
+		_exit(0);
+	}
+	close(socks[1]);
+	launcher=new ProcessLauncher(helperPid,socks[0]);
+	std::thread receiver([](){ launcher->receiveReplies(); });
+	receiver.detach();
+	setProcessSpawner(launcher);
+	log_info("Started process launcher with PID " << helperPid);
+}
+
+std::string getProcessLauncherStatistics(){
+	if(!launcher)
+		return "";
+	return launcher->getStatistics();
+}
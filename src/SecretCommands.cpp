@@ -8,6 +8,7 @@
 #include "ServerUtilities.h"
 #include "KubeInterface.h"
 #include "Archive.h"
+#include "ClusterCommands.h"
 
 //conforms to the interface of rapidjson::GenericStringBuffer<UTF8<char>> but
 //tries to only keep data in buffers which will be automatically cleared
@@ -73,7 +74,8 @@ struct SecretStringBuffer{
 };
 
 crow::response listSecrets(PersistentStore& store, const crow::request& req){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list secrets from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -88,8 +90,16 @@ crow::response listSecrets(PersistentStore& store, const crow::request& req){
 	if(clusterRaw)
 		cluster=clusterRaw;
 	
+	ListingOptions options;
+	try{
+		options=parseListingOptions(req,{"id","name","group","cluster","created"});
+	}catch(std::runtime_error& err){
+		return crow::response(400,generateError(err.what()));
+	}
+	
 	//get information on the owning Group, needed to look up services, etc.
-	const Group group=store.getGroup(groupRaw);
+	const auto groupRecord=store.getGroup(groupRaw);
+	const Group& group=*groupRecord;
 	if(!group)
 		return crow::response(404,generateError("Group not found"));
 	
@@ -98,34 +108,53 @@ crow::response listSecrets(PersistentStore& store, const crow::request& req){
 		return crow::response(403,generateError("Not authorized"));
 	
 	std::vector<Secret> secrets=store.listSecrets(group.id,cluster);
+	const std::string nextCursor=selectPage(secrets,options);
 	
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
-	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	rapidjson::Value resultItems(rapidjson::kArrayType);
-	resultItems.Reserve(secrets.size(), alloc);
-	
+	//look up the names of all groups and clusters involved together
+	std::vector<std::string> groupIDs, clusterIDs;
 	for(const Secret& secret : secrets){
-		rapidjson::Value secretResult(rapidjson::kObjectType);
-		secretResult.AddMember("apiVersion", "v1alpha3", alloc);
-		secretResult.AddMember("kind", "Secret", alloc);
-		rapidjson::Value secretData(rapidjson::kObjectType);
-		secretData.AddMember("id", secret.id, alloc);
-		secretData.AddMember("name", secret.name, alloc);
-		secretData.AddMember("group", store.getGroup(secret.group).name, alloc);
-		secretData.AddMember("cluster", store.getCluster(secret.cluster).name, alloc);
-		secretData.AddMember("created", secret.ctime, alloc);
-		secretResult.AddMember("metadata", secretData, alloc);
-		resultItems.PushBack(secretResult, alloc);
+		if(options.includes("group"))
+			groupIDs.push_back(secret.group);
+		if(options.includes("cluster"))
+			clusterIDs.push_back(secret.cluster);
 	}
-	result.AddMember("items", resultItems, alloc);
+	std::map<std::string,Group> groups=store.getGroups(groupIDs);
+	std::map<std::string,Cluster> clusters=store.getClusters(clusterIDs);
+	static const Group noGroup;
+	static const Cluster noCluster;
+	
+	JSONStreamWriter writer;
+	writer.StartObject();
+	writer.Key("apiVersion");
+	writer.String("v1alpha3");
+	writer.Key("items");
+	writer.StartArray();
+	for(const Secret& secret : secrets){
+		writer.StartObject();
+		writer.Key("apiVersion");
+		writer.String("v1alpha3");
+		writer.Key("kind");
+		writer.String("Secret");
+		writer.Key("metadata");
+		writer.StartObject();
+		writeField(writer,options,"id",secret.id);
+		writeField(writer,options,"name",secret.name);
+		writeField(writer,options,"group",findOrDefault(groups,secret.group,noGroup).name);
+		writeField(writer,options,"cluster",findOrDefault(clusters,secret.cluster,noCluster).name);
+		writeField(writer,options,"created",secret.ctime);
+		writer.EndObject();
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writeNextCursor(writer,nextCursor);
+	writer.EndObject();
 	
-	return crow::response(to_string(result));
+	return crow::response(writer.take());
 }
 
 crow::response createSecret(PersistentStore& store, const crow::request& req){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to create a secret from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -204,7 +233,8 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 	if(secret.name.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789-.")!=std::string::npos)
 		return crow::response(400,generateError("Secret name contains an invalid character"));
 	
-	Group group=store.getGroup(secret.group);
+	const auto groupRecord=store.getGroup(secret.group);
+	const Group& group=*groupRecord;
 	if(!group)
 		return crow::response(404,generateError("Group not found"));
 	//canonicalize group
@@ -214,7 +244,8 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 	if(!store.userInGroup(user.id,group.id))
 		return crow::response(403,generateError("Not authorized"));
 	
-	Cluster cluster=store.getCluster(secret.cluster);
+	const auto clusterRecord=store.getCluster(secret.cluster);
+	const Cluster& cluster=*clusterRecord;
 	if(!cluster)
 		return crow::response(404,generateError("Cluster not found"));
 	//canonicalize cluster
@@ -224,6 +255,8 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 	//they've been granted access
 	if(group.id!=cluster.owningGroup && !store.groupAllowedOnCluster(group.id,cluster.id))
 		return crow::response(403,generateError("Not authorized"));
+	if(!checkClusterReachable(store,cluster))
+		return crow::response(503,generateError("Cluster is not reachable"));
 	
 	//check that name is not in use
 	Secret existing=store.findSecretByName(group.id,secret.cluster,secret.name);
@@ -256,10 +289,12 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 		//make sure that the requesting user has access to the source secret
 		if(!store.userInGroup(user.id,existing.group))
 			return crow::response(403,generateError("Not authorized"));
-		secret.data=existing.data;
 		//Unfortunately, we _also_ need to decrypt the secret in order to pass
 		//its data to Kubernetes. 
 		SecretData secretData=store.decryptSecret(existing);
+		//Give the copy its own data key; this is cheap, and also ensures that 
+		//copies of secrets stored in the legacy format use the current one.
+		secret.data=store.encryptSecret(secretData);
 		rapidjson::Document contents(rapidjson::kObjectType,&body.GetAllocator());
 		contents.Parse(secretData.data.get(),secretData.dataSize);
 		body.AddMember("contents",contents,body.GetAllocator());
@@ -346,7 +381,8 @@ crow::response createSecret(PersistentStore& store, const crow::request& req){
 
 crow::response deleteSecret(PersistentStore& store, const crow::request& req,
                             const std::string& secretID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to delete secret " << secretID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -359,6 +395,9 @@ crow::response deleteSecret(PersistentStore& store, const crow::request& req,
 	if(!store.userInGroup(user.id,secret.group))
 		return crow::response(403,generateError("Not authorized"));
 	bool force=(req.url_params.get("force")!=nullptr);
+	//a forced deletion proceeds even if the cluster cannot be contacted
+	if(!force && !checkClusterReachable(store,*store.getCluster(secret.cluster)))
+		return crow::response(503,generateError("Cluster is not reachable"));
 	
 	auto err=internal::deleteSecret(store,secret,force);
 	if(!err.empty())
@@ -404,7 +443,8 @@ std::string deleteSecret(PersistentStore& store, const Secret& secret, bool forc
 
 crow::response getSecret(PersistentStore& store, const crow::request& req,
                          const std::string& secretID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to get secret " << secretID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -427,8 +467,8 @@ crow::response getSecret(PersistentStore& store, const crow::request& req,
 	rapidjson::Value metadata(rapidjson::kObjectType);
 	metadata.AddMember("id", secret.id, alloc);
 	metadata.AddMember("name", secret.name, alloc);
-	metadata.AddMember("group", store.getGroup(secret.group).name, alloc);
-	metadata.AddMember("cluster", store.getCluster(secret.cluster).name, alloc);
+	metadata.AddMember("group", store.getGroup(secret.group)->name, alloc);
+	metadata.AddMember("cluster", store.getCluster(secret.cluster)->name, alloc);
 	metadata.AddMember("created", secret.ctime, alloc);
 	result.AddMember("metadata", metadata, alloc);
 	
@@ -12,6 +12,79 @@ std::string timestamp(){
 	return to_simple_string(now)+" UTC";
 }
 
+namespace{
+	///The largest amount of space which a JSONStringStream reserves in 
+	///advance, so that a rare huge response does not cause every following 
+	///response on the same thread to reserve a huge string
+	const std::size_t maxJSONSizeHint=4<<20;
+	
+	///The size of the last JSON text produced on this thread
+	thread_local std::size_t threadJSONSizeHint=0;
+}
+
+namespace internal{
+JSONStringStream::JSONStringStream(){
+	text.resize(threadJSONSizeHint);
+	setStorage(0);
+}
+
+void JSONStringStream::grow(std::size_t count){
+	std::size_t used=size();
+	text.resize(std::max(2*text.size(),used+count));
+	setStorage(used);
+}
+
+void JSONStringStream::setStorage(std::size_t used){
+	begin=&text[0];
+	next=begin+used;
+	end=begin+text.size();
+}
+
+std::string JSONStringStream::take(){
+	std::size_t used=size();
+	threadJSONSizeHint=std::min(used,maxJSONSizeHint);
+	text.resize(used);
+	std::string result;
+	result.swap(text);
+	setStorage(0);
+	return result;
+}
+}
+
+bool getFlagParameter(const crow::request& req, const char* name){
+	const char* value=req.url_params.get(name);
+	if(!value)
+		return false;
+	const std::string setting=value;
+	if(setting.empty() || setting=="true" || setting=="yes" || setting=="1")
+		return true;
+	if(setting=="false" || setting=="no" || setting=="0")
+		return false;
+	throw std::runtime_error("Invalid value for "+std::string(name)+": must be true or false");
+}
+
+ListingOptions parseListingOptions(const crow::request& req, const std::set<std::string>& knownFields){
+	ListingOptions options;
+	if(const char* limit=req.url_params.get("limit")){
+		std::istringstream is(limit);
+		long long value=0;
+		is >> value;
+		if(is.fail() || !is.eof() || value<=0)
+			throw std::runtime_error("Invalid limit: must be a positive integer");
+		options.limit=value;
+	}
+	if(const char* cursor=req.url_params.get("cursor"))
+		options.cursor=cursor;
+	if(const char* fields=req.url_params.get("fields")){
+		for(const auto& field : string_split_columns(fields,',',false)){
+			if(!knownFields.count(field))
+				throw std::runtime_error("Unknown field: "+field);
+			options.fields.insert(field);
+		}
+	}
+	return options;
+}
+
 std::string generateError(const std::string& message){
 	rapidjson::Document err(rapidjson::kObjectType);
 	err.AddMember("kind", "Error", err.GetAllocator());
@@ -0,0 +1,145 @@
+#include "Tracing.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace tracing{
+
+namespace{
+	thread_local std::shared_ptr<Trace> threadTrace;
+	thread_local std::size_t threadSpan=Trace::noSpan;
+
+	double milliseconds(clock::duration d){
+		return std::chrono::duration_cast<std::chrono::duration<double,std::milli>>(d).count();
+	}
+}
+
+const std::size_t Trace::noSpan;
+const std::size_t Trace::maxSpans;
+
+Trace::Trace(std::string description):
+desc(std::move(description)),start(clock::now()),droppedSpans(0){}
+
+std::size_t Trace::begin(const char* category, std::string detail, std::size_t parent,
+                         clock::time_point start){
+	std::lock_guard<std::mutex> lock(mutex);
+	if(spans.size()>=maxSpans){
+		droppedSpans++;
+		return noSpan;
+	}
+	spans.push_back(SpanRecord{category,std::move(detail),parent,start,start,false});
+	return spans.size()-1;
+}
+
+void Trace::end(std::size_t span, const char* category, clock::time_point start,
+                clock::time_point end){
+	std::lock_guard<std::mutex> lock(mutex);
+	if(span!=noSpan){
+		spans[span].end=end;
+		spans[span].finished=true;
+	}
+	auto total=std::find_if(totals.begin(),totals.end(),
+	                        [category](const std::pair<std::string,CategoryTotal>& t){ return t.first==category; });
+	if(total==totals.end())
+		total=totals.insert(totals.end(),std::make_pair(std::string(category),CategoryTotal{0,clock::duration::zero()}));
+	total->second.count++;
+	total->second.time+=end-start;
+}
+
+std::string Trace::serverTiming(clock::duration total) const{
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(3);
+	std::lock_guard<std::mutex> lock(mutex);
+	for(const auto& category : totals){
+		os << category.first << ";dur=" << milliseconds(category.second.time)
+		   << ";desc=\"" << category.second.count
+		   << (category.second.count==1 ? " operation" : " operations") << "\", ";
+	}
+	os << "total;dur=" << milliseconds(total);
+	return os.str();
+}
+
+std::string Trace::format(clock::duration total) const{
+	std::lock_guard<std::mutex> lock(mutex);
+	//spans are recorded in the order in which they began, so listing the
+	//children of each span in order keeps them in time order
+	std::vector<std::vector<std::size_t>> children(spans.size());
+	std::vector<std::size_t> roots;
+	for(std::size_t i=0; i<spans.size(); i++){
+		if(spans[i].parent==noSpan)
+			roots.push_back(i);
+		else
+			children[spans[i].parent].push_back(i);
+	}
+
+	std::ostringstream os;
+	os << std::fixed << std::setprecision(3);
+	os << desc << " took " << milliseconds(total) << " ms";
+	std::vector<std::pair<std::size_t,unsigned int>> pending; //span, depth
+	for(auto root=roots.rbegin(); root!=roots.rend(); root++)
+		pending.emplace_back(*root,1);
+	while(!pending.empty()){
+		std::size_t index=pending.back().first;
+		unsigned int depth=pending.back().second;
+		pending.pop_back();
+		const SpanRecord& span=spans[index];
+		os << '\n' << std::string(2*depth,' ') << "+" << milliseconds(span.start-start)
+		   << " ms " << span.category;
+		if(!span.detail.empty())
+			os << ' ' << span.detail;
+		if(span.finished)
+			os << ": " << milliseconds(span.end-span.start) << " ms";
+		else
+			os << ": unfinished";
+		for(auto child=children[index].rbegin(); child!=children[index].rend(); child++)
+			pending.emplace_back(*child,depth+1);
+	}
+	if(droppedSpans)
+		os << "\n  (" << droppedSpans << " further spans not recorded)";
+	return os.str();
+}
+
+std::shared_ptr<Trace> currentTrace(){
+	return threadTrace;
+}
+
+std::size_t currentSpan(){
+	return threadSpan;
+}
+
+void setCurrentTrace(std::shared_ptr<Trace> trace){
+	threadTrace=std::move(trace);
+	threadSpan=Trace::noSpan;
+}
+
+Scope::Scope(std::shared_ptr<Trace> trace, std::size_t parent):
+previousTrace(std::move(threadTrace)),previousSpan(threadSpan){
+	threadTrace=std::move(trace);
+	threadSpan=parent;
+}
+
+Scope::~Scope(){
+	threadTrace=std::move(previousTrace);
+	threadSpan=previousSpan;
+}
+
+Span::Span(const char* category, std::string detail):
+category(category),index(Trace::noSpan),parent(threadSpan){
+	if(!threadTrace)
+		return;
+	trace=threadTrace;
+	start=clock::now();
+	index=trace->begin(category,std::move(detail),parent,start);
+	if(index!=Trace::noSpan)
+		threadSpan=index;
+}
+
+Span::~Span(){
+	if(!trace)
+		return;
+	trace->end(index,category,start,clock::now());
+	threadSpan=parent;
+}
+
+}
@@ -4,45 +4,60 @@
 #include "ServerUtilities.h"
 
 crow::response listUsers(PersistentStore& store, const crow::request& req){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to list users from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	//TODO: Are all users are allowed to list all users?
+	
+	ListingOptions options;
+	try{
+		options=parseListingOptions(req,{"id","name","email","phone","institution"});
+	}catch(std::runtime_error& err){
+		return crow::response(400,generateError(err.what()));
+	}
 
 	std::vector<User> users;
 	if (auto group = req.url_params.get("group"))
 		users = store.listUsersByGroup(group);
 	else
 		users = store.listUsers();
+	const std::string nextCursor=selectPage(users,options);
 
-	rapidjson::Document result(rapidjson::kObjectType);
-	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
-	
-	result.AddMember("apiVersion", "v1alpha3", alloc);
-	rapidjson::Value resultItems(rapidjson::kArrayType);
-	resultItems.Reserve(users.size(), alloc);
+	JSONStreamWriter writer;
+	writer.StartObject();
+	writer.Key("apiVersion");
+	writer.String("v1alpha3");
+	writer.Key("items");
+	writer.StartArray();
 	for(const User& user : users){
-		rapidjson::Value userResult(rapidjson::kObjectType);
-		userResult.AddMember("apiVersion", "v1alpha3", alloc);
-		userResult.AddMember("kind", "User", alloc);
-		rapidjson::Value userData(rapidjson::kObjectType);
-		userData.AddMember("id", rapidjson::StringRef(user.id.c_str()), alloc);
-		userData.AddMember("name", rapidjson::StringRef(user.name.c_str()), alloc);
-		userData.AddMember("email", rapidjson::StringRef(user.email.c_str()), alloc);
-		userData.AddMember("phone", rapidjson::StringRef(user.phone.c_str()), alloc);
-		userData.AddMember("institution", rapidjson::StringRef(user.institution.c_str()), alloc);
-		userResult.AddMember("metadata", userData, alloc);
-		resultItems.PushBack(userResult, alloc);
-	}
-	result.AddMember("items", resultItems, alloc);
+		writer.StartObject();
+		writer.Key("apiVersion");
+		writer.String("v1alpha3");
+		writer.Key("kind");
+		writer.String("User");
+		writer.Key("metadata");
+		writer.StartObject();
+		writeField(writer,options,"id",user.id);
+		writeField(writer,options,"name",user.name);
+		writeField(writer,options,"email",user.email);
+		writeField(writer,options,"phone",user.phone);
+		writeField(writer,options,"institution",user.institution);
+		writer.EndObject();
+		writer.EndObject();
+	}
+	writer.EndArray();
+	writeNextCursor(writer,nextCursor);
+	writer.EndObject();
 	
-	return crow::response(to_string(result));
+	return crow::response(writer.take());
 }
 
 crow::response createUser(PersistentStore& store, const crow::request& req){
 	//important: user is the user issuing the command, not the user being modified
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to create a user from " << req.remote_endpoint);
 	if(!user){
 		log_warn(user << " is not authorized to create users");
@@ -170,7 +185,8 @@ crow::response createUser(PersistentStore& store, const crow::request& req){
 
 crow::response getUserInfo(PersistentStore& store, const crow::request& req, const std::string uID){
 	//important: user is the user issuing the command, not the user being modified
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested information about " << uID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -178,7 +194,8 @@ crow::response getUserInfo(PersistentStore& store, const crow::request& req, con
 	if(!user.admin && user.id!=uID)
 		return crow::response(403,generateError("Not authorized"));
 	
-	User targetUser=store.getUser(uID);
+	const auto targetUserRecord=store.getUser(uID);
+	const User& targetUser=*targetUserRecord;
 	if(!targetUser)
 		return crow::response(404,generateError("Not found"));
 
@@ -210,7 +227,8 @@ crow::response getUserInfo(PersistentStore& store, const crow::request& req, con
 
 crow::response updateUser(PersistentStore& store, const crow::request& req, const std::string uID){
 	//important: user is the user issuing the command, not the user being modified
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to update information about " << uID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -218,7 +236,8 @@ crow::response updateUser(PersistentStore& store, const crow::request& req, cons
 	if(!user.admin && user.id!=uID)
 		return crow::response(403,generateError("Not authorized"));
 	
-	User targetUser=store.getUser(uID);
+	const auto targetUserRecord=store.getUser(uID);
+	const User& targetUser=*targetUserRecord;
 	
 	if(!targetUser)
 		return crow::response(404,generateError("User not found"));
@@ -276,7 +295,8 @@ crow::response updateUser(PersistentStore& store, const crow::request& req, cons
 }
 
 crow::response deleteUser(PersistentStore& store, const crow::request& req, const std::string uID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " to delete " << uID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -288,7 +308,7 @@ crow::response deleteUser(PersistentStore& store, const crow::request& req, cons
 	if(user.id==uID)
 		targetUser=user;
 	else{
-		targetUser=store.getUser(uID);
+		targetUser=*store.getUser(uID);
 		if(!targetUser)
 			return crow::response(404,generateError("Not found"));
 	}
@@ -306,7 +326,8 @@ crow::response deleteUser(PersistentStore& store, const crow::request& req, cons
 }
 
 crow::response listUsergroups(PersistentStore& store, const crow::request& req, const std::string uID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested Group listing for " << uID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -315,7 +336,7 @@ crow::response listUsergroups(PersistentStore& store, const crow::request& req,
 	if(user.id==uID)
 		targetUser=user;
 	else{
-		User targetUser=store.getUser(uID);
+		User targetUser=*store.getUser(uID);
 		if(!targetUser)
 			return crow::response(404,generateError("Not found"));
 	}
@@ -344,16 +365,19 @@ crow::response listUsergroups(PersistentStore& store, const crow::request& req,
 
 crow::response addUserToGroup(PersistentStore& store, const crow::request& req, 
 						   const std::string uID, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to add " << uID << " to " << groupID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	User targetUser=store.getUser(uID);
+	const auto targetUserRecord=store.getUser(uID);
+	const User& targetUser=*targetUserRecord;
 	if(!targetUser)
 		return crow::response(404,generateError("User not found"));
 	
-	Group group=store.getGroup(groupID);
+	const auto groupRecord=store.getGroup(groupID);
+	const Group& group=*groupRecord;
 	if(!group)
 		return(crow::response(404,generateError("Group not found")));
 	
@@ -371,12 +395,14 @@ crow::response addUserToGroup(PersistentStore& store, const crow::request& req,
 
 crow::response removeUserFromGroup(PersistentStore& store, const crow::request& req, 
 								const std::string uID, const std::string& groupID){
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to remove " << uID << " from " << groupID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
 	
-	User targetUser=store.getUser(uID);
+	const auto targetUserRecord=store.getUser(uID);
+	const User& targetUser=*targetUserRecord;
 	if(!targetUser)
 		return crow::response(404,generateError("User not found"));
 	
@@ -394,7 +420,8 @@ crow::response removeUserFromGroup(PersistentStore& store, const crow::request&
 
 crow::response findUser(PersistentStore& store, const crow::request& req){
 	//this is the requesting user, not the requested user
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested user information for a globus ID from " << req.remote_endpoint);
 	if(!user || !user.admin)
 		return crow::response(403,generateError("Not authorized"));
@@ -423,7 +450,8 @@ crow::response findUser(PersistentStore& store, const crow::request& req){
 
 crow::response replaceUserToken(PersistentStore& store, const crow::request& req, const std::string uID){
 	//important: user is the user issuing the command, not the user being modified
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested to replace access token for " << uID << " from " << req.remote_endpoint);
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -431,7 +459,8 @@ crow::response replaceUserToken(PersistentStore& store, const crow::request& req
 	if(!user.admin && user.id!=uID)
 		return crow::response(403,generateError("Not authorized"));
 	
-	User targetUser=store.getUser(uID);
+	const auto targetUserRecord=store.getUser(uID);
+	const User& targetUser=*targetUserRecord;
 	
 	if(!targetUser)
 		return crow::response(404,generateError("User not found"));
@@ -0,0 +1,96 @@
+#include "WorkerPool.h"
+
+#include "Logging.h"
+
+namespace{
+	///The pool to which the current thread belongs, if any
+	thread_local const WorkerPool* currentPool=nullptr;
+	///The index of the current thread within its pool
+	thread_local std::size_t currentIndex=0;
+}
+
+WorkerPool::WorkerPool(std::size_t threadCount):
+nextQueue(0),pending(0),stopping(false){
+	if(!threadCount)
+		threadCount=1;
+	for(std::size_t i=0; i<threadCount; i++)
+		queues.emplace_back(new TaskQueue);
+	for(std::size_t i=0; i<threadCount; i++)
+		threads.emplace_back(&WorkerPool::work,this,i);
+}
+
+WorkerPool::~WorkerPool(){
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		stopping=true;
+	}
+	wakeCondition.notify_all();
+	for(auto& thread : threads)
+		thread.join();
+}
+
+void WorkerPool::submit(std::function<void()> task){
+	std::size_t index;
+	if(currentPool==this)
+		index=currentIndex;
+	else
+		index=nextQueue++%queues.size();
+	{
+		//taking the lock ensures that no worker can miss this wake-up between
+		//checking for pending tasks and going to sleep
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		pending++;
+	}
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->tasks.push_back(std::move(task));
+	}
+	wakeCondition.notify_one();
+}
+
+bool WorkerPool::takeTask(std::size_t index, std::function<void()>& task){
+	{
+		TaskQueue& own=*queues[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if(!own.tasks.empty()){
+			task=std::move(own.tasks.back());
+			own.tasks.pop_back();
+			pending--;
+			return true;
+		}
+	}
+	for(std::size_t i=1; i<queues.size(); i++){
+		TaskQueue& other=*queues[(index+i)%queues.size()];
+		std::lock_guard<std::mutex> lock(other.mutex);
+		if(!other.tasks.empty()){
+			task=std::move(other.tasks.front());
+			other.tasks.pop_front();
+			pending--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkerPool::work(std::size_t index){
+	currentPool=this;
+	currentIndex=index;
+	std::function<void()> task;
+	while(true){
+		if(takeTask(index,task)){
+			try{
+				task();
+			}catch(std::exception& ex){
+				log_error("Exception escaped from worker task: " << ex.what());
+			}catch(...){
+				log_error("Exception escaped from worker task");
+			}
+			task=nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		if(stopping && !pending)
+			return;
+		wakeCondition.wait(lock,[this]{ return pending || stopping; });
+	}
+}
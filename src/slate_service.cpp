@@ -1,6 +1,10 @@
 #include <cerrno>
 #include <iostream>
 #include <cctype>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <thread>
 
 #include <sys/stat.h>
 
@@ -9,9 +13,13 @@
 
 #include "Entities.h"
 #include "Logging.h"
+#include "Metrics.h"
+#include "Tracing.h"
 #include "PersistentStore.h"
 #include "Process.h"
+#include "ProcessLauncher.h"
 #include "ServerUtilities.h"
+#include "WorkerPool.h"
 
 #include "ApplicationCommands.h"
 #include "ApplicationInstanceCommands.h"
@@ -19,7 +27,9 @@
 #include "SecretCommands.h"
 #include "UserCommands.h"
 #include "GroupCommands.h"
+#include "JobCommands.h"
 #include "VersionCommands.h"
+#include "KubeInformer.h"
 #include "KubeInterface.h"
 
 void initializeHelm(){
@@ -33,9 +43,10 @@ void initializeHelm(){
 		log_fatal("`helm` is not available: " << err.what());
 	}
 	
-	unsigned int helmMajorVersion=kubernetes::getHelmMajorVersion();
+	//Determine helm's version and behavior once, up front, for all later uses
+	auto helmCapabilities=kubernetes::refreshHelmCapabilities();
 	
-	if(helmMajorVersion==2){
+	if(helmCapabilities->usesTiller){
 		std::string helmHome;
 		fetchFromEnvironment("HELM_HOME",helmHome);
 		if(helmHome.empty()){
@@ -67,20 +78,8 @@ void initializeHelm(){
 		}
 	}
 	{ //Ensure that necessary repositories are installed
-		auto helmResult=runCommand("helm",{"repo","list"});
-		if(helmResult.status)
-			log_fatal("helm repo list failed");
-		auto lines=string_split_lines(helmResult.output);
-		bool hasMain=false, hasDev=false;
-		for(const auto& line  : lines){
-			auto tokens=string_split_columns(line,'\t');
-			if(!tokens.empty()){
-				if(trim(tokens[0])=="slate")
-					hasMain=true;
-				else if(trim(tokens[0])=="slate-dev")
-					hasDev=true;
-			}
-		}
+		bool hasMain=helmCapabilities->hasRepository("slate");
+		bool hasDev=helmCapabilities->hasRepository("slate-dev");
 		if(!hasMain){
 			log_info("Main slate repository not installed; installing");
 			int err=runCommand("helm",{"repo","add","slate",helmRepoBase+"/stable/"}).status;
@@ -93,6 +92,9 @@ void initializeHelm(){
 			if(err)
 				log_fatal("Unable to install slate development repository");
 		}
+		//make sure that the recorded repository list reflects any additions
+		if(!hasMain || !hasDev)
+			kubernetes::refreshHelmCapabilities();
 	}
 	{ //Ensure that repositories are up-to-date
 		int err=runCommand("helm",{"repo","update"}).status;
@@ -148,6 +150,23 @@ struct Configuration{
 	std::string appLoggingServerName;
 	std::string appLoggingServerPortString;
 	bool allowAdHocApps;
+	bool useProcessLauncher;
+	std::string informerMaxStalenessString;
+	std::string multiplexThreadsString;
+	std::string ioThreadsString;
+	std::string blockingThreadsString;
+	std::string jobThreadsString;
+	std::string multiplexBundleConcurrencyString;
+	std::string databaseScanSegmentsString;
+	bool warmCaches;
+	std::string cacheEntryLimitString;
+	std::string cacheMemoryLimitString;
+	std::string clusterOperationLimitString;
+	std::string totalOperationLimitString;
+	std::string logLevel;
+	std::string slowRequestThresholdString;
+	std::string slowRequestLog;
+	bool serverTiming;
 	
 	std::map<std::string,ParamRef> options;
 	
@@ -162,6 +181,22 @@ struct Configuration{
 	encryptionKeyFile("encryptionKey"),
 	appLoggingServerPortString("9200"),
 	allowAdHocApps(false),
+	useProcessLauncher(true),
+	informerMaxStalenessString("30"),
+	multiplexThreadsString("32"),
+	ioThreadsString("0"),
+	blockingThreadsString("32"),
+	jobThreadsString("8"),
+	multiplexBundleConcurrencyString("8"),
+	databaseScanSegmentsString("8"),
+	warmCaches(false),
+	cacheEntryLimitString("100000"),
+	cacheMemoryLimitString("64"),
+	clusterOperationLimitString("4"),
+	totalOperationLimitString("32"),
+	logLevel("info"),
+	slowRequestThresholdString("5"),
+	serverTiming(false),
 	options{
 		{"awsAccessKey",awsAccessKey},
 		{"awsSecretKey",awsSecretKey},
@@ -176,6 +211,23 @@ struct Configuration{
 		{"appLoggingServerName",appLoggingServerName},
 		{"appLoggingServerPort",appLoggingServerPortString},
 		{"allowAdHocApps",allowAdHocApps},
+		{"useProcessLauncher",useProcessLauncher},
+		{"informerMaxStaleness",informerMaxStalenessString},
+		{"multiplexThreads",multiplexThreadsString},
+		{"ioThreads",ioThreadsString},
+		{"blockingThreads",blockingThreadsString},
+		{"jobThreads",jobThreadsString},
+		{"multiplexBundleConcurrency",multiplexBundleConcurrencyString},
+		{"databaseScanSegments",databaseScanSegmentsString},
+		{"warmCaches",warmCaches},
+		{"cacheEntryLimit",cacheEntryLimitString},
+		{"cacheMemoryLimit",cacheMemoryLimitString},
+		{"clusterOperationLimit",clusterOperationLimitString},
+		{"totalOperationLimit",totalOperationLimitString},
+		{"logLevel",logLevel},
+		{"slowRequestThreshold",slowRequestThresholdString},
+		{"slowRequestLog",slowRequestLog},
+		{"serverTiming",serverTiming},
 	}
 	{
 		//check for environment variables
@@ -256,13 +308,243 @@ struct Configuration{
 	
 };
 
-///Accept a dictionary describing several individual requests, execute them all 
-///concurrently, and return the results in another dictionary. Currently very
-///simplistic; a new thread will be spawned for every individual request. 
-crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const crow::request& req){
+///Copy the result produced by a handler into the response object owned by the
+///server for a request, and send it
+void completeResponse(crow::response& res, crow::response& result){
+	res.code=result.code;
+	res.body=std::move(result.body);
+	for(const auto& header : result.headers)
+		res.set_header(header.first,header.second);
+	res.end();
+}
+
+///Run a slow request handler on a pool of threads set aside for that purpose, 
+///so that the I/O thread which received the request can go on serving others. 
+///The response is sent from the receiving I/O thread once the handler 
+///finishes. Requests which did not arrive over a connection, such as those 
+///unpacked from a multiplexed bundle, are handled immediately instead. 
+///\param pool the pool on which to run the handler
+///\param req the request being handled
+///\param res the server's response object for the request
+///\param handler the function which produces the response
+void handleBlocking(WorkerPool& pool, const crow::request& req, crow::response& res, 
+                    std::function<crow::response()> handler){
+	//mirror crow's own treatment of exceptions thrown by handlers
+	auto run=[handler]()->crow::response{
+		try{
+			return handler();
+		}catch(std::exception& ex){
+			log_error("An uncaught exception occurred: " << ex.what());
+			return crow::response(500);
+		}catch(...){
+			log_error("An uncaught exception occurred: Unknown exception type");
+			return crow::response(500);
+		}
+	};
+	boost::asio::io_service* io=req.io_service;
+	if(!io){
+		crow::response result=run();
+		completeResponse(res,result);
+		return;
+	}
+	//the request's trace continues on the pool thread, rather than on this 
+	//one, which goes on to serve other requests
+	auto trace=tracing::currentTrace();
+	auto parent=tracing::currentSpan();
+	auto submitted=tracing::clock::now();
+	tracing::setCurrentTrace(nullptr);
+	pool.submit([io,&res,run,trace,parent,submitted]{
+		tracing::Scope scope(trace,parent);
+		if(trace)
+			trace->add("queue","",parent,submitted,tracing::clock::now());
+		auto result=std::make_shared<crow::response>(run());
+		io->post([&res,result]{ completeResponse(res,*result); });
+	});
+}
+
+///Run a slow request handler like handleBlocking, unless the request sets the
+///'async' query parameter, in which case the handler is run as a job and the 
+///request is answered immediately with the job's ID.
+///\param pool the pool on which to run the handler when it is not a job
+///\param jobPool the pool on which to run jobs, which is kept separate so that
+///               a backlog of jobs cannot delay ordinary requests
+///\param jobs the table in which to track the job
+///\param req the request being handled
+///\param res the server's response object for the request
+///\param description a short explanation of the operation, for the job record
+///\param handler the function which produces the response
+void handleLongRunning(WorkerPool& pool, WorkerPool& jobPool, JobTable& jobs, 
+                       PersistentStore& store, const crow::request& req, crow::response& res, 
+                       const std::string& description, std::function<crow::response()> handler){
+	bool async=false;
+	try{
+		async=getFlagParameter(req,"async");
+	}catch(std::runtime_error& err){
+		crow::response result(400,generateError(err.what()));
+		completeResponse(res,result);
+		return;
+	}
+	if(!async){
+		handleBlocking(pool,req,res,std::move(handler));
+		return;
+	}
+	crow::response result=startJob(store,jobs,jobPool,req,description,std::move(handler));
+	completeResponse(res,result);
+}
+
+///Record how long a request took to handle and what its result was, labeled by
+///the route which handled it, rather than by its URL, so that the number of 
+///distinct series stays bounded
+void recordRequestMetrics(const crow::request& req, const crow::response& res,
+                          std::chrono::steady_clock::duration duration){
+	const std::string method=crow::method_name(req.method);
+	const std::string route=res.matched_route().empty() ? "unmatched" : res.matched_route();
+	metrics::histogram("slate_http_request_duration_seconds","Time taken to handle API requests",
+	                   {{"method",method},{"route",route}}).record(duration);
+	metrics::counter("slate_http_responses_total","API responses, by status code",
+	                 {{"method",method},{"route",route},{"code",std::to_string(res.code)}}).add();
+}
+
+///Crow middleware which measures every request, including those whose 
+///responses are completed later by handleBlocking
+struct RequestMetrics{
+	struct context{
+		std::chrono::steady_clock::time_point start;
+	};
+	
+	void before_handle(crow::request& req, crow::response& res, context& ctx){
+		ctx.start=std::chrono::steady_clock::now();
+	}
+	
+	void after_handle(crow::request& req, crow::response& res, context& ctx){
+		recordRequestMetrics(req,res,std::chrono::steady_clock::now()-ctx.start);
+	}
+};
+
+///Crow middleware which gives each request a trace, optionally reports the 
+///time spent in each kind of operation in a Server-Timing header, and writes 
+///the full trace of each request which takes longer than a threshold to the 
+///slow request log
+struct RequestTracing{
+	struct context{
+		std::shared_ptr<tracing::Trace> trace;
+	};
+	
+	RequestTracing():slowThreshold(tracing::clock::duration::zero()),slowLog(nullptr),
+	serverTiming(false){}
+	
+	///\param threshold the duration beyond which requests are logged, or zero 
+	///                 to log none
+	///\param log the destination for slow requests, or null to use the main log
+	void setSlowRequestLog(tracing::clock::duration threshold, logTarget* log){
+		slowThreshold=threshold;
+		slowLog=log;
+	}
+	
+	///\param enable whether responses should carry a Server-Timing header. 
+	///               This reveals how the server spends its time, so it is off 
+	///               unless the operator turns it on. 
+	void setServerTiming(bool enable){
+		serverTiming=enable;
+	}
+	
+	void before_handle(crow::request& req, crow::response& res, context& ctx){
+		//the URL is used without its query, which may contain a token
+		ctx.trace=std::make_shared<tracing::Trace>(std::string(crow::method_name(req.method))+" "+req.url);
+		tracing::setCurrentTrace(ctx.trace);
+	}
+	
+	void after_handle(crow::request& req, crow::response& res, context& ctx){
+		if(tracing::currentTrace()==ctx.trace)
+			tracing::setCurrentTrace(nullptr);
+		auto total=ctx.trace->elapsed();
+		if(serverTiming)
+			res.set_header("Server-Timing",ctx.trace->serverTiming(total));
+		if(slowThreshold==tracing::clock::duration::zero() || total<slowThreshold)
+			return;
+		if(!slowLog){
+			log_warn("Slow request: " << ctx.trace->format(total));
+			return;
+		}
+		std::ostringstream str;
+		str << "SLOW: [";
+		logTimestamp(str);
+		str << "] " << ctx.trace->format(total) << '\n';
+		slowLog->write(str.str(),LogLevel::Warn);
+	}
+	
+private:
+	tracing::clock::duration slowThreshold;
+	logTarget* slowLog;
+	bool serverTiming;
+};
+
+using Server=crow::App<RequestMetrics,RequestTracing>;
+
+///The state of a bundle of multiplexed requests which is being executed
+struct MultiplexBundle{
+	///The distinct requests in the bundle
+	std::vector<crow::request> requests;
+	///The results of the requests, indexed like requests
+	std::vector<crow::response> responses;
+	///The indices of requests in the order in which they completed
+	std::vector<std::size_t> completionOrder;
+	///Guards all following members
+	std::mutex mutex;
+	std::condition_variable completed;
+	///The index of the next request which no thread has started
+	std::size_t nextRequest=0;
+	
+	///Claim the next unstarted request
+	///\return whether there was a request to claim
+	bool claim(std::size_t& index){
+		std::lock_guard<std::mutex> lock(mutex);
+		if(nextRequest==requests.size())
+			return false;
+		index=nextRequest++;
+		return true;
+	}
+	
+	///Execute requests until none remain unstarted
+	void run(Server& server){
+		std::size_t index;
+		while(claim(index)){
+			crow::response response;
+			auto start=std::chrono::steady_clock::now();
+			try{
+				tracing::Span span("request",std::string(crow::method_name(requests[index].method))
+				                   +" "+requests[index].url);
+				server.handle(requests[index], response);
+			}
+			catch(std::exception& ex){
+				response=crow::response(400,generateError(ex.what()));
+			}
+			catch(...){
+				response=crow::response(400,generateError("Exception"));
+			}
+			//these requests do not pass through the server's middleware
+			recordRequestMetrics(requests[index],response,std::chrono::steady_clock::now()-start);
+			std::lock_guard<std::mutex> lock(mutex);
+			responses[index]=std::move(response);
+			completionOrder.push_back(index);
+			if(completionOrder.size()==requests.size())
+				completed.notify_all();
+		}
+	}
+};
+
+///Accept a dictionary describing several individual requests, execute them 
+///concurrently, and return the results in another dictionary, in the order in 
+///which they completed. Identical requests are executed only once. At most 
+///\p bundleConcurrency requests from the bundle run at a time: one in the 
+///calling thread, and the rest on \p pool. 
+crow::response multiplex(Server& server, PersistentStore& store, 
+                         WorkerPool& pool, std::size_t bundleConcurrency, 
+                         const crow::request& req){
 	using namespace std::chrono;
 	high_resolution_clock::time_point t1 = high_resolution_clock::now();
-	const User user=authenticateUser(store, req.url_params.get("token"));
+	const auto userRecord=authenticateUser(store, req.url_params.get("token"));
+	const User& user=*userRecord;
 	log_info(user << " requested execute a command bundle");
 	if(!user)
 		return crow::response(403,generateError("Not authorized"));
@@ -292,8 +574,13 @@ crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const
 		throw std::runtime_error(generateError("Unrecognized HTTP method: "+method));
 	};
 	
-	std::vector<crow::request> requests;
+	auto bundle=std::make_shared<MultiplexBundle>();
+	std::vector<crow::request>& requests=bundle->requests;
 	requests.reserve(body.GetObject().MemberCount());
+	//for each raw request, the index of the distinct request which will answer it
+	std::vector<std::size_t> requestIndices;
+	std::map<std::string,std::size_t> distinctRequests;
+	std::vector<std::string> rawURLs;
 	for(const auto& rawRequest : body.GetObject()){
 		if(!rawRequest.value.IsObject())
 			return crow::response(400,generateError("Individual requests must be represented as JSON objects/dictionaries"));
@@ -305,7 +592,17 @@ crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const
 		std::string body;
 		if(rawRequest.value.HasMember("body"))
 			body=rawRequest.value["body"].GetString();
-		requests.emplace_back(parseHTTPMethod(rawRequest.value["method"].GetString()), //method
+		rawURLs.push_back(rawURL);
+		crow::HTTPMethod method=parseHTTPMethod(rawRequest.value["method"].GetString());
+		std::string requestKey=std::string(crow::method_name(method))+'\0'+rawURL+'\0'+body;
+		auto existing=distinctRequests.find(requestKey);
+		if(existing!=distinctRequests.end()){
+			requestIndices.push_back(existing->second);
+			continue;
+		}
+		distinctRequests.emplace(requestKey,requests.size());
+		requestIndices.push_back(requests.size());
+		requests.emplace_back(method, //method
 		                      rawURL, //raw_url
 		                      rawURL.substr(0, rawURL.find("?")), //url
 		                      crow::query_string(rawURL), //url_params
@@ -315,38 +612,44 @@ crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const
 		requests.back().remote_endpoint=req.remote_endpoint;
 	}
 	
-	std::vector<std::future<crow::response>> responses;
-	responses.reserve(requests.size());
+	bundle->responses.resize(requests.size());
+	bundle->completionOrder.reserve(requests.size());
 	
-	for(const auto& request : requests)
-		responses.emplace_back(std::async(std::launch::async,[&](){ 
-			crow::response response;
-			server.handle(request, response);
-			return response;
-		}));
+	//Pool threads which find no work left in the bundle return immediately, 
+	//and the calling thread always makes progress itself, so a bundle cannot 
+	//be starved even if every pool thread is busy. 
+	std::size_t helpers=std::min(bundleConcurrency,requests.size());
+	auto trace=tracing::currentTrace();
+	auto parent=tracing::currentSpan();
+	for(std::size_t i=1; i<helpers; i++)
+		pool.submit([bundle,&server,trace,parent]{
+			tracing::Scope scope(trace,parent);
+			bundle->run(server);
+		});
+	bundle->run(server);
+	{
+		std::unique_lock<std::mutex> lock(bundle->mutex);
+		bundle->completed.wait(lock,[&]{ return bundle->completionOrder.size()==requests.size(); });
+	}
+	
+	//group the raw requests answered by each distinct request
+	std::vector<std::vector<std::size_t>> answeredBy(requests.size());
+	for(std::size_t i=0; i<requestIndices.size(); i++)
+		answeredBy[requestIndices[i]].push_back(i);
 	
 	rapidjson::Document result(rapidjson::kObjectType);
 	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
 	
-	for(std::size_t i=0; i<requests.size(); i++){
-		const auto& request=requests[i];
-		rapidjson::Value singleResult(rapidjson::kObjectType);
-		try{
-			crow::response response=responses[i].get();
+	for(std::size_t index : bundle->completionOrder){
+		const crow::response& response=bundle->responses[index];
+		for(std::size_t i : answeredBy[index]){
+			rapidjson::Value singleResult(rapidjson::kObjectType);
 			singleResult.AddMember("status",response.code,alloc);
 			singleResult.AddMember("body",response.body,alloc);
+			rapidjson::Value key(rapidjson::kStringType);
+			key.SetString(rawURLs[i], alloc);
+			result.AddMember(key, singleResult, alloc);
 		}
-		catch(std::exception& ex){
-			singleResult.AddMember("status",400,alloc);
-			singleResult.AddMember("body",generateError(ex.what()),alloc);
-		}
-		catch(...){
-			singleResult.AddMember("status",400,alloc);
-			singleResult.AddMember("body",generateError("Exception"),alloc);
-		}
-		rapidjson::Value key(rapidjson::kStringType);
-		key.SetString(requests[i].raw_url, alloc);
-		result.AddMember(key, singleResult, alloc);
 	}
 	
 	high_resolution_clock::time_point t2 = high_resolution_clock::now();
@@ -357,6 +660,15 @@ crow::response multiplex(crow::SimpleApp& server, PersistentStore& store, const
 int main(int argc, char* argv[]){
 	Configuration config(argc, argv);
 	
+	if(config.logLevel=="info")
+		setLogLevel(LogLevel::Info);
+	else if(config.logLevel=="warn")
+		setLogLevel(LogLevel::Warn);
+	else if(config.logLevel=="error")
+		setLogLevel(LogLevel::Error);
+	else
+		log_fatal("Unable to parse \"" << config.logLevel << "\" as a log level; expected info, warn, or error");
+	
 	if(config.sslCertificate.empty()!=config.sslKey.empty()){
 		log_fatal("--sslCertificate ($SLATE_sslCertificate) and --sslKey ($SLATE_sslKey)"
 		          " must be specified together");
@@ -380,6 +692,125 @@ int main(int argc, char* argv[]){
 			log_fatal("Unable to parse \"" << config.appLoggingServerPortString << "\" as a valid port number");
 	}
 	
+	unsigned long informerMaxStaleness=0;
+	{
+		std::istringstream is(config.informerMaxStalenessString);
+		is >> informerMaxStaleness;
+		if(is.fail())
+			log_fatal("Unable to parse \"" << config.informerMaxStalenessString << "\" as a number of seconds");
+	}
+	kubernetes::setInformerMaxStaleness(std::chrono::seconds(informerMaxStaleness));
+	
+	unsigned int clusterOperationLimit=0;
+	{
+		std::istringstream is(config.clusterOperationLimitString);
+		is >> clusterOperationLimit;
+		if(!clusterOperationLimit || is.fail())
+			log_fatal("Unable to parse \"" << config.clusterOperationLimitString << "\" as a valid number of concurrent operations");
+	}
+	unsigned int totalOperationLimit=0;
+	{
+		std::istringstream is(config.totalOperationLimitString);
+		is >> totalOperationLimit;
+		if(!totalOperationLimit || is.fail())
+			log_fatal("Unable to parse \"" << config.totalOperationLimitString << "\" as a valid number of concurrent operations");
+	}
+	kubernetes::setOperationLimits(clusterOperationLimit,totalOperationLimit);
+	
+	double slowRequestThreshold=0;
+	{
+		std::istringstream is(config.slowRequestThresholdString);
+		is >> slowRequestThreshold;
+		if(slowRequestThreshold<0 || is.fail())
+			log_fatal("Unable to parse \"" << config.slowRequestThresholdString << "\" as a number of seconds");
+	}
+	//Slow requests are written to a file of their own if one is given, and 
+	//otherwise to the main log
+	std::ofstream slowRequestFile;
+	std::unique_ptr<logTarget> slowRequestLog;
+	if(!config.slowRequestLog.empty()){
+		slowRequestFile.open(config.slowRequestLog,std::ios::app);
+		if(!slowRequestFile)
+			log_fatal("Unable to open " << config.slowRequestLog << " for writing");
+		slowRequestLog.reset(new logTarget(slowRequestFile));
+	}
+	
+	unsigned int multiplexThreads=0;
+	{
+		std::istringstream is(config.multiplexThreadsString);
+		is >> multiplexThreads;
+		if(!multiplexThreads || is.fail())
+			log_fatal("Unable to parse \"" << config.multiplexThreadsString << "\" as a valid number of threads");
+	}
+	unsigned int ioThreads=0;
+	{
+		std::istringstream is(config.ioThreadsString);
+		is >> ioThreads;
+		if(is.fail() || ioThreads>std::numeric_limits<std::uint16_t>::max())
+			log_fatal("Unable to parse \"" << config.ioThreadsString << "\" as a valid number of threads");
+		//zero means one per core, as crow's multithreaded() would choose
+		if(!ioThreads)
+			ioThreads=std::max(std::thread::hardware_concurrency(),1u);
+	}
+	unsigned int blockingThreads=0;
+	{
+		std::istringstream is(config.blockingThreadsString);
+		is >> blockingThreads;
+		if(!blockingThreads || is.fail())
+			log_fatal("Unable to parse \"" << config.blockingThreadsString << "\" as a valid number of threads");
+	}
+	unsigned int jobThreads=0;
+	{
+		std::istringstream is(config.jobThreadsString);
+		is >> jobThreads;
+		if(!jobThreads || is.fail())
+			log_fatal("Unable to parse \"" << config.jobThreadsString << "\" as a valid number of threads");
+	}
+	unsigned int multiplexBundleConcurrency=0;
+	{
+		std::istringstream is(config.multiplexBundleConcurrencyString);
+		is >> multiplexBundleConcurrency;
+		if(!multiplexBundleConcurrency || is.fail())
+			log_fatal("Unable to parse \"" << config.multiplexBundleConcurrencyString << "\" as a valid concurrency limit");
+	}
+	unsigned int databaseScanSegments=0;
+	{
+		std::istringstream is(config.databaseScanSegmentsString);
+		is >> databaseScanSegments;
+		if(!databaseScanSegments || is.fail())
+			log_fatal("Unable to parse \"" << config.databaseScanSegmentsString << "\" as a valid number of scan segments");
+	}
+	//the cache limits apply to each of the store's caches separately, so the 
+	//total memory used by all caches may be several times cacheMemoryLimit
+	std::size_t cacheEntryLimit=0;
+	{
+		std::istringstream is(config.cacheEntryLimitString);
+		is >> cacheEntryLimit;
+		if(!cacheEntryLimit || is.fail())
+			log_fatal("Unable to parse \"" << config.cacheEntryLimitString << "\" as a valid number of cache entries");
+	}
+	//the limit is specified in megabytes
+	std::size_t cacheMemoryLimit=0;
+	{
+		std::istringstream is(config.cacheMemoryLimitString);
+		is >> cacheMemoryLimit;
+		if(!cacheMemoryLimit || is.fail())
+			log_fatal("Unable to parse \"" << config.cacheMemoryLimitString << "\" as a valid cache memory limit");
+		cacheMemoryLimit<<=20;
+	}
+	
+	//The launcher must be started while this process is still small and has no 
+	//other threads
+	if(config.useProcessLauncher){
+		try{
+			startProcessLauncher();
+		}catch(std::runtime_error& err){
+			log_error(err.what() << "; child processes will be started directly");
+		}
+	}
+	//Writing log messages in the background requires a thread, so this waits
+	//until the launcher has been forked
+	startLogWriters();
 	startReaper();
 	initializeHelm();
 	// DB client initialization
@@ -402,13 +833,33 @@ int main(int argc, char* argv[]){
 	clientConfig.endpointOverride=config.awsEndpoint;
 	PersistentStore store(credentials,clientConfig,
 	                      config.bootstrapUserFile,config.encryptionKeyFile,
-	                      config.appLoggingServerName,appLoggingServerPort);
+	                      config.appLoggingServerName,appLoggingServerPort,
+	                      databaseScanSegments,cacheEntryLimit,cacheMemoryLimit);
+	//Fill the caches before accepting connections, so that the first requests 
+	//do not have to wait for full table scans
+	if(config.warmCaches)
+		store.warmCaches();
 	
 	// REST server initialization
-	crow::SimpleApp server;
+	Server server;
+	server.get_middleware<RequestTracing>().setSlowRequestLog(
+	  std::chrono::duration_cast<tracing::clock::duration>(std::chrono::duration<double>(slowRequestThreshold)),
+	  slowRequestLog.get());
+	server.get_middleware<RequestTracing>().setServerTiming(config.serverTiming);
+	WorkerPool multiplexPool(multiplexThreads);
+	//Operations which clients have asked to run in the background. This must 
+	//outlive jobPool, which runs them.
+	JobTable jobs;
+	//Handlers which run helm or kubectl, or otherwise take a long time, run on 
+	//this pool rather than on crow's I/O threads
+	WorkerPool blockingPool(blockingThreads);
+	//Background jobs run on their own threads, so that however many are queued
+	//they cannot occupy the threads needed by ordinary requests
+	WorkerPool jobPool(jobThreads);
 	
 	CROW_ROUTE(server, "/v1alpha3/multiplex").methods("POST"_method)(
-	  [&](const crow::request& req){ return multiplex(server,store,req); });
+	  [&](const crow::request& req, crow::response& res){ 
+		  handleBlocking(blockingPool,req,res,[&,req]{ return multiplex(server,store,multiplexPool,multiplexBundleConcurrency,req); }); });
 	
 	// == User commands ==
 	CROW_ROUTE(server, "/v1alpha3/users").methods("GET"_method)(
@@ -436,17 +887,22 @@ int main(int argc, char* argv[]){
 	CROW_ROUTE(server, "/v1alpha3/clusters").methods("GET"_method)(
 	  [&](const crow::request& req){ return listClusters(store,req); });
 	CROW_ROUTE(server, "/v1alpha3/clusters").methods("POST"_method)(
-	  [&](const crow::request& req){ return createCluster(store,req); });
+	  [&](const crow::request& req, crow::response& res){ 
+		  handleLongRunning(blockingPool,jobPool,jobs,store,req,res,"create a cluster",
+		                    [&,req]{ return createCluster(store,req); }); });
 	CROW_ROUTE(server, "/v1alpha3/clusters/<string>").methods("GET"_method)(
 	  [&](const crow::request& req, const std::string& cID){ return getClusterInfo(store,req,cID); });
 	CROW_ROUTE(server, "/v1alpha3/clusters/<string>").methods("DELETE"_method)(
-	  [&](const crow::request& req, const std::string& cID){ return deleteCluster(store,req,cID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& cID){ 
+		  handleLongRunning(blockingPool,jobPool,jobs,store,req,res,"delete cluster "+cID,
+		                    [&,req,cID]{ return deleteCluster(store,req,cID); }); });
 	CROW_ROUTE(server, "/v1alpha3/clusters/<string>").methods("PUT"_method)(
 	  [&](const crow::request& req, const std::string& cID){ return updateCluster(store,req,cID); });
 	CROW_ROUTE(server, "/v1alpha3/clusters/<string>/ping").methods("GET"_method)(
 	  [&](const crow::request& req, const std::string& cID){ return pingCluster(store,req,cID); });
 	CROW_ROUTE(server, "/v1alpha3/clusters/<string>/verify").methods("GET"_method)(
-	  [&](const crow::request& req, const std::string& cID){ return verifyCluster(store,req,cID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& cID){ 
+		  handleBlocking(blockingPool,req,res,[&,req,cID]{ return verifyCluster(store,req,cID); }); });
 	CROW_ROUTE(server, "/v1alpha3/clusters/<string>/allowed_groups").methods("GET"_method)(
 	  [&](const crow::request& req, const std::string& cID){ return listClusterAllowedgroups(store,req,cID); });
 	CROW_ROUTE(server, "/v1alpha3/clusters/<string>/allowed_groups/<string>").methods("PUT"_method)(
@@ -478,7 +934,9 @@ int main(int argc, char* argv[]){
 	CROW_ROUTE(server, "/v1alpha3/groups/<string>").methods("PUT"_method)(
 	  [&](const crow::request& req, const std::string& groupID){ return updateGroup(store,req,groupID); });
 	CROW_ROUTE(server, "/v1alpha3/groups/<string>").methods("DELETE"_method)(
-	  [&](const crow::request& req, const std::string& groupID){ return deleteGroup(store,req,groupID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& groupID){ 
+		  handleLongRunning(blockingPool,jobPool,jobs,store,req,res,"delete group "+groupID,
+		                    [&,req,groupID]{ return deleteGroup(store,req,groupID); }); });
 	CROW_ROUTE(server, "/v1alpha3/groups/<string>/members").methods("GET"_method)(
 	  [&](const crow::request& req, const std::string& groupID){ return listGroupMembers(store,req,groupID); });
 	CROW_ROUTE(server, "/v1alpha3/groups/<string>/clusters").methods("GET"_method)(
@@ -493,16 +951,24 @@ int main(int argc, char* argv[]){
 	  [&](const crow::request& req, const std::string& aID){ return fetchApplicationDocumentation(store,req,aID); });
 	if(config.allowAdHocApps){
 		CROW_ROUTE(server, "/v1alpha3/apps/ad-hoc").methods("POST"_method)(
-		  [&](const crow::request& req){ return installAdHocApplication(store,req); });
+		  [&](const crow::request& req, crow::response& res){ 
+			  handleLongRunning(blockingPool,jobPool,jobs,store,req,res,"install an ad-hoc application",
+			                    [&,req]{ return installAdHocApplication(store,req); }); });
 	}
 	else{
 		CROW_ROUTE(server, "/v1alpha3/apps/ad-hoc").methods("POST"_method)(
 		  [&](const crow::request& req){ return crow::response(400,generateError("Ad-hoc application installation is not permitted")); });
 	}
 	CROW_ROUTE(server, "/v1alpha3/apps/<string>").methods("POST"_method)(
-	  [&](const crow::request& req, const std::string& aID){ return installApplication(store,req,aID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& aID){ 
+		  handleLongRunning(blockingPool,jobPool,jobs,store,req,res,"install application "+aID,
+		                    [&,req,aID]{ return installApplication(store,req,aID); }); });
 	CROW_ROUTE(server, "/v1alpha3/update_apps").methods("POST"_method)(
-	  [&](const crow::request& req){ return updateCatalog(store,req); });
+	  [&](const crow::request& req, crow::response& res){ 
+		  handleBlocking(blockingPool,req,res,[&,req]{ return updateCatalog(store,req); }); });
+	CROW_ROUTE(server, "/v1alpha3/update_helm").methods("POST"_method)(
+	  [&](const crow::request& req, crow::response& res){ 
+		  handleBlocking(blockingPool,req,res,[&,req]{ return updateHelmCapabilities(store,req); }); });
 	
 	// == Application Instance commands ==
 	CROW_ROUTE(server, "/v1alpha3/instances").methods("GET"_method)(
@@ -510,15 +976,24 @@ int main(int argc, char* argv[]){
 	CROW_ROUTE(server, "/v1alpha3/instances/<string>").methods("GET"_method)(
 	  [&](const crow::request& req, const std::string& iID){ return fetchApplicationInstanceInfo(store,req,iID); });
 	CROW_ROUTE(server, "/v1alpha3/instances/<string>").methods("DELETE"_method)(
-	  [&](const crow::request& req, const std::string& iID){ return deleteApplicationInstance(store,req,iID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& iID){ 
+		  handleLongRunning(blockingPool,jobPool,jobs,store,req,res,"delete instance "+iID,
+		                    [&,req,iID]{ return deleteApplicationInstance(store,req,iID); }); });
 	CROW_ROUTE(server, "/v1alpha3/instances/<string>/restart").methods("PUT"_method)(
-	  [&](const crow::request& req, const std::string& iID){ return restartApplicationInstance(store,req,iID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& iID){ 
+		  handleBlocking(blockingPool,req,res,[&,req,iID]{ return restartApplicationInstance(store,req,iID); }); });
 	CROW_ROUTE(server, "/v1alpha3/instances/<string>/logs").methods("GET"_method)(
-	  [&](const crow::request& req, const std::string& iID){ return getApplicationInstanceLogs(store,req,iID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& iID){ 
+		  handleBlocking(blockingPool,req,res,[&,req,iID]{ return getApplicationInstanceLogs(store,req,iID); }); });
 	CROW_ROUTE(server, "/v1alpha3/instances/<string>/scale").methods("GET"_method)(
 	  [&](const crow::request& req, const std::string& iID){ return getApplicationInstanceScale(store,req,iID); });
 	CROW_ROUTE(server, "/v1alpha3/instances/<string>/scale").methods("PUT"_method)(
-	  [&](const crow::request& req, const std::string& iID){ return scaleApplicationInstance(store,req,iID); });
+	  [&](const crow::request& req, crow::response& res, const std::string& iID){ 
+		  handleBlocking(blockingPool,req,res,[&,req,iID]{ return scaleApplicationInstance(store,req,iID); }); });
+	
+	// == Job commands ==
+	CROW_ROUTE(server, "/v1alpha3/jobs/<string>").methods("GET"_method)(
+	  [&](const crow::request& req, const std::string& jobID){ return getJob(store,jobs,req,jobID); });
 	
 	// == Secret commands ==
 	CROW_ROUTE(server, "/v1alpha3/secrets").methods("GET"_method)(
@@ -531,7 +1006,15 @@ int main(int argc, char* argv[]){
 	  [&](const crow::request& req, const std::string& id){ return deleteSecret(store,req,id); });
 	
 	CROW_ROUTE(server, "/v1alpha3/stats").methods("GET"_method)(
-	  [&](){ return(store.getStatistics()); });
+	  [&](){ return(store.getStatistics()+getProcessLauncherStatistics()+kubernetes::getInformerStatistics()
+	           +kubernetes::getOperationStatistics()+getLoggingStatistics()); });
+	
+	CROW_ROUTE(server, "/metrics").methods("GET"_method)(
+	  [](){
+	  	crow::response res(metrics::exportPrometheus());
+	  	res.set_header("Content-Type","text/plain; version=0.0.4");
+	  	return res;
+	  });
 	
 	CROW_ROUTE(server, "/version").methods("GET"_method)(&serverVersionInfo);
 	
@@ -542,8 +1025,7 @@ int main(int argc, char* argv[]){
 	
 	server.loglevel(crow::LogLevel::Warning);
 	if(!config.sslCertificate.empty())
-		server.port(port).ssl_file(config.sslCertificate,config.sslKey).multithreaded().run();
-		//server.port(port).ssl_file(config.sslCertificate,config.sslKey).concurrency(128).run();
+		server.port(port).ssl_file(config.sslCertificate,config.sslKey).concurrency(ioThreads).run();
 	else
-		server.port(port).multithreaded().run();
+		server.port(port).concurrency(ioThreads).run();
 }
@@ -0,0 +1,128 @@
+//Compares the time taken to serialize a large application instance listing by
+//building a rapidjson document, as handlers formerly did, and by writing the
+//JSON directly with a JSONStreamWriter.
+//Usage: slate-benchmark-json-serialization [instance count] [repetitions]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ApplicationInstanceCommands.h"
+#include "ServerUtilities.h"
+
+namespace{
+
+///The listing as it was produced before streaming serialization
+std::string buildDocumentListing(const std::vector<ApplicationInstance>& instances,
+                                 std::map<std::string,Group>& groups,
+                                 std::map<std::string,Cluster>& clusters){
+	rapidjson::Document result(rapidjson::kObjectType);
+	rapidjson::Document::AllocatorType& alloc = result.GetAllocator();
+
+	result.AddMember("apiVersion", "v1alpha3", alloc);
+	rapidjson::Value resultItems(rapidjson::kArrayType);
+	resultItems.Reserve(instances.size(), alloc);
+	for(const ApplicationInstance& instance : instances){
+		rapidjson::Value instanceResult(rapidjson::kObjectType);
+		instanceResult.AddMember("apiVersion", "v1alpha3", alloc);
+		instanceResult.AddMember("kind", "ApplicationInstance", alloc);
+		rapidjson::Value instanceData(rapidjson::kObjectType);
+		instanceData.AddMember("id", instance.id, alloc);
+		instanceData.AddMember("name", instance.name, alloc);
+		std::string application=instance.application;
+		if(application.find('/')!=std::string::npos && application.find('/')<application.size()-1)
+			application=application.substr(application.find('/')+1);
+		instanceData.AddMember("application", application, alloc);
+		instanceData.AddMember("group", groups[instance.owningGroup].name, alloc);
+		instanceData.AddMember("cluster", clusters[instance.cluster].name, alloc);
+		instanceData.AddMember("created", instance.ctime, alloc);
+		instanceResult.AddMember("metadata", instanceData, alloc);
+		resultItems.PushBack(instanceResult, alloc);
+	}
+	result.AddMember("items", resultItems, alloc);
+	rapidjson::StringBuffer buf;
+	rapidjson::Writer<rapidjson::StringBuffer> writer(buf);
+	result.Accept(writer);
+	return crow::response(buf.GetString()).body;
+}
+
+std::string writeStreamingListing(const std::vector<ApplicationInstance>& instances,
+                                  const std::map<std::string,Group>& groups,
+                                  const std::map<std::string,Cluster>& clusters){
+	JSONStreamWriter writer;
+	internal::writeApplicationInstanceListing(writer,instances,groups,clusters);
+	return crow::response(writer.take()).body;
+}
+
+template<typename Function>
+double timeRepetitions(unsigned int repetitions, Function f, std::string& output){
+	auto start=std::chrono::steady_clock::now();
+	for(unsigned int i=0; i<repetitions; i++)
+		output=f();
+	auto end=std::chrono::steady_clock::now();
+	return std::chrono::duration<double,std::milli>(end-start).count()/repetitions;
+}
+
+}
+
+int main(int argc, char* argv[]){
+	std::size_t instanceCount=10000;
+	unsigned int repetitions=50;
+	if(argc>1)
+		instanceCount=std::strtoul(argv[1],nullptr,10);
+	if(argc>2)
+		repetitions=std::strtoul(argv[2],nullptr,10);
+	if(!instanceCount || !repetitions){
+		std::cerr << "Usage: " << argv[0] << " [instance count] [repetitions]" << std::endl;
+		return 1;
+	}
+
+	std::map<std::string,Group> groups;
+	for(unsigned int i=0; i<100; i++){
+		Group group("group-"+std::to_string(i));
+		group.id="group_"+std::to_string(i);
+		groups.emplace(group.id,group);
+	}
+	std::map<std::string,Cluster> clusters;
+	for(unsigned int i=0; i<20; i++){
+		Cluster cluster("cluster-"+std::to_string(i));
+		cluster.id="cluster_"+std::to_string(i);
+		clusters.emplace(cluster.id,cluster);
+	}
+	std::vector<ApplicationInstance> instances;
+	instances.reserve(instanceCount);
+	for(std::size_t i=0; i<instanceCount; i++){
+		ApplicationInstance instance;
+		instance.valid=true;
+		instance.id="instance_"+std::to_string(i);
+		instance.name="application-"+std::to_string(i);
+		instance.application="stable/application";
+		instance.owningGroup="group_"+std::to_string(i%groups.size());
+		instance.cluster="cluster_"+std::to_string(i%clusters.size());
+		instance.ctime="2020-Jan-01 00:00:00 UTC";
+		instances.push_back(instance);
+	}
+
+	std::string documentOutput, streamingOutput;
+	//warm up the allocator and the thread's size hint for JSON text
+	documentOutput=buildDocumentListing(instances,groups,clusters);
+	streamingOutput=writeStreamingListing(instances,groups,clusters);
+
+	double documentTime=timeRepetitions(repetitions,
+	  [&]{ return buildDocumentListing(instances,groups,clusters); },documentOutput);
+	double streamingTime=timeRepetitions(repetitions,
+	  [&]{ return writeStreamingListing(instances,groups,clusters); },streamingOutput);
+
+	if(documentOutput!=streamingOutput){
+		std::cerr << "Serialized listings differ" << std::endl;
+		return 1;
+	}
+	std::cout << "Listing of " << instanceCount << " instances (" << streamingOutput.size()
+	          << " bytes), mean of " << repetitions << " repetitions:\n"
+	          << "  document:  " << documentTime << " ms\n"
+	          << "  streaming: " << streamingTime << " ms\n"
+	          << "  speedup:   " << documentTime/streamingTime << "x" << std::endl;
+}
@@ -4,6 +4,7 @@
 #include <stdexcept>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include <curl/curl.h>
 
@@ -91,6 +92,10 @@ auto sendCurlInput(char* buffer, size_t size, size_t nitems, void* userp)->size_
 } //namespace detail
 
 Response httpGet(const std::string& url){
+	return httpGet(url,{});
+}
+
+Response httpGet(const std::string& url, const std::vector<std::string>& headers){
 	detail::CurlOutputData data{{},"GET "+url};
 	
 	CURLcode err;
@@ -108,6 +113,19 @@ Response httpGet(const std::string& url){
 	err=curl_easy_setopt(curlSession.get(), CURLOPT_HTTPGET, 1);
 	if(err!=CURLE_OK)
 		detail::reportCurlError("Failed to set curl GET option",err,errBuf.get());
+	std::unique_ptr<curl_slist,void (*)(curl_slist*)> headerList(nullptr,curl_slist_free_all);
+	for(const auto& header : headers){
+		curl_slist* extended=curl_slist_append(headerList.get(),header.c_str());
+		if(!extended)
+			throw std::runtime_error("Failed to add header to curl header list");
+		headerList.release();
+		headerList.reset(extended);
+	}
+	if(headerList){
+		err=curl_easy_setopt(curlSession.get(), CURLOPT_HTTPHEADER, headerList.get());
+		if(err!=CURLE_OK)
+			detail::reportCurlError("Failed to set curl header option",err,errBuf.get());
+	}
 	err=curl_easy_setopt(curlSession.get(), CURLOPT_WRITEFUNCTION, detail::collectCurlOutput);
 	if(err!=CURLE_OK)
 		detail::reportCurlError("Failed to set curl output callback",err,errBuf.get());
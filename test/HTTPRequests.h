@@ -1,6 +1,9 @@
 #ifndef SLATE_HTTPREQUESTS_H
 #define SLATE_HTTPREQUESTS_H
 
+#include <string>
+#include <vector>
+
 ///Trivial HTTP(S) request wrappers around libcurl. 
 namespace httpRequests{
 
@@ -15,6 +18,11 @@ struct Response{
 ///Make an HTTP(S) GET request
 ///\param url the URL to request
 Response httpGet(const std::string& url);
+
+///Make an HTTP(S) GET request with additional headers
+///\param url the URL to request
+///\param headers the extra headers to send, each in the form 'Name: value'
+Response httpGet(const std::string& url, const std::vector<std::string>& headers);
 	
 ///Make an HTTP(S) DELETE request
 ///\param url the URL to request
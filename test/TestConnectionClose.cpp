@@ -0,0 +1,25 @@
+#include "test.h"
+
+TEST(BlockingRequestWithConnectionClose){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	std::string adminKey=getPortalToken();
+	//fetching logs is handled on the blocking pool, so the response is 
+	//completed after the handler has returned to crow
+	std::string logsURL=tc.getAPIServerURL()+"/"+currentAPIVersion
+	  +"/instances/Instance_nonexistent/logs?token="+adminKey;
+	
+	//each request asks for its connection to be closed, which must not 
+	//destroy the connection before the pending response is sent
+	for(unsigned int i=0; i<20; i++){
+		auto resp=httpGet(logsURL,{"Connection: close"});
+		ENSURE_EQUAL(resp.status,404,
+		             "Requests for logs of nonexistent instances should be rejected");
+		ENSURE(!resp.body.empty(),"The error response should be delivered");
+	}
+	
+	//the server should continue to serve ordinary requests
+	auto resp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey);
+	ENSURE_EQUAL(resp.status,200,"The server should remain available");
+}
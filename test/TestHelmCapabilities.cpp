@@ -0,0 +1,71 @@
+#include "test.h"
+
+#include <ServerUtilities.h>
+
+TEST(UnauthenticatedUpdateHelmCapabilities){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	//try refreshing with no authentication
+	auto resp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/update_helm","");
+	ENSURE_EQUAL(resp.status,403,
+				 "Requests to refresh helm capabilities without authentication should be rejected");
+	
+	//try refreshing with invalid authentication
+	resp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/update_helm?token=00112233-4455-6677-8899-aabbccddeeff","");
+	ENSURE_EQUAL(resp.status,403,
+				 "Requests to refresh helm capabilities with invalid authentication should be rejected");
+}
+
+TEST(NonAdminUpdateHelmCapabilities){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	const std::string adminKey=getPortalToken();
+	
+	std::string tok;
+	{ //create a non-admin user
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "Bob", alloc);
+		metadata.AddMember("email", "bob@place.com", alloc);
+		metadata.AddMember("phone", "555-5555", alloc);
+		metadata.AddMember("institution", "Center of the Earth University", alloc);
+		metadata.AddMember("admin", false, alloc);
+		metadata.AddMember("globusID", "bobs_globus_id", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"User creation request should succeed");
+		rapidjson::Document createData;
+		createData.Parse(createResp.body);
+		tok=createData["metadata"]["access_token"].GetString();
+	}
+	
+	auto resp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/update_helm?token="+tok,"");
+	ENSURE_EQUAL(resp.status,403,
+				 "Requests to refresh helm capabilities by non-admins should be rejected");
+}
+
+TEST(UpdateHelmCapabilities){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	const std::string adminKey=getPortalToken();
+	
+	auto schema=loadSchema(getSchemaDir()+"/HelmCapabilitiesResultSchema.json");
+	
+	auto resp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/update_helm?token="+adminKey,"");
+	ENSURE_EQUAL(resp.status,200,"Refreshing helm capabilities should succeed");
+	rapidjson::Document data;
+	data.Parse(resp.body);
+	ENSURE_CONFORMS(data,schema);
+	ENSURE(data["metadata"]["majorVersion"].GetUint()>=2,"Helm major version should be plausible");
+	bool foundMain=false;
+	for(const auto& repository : data["metadata"]["repositories"].GetArray()){
+		if(repository.GetString()==std::string("slate"))
+			foundMain=true;
+	}
+	ENSURE(foundMain,"The main slate repository should be configured");
+}
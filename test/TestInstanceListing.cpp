@@ -314,3 +314,115 @@ TEST(ScopedInstanceList){
 		}
 	}
 }
+
+TEST(InstanceListPaged){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	std::string adminKey=getPortalToken();
+	auto schema=loadSchema(getSchemaDir()+"/InstanceListResultSchema.json");
+	std::string listURL=tc.getAPIServerURL()+"/"+currentAPIVersion+"/instances?token="+adminKey;
+	
+	std::string groupName="test-inst-list-paged";
+	std::string clusterName="testcluster";
+	
+	{ //create a VO
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", groupName, alloc);
+		metadata.AddMember("scienceField", "Logic", alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/groups?token="+adminKey,to_string(request));
+		ENSURE_EQUAL(createResp.status,200,"Group creation request should succeed");
+	}
+	
+	{ //create a cluster
+		auto kubeConfig = tc.getKubeConfig();
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", clusterName, alloc);
+		metadata.AddMember("group", groupName, alloc);
+		metadata.AddMember("owningOrganization", "Department of Labor", alloc);
+		metadata.AddMember("kubeconfig", kubeConfig, alloc);
+		request.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters?token="+adminKey, to_string(request));
+		ENSURE_EQUAL(createResp.status,200,
+					 "Cluster creation request should succeed");
+	}
+	
+	std::string instID1, instID2;
+	struct cleanupHelper{
+		TestContext& tc;
+		const std::string& id, key;
+		cleanupHelper(TestContext& tc, const std::string& id, const std::string& key):
+		tc(tc),id(id),key(key){}
+		~cleanupHelper(){
+			if(!id.empty())
+				auto delResp=httpDelete(tc.getAPIServerURL()+"/"+currentAPIVersion+"/instances/"+id+"?token="+key);
+		}
+	} cleanup1(tc,instID1,adminKey), cleanup2(tc,instID2,adminKey);
+	
+	//install two instances, so that there is more than one page
+	auto install=[&](const std::string& tag, std::string& instID){
+		rapidjson::Document request(rapidjson::kObjectType);
+		auto& alloc = request.GetAllocator();
+		request.AddMember("apiVersion", currentAPIVersion, alloc);
+		request.AddMember("group", groupName, alloc);
+		request.AddMember("cluster", clusterName, alloc);
+		request.AddMember("configuration", rapidjson::Value("Instance: "+tag,alloc), alloc);
+		auto instResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/apps/test-app?test&token="+adminKey,to_string(request));
+		ENSURE_EQUAL(instResp.status,200,"Application install request should succeed");
+		rapidjson::Document data;
+		data.Parse(instResp.body);
+		if(data.HasMember("metadata") && data["metadata"].IsObject() && data["metadata"].HasMember("id"))
+			instID=data["metadata"]["id"].GetString();
+	};
+	install("page1",instID1);
+	install("page2",instID2);
+	
+	//list the first page
+	auto listResp=httpGet(listURL+"&limit=1");
+	ENSURE_EQUAL(listResp.status,200,"Listing application instances by page should succeed");
+	rapidjson::Document data;
+	data.Parse(listResp.body);
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),1,"One instance should be returned");
+	ENSURE(data.HasMember("nextCursor"),"A cursor should be returned when more instances remain");
+	std::string firstID=data["items"][0]["metadata"]["id"].GetString();
+	std::string cursor=data["nextCursor"].GetString();
+	ENSURE_EQUAL(cursor,firstID,"The cursor should be the last ID on the page");
+	
+	//list the second page
+	listResp=httpGet(listURL+"&limit=1&cursor="+cursor);
+	ENSURE_EQUAL(listResp.status,200,"Listing application instances by page should succeed");
+	data.Parse(listResp.body);
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),1,"One instance should be returned");
+	ENSURE(!data.HasMember("nextCursor"),"No cursor should be returned with the last page");
+	ENSURE(data["items"][0]["metadata"]["id"].GetString()>firstID,
+	       "Pages should be ordered by ID");
+	
+	//list only fields which do not require looking up groups or clusters
+	listResp=httpGet(listURL+"&fields=id,name,created");
+	ENSURE_EQUAL(listResp.status,200,"Listing selected fields of application instances should succeed");
+	data.Parse(listResp.body);
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),2,"Two instances should be returned");
+	for(const auto& item : data["items"].GetArray()){
+		const auto& metadata=item["metadata"];
+		ENSURE_EQUAL(metadata.MemberCount(),3,"Only the requested fields should be returned");
+		ENSURE(metadata.HasMember("id"));
+		ENSURE(metadata.HasMember("name"));
+		ENSURE(metadata.HasMember("created"));
+		ENSURE(!metadata.HasMember("group"));
+		ENSURE(!metadata.HasMember("cluster"));
+	}
+	
+	//fields which instances do not have should be rejected
+	listResp=httpGet(listURL+"&fields=id,configuration");
+	ENSURE_EQUAL(listResp.status,400,"Requests for unknown fields should be rejected");
+}
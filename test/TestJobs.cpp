@@ -0,0 +1,151 @@
+#include "test.h"
+
+#include <chrono>
+#include <thread>
+
+#include <ServerUtilities.h>
+
+TEST(UnauthenticatedGetJob){
+	using namespace httpRequests;
+	TestContext tc;
+
+	//try fetching a job with no authentication
+	auto getResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/jobs/job_nonexistent");
+	ENSURE_EQUAL(getResp.status,403,
+	             "Requests to get a job without authentication should be rejected");
+
+	//try fetching a job with invalid authentication
+	getResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/jobs/job_nonexistent?token=00112233-4455-6677-8899-aabbccddeeff");
+	ENSURE_EQUAL(getResp.status,403,
+	             "Requests to get a job with invalid authentication should be rejected");
+}
+
+TEST(GetNonexistentJob){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=getPortalToken();
+	auto getResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/jobs/job_nonexistent?token="+adminKey);
+	ENSURE_EQUAL(getResp.status,404,
+	             "Requests to get a nonexistent job should be rejected");
+}
+
+TEST(UnauthenticatedAsyncRequest){
+	using namespace httpRequests;
+	TestContext tc;
+
+	//jobs should not be started for unauthenticated users
+	auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters?async","");
+	ENSURE_EQUAL(createResp.status,403,
+	             "Requests to start a job without authentication should be rejected");
+}
+
+TEST(AsyncRequestResult){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=getPortalToken();
+	auto schema=loadSchema(getSchemaDir()+"/JobInfoResultSchema.json");
+
+	//start a cluster creation which will fail because the request is invalid
+	auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters?async&token="+adminKey,
+	                         "This is not JSON");
+	ENSURE_EQUAL(createResp.status,202,
+	             "Asynchronous requests should be accepted immediately");
+	rapidjson::Document createData;
+	createData.Parse(createResp.body.c_str());
+	ENSURE_CONFORMS(createData,schema);
+	ENSURE_EQUAL(createData["kind"].GetString(),std::string("Job"),
+	             "Kind of result should be Job");
+	std::string jobID=createData["metadata"]["id"].GetString();
+
+	//wait for the job to finish
+	std::string jobURL=tc.getAPIServerURL()+"/"+currentAPIVersion+"/jobs/"+jobID+"?token="+adminKey;
+	rapidjson::Document jobData;
+	std::string state;
+	for(unsigned int i=0; i<100; i++){
+		auto getResp=httpGet(jobURL);
+		ENSURE_EQUAL(getResp.status,200,"Fetching the job should succeed");
+		jobData.Parse(getResp.body.c_str());
+		ENSURE_CONFORMS(jobData,schema);
+		state=jobData["metadata"]["state"].GetString();
+		if(state!="Pending" && state!="Running")
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+	ENSURE_EQUAL(state,std::string("Failed"),
+	             "The job should fail because the original request was invalid");
+	ENSURE(jobData.HasMember("result"));
+	ENSURE_EQUAL(jobData["result"]["status"].GetInt(),400,
+	             "The job result should contain the status of the original request");
+}
+
+TEST(AsyncFlagValues){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=getPortalToken();
+	std::string clustersURL=tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters?token="+adminKey;
+
+	//a false flag should run the operation synchronously, so the invalid 
+	//request is rejected directly
+	auto createResp=httpPost(clustersURL+"&async=false","This is not JSON");
+	ENSURE_EQUAL(createResp.status,400,
+	             "Requests with async=false should not be run as jobs");
+
+	createResp=httpPost(clustersURL+"&async=true","This is not JSON");
+	ENSURE_EQUAL(createResp.status,202,
+	             "Requests with async=true should be run as jobs");
+
+	createResp=httpPost(clustersURL+"&async=sometimes","This is not JSON");
+	ENSURE_EQUAL(createResp.status,400,
+	             "Requests with unrecognized async values should be rejected");
+	rapidjson::Document data;
+	data.Parse(createResp.body.c_str());
+	ENSURE(data.HasMember("message"));
+	ENSURE(std::string(data["message"].GetString()).find("async")!=std::string::npos,
+	       "The error should identify the invalid parameter");
+}
+
+TEST(GetJobAuthorization){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=getPortalToken();
+
+	std::string tok;
+	{ //add a new user
+		rapidjson::Document request1(rapidjson::kObjectType);
+		auto& alloc = request1.GetAllocator();
+		request1.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "Bob", alloc);
+		metadata.AddMember("email", "bob@place.com", alloc);
+		metadata.AddMember("phone", "555-5555", alloc);
+		metadata.AddMember("institution", "Center of the Earth University", alloc);
+		metadata.AddMember("admin", false, alloc);
+		metadata.AddMember("globusID", "Bob's Globus ID", alloc);
+		request1.AddMember("metadata", metadata, alloc);
+		auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey,
+		                         to_string(request1));
+		ENSURE_EQUAL(createResp.status,200,
+		             "User creation request should succeed");
+		rapidjson::Document createData;
+		createData.Parse(createResp.body.c_str());
+		tok=createData["metadata"]["access_token"].GetString();
+	}
+
+	//start a job as the admin
+	auto createResp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/clusters?async&token="+adminKey,
+	                         "This is not JSON");
+	ENSURE_EQUAL(createResp.status,202,
+	             "Asynchronous requests should be accepted immediately");
+	rapidjson::Document createData;
+	createData.Parse(createResp.body.c_str());
+	std::string jobID=createData["metadata"]["id"].GetString();
+
+	//another user should not be able to see it
+	auto getResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/jobs/"+jobID+"?token="+tok);
+	ENSURE_EQUAL(getResp.status,403,
+	             "Users should not be able to see jobs started by other users");
+}
@@ -0,0 +1,28 @@
+#include "test.h"
+
+TEST(MetricsFormat){
+	using namespace httpRequests;
+	TestContext tc;
+
+	auto resp=httpGet(tc.getAPIServerURL()+"/metrics");
+	ENSURE_EQUAL(resp.status,200,"Metrics should be available without authentication");
+	ENSURE(resp.body.find("# TYPE slate_http_request_duration_seconds histogram")!=std::string::npos,
+	       "Request durations should be exported as a histogram");
+}
+
+TEST(RequestsLabeledByRoute){
+	using namespace httpRequests;
+	TestContext tc;
+
+	std::string adminKey=getPortalToken();
+	auto infoResp=httpGet(tc.getAPIServerURL()+"/"+currentAPIVersion+"/users/User_nonexistent?token="+adminKey);
+	ENSURE_EQUAL(infoResp.status,404,"Requests for nonexistent users should be rejected");
+
+	auto resp=httpGet(tc.getAPIServerURL()+"/metrics");
+	ENSURE_EQUAL(resp.status,200,"Metrics should be available");
+	//requests should be labeled by the route's pattern, not by the specific URL
+	ENSURE(resp.body.find("route=\"/"+currentAPIVersion+"/users/<string>\",code=\"404\"")!=std::string::npos,
+	       "Responses should be counted by route and status code");
+	ENSURE(resp.body.find("User_nonexistent")==std::string::npos,
+	       "Request URLs should not appear in metric labels");
+}
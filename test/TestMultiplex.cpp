@@ -0,0 +1,60 @@
+#include "test.h"
+
+#include <ServerUtilities.h>
+
+TEST(UnauthenticatedMultiplex){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	//try executing a bundle with no authentication
+	auto resp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/multiplex","{}");
+	ENSURE_EQUAL(resp.status,403,
+				 "Requests to execute a bundle without authentication should be rejected");
+	
+	//try executing a bundle with invalid authentication
+	resp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/multiplex?token=00112233-4455-6677-8899-aabbccddeeff","{}");
+	ENSURE_EQUAL(resp.status,403,
+				 "Requests to execute a bundle with invalid authentication should be rejected");
+}
+
+TEST(MultiplexManyRequests){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	const std::string adminKey=getPortalToken();
+	const std::string adminID=getPortalUserID();
+	
+	//more requests than any plausible per-bundle concurrency limit, including 
+	//exact duplicates, which must each still get a result
+	const std::size_t distinctRequests=40;
+	const std::size_t copies=3;
+	rapidjson::Document request(rapidjson::kObjectType);
+	auto& alloc = request.GetAllocator();
+	for(std::size_t i=0; i<distinctRequests; i++){
+		for(std::size_t j=0; j<copies; j++){
+			rapidjson::Value entry(rapidjson::kObjectType);
+			entry.AddMember("method", "GET", alloc);
+			rapidjson::Value key(rapidjson::kStringType);
+			//the extra parameter is ignored by the server but makes each 
+			//distinct request different
+			key.SetString("/"+currentAPIVersion+"/users/"+adminID+"?token="+adminKey+"&n="+std::to_string(i), alloc);
+			request.AddMember(key, entry, alloc);
+		}
+	}
+	
+	auto resp=httpPost(tc.getAPIServerURL()+"/"+currentAPIVersion+"/multiplex?token="+adminKey,to_string(request));
+	ENSURE_EQUAL(resp.status,200,"Executing a bundle should succeed");
+	rapidjson::Document data;
+	data.Parse(resp.body);
+	ENSURE(data.IsObject(),"Bundle result should be an object");
+	ENSURE_EQUAL(data.MemberCount(),distinctRequests*copies,
+				 "Bundle result should contain one entry per request");
+	for(const auto& result : data.GetObject()){
+		ENSURE(result.value.HasMember("status"),"Each result should have a status");
+		ENSURE_EQUAL(result.value["status"].GetInt(),200,"Each request should succeed");
+		rapidjson::Document body;
+		body.Parse(result.value["body"].GetString());
+		ENSURE_EQUAL(body["metadata"]["id"].GetString(),adminID,
+					 "Each request should return the requested user's information");
+	}
+}
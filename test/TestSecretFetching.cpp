@@ -1,7 +1,15 @@
 #include "test.h"
 
+#include <chrono>
+#include <fstream>
+#include <thread>
+
 #include <Archive.h>
+#include <PersistentStore.h>
 #include <ServerUtilities.h>
+extern "C"{
+	#include <scrypt/scryptenc/scryptenc.h>
+}
 
 TEST(UnauthenticatedFetchSecret){
 	using namespace httpRequests;
@@ -217,3 +225,97 @@ TEST(FetchSecretMalformed){
 		ENSURE_EQUAL(getResp.status,403,"Requests to fetch secrets by non-members of the owning Group should be rejected");
 	}
 }
+
+TEST(FetchLegacySecret){
+	//Secrets stored before data keys were introduced were each encrypted 
+	//directly with scrypt. The API can no longer create such secrets, so 
+	//reading and re-encrypting them requires testing the PersistentStore 
+	//directly.
+	
+	auto dbResp=httpRequests::httpGet("http://localhost:52000/dynamo/create");
+	ENSURE_EQUAL(dbResp.status,200);
+	std::string dbPort=dbResp.body;
+	
+	const std::string awsAccessKey="foo";
+	const std::string awsSecretKey="bar";
+	Aws::SDKOptions options;
+	Aws::InitAPI(options);
+	using AWSOptionsHandle=std::unique_ptr<Aws::SDKOptions,void(*)(Aws::SDKOptions*)>;
+	AWSOptionsHandle opt_holder(&options,
+								[](Aws::SDKOptions* options){
+									Aws::ShutdownAPI(*options); 
+								});
+	Aws::Auth::AWSCredentials credentials(awsAccessKey,awsSecretKey);
+	Aws::Client::ClientConfiguration clientConfig;
+	clientConfig.scheme=Aws::Http::Scheme::HTTP;
+	clientConfig.endpointOverride="localhost:"+dbPort;
+	
+	//encrypt the data as the server formerly did, with the same key file 
+	//which the store uses
+	std::ifstream keyFile("encryptionKey");
+	ENSURE(keyFile,"The encryption key file should be readable");
+	std::string key(1024,'\0');
+	keyFile.read(&key.front(),key.size());
+	key.resize(keyFile.gcount());
+	const std::string plaintext="password: correct horse battery staple";
+	std::string legacyData(plaintext.size()+128,'\0');
+	int err=scryptenc_buf((const uint8_t*)plaintext.data(),plaintext.size(),
+	                      (uint8_t*)&legacyData.front(),
+	                      (const uint8_t*)key.data(),key.size(),
+	                      17,8,1);
+	ENSURE_EQUAL(err,0,"Encrypting the secret in the legacy format should succeed");
+	
+	Secret secret;
+	secret.id=idGenerator.generateSecretID();
+	secret.name="legacy-secret";
+	secret.group=idGenerator.generateGroupID();
+	secret.cluster=idGenerator.generateClusterID();
+	secret.ctime="-"; //not used
+	secret.data=legacyData;
+	secret.valid=true;
+	
+	std::string envelope;
+	{
+		PersistentStore store(credentials,clientConfig,
+		                      "slate_portal_user","encryptionKey",
+		                      "",9200);
+		bool success=store.addSecret(secret);
+		ENSURE(success,"Secret addition should succeed");
+		
+		SecretData decrypted=store.decryptSecret(store.getSecret(secret.id));
+		ENSURE_EQUAL(std::string(decrypted.data.get(),decrypted.dataSize),plaintext,
+		             "The legacy secret should be decrypted correctly");
+		
+		//the secret is re-encrypted in the background, and the cached copy 
+		//is replaced only once the database has been updated
+		for(unsigned int i=0; i<100; i++){
+			envelope=store.getSecret(secret.id).data;
+			if(envelope!=legacyData)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		}
+		ENSURE(envelope.compare(0,6,"slenv1")==0,
+		       "The secret should be re-encrypted with a data key after being read");
+		
+		//decrypting the outdated legacy data again attempts another 
+		//re-encryption, which must not replace the data which was already 
+		//stored, since it is conditional on the old data still being present
+		decrypted=store.decryptSecret(secret);
+		ENSURE_EQUAL(std::string(decrypted.data.get(),decrypted.dataSize),plaintext,
+		             "The legacy secret should still be decrypted correctly");
+	} //destroying the store finishes its background work
+	
+	{
+		//a new store has empty caches, so it reads what was actually stored
+		PersistentStore store(credentials,clientConfig,
+		                      "slate_portal_user","encryptionKey",
+		                      "",9200);
+		Secret stored=store.getSecret(secret.id);
+		ENSURE(stored,"The secret should still exist");
+		ENSURE_EQUAL(stored.data,envelope,
+		             "The database should hold the data from the first re-encryption");
+		SecretData decrypted=store.decryptSecret(stored);
+		ENSURE_EQUAL(std::string(decrypted.data.get(),decrypted.dataSize),plaintext,
+		             "The re-encrypted secret should decrypt to the original data");
+	}
+}
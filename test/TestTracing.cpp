@@ -0,0 +1,86 @@
+#include "test.h"
+
+#include <sstream>
+#include <thread>
+
+#include <Tracing.h>
+
+namespace{
+	///\return the line of text which contains a substring, or an empty string
+	std::string lineContaining(const std::string& text, const std::string& sub){
+		std::istringstream is(text);
+		std::string line;
+		while(std::getline(is,line)){
+			if(line.find(sub)!=std::string::npos)
+				return line;
+		}
+		return "";
+	}
+}
+
+TEST(ServerTimingCategoryTotals){
+	using namespace tracing;
+	using std::chrono::milliseconds;
+	Trace trace("GET /test");
+	auto start=clock::now();
+	trace.add("db","first",Trace::noSpan,start,start+milliseconds(2));
+	trace.add("kubectl","get",Trace::noSpan,start,start+milliseconds(10));
+	trace.add("db","second",Trace::noSpan,start+milliseconds(2),start+milliseconds(5));
+
+	ENSURE_EQUAL(trace.serverTiming(milliseconds(20)),
+	             std::string("db;dur=5.000;desc=\"2 operations\", "
+	                         "kubectl;dur=10.000;desc=\"1 operation\", "
+	                         "total;dur=20.000"),
+	             "Each category should be reported once, with its total time and count, "
+	             "in the order in which it first appeared");
+}
+
+TEST(SpanLimit){
+	using namespace tracing;
+	using std::chrono::milliseconds;
+	Trace trace("GET /test");
+	auto start=clock::now();
+	const std::size_t extra=10;
+	for(std::size_t i=0; i<Trace::maxSpans+extra; i++)
+		trace.add("db","",Trace::noSpan,start,start+milliseconds(1));
+
+	std::string formatted=trace.format(milliseconds(100));
+	ENSURE(formatted.find("("+std::to_string(extra)+" further spans not recorded)")!=std::string::npos,
+	       "Spans beyond the limit should be counted as not recorded");
+	std::size_t lines=0;
+	for(char c : formatted){
+		if(c=='\n')
+			lines++;
+	}
+	//one line for each kept span, and one for the note of dropped spans
+	ENSURE_EQUAL(lines,Trace::maxSpans+1,"Only the spans within the limit should be listed");
+
+	ENSURE(trace.serverTiming(milliseconds(100)).find("desc=\""+std::to_string(Trace::maxSpans+extra)+" operations\"")!=std::string::npos,
+	       "Spans beyond the limit should still be included in category totals");
+}
+
+TEST(NestingAcrossThreads){
+	using namespace tracing;
+	auto trace=std::make_shared<Trace>("GET /test");
+	setCurrentTrace(trace);
+	{
+		Span outer("handler");
+		std::size_t parent=currentSpan();
+		ENSURE(parent!=Trace::noSpan,"Creating a span should make it current");
+		std::thread worker([&trace,parent]{
+			Scope scope(trace,parent);
+			Span inner("db","lookup");
+		});
+		worker.join();
+	}
+	ENSURE_EQUAL(currentSpan(),Trace::noSpan,"Ending a span should restore its parent");
+	setCurrentTrace(nullptr);
+
+	std::string formatted=trace->format(trace->elapsed());
+	std::string outerLine=lineContaining(formatted,"handler");
+	std::string innerLine=lineContaining(formatted,"db lookup");
+	ENSURE(outerLine.compare(0,3,"  +")==0,"The outer span should be at the top level");
+	ENSURE(innerLine.compare(0,5,"    +")==0,
+	       "A span on another thread should be nested within the span given to its Scope");
+	ENSURE(innerLine.find("unfinished")==std::string::npos,"The inner span should have ended");
+}
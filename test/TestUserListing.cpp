@@ -167,3 +167,73 @@ TEST(ListUsersByGroup){
 	             std::string("User_12345678-9abc-def0-1234-56789abcdef0"),
 	             "User ID should match");
 }
+
+TEST(ListUsersPaged){
+	using namespace httpRequests;
+	TestContext tc;
+	
+	std::string adminKey=getPortalToken();
+	std::string userURL=tc.getAPIServerURL()+"/"+currentAPIVersion+"/users?token="+adminKey;
+	
+	//add a second user so that there is more than one page
+	rapidjson::Document request1(rapidjson::kObjectType);
+	{
+		auto& alloc = request1.GetAllocator();
+		request1.AddMember("apiVersion", currentAPIVersion, alloc);
+		rapidjson::Value metadata(rapidjson::kObjectType);
+		metadata.AddMember("name", "Bob", alloc);
+		metadata.AddMember("email", "bob@place.com", alloc);
+		metadata.AddMember("phone", "555-5555", alloc);
+		metadata.AddMember("institution", "Center of the Earth University", alloc);
+		metadata.AddMember("admin", false, alloc);
+		metadata.AddMember("globusID", "Bob's Globus ID", alloc);
+		request1.AddMember("metadata", metadata, alloc);
+	}
+	auto createResp=httpPost(userURL,to_string(request1));
+	ENSURE_EQUAL(createResp.status,200,"Portal admin user should be able to create a user");
+	
+	auto schema=loadSchema(getSchemaDir()+"/UserListResultSchema.json");
+	
+	//list the first page
+	auto listResp=httpGet(userURL+"&limit=1");
+	ENSURE_EQUAL(listResp.status,200,"Portal admin user should be able to list users by page");
+	rapidjson::Document data;
+	data.Parse(listResp.body.c_str());
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),1,"One user record should be returned");
+	ENSURE(data.HasMember("nextCursor"),"A cursor should be returned when more users remain");
+	std::string firstID=data["items"][0]["metadata"]["id"].GetString();
+	std::string cursor=data["nextCursor"].GetString();
+	ENSURE_EQUAL(cursor,firstID,"The cursor should be the last ID on the page");
+	
+	//list the second page
+	listResp=httpGet(userURL+"&limit=1&cursor="+cursor);
+	ENSURE_EQUAL(listResp.status,200,"Portal admin user should be able to list users by page");
+	data.Parse(listResp.body.c_str());
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),1,"One user record should be returned");
+	ENSURE(!data.HasMember("nextCursor"),"No cursor should be returned with the last page");
+	ENSURE(data["items"][0]["metadata"]["id"].GetString()>firstID,
+	       "Pages should be ordered by ID");
+	
+	//list only some fields
+	listResp=httpGet(userURL+"&fields=id,name");
+	ENSURE_EQUAL(listResp.status,200,"Portal admin user should be able to list selected fields");
+	data.Parse(listResp.body.c_str());
+	ENSURE_CONFORMS(data,schema);
+	ENSURE_EQUAL(data["items"].Size(),2,"Two user records should be returned");
+	for(const auto& item : data["items"].GetArray()){
+		const auto& metadata=item["metadata"];
+		ENSURE_EQUAL(metadata.MemberCount(),2,"Only the requested fields should be returned");
+		ENSURE(metadata.HasMember("id"));
+		ENSURE(metadata.HasMember("name"));
+	}
+	
+	//an invalid page size should be rejected
+	listResp=httpGet(userURL+"&limit=0");
+	ENSURE_EQUAL(listResp.status,400,"Requests with invalid page sizes should be rejected");
+	
+	//fields which users do not have should be rejected
+	listResp=httpGet(userURL+"&fields=id,token");
+	ENSURE_EQUAL(listResp.status,400,"Requests for unknown fields should be rejected");
+}